@@ -16,4 +16,12 @@ struct material_cb
 	float metallicOverride;
 };
 
+struct material_texture_slots
+{
+	uint albedo;
+	uint normal;
+	uint roughness;
+	uint metallic;
+};
+
 #endif
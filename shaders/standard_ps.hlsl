@@ -35,11 +35,9 @@ TextureCube<float4> irradianceTexture		: register(t0, space1);
 TextureCube<float4> environmentTexture		: register(t1, space1);
 Texture2D<float4> brdf						: register(t2, space1);
 
-// Materials.
-Texture2D<float4> albedoTextures[]			: register(t0, space2);
-Texture2D<float4> normalTextures[]			: register(t0, space3);
-Texture2D<float> roughnessTextures[]		: register(t0, space4);
-Texture2D<float> metallicTextures[]			: register(t0, space5);
+// Materials. The texture ID selects the material's slots in the bindless texture table.
+Texture2D<float4> bindlessTextures[]					: register(t0, space2);
+StructuredBuffer<material_texture_slots> materialTextures	: register(t0, space3);
 
 // Shadow maps.
 Texture2D<float> sunShadowMapCascades[4]	: register(t0, space6);
@@ -55,23 +53,24 @@ ps_output main(ps_input IN)
 {
 	uint textureID = material.textureID_usageFlags >> 16;
 	uint usageFlags = material.textureID_usageFlags & 0xFFFF;
+	material_texture_slots slots = materialTextures[textureID];
 
 	float4 albedo = ((usageFlags & USE_ALBEDO_TEXTURE)
-		? albedoTextures[textureID].Sample(linearWrapSampler, IN.uv)
+		? bindlessTextures[slots.albedo].Sample(linearWrapSampler, IN.uv)
 		: float4(1.f, 1.f, 1.f, 1.f))
 		* material.albedoTint;
 
 	float3 N = (usageFlags & USE_NORMAL_TEXTURE)
-		? mul(normalTextures[textureID].Sample(linearWrapSampler, IN.uv).xyz * 2.f - float3(1.f, 1.f, 1.f), IN.tbn)
+		? mul(bindlessTextures[slots.normal].Sample(linearWrapSampler, IN.uv).xyz * 2.f - float3(1.f, 1.f, 1.f), IN.tbn)
 		: IN.tbn[2];
 
 	float roughness = (usageFlags & USE_ROUGHNESS_TEXTURE)
-		? roughnessTextures[textureID].Sample(linearWrapSampler, IN.uv)
+		? bindlessTextures[slots.roughness].Sample(linearWrapSampler, IN.uv).x
 		: material.roughnessOverride;
 	roughness = clamp(roughness, 0.01f, 0.99f);
 
 	float metallic = (usageFlags & USE_METALLIC_TEXTURE)
-		? metallicTextures[textureID].Sample(linearWrapSampler, IN.uv)
+		? bindlessTextures[slots.metallic].Sample(linearWrapSampler, IN.uv).x
 		: material.metallicOverride;
 	float ao = 1.f;// (material.usageFlags & USE_AO_TEXTURE) ? RMAO.z : 1.f;
 
@@ -1,58 +1,44 @@
 #pragma once
 
 #include <memory>
+#include <new>
 
-template <typename T, int alignment = alignof(T)>
+// Standard allocator interface with a minimum alignment, e.g. for containers of SIMD types. Uses the aligned operator new,
+// so the allocations are portable and show up in the memory tracking.
+template <typename T, size_t alignment = alignof(T)>
 class aligned_allocator
 {
 
 public:
 
 	typedef T value_type;
-	typedef T& reference;
-	typedef const T& const_reference;
-	typedef T* pointer;
-	typedef const T* const_pointer;
-	typedef size_t size_type;
-	typedef ptrdiff_t difference_type;
+
+	static constexpr size_t actualAlignment = (alignment > alignof(T)) ? alignment : alignof(T);
 
 	template <class U>
 	struct rebind
 	{
-		typedef aligned_allocator<U, N> other;
+		typedef aligned_allocator<U, alignment> other;
 	};
 
-	inline aligned_allocator() throw() {}
-	inline aligned_allocator(const aligned_allocator&) throw() {}
+	inline aligned_allocator() noexcept {}
+	inline aligned_allocator(const aligned_allocator&) noexcept {}
 
 	template <typename U>
-	inline aligned_allocator(const aligned_allocator<U, alignment>&) throw() {}
-
-	inline ~aligned_allocator() throw() {}
-
-	inline pointer address(reference r) { return &r; }
-	inline const_pointer address(const_reference r) const { return &r; }
+	inline aligned_allocator(const aligned_allocator<U, alignment>&) noexcept {}
 
-	pointer allocate(size_type n, typename std::allocator<void>::const_pointer hint = 0)
+	T* allocate(size_t n)
 	{
-		pointer res = reinterpret_cast<pointer>(_aligned_malloc(sizeof(T) * n, alignment));
-		if (res == 0)
-			throw std::bad_alloc();
-		return res;
+		return (T*)::operator new(sizeof(T) * n, std::align_val_t(actualAlignment));
 	}
 
-
-	inline void deallocate(pointer p, size_type)
+	inline void deallocate(T* p, size_t)
 	{
-		_aligned_free(p);
+		::operator delete(p, std::align_val_t(actualAlignment));
 	}
 
-	inline void construct(pointer p, const_reference value) { new (p) value_type(value); }
-	inline void destroy(pointer p) { p->~value_type(); }
-
-	inline size_type max_size() const throw() { return size_type(-1) / sizeof(T); }
-
-	inline bool operator==(const aligned_allocator&) { return true; }
-	inline bool operator!=(const aligned_allocator& rhs) { return !operator==(rhs); }
+	template <typename U>
+	inline bool operator==(const aligned_allocator<U, alignment>&) const { return true; }
+	template <typename U>
+	inline bool operator!=(const aligned_allocator<U, alignment>&) const { return false; }
 };
-
@@ -0,0 +1,305 @@
+#include "pch.h"
+#include "benchmark.h"
+#include "descriptor_allocator.h"
+#include "resource_state_tracker.h"
+#include "command_stream.h"
+#include "frame_graph.h"
+#include "indirect_drawing.h"
+#include "model.h"
+
+
+benchmark_result benchmarkDescriptorAllocation(uint32 numThreads, uint32 numAllocationsPerThread, bool useThreadCaches)
+{
+	bool oldEnableThreadCaches = dx_descriptor_allocator::enableThreadCaches;
+	dx_descriptor_allocator::enableThreadCaches = useThreadCaches;
+
+	const uint32 batchSize = 16;
+
+	double milliseconds = runThreads(numThreads, [numAllocationsPerThread](uint32 threadIndex)
+	{
+		dx_descriptor_allocation allocations[batchSize];
+
+		for (uint32 i = 0; i < numAllocationsPerThread; i += batchSize)
+		{
+			uint32 count = min(batchSize, numAllocationsPerThread - i);
+			for (uint32 j = 0; j < count; ++j)
+			{
+				allocations[j] = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			}
+			for (uint32 j = 0; j < count; ++j)
+			{
+				dx_descriptor_allocator::freeDescriptors(allocations[j]);
+			}
+		}
+	});
+
+	dx_descriptor_allocator::enableThreadCaches = oldEnableThreadCaches;
+
+	benchmark_result result;
+	result.name = useThreadCaches ? "Descriptor allocation (thread caches)" : "Descriptor allocation (global lock)";
+	result.numThreads = numThreads;
+	result.numOperations = (uint64)numThreads * numAllocationsPerThread * 2;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkResourceStateTracking(uint32 numThreads, uint32 numListsPerThread, uint32 numTransitionsPerList, bool useHandles)
+{
+	const uint32 numResources = 1024;
+
+	// The tracker never dereferences the resources, so any distinct addresses will do.
+	static uint8 fakeResourceMemory[numResources];
+
+	ID3D12Resource* resources[numResources];
+	uint32 handles[numResources];
+	for (uint32 i = 0; i < numResources; ++i)
+	{
+		resources[i] = (ID3D12Resource*)(fakeResourceMemory + i);
+
+		// Every fourth resource is a texture with a full mip chain.
+		uint32 numSubresources = (i % 4 == 0) ? 12 : 1;
+		handles[i] = dx_resource_state_tracker::addGlobalResourceState(resources[i], D3D12_RESOURCE_STATE_COMMON, numSubresources);
+	}
+
+	const D3D12_RESOURCE_STATES states[] =
+	{
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+	};
+
+	double milliseconds = runThreads(numThreads, [&](uint32 threadIndex)
+	{
+		dx_resource_state_tracker tracker;
+		tracker.initialize();
+
+		command_stream stream;
+		std::vector<D3D12_RESOURCE_BARRIER> pendingBarriers;
+
+		for (uint32 list = 0; list < numListsPerThread; ++list)
+		{
+			for (uint32 i = 0; i < numTransitionsPerList; ++i)
+			{
+				uint32 resourceIndex = (i * 7 + threadIndex * 131 + list) % numResources;
+				D3D12_RESOURCE_STATES state = states[(i + list) % arraysize(states)];
+
+				if (useHandles)
+				{
+					tracker.transitionResource(handles[resourceIndex], resources[resourceIndex], state);
+				}
+				else
+				{
+					tracker.transitionResource(resources[resourceIndex], state);
+				}
+			}
+
+			tracker.flushResourceBarriers(stream);
+			stream.clear();
+
+			// Same as a submission.
+			uint32 shardMask = tracker.getShardMask();
+			dx_resource_state_tracker::lockShards(shardMask);
+			pendingBarriers.clear();
+			tracker.resolvePendingResourceBarriers(pendingBarriers);
+			tracker.commitFinalResourceStates();
+			dx_resource_state_tracker::unlockShards(shardMask);
+
+			tracker.reset();
+		}
+	});
+
+	for (uint32 i = 0; i < numResources; ++i)
+	{
+		dx_resource_state_tracker::removeGlobalResourceState(resources[i]);
+	}
+
+	benchmark_result result;
+	result.name = useHandles ? "Resource transitions (state handles)" : "Resource transitions (pointer lookup)";
+	result.numThreads = numThreads;
+	result.numOperations = (uint64)numThreads * numListsPerThread * numTransitionsPerList;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+static D3D12_RESOURCE_DESC textureDesc(DXGI_FORMAT format, uint32 width, uint32 height, D3D12_RESOURCE_FLAGS flags)
+{
+	return CD3DX12_RESOURCE_DESC::Tex2D(format, width, height, 1, 1, 1, 0, flags);
+}
+
+benchmark_result benchmarkFrameGraphCompilation(uint32 numIterations, frame_graph_report& outReport)
+{
+	const uint32 width = 1920;
+	const uint32 height = 1080;
+	const uint32 numBloomLevels = 5;
+
+	const D3D12_RESOURCE_FLAGS rt = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	const D3D12_RESOURCE_FLAGS ds = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+	const D3D12_RESOURCE_FLAGS uav = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+	const D3D12_RESOURCE_STATES srv = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+	// The passes are never executed.
+	frame_graph_execute_func nop = [](dx_command_list*, frame_graph&) {};
+
+	frame_graph graph;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+		{
+			graph.reset();
+
+			frame_graph_resource albedo = graph.createTexture("Albedo", textureDesc(DXGI_FORMAT_R8G8B8A8_UNORM, width, height, rt));
+			frame_graph_resource normals = graph.createTexture("Normals", textureDesc(DXGI_FORMAT_R16G16B16A16_FLOAT, width, height, rt));
+			frame_graph_resource depth = graph.createTexture("Depth", textureDesc(DXGI_FORMAT_D32_FLOAT, width, height, ds));
+			frame_graph_resource ao = graph.createTexture("SSAO", textureDesc(DXGI_FORMAT_R8_UNORM, width / 2, height / 2, uav));
+			frame_graph_resource shadowMap = graph.createTexture("Shadow map", textureDesc(DXGI_FORMAT_D32_FLOAT, 2048, 2048, ds));
+			frame_graph_resource hdr = graph.createTexture("HDR", textureDesc(DXGI_FORMAT_R16G16B16A16_FLOAT, width, height, rt));
+			frame_graph_resource ldr = graph.createTexture("LDR", textureDesc(DXGI_FORMAT_R8G8B8A8_UNORM, width, height, rt | uav));
+			frame_graph_resource debug = graph.createTexture("Debug", textureDesc(DXGI_FORMAT_R8G8B8A8_UNORM, width, height, rt));
+
+			frame_graph_resource bloom[numBloomLevels];
+			for (uint32 i = 0; i < numBloomLevels; ++i)
+			{
+				bloom[i] = graph.createTexture("Bloom", textureDesc(DXGI_FORMAT_R11G11B10_FLOAT, width >> (i + 1), height >> (i + 1), uav));
+			}
+
+			graph.addPass("G-Buffer", nop)
+				.write(albedo, D3D12_RESOURCE_STATE_RENDER_TARGET)
+				.write(normals, D3D12_RESOURCE_STATE_RENDER_TARGET)
+				.write(depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+			// Overlaps with the shadow map pass.
+			graph.addPass("SSAO", nop)
+				.read(depth, srv)
+				.read(normals, srv)
+				.write(ao, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+				.setAsyncCompute();
+
+			graph.addPass("Shadow map", nop)
+				.write(shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+			graph.addPass("Lighting", nop)
+				.read(shadowMap)
+				.read(albedo)
+				.read(normals)
+				.read(ao)
+				.read(depth, D3D12_RESOURCE_STATE_DEPTH_READ | srv)
+				.write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+			graph.addPass("Debug view", nop)
+				.read(normals)
+				.write(debug, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+			graph.addPass("Bloom downsample", nop)
+				.read(hdr)
+				.write(bloom[0], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+			for (uint32 i = 1; i < numBloomLevels; ++i)
+			{
+				graph.addPass("Bloom downsample", nop)
+					.read(bloom[i - 1])
+					.write(bloom[i], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			}
+
+			graph.addPass("Tone mapping", nop)
+				.read(hdr)
+				.read(bloom[numBloomLevels - 1])
+				.write(ldr, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+				.setSideEffects();
+
+			graph.compile();
+		}
+	});
+
+	outReport = graph.getReport();
+
+	// The debug view is culled. The SSAO waits for the G-buffer, the lighting for the SSAO, and the shadow map gets its own
+	// list in between. Textures which are dead before others are written share memory with them.
+	assert(outReport.numPasses == 6 + numBloomLevels);
+	assert(outReport.numCulledPasses == 1);
+	assert(outReport.numAsyncComputePasses == 1);
+	assert(outReport.numTransientTextures == 7 + numBloomLevels);
+	assert(outReport.numCommandLists == 4);
+	assert(outReport.numCrossQueueWaits == 2);
+	assert(outReport.numAliasingBarriers > 0);
+	assert(outReport.aliasedSizeInBytes < outReport.unaliasedSizeInBytes);
+
+	benchmark_result result;
+	result.name = "Frame graph compilation";
+	result.numThreads = 1;
+	result.numOperations = numIterations;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkIndirectCommandBuilding(uint32 numIterations, uint32 numSubmeshes, uint32 numInstancesPerSubmesh)
+{
+	std::vector<submesh_info> submeshes(numSubmeshes);
+	for (uint32 i = 0; i < numSubmeshes; ++i)
+	{
+		submeshes[i].firstTriangle = i * 512;
+		submeshes[i].numTriangles = 512;
+		submeshes[i].baseVertex = i * 256;
+		submeshes[i].textureID_usageFlags = (i % 32) << 16;
+	}
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+		{
+			SCRATCH_SCOPE();
+
+			scratch_vector<indirect_command> commands;
+			scratch_vector<indirect_depth_only_command> depthOnlyCommands;
+			scratch_vector<mat4> instanceData;
+
+			indirect_draw_buffer buffer;
+
+			// Interleaved like a scene which places the same few objects over and over.
+			for (uint32 instance = 0; instance < numInstancesPerSubmesh; ++instance)
+			{
+				mat4 transform = createTranslationMatrix((float)instance, 0.f, (float)iteration);
+				for (uint32 i = 0; i < numSubmeshes; ++i)
+				{
+					buffer.pushInstance(submeshes[i], transform);
+				}
+			}
+
+			buffer.buildCommands(commands, depthOnlyCommands, instanceData);
+		}
+	});
+
+	benchmark_result result;
+	result.name = "Indirect command building";
+	result.numThreads = 1;
+	result.numOperations = (uint64)numIterations * numSubmeshes * numInstancesPerSubmesh;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkMeshImport(const char* filename, uint32 numIterations)
+{
+	benchmark_result result;
+	result.name = "Mesh import";
+	result.numThreads = 1;
+	result.numOperations = 0;
+	result.milliseconds = 0.0;
+
+	if (!fs::exists(filename))
+	{
+		return result;
+	}
+
+	result.milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+		{
+			cpu_triangle_mesh<vertex_3PUNTL> mesh;
+			mesh.pushFromFile(filename);
+		}
+	});
+	result.numOperations = numIterations;
+	return result;
+}
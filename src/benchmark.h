@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+
+#include <thread>
+
+struct frame_graph_report;
+
+struct benchmark_result
+{
+	const char* name;
+	uint32 numThreads;
+	uint64 numOperations;
+	double milliseconds;
+};
+
+// Starts all threads at once and returns the wall clock time until the last one has finished.
+template <typename thread_func>
+inline double runThreads(uint32 numThreads, const thread_func& func)
+{
+	std::atomic_bool start = false;
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads);
+	for (uint32 i = 0; i < numThreads; ++i)
+	{
+		threads.emplace_back([&start, &func, i]()
+		{
+			while (!start)
+			{
+				std::this_thread::yield();
+			}
+			func(i);
+		});
+	}
+
+	auto begin = std::chrono::high_resolution_clock::now();
+	start = true;
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// Allocates and frees single CBV/SRV/UAV descriptors from several threads at once, like texture and buffer creation on
+// loading threads does. The freed descriptors become available again a few frames later, as usual.
+benchmark_result benchmarkDescriptorAllocation(uint32 numThreads, uint32 numAllocationsPerThread, bool useThreadCaches);
+
+// Records transitions of a fixed set of resources into several command lists per thread, and resolves and commits them like
+// a submission would. Resources are either passed with their state handle, or as raw pointers which need a lookup.
+benchmark_result benchmarkResourceStateTracking(uint32 numThreads, uint32 numListsPerThread, uint32 numTransitionsPerList, bool useHandles);
+
+// Builds a frame graph like a typical deferred frame (g-buffer, SSAO, lighting, bloom chain, tone mapping and an unused
+// debug pass) and compiles it repeatedly. No device is involved, so this only measures culling, aliasing and barrier planning.
+benchmark_result benchmarkFrameGraphCompilation(uint32 numIterations, frame_graph_report& outReport);
+
+// Pushes instances of many submeshes into an indirect draw buffer and builds the command and instance data, like
+// the scene setup does. Only the CPU side of indirect_draw_buffer::finish is measured; nothing is uploaded.
+benchmark_result benchmarkIndirectCommandBuilding(uint32 numIterations, uint32 numSubmeshes, uint32 numInstancesPerSubmesh);
+
+// Loads a mesh through cpu_triangle_mesh::pushFromFile. After the first run, this reads the .assbin cache next to the file.
+// Returns zero operations if the file does not exist.
+benchmark_result benchmarkMeshImport(const char* filename, uint32 numIterations);
@@ -0,0 +1,227 @@
+#include "pch.h"
+#include "cpu_benchmarks.h"
+#include "input_recording.h"
+
+// Entry point of the headless benchmark executable. This does not create a window or a device.
+//
+// Usage: benchmarks [--filter <substring>] [--repetitions <n>] [--output <file.json>] [--list]
+//                   [--replay <file> [--fixed-dt <seconds>]]
+//
+// Every selected benchmark runs once for warm up and then <repetitions> times. The results are written as json to the output
+// file (or stdout), the progress goes to stderr. Times are in milliseconds, nsPerOperation is based on the median.
+// With --replay, only the headless replay of an input recording (written by the renderer with --record) runs.
+//
+// On Windows, build the Benchmarks project in the solution. On Linux, DirectXMath (github.com/microsoft/DirectXMath) and the
+// sal.h stub from DirectX-Headers (include/wsl/stubs) have to be on the include path. From the repository root (one line):
+//   g++ -std=c++17 -O2 -DNDEBUG -I <DirectXMath>/Inc -I <DirectX-Headers>/include/wsl/stubs -o benchmarks
+//     src/benchmark_main.cpp src/cpu_benchmarks.cpp src/camera.cpp src/math.cpp src/skeleton.cpp src/input_recording.cpp
+//     src/particle_simulation.cpp src/light_probe_tetrahedra.cpp src/ring_allocator.cpp src/free_list_allocator.cpp
+//     src/bindless_slot_allocator.cpp src/tlsf_allocator.cpp -pthread
+// Do not add src to the include path, or src/math.h shadows the system's math.h.
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+
+struct benchmark_summary
+{
+	const char* name;
+	benchmark_result result; // Of the last repetition.
+	std::vector<double> milliseconds;
+
+	double min;
+	double median;
+	double mean;
+	double max;
+};
+
+static void writeJSONString(FILE* file, const char* s)
+{
+	fputc('"', file);
+	for (; *s; ++s)
+	{
+		if (*s == '"' || *s == '\\')
+		{
+			fputc('\\', file);
+		}
+		fputc(*s, file);
+	}
+	fputc('"', file);
+}
+
+static void summarize(benchmark_summary& summary)
+{
+	std::vector<double> sorted = summary.milliseconds;
+	std::sort(sorted.begin(), sorted.end());
+
+	uint32 count = (uint32)sorted.size();
+	summary.min = sorted.front();
+	summary.max = sorted.back();
+	summary.median = (count % 2) ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+
+	double sum = 0.0;
+	for (double ms : sorted)
+	{
+		sum += ms;
+	}
+	summary.mean = sum / count;
+}
+
+static void writeResults(FILE* file, const std::vector<benchmark_summary>& summaries, uint32 numRepetitions)
+{
+#ifdef _WIN32
+	const char* platform = "windows";
+#else
+	const char* platform = "linux";
+#endif
+
+#ifdef NDEBUG
+	const char* configuration = "release";
+#else
+	const char* configuration = "debug";
+#endif
+
+	char date[32];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	fprintf(file, "{\"platform\":\"%s\",\"configuration\":\"%s\",\"date\":\"%s\",\"hardwareThreads\":%u,\"repetitions\":%u,\n\"benchmarks\":[",
+		platform, configuration, date, std::thread::hardware_concurrency(), numRepetitions);
+
+	for (uint32 i = 0; i < (uint32)summaries.size(); ++i)
+	{
+		const benchmark_summary& s = summaries[i];
+
+		fprintf(file, "%s\n{\"name\":", i ? "," : "");
+		writeJSONString(file, s.name);
+		fprintf(file, ",\"title\":");
+		writeJSONString(file, s.result.name);
+		fprintf(file, ",\"threads\":%u,\"operations\":%llu,\"min\":%g,\"median\":%g,\"mean\":%g,\"max\":%g,\"nsPerOperation\":%g,\"runs\":[",
+			s.result.numThreads, (unsigned long long)s.result.numOperations, s.min, s.median, s.mean, s.max,
+			s.result.numOperations ? (s.median * 1e6 / s.result.numOperations) : 0.0);
+		for (uint32 r = 0; r < (uint32)s.milliseconds.size(); ++r)
+		{
+			fprintf(file, "%s%g", r ? "," : "", s.milliseconds[r]);
+		}
+		fprintf(file, "]}");
+	}
+	fprintf(file, "\n]}\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = nullptr;
+	const char* outputPath = nullptr;
+	uint32 numRepetitions = 5;
+	const char* replayPath = nullptr;
+	float fixedDt = 0.f;
+	bool listOnly = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--filter") == 0 && hasValue)
+		{
+			filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "--repetitions") == 0 && hasValue)
+		{
+			numRepetitions = max(atoi(argv[++i]), 1);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+		{
+			outputPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+		{
+			replayPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--fixed-dt") == 0 && hasValue)
+		{
+			fixedDt = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--list") == 0)
+		{
+			listOnly = true;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--filter <substring>] [--repetitions <n>] [--output <file.json>] [--list] [--replay <file> [--fixed-dt <seconds>]]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<cpu_benchmark> benchmarks;
+
+	input_recording recording;
+	std::string replayName;
+	if (replayPath)
+	{
+		if (!recording.load(replayPath))
+		{
+			return 1;
+		}
+		replayName = std::string("replay/") + replayPath;
+		benchmarks.push_back({ replayName.c_str(), [&recording, fixedDt]() { return benchmarkInputReplay(recording, fixedDt); } });
+	}
+	else
+	{
+		benchmarks = getCPUBenchmarks();
+	}
+
+	std::vector<benchmark_summary> summaries;
+	for (const cpu_benchmark& benchmark : benchmarks)
+	{
+		if (filter && !strstr(benchmark.name, filter))
+		{
+			continue;
+		}
+
+		if (listOnly)
+		{
+			printf("%s\n", benchmark.name);
+			continue;
+		}
+
+		fprintf(stderr, "%s", benchmark.name);
+
+		benchmark_summary summary;
+		summary.name = benchmark.name;
+
+		// Warm up caches and the allocator.
+		benchmark.run();
+
+		for (uint32 r = 0; r < numRepetitions; ++r)
+		{
+			summary.result = benchmark.run();
+			summary.milliseconds.push_back(summary.result.milliseconds);
+		}
+		summarize(summary);
+
+		fprintf(stderr, ": %.3f ms median\n", summary.median);
+
+		summaries.push_back(summary);
+	}
+
+	if (listOnly)
+	{
+		return 0;
+	}
+
+	FILE* file = outputPath ? fopen(outputPath, "w") : stdout;
+	if (!file)
+	{
+		fprintf(stderr, "Could not open %s\n", outputPath);
+		return 1;
+	}
+
+	writeResults(file, summaries, numRepetitions);
+
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+
+	return 0;
+}
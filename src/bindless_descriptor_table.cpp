@@ -0,0 +1,161 @@
+#include "pch.h"
+#include "bindless_descriptor_table.h"
+#include "texture.h"
+#include "error.h"
+#include "graphics.h"
+#include "profiling.h"
+#include "memory_tracking.h"
+
+static ComPtr<ID3D12Device2> device;
+static ComPtr<ID3D12DescriptorHeap> descriptorHeap;
+static uint32 descriptorHandleIncrementSize;
+
+static uint32 numStaticDescriptors;
+static uint32 numUsedStaticDescriptors;
+
+static bindless_slot_allocator slotAllocator;
+static std::mutex mutex;
+static uint64 currentFrameNumber;
+
+void dx_bindless_descriptor_table::initialize(ComPtr<ID3D12Device2> device, uint32 numSlots, uint32 numStaticDescriptors)
+{
+	::device = device;
+	::numStaticDescriptors = numStaticDescriptors;
+	numUsedStaticDescriptors = 0;
+
+	D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
+	descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	descriptorHeapDesc.NumDescriptors = numStaticDescriptors + numSlots;
+	descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	checkResult(device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&descriptorHeap)));
+	SET_NAME(descriptorHeap, "Bindless descriptor heap");
+
+	descriptorHandleIncrementSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	trackGPUMemory(descriptorHeap.Get(), (uint64)descriptorHeapDesc.NumDescriptors * descriptorHandleIncrementSize, memory_tag_descriptors);
+
+	slotAllocator.initialize(numSlots);
+
+	bindless_handle fallback;
+	slotAllocator.allocate(fallback);
+	assert(fallback.index == getFallbackSlot());
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC nullDesc = {};
+	nullDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	nullDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	nullDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	nullDesc.Texture2D.MipLevels = 1;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle(descriptorHeap->GetCPUDescriptorHandleForHeapStart(), numStaticDescriptors + fallback.index, descriptorHandleIncrementSize);
+	device->CreateShaderResourceView(nullptr, &nullDesc, cpuHandle);
+}
+
+dx_descriptor_heap dx_bindless_descriptor_table::allocateStaticRange(uint32 count)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	assert(numUsedStaticDescriptors + count <= numStaticDescriptors && "Static part of the bindless heap is full.");
+
+	dx_descriptor_heap result;
+	result.initialize(device, descriptorHeap, numUsedStaticDescriptors);
+	numUsedStaticDescriptors += count;
+	return result;
+}
+
+bindless_handle dx_bindless_descriptor_table::registerTexture(dx_texture& texture)
+{
+	// The texture object is being reused for a new resource.
+	unregisterTexture(texture);
+
+	bindless_handle handle;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		bool success = slotAllocator.allocate(handle);
+		assert(success && "Bindless descriptor table is full.");
+	}
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle(descriptorHeap->GetCPUDescriptorHandleForHeapStart(), numStaticDescriptors + handle.index, descriptorHandleIncrementSize);
+	device->CreateShaderResourceView(texture.resource.Get(), nullptr, cpuHandle);
+
+	texture.bindlessSRV = handle;
+	texture.ownsBindlessSRV = true;
+	return handle;
+}
+
+void dx_bindless_descriptor_table::unregisterTexture(dx_texture& texture)
+{
+	// Copies only let go of the slot.
+	if (texture.bindlessSRV.isValid() && texture.ownsBindlessSRV)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slotAllocator.freeDeferred(texture.bindlessSRV, currentFrameNumber);
+	}
+	texture.bindlessSRV = {};
+	texture.ownsBindlessSRV = false;
+}
+
+void dx_bindless_descriptor_table::updateTexture(dx_texture& texture)
+{
+	if (texture.bindlessSRV.isValid() && texture.ownsBindlessSRV)
+	{
+		CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle(descriptorHeap->GetCPUDescriptorHandleForHeapStart(), numStaticDescriptors + texture.bindlessSRV.index, descriptorHandleIncrementSize);
+		device->CreateShaderResourceView(texture.resource.Get(), nullptr, cpuHandle);
+	}
+}
+
+uint32 dx_bindless_descriptor_table::getSlot(bindless_handle handle)
+{
+	if (!handle.isValid())
+	{
+		return getFallbackSlot();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!slotAllocator.isAlive(handle))
+	{
+		// The slot might already hold a different texture, so never hand it out.
+		assert(!"Bindless handle refers to a slot which has been freed.");
+		return getFallbackSlot();
+	}
+	return handle.index;
+}
+
+bool dx_bindless_descriptor_table::isAlive(bindless_handle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return slotAllocator.isAlive(handle);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE dx_bindless_descriptor_table::getTexturesGPUHandle()
+{
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(descriptorHeap->GetGPUDescriptorHandleForHeapStart(), numStaticDescriptors, descriptorHandleIncrementSize);
+}
+
+ComPtr<ID3D12DescriptorHeap> dx_bindless_descriptor_table::getDescriptorHeap()
+{
+	return descriptorHeap;
+}
+
+void dx_bindless_descriptor_table::beginFrame(uint64 frameNumber)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	currentFrameNumber = frameNumber;
+
+	PROFILE_COUNTER_SET("Bindless slots in use", slotAllocator.getNumAllocated());
+}
+
+void dx_bindless_descriptor_table::releaseStaleSlots(uint64 completedFrameNumber)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	slotAllocator.releaseStale(completedFrameNumber);
+}
+
+bindless_table_statistics dx_bindless_descriptor_table::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bindless_table_statistics result;
+	result.numAllocatedSlots = slotAllocator.getNumAllocated();
+	result.numStaleSlots = slotAllocator.getNumStale();
+	result.capacity = slotAllocator.getCapacity();
+	return result;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.h"
+#include "bindless_slot_allocator.h"
+#include "descriptor_heap.h"
+
+struct dx_texture;
+
+struct bindless_table_statistics
+{
+	uint32 numAllocatedSlots;
+	uint32 numStaleSlots;
+	uint32 capacity;
+};
+
+// One global shader visible heap. The front of the heap holds descriptors which are set up once and bound as regular
+// tables (see allocateStaticRange). The rest are bindless texture slots, which shaders index directly.
+// A registered texture keeps its slot until it is unregistered. Slots are reused a few frames later, once the GPU is
+// done with them. Slot 0 holds a null SRV (reads return 0), which stands in for missing and stale textures.
+class dx_bindless_descriptor_table
+{
+public:
+	static void initialize(ComPtr<ID3D12Device2> device, uint32 numSlots = 4096, uint32 numStaticDescriptors = 64);
+
+	// Returns a view into the static part of the heap, into which count descriptors can be pushed.
+	static dx_descriptor_heap allocateStaticRange(uint32 count);
+
+	// Creates an SRV for the texture in a new slot and stores the handle in the texture. A slot the texture had before
+	// is freed.
+	static bindless_handle registerTexture(dx_texture& texture);
+	static void unregisterTexture(dx_texture& texture);
+
+	// Creates the SRV in the texture's slot again, e.g. after the texture has been relocated. Only for the texture which
+	// owns the slot, and only while the GPU does not read it.
+	static void updateTexture(dx_texture& texture);
+
+	// Returns the fallback slot for invalid handles, and for handles whose slot has been freed (this asserts in debug builds).
+	static uint32 getSlot(bindless_handle handle);
+	static bool isAlive(bindless_handle handle);
+	static uint32 getFallbackSlot() { return 0; }
+
+	// GPU handle of slot 0. Bind this as an unbounded SRV table.
+	static D3D12_GPU_DESCRIPTOR_HANDLE getTexturesGPUHandle();
+	static ComPtr<ID3D12DescriptorHeap> getDescriptorHeap();
+
+	// Same frame numbers as in dx_descriptor_allocator.
+	static void beginFrame(uint64 frameNumber);
+	static void releaseStaleSlots(uint64 completedFrameNumber);
+
+	static bindless_table_statistics getStatistics();
+};
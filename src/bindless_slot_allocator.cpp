@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "bindless_slot_allocator.h"
+
+
+void bindless_slot_allocator::initialize(uint32 capacity)
+{
+	generations.assign(capacity, 0);
+	allocated.assign(capacity, false);
+	staleSlots.clear();
+	numAllocated = 0;
+
+	// Reversed, so that the lowest slots are handed out first.
+	freeSlots.resize(capacity);
+	for (uint32 i = 0; i < capacity; ++i)
+	{
+		freeSlots[i] = capacity - i - 1;
+	}
+}
+
+bool bindless_slot_allocator::allocate(bindless_handle& outHandle)
+{
+	if (freeSlots.empty())
+	{
+		return false;
+	}
+
+	uint32 index = freeSlots.back();
+	freeSlots.pop_back();
+
+	assert(!allocated[index]);
+	allocated[index] = true;
+	++numAllocated;
+
+	outHandle.index = index;
+	outHandle.generation = generations[index];
+	return true;
+}
+
+void bindless_slot_allocator::freeDeferred(bindless_handle handle, uint64 frameNumber)
+{
+	assert(isAlive(handle) && "Slot is not allocated or has already been freed.");
+
+	allocated[handle.index] = false;
+	++generations[handle.index];
+	--numAllocated;
+
+	// Same as in free_list_allocator: frees can arrive slightly out of frame order, so keep the queue sorted.
+	auto it = staleSlots.end();
+	while (it != staleSlots.begin() && std::prev(it)->frameNumber > frameNumber)
+	{
+		--it;
+	}
+	staleSlots.insert(it, { handle.index, frameNumber });
+}
+
+void bindless_slot_allocator::releaseStale(uint64 completedFrameNumber)
+{
+	while (!staleSlots.empty() && staleSlots.front().frameNumber <= completedFrameNumber)
+	{
+		freeSlots.push_back(staleSlots.front().index);
+		staleSlots.pop_front();
+	}
+}
+
+bool bindless_slot_allocator::isAlive(bindless_handle handle) const
+{
+	return handle.index < (uint32)generations.size()
+		&& allocated[handle.index]
+		&& generations[handle.index] == handle.generation;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+#include <deque>
+
+// Refers to a slot in a bindless table. The generation is increased every time the slot is freed, so that handles to a
+// freed (and possibly reused) slot can be detected.
+struct bindless_handle
+{
+	uint32 index = (uint32)-1;
+	uint32 generation = 0;
+
+	bool isValid() const { return index != (uint32)-1; }
+};
+
+// Hands out stable slots in [0, capacity). This only manages indices; it does not own any descriptors.
+// Freed slots might still be referenced by command lists in flight, so they are only reused once releaseStale has been
+// called with the frame number they were freed in (or a later one).
+class bindless_slot_allocator
+{
+public:
+	void initialize(uint32 capacity);
+
+	// Returns false if all slots are in use.
+	bool allocate(bindless_handle& outHandle);
+
+	// The handle is invalid right away, but the slot is not reused before releaseStale(frameNumber).
+	void freeDeferred(bindless_handle handle, uint64 frameNumber);
+	void releaseStale(uint64 completedFrameNumber);
+
+	bool isAlive(bindless_handle handle) const;
+
+	uint32 getCapacity() const { return (uint32)generations.size(); }
+	uint32 getNumAllocated() const { return numAllocated; }
+	uint32 getNumStale() const { return (uint32)staleSlots.size(); }
+
+private:
+	struct stale_slot
+	{
+		uint32 index;
+		uint64 frameNumber;
+	};
+
+	std::vector<uint32> generations;
+	std::vector<bool> allocated;
+	std::vector<uint32> freeSlots; // Used as a stack, so that recently freed slots are reused first.
+	std::deque<stale_slot> staleSlots;
+
+	uint32 numAllocated = 0;
+};
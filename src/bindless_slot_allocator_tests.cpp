@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "tests.h"
+#include "bindless_slot_allocator.h"
+
+
+static void testLowestSlotsFirst()
+{
+	bindless_slot_allocator allocator;
+	allocator.initialize(4);
+
+	bindless_handle handles[4];
+	for (uint32 i = 0; i < 4; ++i)
+	{
+		CHECK(allocator.allocate(handles[i]));
+		CHECK(handles[i].isValid());
+		CHECK(handles[i].index == i);
+		CHECK(handles[i].generation == 0);
+		CHECK(allocator.isAlive(handles[i]));
+	}
+	CHECK(allocator.getNumAllocated() == 4);
+
+	bindless_handle handle;
+	CHECK(!allocator.allocate(handle));
+	CHECK(!handle.isValid());
+	CHECK(!allocator.isAlive(handle));
+}
+
+static void testFreedSlotsAreReusedAfterTheirFrame()
+{
+	bindless_slot_allocator allocator;
+	allocator.initialize(2);
+
+	bindless_handle a, b;
+	CHECK(allocator.allocate(a));
+	CHECK(allocator.allocate(b));
+
+	// The handle dies right away, but the slot might still be read by command lists in flight.
+	allocator.freeDeferred(a, 10);
+	CHECK(!allocator.isAlive(a));
+	CHECK(allocator.isAlive(b));
+	CHECK(allocator.getNumAllocated() == 1);
+	CHECK(allocator.getNumStale() == 1);
+
+	bindless_handle c;
+	CHECK(!allocator.allocate(c));
+
+	allocator.releaseStale(9);
+	CHECK(allocator.getNumStale() == 1);
+	CHECK(!allocator.allocate(c));
+
+	allocator.releaseStale(10);
+	CHECK(allocator.getNumStale() == 0);
+	CHECK(allocator.allocate(c));
+
+	// Same slot, new generation. The old handle does not come back to life.
+	CHECK(c.index == a.index);
+	CHECK(c.generation == a.generation + 1);
+	CHECK(allocator.isAlive(c));
+	CHECK(!allocator.isAlive(a));
+}
+
+static void testOutOfOrderFrees()
+{
+	bindless_slot_allocator allocator;
+	allocator.initialize(3);
+
+	bindless_handle handles[3];
+	for (uint32 i = 0; i < 3; ++i)
+	{
+		CHECK(allocator.allocate(handles[i]));
+	}
+
+	allocator.freeDeferred(handles[0], 7);
+	allocator.freeDeferred(handles[1], 5);
+	allocator.freeDeferred(handles[2], 6);
+	CHECK(allocator.getNumAllocated() == 0);
+	CHECK(allocator.getNumStale() == 3);
+
+	// Only the slot freed in frame 5 is released, even though it was not the first one freed.
+	allocator.releaseStale(5);
+	CHECK(allocator.getNumStale() == 2);
+
+	bindless_handle handle;
+	CHECK(allocator.allocate(handle) && handle.index == handles[1].index);
+	CHECK(!allocator.allocate(handle));
+
+	allocator.releaseStale(7);
+	CHECK(allocator.getNumStale() == 0);
+
+	// Recently freed slots are reused first.
+	CHECK(allocator.allocate(handle) && handle.index == handles[0].index);
+	CHECK(allocator.allocate(handle) && handle.index == handles[2].index);
+}
+
+static void testInvalidHandles()
+{
+	bindless_slot_allocator allocator;
+	allocator.initialize(2);
+
+	bindless_handle defaultHandle;
+	CHECK(!defaultHandle.isValid());
+	CHECK(!allocator.isAlive(defaultHandle));
+
+	bindless_handle outOfRange;
+	outOfRange.index = 2;
+	CHECK(!allocator.isAlive(outOfRange));
+
+	// Never allocated.
+	bindless_handle unallocated;
+	unallocated.index = 1;
+	CHECK(!allocator.isAlive(unallocated));
+
+	// Initializing again drops all slots, including the ones which are still stale.
+	bindless_handle a, b;
+	CHECK(allocator.allocate(a));
+	CHECK(allocator.allocate(b));
+	allocator.freeDeferred(b, 1);
+	allocator.initialize(2);
+	CHECK(!allocator.isAlive(a));
+	CHECK(allocator.getNumAllocated() == 0);
+	CHECK(allocator.getNumStale() == 0);
+	CHECK(allocator.getCapacity() == 2);
+}
+
+std::vector<unit_test> getBindlessSlotAllocatorTests()
+{
+	return
+	{
+		{ "bindless_slot_allocator/lowest_slots_first", testLowestSlotsFirst },
+		{ "bindless_slot_allocator/freed_slots_are_reused_after_their_frame", testFreedSlotsAreReusedAfterTheirFrame },
+		{ "bindless_slot_allocator/out_of_order_frees", testOutOfOrderFrees },
+		{ "bindless_slot_allocator/invalid_handles", testInvalidHandles },
+	};
+}
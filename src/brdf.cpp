@@ -2,9 +2,10 @@
 #include "brdf.h"
 #include "error.h"
 #include "descriptor_allocator.h"
+#include "shader_store.h"
 
 
-void dx_equirectangular_to_cubemap_pso::initialize(ComPtr<ID3D12Device2> device)
+pipeline_handle dx_equirectangular_to_cubemap_pso::initialize(ComPtr<ID3D12Device2> device)
 {
 	CD3DX12_DESCRIPTOR_RANGE1 srcMip(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 	CD3DX12_DESCRIPTOR_RANGE1 outMip(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 5, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -31,8 +32,7 @@ void dx_equirectangular_to_cubemap_pso::initialize(ComPtr<ID3D12Device2> device)
 	rootSignature.initialize(device, rootSignatureDesc);
 
 
-	ComPtr<ID3DBlob> shaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/equirectangular_to_cubemap.cso", &shaderBlob));
+	D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/equirectangular_to_cubemap.cso");
 
 	struct pipeline_state_stream
 	{
@@ -41,12 +41,9 @@ void dx_equirectangular_to_cubemap_pso::initialize(ComPtr<ID3D12Device2> device)
 	} pipelineStateStream;
 
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
-	pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+	pipelineStateStream.cs = shader;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	pipeline_handle handle = dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState);
 
 
 	dx_descriptor_allocation allocation = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 5);
@@ -65,9 +62,11 @@ void dx_equirectangular_to_cubemap_pso::initialize(ComPtr<ID3D12Device2> device)
 			allocation.getDescriptorHandle(i)
 		);
 	}
+
+	return handle;
 }
 
-void dx_cubemap_to_irradiance_pso::initialize(ComPtr<ID3D12Device2> device)
+pipeline_handle dx_cubemap_to_irradiance_pso::initialize(ComPtr<ID3D12Device2> device)
 {
 	CD3DX12_DESCRIPTOR_RANGE1 srcMip(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 	CD3DX12_DESCRIPTOR_RANGE1 outMip(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -94,8 +93,7 @@ void dx_cubemap_to_irradiance_pso::initialize(ComPtr<ID3D12Device2> device)
 	rootSignature.initialize(device, rootSignatureDesc);
 
 
-	ComPtr<ID3DBlob> shaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/cubemap_to_irradiance.cso", &shaderBlob));
+	D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/cubemap_to_irradiance.cso");
 
 	struct pipeline_state_stream
 	{
@@ -104,15 +102,12 @@ void dx_cubemap_to_irradiance_pso::initialize(ComPtr<ID3D12Device2> device)
 	} pipelineStateStream;
 
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
-	pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+	pipelineStateStream.cs = shader;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	return dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState);
 }
 
-void dx_prefilter_environment_pso::initialize(ComPtr<ID3D12Device2> device)
+pipeline_handle dx_prefilter_environment_pso::initialize(ComPtr<ID3D12Device2> device)
 {
 	CD3DX12_DESCRIPTOR_RANGE1 srcMip(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 	CD3DX12_DESCRIPTOR_RANGE1 outMip(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 5, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -139,8 +134,7 @@ void dx_prefilter_environment_pso::initialize(ComPtr<ID3D12Device2> device)
 	rootSignature.initialize(device, rootSignatureDesc);
 
 
-	ComPtr<ID3DBlob> shaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/prefilter_environment.cso", &shaderBlob));
+	D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/prefilter_environment.cso");
 
 	struct pipeline_state_stream
 	{
@@ -149,12 +143,9 @@ void dx_prefilter_environment_pso::initialize(ComPtr<ID3D12Device2> device)
 	} pipelineStateStream;
 
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
-	pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+	pipelineStateStream.cs = shader;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	pipeline_handle handle = dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState);
 
 
 	dx_descriptor_allocation allocation = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 5);
@@ -173,9 +164,11 @@ void dx_prefilter_environment_pso::initialize(ComPtr<ID3D12Device2> device)
 			allocation.getDescriptorHandle(i)
 		);
 	}
+
+	return handle;
 }
 
-void dx_integrate_brdf_pso::initialize(ComPtr<ID3D12Device2> device)
+pipeline_handle dx_integrate_brdf_pso::initialize(ComPtr<ID3D12Device2> device)
 {
 	CD3DX12_DESCRIPTOR_RANGE1 outMip(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 
@@ -190,8 +183,7 @@ void dx_integrate_brdf_pso::initialize(ComPtr<ID3D12Device2> device)
 	rootSignature.initialize(device, rootSignatureDesc);
 
 
-	ComPtr<ID3DBlob> shaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/integrate_brdf.cso", &shaderBlob));
+	D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/integrate_brdf.cso");
 
 	struct pipeline_state_stream
 	{
@@ -200,15 +192,12 @@ void dx_integrate_brdf_pso::initialize(ComPtr<ID3D12Device2> device)
 	} pipelineStateStream;
 
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
-	pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+	pipelineStateStream.cs = shader;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	return dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState);
 }
 
-void dx_cubemap_to_sh_pso::initialize(ComPtr<ID3D12Device2> device)
+pipeline_handle dx_cubemap_to_sh_pso::initialize(ComPtr<ID3D12Device2> device)
 {
 	CD3DX12_DESCRIPTOR_RANGE1 srcMip(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 	CD3DX12_DESCRIPTOR_RANGE1 outSH(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -235,8 +224,7 @@ void dx_cubemap_to_sh_pso::initialize(ComPtr<ID3D12Device2> device)
 	rootSignature.initialize(device, rootSignatureDesc);
 
 
-	ComPtr<ID3DBlob> shaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/cubemap_to_sh.cso", &shaderBlob));
+	D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/cubemap_to_sh.cso");
 
 	struct pipeline_state_stream
 	{
@@ -245,10 +233,7 @@ void dx_cubemap_to_sh_pso::initialize(ComPtr<ID3D12Device2> device)
 	} pipelineStateStream;
 
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
-	pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+	pipelineStateStream.cs = shader;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	return dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState);
 }
@@ -3,6 +3,7 @@
 #include "common.h"
 #include "math.h"
 #include "root_signature.h"
+#include "pipeline_factory.h"
 
 struct equirectangular_to_cubemap_cb
 {
@@ -22,7 +23,7 @@ enum equirectangular_to_cubemap_root_parameter
 
 struct dx_equirectangular_to_cubemap_pso
 {
-	void initialize(ComPtr<ID3D12Device2> device);
+	pipeline_handle initialize(ComPtr<ID3D12Device2> device); // The pipeline is built asynchronously.
 
 	dx_root_signature rootSignature;
 	ComPtr<ID3D12PipelineState> pipelineState;
@@ -48,7 +49,7 @@ enum cubemap_to_irradiance_root_parameter
 
 struct dx_cubemap_to_irradiance_pso
 {
-	void initialize(ComPtr<ID3D12Device2> device);
+	pipeline_handle initialize(ComPtr<ID3D12Device2> device); // The pipeline is built asynchronously.
 
 	dx_root_signature rootSignature;
 	ComPtr<ID3D12PipelineState> pipelineState;
@@ -75,7 +76,7 @@ enum prefilter_environment_root_parameter
 
 struct dx_prefilter_environment_pso
 {
-	void initialize(ComPtr<ID3D12Device2> device);
+	pipeline_handle initialize(ComPtr<ID3D12Device2> device); // The pipeline is built asynchronously.
 
 	dx_root_signature rootSignature;
 	ComPtr<ID3D12PipelineState> pipelineState;
@@ -99,7 +100,7 @@ enum integrate_brdf_root_parameter
 
 struct dx_integrate_brdf_pso
 {
-	void initialize(ComPtr<ID3D12Device2> device);
+	pipeline_handle initialize(ComPtr<ID3D12Device2> device); // The pipeline is built asynchronously.
 
 	dx_root_signature rootSignature;
 	ComPtr<ID3D12PipelineState> pipelineState;
@@ -124,7 +125,7 @@ enum cubemap_to_sh_root_parameter
 
 struct dx_cubemap_to_sh_pso
 {
-	void initialize(ComPtr<ID3D12Device2> device);
+	pipeline_handle initialize(ComPtr<ID3D12Device2> device); // The pipeline is built asynchronously.
 
 	dx_root_signature rootSignature;
 	ComPtr<ID3D12PipelineState> pipelineState;
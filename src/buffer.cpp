@@ -4,22 +4,70 @@
 #include "resource_state_tracker.h"
 #include "command_list.h"
 #include "command_queue.h"
+#include "heap_allocator.h"
+
+dx_buffer::dx_buffer(const dx_buffer& other)
+	: resource(other.resource), device(other.device), stateHandle(other.stateHandle)
+{
+}
+
+dx_buffer::dx_buffer(dx_buffer&& other) noexcept
+	: dx_buffer((const dx_buffer&)other)
+{
+	self = std::move(other.self);
+	if (self)
+	{
+		*self = this;
+	}
+}
+
+dx_buffer& dx_buffer::operator=(const dx_buffer& other)
+{
+	resource = other.resource;
+	device = other.device;
+	stateHandle = other.stateHandle;
+	self = nullptr;
+	return *this;
+}
+
+dx_buffer& dx_buffer::operator=(dx_buffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		*this = (const dx_buffer&)other;
+		self = std::move(other.self);
+		if (self)
+		{
+			*self = this;
+		}
+	}
+	return *this;
+}
 
 void dx_buffer::initialize(ComPtr<ID3D12Device2> device, uint32 size, const void* data, dx_command_list* commandList,
 	D3D12_RESOURCE_FLAGS flags)
 {
 	this->device = device;
 
-	// Create a committed resource for the GPU resource in a default heap.
-	checkResult(device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(size, flags),
-		D3D12_RESOURCE_STATE_COMMON,
-		nullptr,
-		IID_PPV_ARGS(&resource)));
+	// The GPU writes to buffers with unordered access, so copies of them must not end up with a different resource.
+	gpu_heap_relocation_func relocateFunc;
+	self = nullptr;
+	if (!(flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS))
+	{
+		self = std::make_shared<dx_buffer*>(this);
+		relocateFunc = [target = std::weak_ptr<dx_buffer*>(self)](ComPtr<ID3D12Resource> newResource)
+		{
+			// The buffer might have been destroyed or re-initialized in the meantime.
+			if (auto buffer = target.lock())
+			{
+				(*buffer)->relocate(newResource);
+			}
+		};
+	}
+
+	resource = dx_heap_allocator::createResource(CD3DX12_RESOURCE_DESC::Buffer(size, flags), D3D12_RESOURCE_STATE_COMMON, nullptr, relocateFunc);
 
-	dx_resource_state_tracker::addGlobalResourceState(resource.Get(), D3D12_RESOURCE_STATE_COMMON, 1);
+	stateHandle = dx_resource_state_tracker::addGlobalResourceState(resource.Get(), D3D12_RESOURCE_STATE_COMMON, 1);
 
 	if (data)
 	{
@@ -28,6 +76,24 @@ void dx_buffer::initialize(ComPtr<ID3D12Device2> device, uint32 size, const void
 	}
 }
 
+void dx_buffer::relocate(ComPtr<ID3D12Resource> newResource)
+{
+	resource = newResource;
+	stateHandle = dx_resource_state_tracker::getGlobalResourceHandle(resource.Get());
+}
+
+void dx_vertex_buffer::relocate(ComPtr<ID3D12Resource> newResource)
+{
+	dx_buffer::relocate(newResource);
+	view.BufferLocation = resource->GetGPUVirtualAddress();
+}
+
+void dx_index_buffer::relocate(ComPtr<ID3D12Resource> newResource)
+{
+	dx_buffer::relocate(newResource);
+	view.BufferLocation = resource->GetGPUVirtualAddress();
+}
+
 void dx_buffer::copyBackToCPU(void* buffer, uint32 size)
 {
 	D3D12_RESOURCE_DESC readbackBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
@@ -45,7 +111,7 @@ void dx_buffer::copyBackToCPU(void* buffer, uint32 size)
 	commandList->copyResource(readbackBuffer, resource, false);
 
 	uint64 fenceValue = dx_command_queue::copyCommandQueue.executeCommandList(commandList);
-	dx_command_queue::copyCommandQueue.waitForFenceValue(fenceValue);
+	dx_command_queue::copyCommandQueue.waitForFenceValue(fenceValue, "Buffer readback");
 
 	D3D12_RANGE readbackBufferRange{ 0, size };
 	void* data;
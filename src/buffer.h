@@ -3,6 +3,8 @@
 #include "common.h"
 #include "model.h"
 
+#include <memory>
+
 template <typename index_t> inline DXGI_FORMAT getFormat() { static_assert(false, "Unknown index format."); return DXGI_FORMAT_UNKNOWN; }
 template <>					inline DXGI_FORMAT getFormat<uint16>() { return DXGI_FORMAT_R16_UINT; }
 template <>					inline DXGI_FORMAT getFormat<uint32>() { return DXGI_FORMAT_R32_UINT; }
@@ -13,6 +15,16 @@ struct dx_buffer
 {
 	ComPtr<ID3D12Resource> resource;
 	ComPtr<ID3D12Device2> device;
+	uint32 stateHandle = (uint32)-1; // See dx_resource::stateHandle.
+
+	// Buffers without unordered access may be moved by dx_heap_allocator::defragment. Only the buffer which created the
+	// resource (or the one it has been moved into) switches to the new resource. Copies keep using the old one.
+	dx_buffer() {}
+	dx_buffer(const dx_buffer& other);
+	dx_buffer(dx_buffer&& other) noexcept;
+	virtual ~dx_buffer() {}
+	dx_buffer& operator=(const dx_buffer& other);
+	dx_buffer& operator=(dx_buffer&& other) noexcept;
 
 	void initialize(ComPtr<ID3D12Device2> device, uint32 size, const void* data = nullptr, dx_command_list* commandList = nullptr, 
 		D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
@@ -23,6 +35,14 @@ struct dx_buffer
 	}
 
 	void copyBackToCPU(void* buffer, uint32 size);
+
+protected:
+	// Called by the relocation callback. Derived buffers update their views.
+	virtual void relocate(ComPtr<ID3D12Resource> newResource);
+
+private:
+	// Points back to this buffer, so that the relocation callback finds it. Moves update it, copies do not get one.
+	std::shared_ptr<dx_buffer*> self;
 };
 
 struct dx_vertex_buffer : dx_buffer
@@ -30,6 +50,9 @@ struct dx_vertex_buffer : dx_buffer
 	D3D12_VERTEX_BUFFER_VIEW view;
 
 	template <typename vertex_t> void initialize(ComPtr<ID3D12Device2> device, vertex_t* vertices, uint32 count, dx_command_list* commandList = nullptr);
+
+protected:
+	void relocate(ComPtr<ID3D12Resource> newResource) override;
 };
 
 struct dx_index_buffer : dx_buffer
@@ -38,6 +61,9 @@ struct dx_index_buffer : dx_buffer
 	uint32 numIndices;
 
 	template <typename index_t> void initialize(ComPtr<ID3D12Device2> device, index_t* indices, uint32 count, dx_command_list* commandList = nullptr);
+
+protected:
+	void relocate(ComPtr<ID3D12Resource> newResource) override;
 };
 
 struct dx_structured_buffer : dx_buffer
@@ -90,6 +116,8 @@ inline void dx_index_buffer::initialize(ComPtr<ID3D12Device2> device, index_t* i
 template<typename vertex_t>
 inline void dx_mesh::initialize(ComPtr<ID3D12Device2> device, dx_command_list* commandList, const cpu_triangle_mesh<vertex_t>& cpuMesh)
 {
+	MEMORY_TAG(memory_tag_meshes);
+
 	vertexBuffer.initialize(device, cpuMesh.vertices.data(), (uint32)cpuMesh.vertices.size(), commandList);
 	indexBuffer.initialize(device, (decltype(cpuMesh.triangles.data()->a)*)cpuMesh.triangles.data(), (uint32)cpuMesh.triangles.size() * 3, commandList);
 }
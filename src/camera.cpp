@@ -201,3 +201,54 @@ bool camera_frustum_planes::cullModelSpaceAABB(const bounding_box& aabb, const m
 
 	return false;
 }
+
+void camera_controller::keyDown(keyboard_key key)
+{
+	switch (key)
+	{
+	case key_w: inputMovement.z -= 1.f; break;
+	case key_s: inputMovement.z += 1.f; break;
+	case key_a: inputMovement.x -= 1.f; break;
+	case key_d: inputMovement.x += 1.f; break;
+	case key_q: inputMovement.y -= 1.f; break;
+	case key_e: inputMovement.y += 1.f; break;
+	case key_shift: inputSpeedModifier = 3.f; break;
+	}
+}
+
+void camera_controller::keyUp(keyboard_key key)
+{
+	switch (key)
+	{
+	case key_w: inputMovement.z += 1.f; break;
+	case key_s: inputMovement.z -= 1.f; break;
+	case key_a: inputMovement.x += 1.f; break;
+	case key_d: inputMovement.x -= 1.f; break;
+	case key_q: inputMovement.y += 1.f; break;
+	case key_e: inputMovement.y -= 1.f; break;
+	case key_shift: inputSpeedModifier = 1.f; break;
+	}
+}
+
+void camera_controller::mouseMove(render_camera& camera, const mouse_move_event& event) const
+{
+	if (event.rightDown)
+	{
+		camera.pitch = camera.pitch - event.relDY * CAMERA_SENSITIVITY;
+		camera.yaw = camera.yaw - event.relDX * CAMERA_SENSITIVITY;
+	}
+}
+
+void camera_controller::simulate(render_camera& camera, float dt) const
+{
+	camera.rotation = (createQuaternionFromAxisAngle(comp_vec(0.f, 1.f, 0.f), camera.yaw)
+		* createQuaternionFromAxisAngle(comp_vec(1.f, 0.f, 0.f), camera.pitch)).normalize();
+
+	camera.position = camera.position + camera.rotation * inputMovement * dt * CAMERA_MOVEMENT_SPEED * inputSpeedModifier;
+}
+
+void camera_controller::update(render_camera& camera, float dt, uint32 width, uint32 height) const
+{
+	simulate(camera, dt);
+	camera.updateMatrices(width, height);
+}
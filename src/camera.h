@@ -2,6 +2,11 @@
 
 #include "common.h"
 #include "math.h"
+#include "input.h"
+
+
+#define CAMERA_SENSITIVITY 4.f
+#define CAMERA_MOVEMENT_SPEED 10.f
 
 union camera_frustum_corners
 {
@@ -98,3 +103,18 @@ struct cubemap_camera : render_camera
 	void initialize(vec3 position, uint32 cubemapIndex);
 };
 
+// Free flying camera steered with WASDQE (shift to speed up) and the right mouse button. This is independent of the window and
+// the device, so recorded input can drive it headlessly as well.
+struct camera_controller
+{
+	vec3 inputMovement = vec3(0.f, 0.f, 0.f);
+	float inputSpeedModifier = 1.f;
+
+	void keyDown(keyboard_key key);
+	void keyUp(keyboard_key key);
+	void mouseMove(render_camera& camera, const mouse_move_event& event) const;
+
+	// Moves and rotates the camera, without updating its matrices.
+	void simulate(render_camera& camera, float dt) const;
+	void update(render_camera& camera, float dt, uint32 width, uint32 height) const;
+};
@@ -0,0 +1,132 @@
+#include "pch.h"
+#include "command_allocator_pool.h"
+#include "error.h"
+#include "profiling.h"
+
+// Rough size of one native command in allocator memory. Only used for the statistics.
+#define COMMAND_ALLOCATOR_BYTES_PER_COMMAND 64
+
+void dx_command_allocator_pool::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type, uint32 maxIdleFrames)
+{
+	this->device = device;
+	this->type = type;
+	this->maxIdleFrames = maxIdleFrames;
+}
+
+command_allocator_size_class dx_command_allocator_pool::getSizeClass(uint32 numCommands)
+{
+	if (numCommands <= 256)
+	{
+		return command_allocator_size_small;
+	}
+	if (numCommands <= 4096)
+	{
+		return command_allocator_size_medium;
+	}
+	return command_allocator_size_large;
+}
+
+dx_command_allocator* dx_command_allocator_pool::acquire(command_allocator_size_class sizeClass)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// The exact class first, then larger allocators (no growing while recording), then smaller ones (they grow into the class).
+	for (uint32 i = sizeClass; i < command_allocator_size_class_count; ++i)
+	{
+		if (!freeAllocators[i].empty())
+		{
+			dx_command_allocator* result = freeAllocators[i].back();
+			freeAllocators[i].pop_back();
+			return result;
+		}
+	}
+	for (int32 i = sizeClass - 1; i >= 0; --i)
+	{
+		if (!freeAllocators[i].empty())
+		{
+			dx_command_allocator* result = freeAllocators[i].back();
+			freeAllocators[i].pop_back();
+			return result;
+		}
+	}
+
+	dx_command_allocator* result = allocators.emplace_back(std::make_unique<dx_command_allocator>()).get();
+	checkResult(device->CreateCommandAllocator(type, IID_PPV_ARGS(&result->allocator)));
+	result->highWaterMark = 0;
+	result->lastUsedFrame = currentFrame;
+	++numCreated;
+
+	return result;
+}
+
+void dx_command_allocator_pool::release(dx_command_allocator* allocator, uint32 numRecordedCommands)
+{
+	checkResult(allocator->allocator->Reset());
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	allocator->highWaterMark = max(allocator->highWaterMark, numRecordedCommands);
+	allocator->lastUsedFrame = currentFrame;
+	freeAllocators[getSizeClass(allocator->highWaterMark)].push_back(allocator);
+}
+
+void dx_command_allocator_pool::beginFrame(uint64 frameID)
+{
+	PROFILE_FUNCTION();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	currentFrame = frameID;
+
+	for (uint32 c = 0; c < command_allocator_size_class_count; ++c)
+	{
+		std::vector<dx_command_allocator*>& freeList = freeAllocators[c];
+		for (uint32 i = 0; i < (uint32)freeList.size();)
+		{
+			dx_command_allocator* allocator = freeList[i];
+			if (allocator->lastUsedFrame + maxIdleFrames >= frameID)
+			{
+				++i;
+				continue;
+			}
+
+			freeList[i] = freeList.back();
+			freeList.pop_back();
+
+			for (uint32 j = 0; j < (uint32)allocators.size(); ++j)
+			{
+				if (allocators[j].get() == allocator)
+				{
+					allocators[j] = std::move(allocators.back());
+					allocators.pop_back();
+					break;
+				}
+			}
+			++numTrimmed;
+		}
+	}
+
+	lastFrameNumCreated = numCreated;
+	lastFrameNumTrimmed = numTrimmed;
+	numCreated = 0;
+	numTrimmed = 0;
+}
+
+command_allocator_pool_statistics dx_command_allocator_pool::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	command_allocator_pool_statistics result = {};
+	for (const std::unique_ptr<dx_command_allocator>& allocator : allocators)
+	{
+		++result.numAllocators[getSizeClass(allocator->highWaterMark)];
+		result.estimatedMemory += (uint64)allocator->highWaterMark * COMMAND_ALLOCATOR_BYTES_PER_COMMAND;
+	}
+	for (uint32 c = 0; c < command_allocator_size_class_count; ++c)
+	{
+		result.numFree[c] = (uint32)freeAllocators[c].size();
+	}
+	result.numCreated = lastFrameNumCreated;
+	result.numTrimmed = lastFrameNumTrimmed;
+	return result;
+}
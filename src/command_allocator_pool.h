@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+
+// Allocator memory only grows: Reset keeps the pages of the largest list ever recorded with an allocator. Allocators are
+// therefore bucketed by the largest number of native commands they have held.
+enum command_allocator_size_class
+{
+	command_allocator_size_small,		// Up to 256 commands. Transitions, uploads, one-off compute work.
+	command_allocator_size_medium,		// Up to 4096 commands. Frame graph passes.
+	command_allocator_size_large,		// The main frame list.
+
+	command_allocator_size_class_count,
+};
+
+struct dx_command_allocator
+{
+	ComPtr<ID3D12CommandAllocator> allocator;
+	uint32 highWaterMark;		// Most native commands recorded in one use.
+	uint64 lastUsedFrame;
+};
+
+struct command_allocator_pool_statistics
+{
+	uint32 numAllocators[command_allocator_size_class_count];
+	uint32 numFree[command_allocator_size_class_count];
+	uint64 estimatedMemory;		// D3D12 does not report allocator memory, so this is derived from the high water marks.
+	uint32 numCreated;			// In the last frame.
+	uint32 numTrimmed;			// In the last frame.
+};
+
+// Per-queue pool of command allocators. A list asks for the size class it expects to need. If that bucket is empty, larger
+// allocators are preferred (they hold the list without growing), then smaller ones, and only then is a new allocator created.
+// When a list is retired, its allocator is reset and goes into the bucket of its high water mark, tagged with the current
+// frame. Allocators which have not been used for maxIdleFrames are released in beginFrame.
+class dx_command_allocator_pool
+{
+public:
+	void initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type, uint32 maxIdleFrames = 8);
+
+	dx_command_allocator* acquire(command_allocator_size_class sizeClass);
+
+	// The GPU must be done with the allocator.
+	void release(dx_command_allocator* allocator, uint32 numRecordedCommands);
+
+	void beginFrame(uint64 frameID);
+
+	command_allocator_pool_statistics getStatistics();
+
+private:
+	static command_allocator_size_class getSizeClass(uint32 numCommands);
+
+	ComPtr<ID3D12Device2> device;
+	D3D12_COMMAND_LIST_TYPE type;
+	uint32 maxIdleFrames;
+
+	std::vector<std::unique_ptr<dx_command_allocator>> allocators;
+	std::vector<dx_command_allocator*> freeAllocators[command_allocator_size_class_count];
+	uint64 currentFrame = 0;
+
+	uint32 numCreated = 0;
+	uint32 numTrimmed = 0;
+	uint32 lastFrameNumCreated = 0;
+	uint32 lastFrameNumTrimmed = 0;
+
+	std::mutex mutex;
+};
@@ -3,34 +3,54 @@
 #include "error.h"
 #include "command_queue.h"
 #include "profiling.h"
+#include "bindless_descriptor_table.h"
 
 #include <DirectXTex/DirectXTex/DirectXTex.h>
 
-static std::unordered_map<std::wstring, ID3D12Resource*> textureCache;
+struct cached_texture
+{
+	// The texture which has loaded the file. It might have been moved to a different resource since, so the resource is
+	// always taken from there. Once it is gone, the file is loaded again.
+	std::weak_ptr<dx_texture*> creator;
+	bindless_handle bindlessSRV; // Shared by all textures loaded from the same file.
+};
+
+static std::unordered_map<std::wstring, cached_texture> textureCache;
 static std::mutex textureCacheMutex;
 
 
-void dx_command_list::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType)
+void dx_command_list::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType, dx_upload_ring* uploadRing, dx_command_allocator* allocator)
 {
 	this->device = device;
 	this->commandListType = commandListType;
 	this->currentRenderTarget = nullptr;
-	checkResult(device->CreateCommandAllocator(commandListType, IID_PPV_ARGS(&commandAllocator)));
-	checkResult(device->CreateCommandList(0, commandListType, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
+	this->commandAllocator = allocator;
+	this->numRecordedCommands = 0;
+	this->numDrawCalls = 0;
+	this->numIndirectDrawCalls = 0;
+	checkResult(device->CreateCommandList(0, commandListType, allocator->allocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
 
-	checkResult(commandList->SetPrivateDataInterface(__uuidof(ID3D12CommandAllocator), commandAllocator.Get()));
-
-	resourceStateTracker.initialize();
-	uploadBuffer.initialize(device);
+	commandFilter.invalidate();
+	resourceStateTracker.initialize(commandListType);
+	uploadBuffer.initialize(uploadRing);
+	uploadToken = 0;
 
 	if (commandListType == D3D12_COMMAND_LIST_TYPE_COMPUTE)
 	{
-		generateMipsPSO.initialize(device);
-		equirectangularToCubemapPSO.initialize(device);
-		cubemapToIrradiancePSO.initialize(device);
-		prefilterEnvironmentPSO.initialize(device);
-		integrateBrdfPSO.initialize(device);
-		cubemapToSHPSO.initialize(device);
+		// Built in parallel. The list may be used right away, so wait for all of them.
+		pipeline_handle handles[] =
+		{
+			generateMipsPSO.initialize(device),
+			equirectangularToCubemapPSO.initialize(device),
+			cubemapToIrradiancePSO.initialize(device),
+			prefilterEnvironmentPSO.initialize(device),
+			integrateBrdfPSO.initialize(device),
+			cubemapToSHPSO.initialize(device),
+		};
+		for (pipeline_handle handle : handles)
+		{
+			dx_pipeline_factory::wait(handle);
+		}
 	}
 
 	for (int i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
@@ -42,10 +62,19 @@ void dx_command_list::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIS
 
 void dx_command_list::transitionBarrier(ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES afterState, uint32 subresource, bool flushBarriers)
 {
-	if (resource)
+	resourceStateTracker.transitionResource(resource.Get(), afterState, subresource);
+
+	if (flushBarriers)
 	{
-		CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(resource.Get(), D3D12_RESOURCE_STATE_COMMON, afterState, subresource);
-		resourceStateTracker.resourceBarrier(barrier);
+		flushResourceBarriers();
+	}
+}
+
+void dx_command_list::transitionBarrier(const dx_resource& resource, D3D12_RESOURCE_STATES afterState, uint32 subresource, bool flushBarriers)
+{
+	if (resource.resource)
+	{
+		resourceStateTracker.transitionResource(resource, afterState, subresource);
 	}
 
 	if (flushBarriers)
@@ -54,9 +83,37 @@ void dx_command_list::transitionBarrier(ComPtr<ID3D12Resource> resource, D3D12_R
 	}
 }
 
-void dx_command_list::transitionBarrier(const dx_resource& resource, D3D12_RESOURCE_STATES afterState, uint32 subresource, bool flushBarriers)
+void dx_command_list::transitionBarrier(const dx_buffer& buffer, D3D12_RESOURCE_STATES afterState, uint32 subresource, bool flushBarriers)
+{
+	if (buffer.resource)
+	{
+		resourceStateTracker.transitionResource(buffer, afterState, subresource);
+	}
+
+	if (flushBarriers)
+	{
+		flushResourceBarriers();
+	}
+}
+
+void dx_command_list::beginTransitionBarrier(ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES afterState)
+{
+	if (resource)
+	{
+		resourceStateTracker.beginTransition(dx_resource_state_tracker::getGlobalResourceHandle(resource.Get()), resource.Get(), afterState);
+	}
+}
+
+void dx_command_list::beginTransitionBarrier(const dx_resource& resource, D3D12_RESOURCE_STATES afterState)
 {
-	transitionBarrier(resource.resource, afterState, subresource, flushBarriers);
+	if (resource.stateHandle != dx_resource_state_tracker::invalidHandle)
+	{
+		resourceStateTracker.beginTransition(resource.stateHandle, resource.resource.Get(), afterState);
+	}
+	else
+	{
+		beginTransitionBarrier(resource.resource, afterState);
+	}
 }
 
 void dx_command_list::uavBarrier(ComPtr<ID3D12Resource> resource, bool flushBarriers)
@@ -114,6 +171,7 @@ void dx_command_list::copyResource(dx_resource& dstRes, const dx_resource& srcRe
 
 void dx_command_list::setScreenRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE* rtvs, uint32 numRTVs, D3D12_CPU_DESCRIPTOR_HANDLE* dsv)
 {
+	flushCommandStream();
 	commandList->OMSetRenderTargets(numRTVs, rtvs, FALSE, dsv);
 	this->currentRenderTarget = nullptr;
 }
@@ -143,6 +201,7 @@ void dx_command_list::setRenderTarget(dx_render_target& renderTarget, uint32 arr
 		dsv = &dsv_;
 	}
 
+	flushCommandStream();
 	commandList->OMSetRenderTargets(numRTVs, rtvs, FALSE, dsv);
 
 	this->currentRenderTarget = &renderTarget;
@@ -150,32 +209,48 @@ void dx_command_list::setRenderTarget(dx_render_target& renderTarget, uint32 arr
 
 void dx_command_list::clearRTV(D3D12_CPU_DESCRIPTOR_HANDLE rtv, float* clearColor)
 {
+	flushResourceBarriers();
 	commandList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
 }
 
 void dx_command_list::clearDepth(D3D12_CPU_DESCRIPTOR_HANDLE dsv, float depth)
 {
+	flushResourceBarriers();
 	commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, depth, 0, 0, nullptr);
 }
 
 void dx_command_list::clearStencil(D3D12_CPU_DESCRIPTOR_HANDLE dsv, uint32 stencil)
 {
+	flushResourceBarriers();
 	commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_STENCIL, 0.f, stencil, 0, nullptr);
 }
 
 void dx_command_list::clearDepthAndStencil(D3D12_CPU_DESCRIPTOR_HANDLE dsv, float depth, uint32 stencil)
 {
+	flushResourceBarriers();
 	commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, depth, stencil, 0, nullptr);
 }
 
 void dx_command_list::setStencilReference(uint32 stencilReference)
 {
+	flushCommandStream();
 	commandList->OMSetStencilRef(stencilReference);
 }
 
+void dx_command_list::discardResource(const dx_resource& resource)
+{
+	flushResourceBarriers();
+	commandList->DiscardResource(resource.resource.Get(), nullptr);
+}
+
 void dx_command_list::uploadBufferData(ComPtr<ID3D12Resource> destinationResource, const void* bufferData, uint32 bufferSize)
 {
-	if (bufferData)
+	if (bufferData && commandListType == D3D12_COMMAND_LIST_TYPE_COPY)
+	{
+		// Batched with the other uploads. This list only depends on the batch.
+		uploadToken = max(uploadToken, dx_upload_queue::uploadBuffer(destinationResource, bufferData, bufferSize));
+	}
+	else if (bufferData)
 	{
 		ComPtr<ID3D12Resource> intermediateResource;
 
@@ -238,7 +313,11 @@ void dx_command_list::updateBufferDataRange(ComPtr<ID3D12Resource> destinationRe
 void dx_command_list::copyTextureSubresource(dx_texture& texture, uint32 firstSubresource, uint32 numSubresources, D3D12_SUBRESOURCE_DATA* subresourceData)
 {
 	ComPtr<ID3D12Resource> destinationResource = texture.resource;
-	if (destinationResource)
+	if (destinationResource && commandListType == D3D12_COMMAND_LIST_TYPE_COPY)
+	{
+		uploadToken = max(uploadToken, dx_upload_queue::uploadTexture(texture, firstSubresource, numSubresources, subresourceData));
+	}
+	else if (destinationResource)
 	{
 		transitionBarrier(texture, D3D12_RESOURCE_STATE_COPY_DEST);
 		flushResourceBarriers();
@@ -270,13 +349,28 @@ void dx_command_list::loadTextureFromFile(dx_texture& texture, const std::wstrin
 	fs::path path(filename);
 	assert(fs::exists(path));
 
+	std::unique_lock<std::mutex> cacheLock(textureCacheMutex);
 	auto it = textureCache.find(filename);
-	if (it != textureCache.end())
+	std::shared_ptr<dx_texture*> creator = (it != textureCache.end()) ? it->second.creator.lock() : nullptr;
+	if (creator)
 	{
-		texture.initialize(device, it->second);
+		texture.initialize(device, (*creator)->resource);
+
+		// Like copies, textures loaded from the same file share the slot. It only needs a new one, if the first texture
+		// has given it up.
+		if (dx_bindless_descriptor_table::isAlive(it->second.bindlessSRV))
+		{
+			texture.bindlessSRV = it->second.bindlessSRV;
+		}
+		else
+		{
+			it->second.bindlessSRV = dx_bindless_descriptor_table::registerTexture(texture);
+		}
 	}
 	else
 	{
+		cacheLock.unlock();
+
 		DirectX::TexMetadata metadata;
 		DirectX::ScratchImage scratchImage;
 
@@ -384,9 +478,11 @@ void dx_command_list::loadTextureFromFile(dx_texture& texture, const std::wstrin
 			generateMips(texture);
 		}
 
+		dx_bindless_descriptor_table::registerTexture(texture);
+
 		// Add the texture resource to the texture cache.
-		std::lock_guard<std::mutex> lock(textureCacheMutex);
-		textureCache[filename] = texture.resource.Get();
+		cacheLock.lock();
+		textureCache[filename] = { texture.getCreator(), texture.bindlessSRV };
 	}
 }
 
@@ -1046,7 +1142,7 @@ void dx_command_list::projectCubemapToSphericalHarmonics(dx_texture& cubemap, dx
 	setCompute32BitConstants(cubemap_to_sh_param_constant_buffer, cubemapToSHCB);
 
 	bindCubemap(cubemap_to_sh_param_src, 0, cubemap, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-	transitionBarrier(sh.resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	transitionBarrier(sh, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	dynamicDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV].stageDescriptors(cubemap_to_sh_param_out, 0, 1, sh.uav);
 
 	dispatch(1, 1, 1);
@@ -1054,7 +1150,7 @@ void dx_command_list::projectCubemapToSphericalHarmonics(dx_texture& cubemap, dx
 
 void dx_command_list::setPipelineState(ComPtr<ID3D12PipelineState> pipelineState)
 {
-	commandList->SetPipelineState(pipelineState.Get());
+	recordedCommands.setPipelineState(pipelineState.Get());
 	trackObject(pipelineState);
 }
 
@@ -1065,7 +1161,7 @@ void dx_command_list::setGraphicsRootSignature(const dx_root_signature& rootSign
 		dynamicDescriptorHeaps[i].parseRootSignature(rootSignature);
 	}
 
-	commandList->SetGraphicsRootSignature(rootSignature.rootSignature.Get());
+	recordedCommands.setGraphicsRootSignature(rootSignature.rootSignature.Get());
 
 	trackObject(rootSignature.rootSignature);
 }
@@ -1077,7 +1173,7 @@ void dx_command_list::setComputeRootSignature(const dx_root_signature& rootSigna
 		dynamicDescriptorHeaps[i].parseRootSignature(rootSignature);
 	}
 
-	commandList->SetComputeRootSignature(rootSignature.rootSignature.Get());
+	recordedCommands.setComputeRootSignature(rootSignature.rootSignature.Get());
 
 	trackObject(rootSignature.rootSignature);
 }
@@ -1134,12 +1230,12 @@ void dx_command_list::setUnorderedAccessView(uint32 rootParameterIndex,
 
 void dx_command_list::setGraphics32BitConstants(uint32 rootParameterIndex, uint32 numConstants, const void* constants)
 {
-	commandList->SetGraphicsRoot32BitConstants(rootParameterIndex, numConstants, constants, 0);
+	recordedCommands.setGraphics32BitConstants(rootParameterIndex, numConstants, constants);
 }
 
 void dx_command_list::setCompute32BitConstants(uint32 rootParameterIndex, uint32 numConstants, const void* constants)
 {
-	commandList->SetComputeRoot32BitConstants(rootParameterIndex, numConstants, constants, 0);
+	recordedCommands.setCompute32BitConstants(rootParameterIndex, numConstants, constants);
 }
 
 D3D12_GPU_VIRTUAL_ADDRESS dx_command_list::uploadDynamicConstantBuffer(uint32 sizeInBytes, const void* data)
@@ -1152,83 +1248,89 @@ D3D12_GPU_VIRTUAL_ADDRESS dx_command_list::uploadDynamicConstantBuffer(uint32 si
 D3D12_GPU_VIRTUAL_ADDRESS dx_command_list::uploadAndSetGraphicsDynamicConstantBuffer(uint32 rootParameterIndex, uint32 sizeInBytes, const void* data)
 {
 	D3D12_GPU_VIRTUAL_ADDRESS address = uploadDynamicConstantBuffer(sizeInBytes, data);
-	commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, address);
+	recordedCommands.setGraphicsConstantBuffer(rootParameterIndex, address);
 	return address;
 }
 
 void dx_command_list::setGraphicsDynamicConstantBuffer(uint32 rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS address)
 {
-	commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, address);
+	recordedCommands.setGraphicsConstantBuffer(rootParameterIndex, address);
 }
 
 D3D12_GPU_VIRTUAL_ADDRESS dx_command_list::uploadAndSetComputeDynamicConstantBuffer(uint32 rootParameterIndex, uint32 sizeInBytes, const void* data)
 {
 	D3D12_GPU_VIRTUAL_ADDRESS address = uploadDynamicConstantBuffer(sizeInBytes, data);
-	commandList->SetComputeRootConstantBufferView(rootParameterIndex, address);
+	recordedCommands.setComputeConstantBuffer(rootParameterIndex, address);
 	return address;
 }
 
 void dx_command_list::setComputeDynamicConstantBuffer(uint32 rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS address)
 {
-	commandList->SetComputeRootConstantBufferView(rootParameterIndex, address);
+	recordedCommands.setComputeConstantBuffer(rootParameterIndex, address);
 }
 
 void dx_command_list::setPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY topology)
 {
-	commandList->IASetPrimitiveTopology(topology);
+	recordedCommands.setPrimitiveTopology(topology);
 }
 
 void dx_command_list::setVertexBuffer(uint32 slot, dx_vertex_buffer& buffer)
 {
-	transitionBarrier(buffer.resource, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-	commandList->IASetVertexBuffers(slot, 1, &buffer.view);
+	transitionBarrier(buffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	recordedCommands.setVertexBuffer(slot, (const command_vertex_buffer_view&)buffer.view);
 	trackObject(buffer.resource);
 }
 
 void dx_command_list::setVertexBuffer(uint32 slot, const D3D12_VERTEX_BUFFER_VIEW& buffer)
 {
-	commandList->IASetVertexBuffers(slot, 1, &buffer);
+	recordedCommands.setVertexBuffer(slot, (const command_vertex_buffer_view&)buffer);
 }
 
 void dx_command_list::setIndexBuffer(dx_index_buffer& buffer)
 {
-	transitionBarrier(buffer.resource, D3D12_RESOURCE_STATE_INDEX_BUFFER);
-	commandList->IASetIndexBuffer(&buffer.view);
+	transitionBarrier(buffer, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+	recordedCommands.setIndexBuffer((const command_index_buffer_view&)buffer.view);
 	trackObject(buffer.resource);
 }
 
 void dx_command_list::setViewport(const D3D12_VIEWPORT& viewport)
 {
-	commandList->RSSetViewports(1, &viewport);
+	recordedCommands.setViewport((const command_viewport&)viewport);
 }
 
 void dx_command_list::setScissor(const D3D12_RECT& scissor)
 {
-	commandList->RSSetScissorRects(1, &scissor);
+	recordedCommands.setScissor((const command_rect&)scissor);
 }
 
 void dx_command_list::draw(uint32 vertexCount, uint32 instanceCount, uint32 startVertex, uint32 startInstance)
 {
-	flushResourceBarriers();
+	resourceStateTracker.flushResourceBarriers(recordedCommands);
 
 	for (int i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
 	{
 		dynamicDescriptorHeaps[i].commitStagedDescriptorsForDraw(this);
 	}
 
-	commandList->DrawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+	recordedCommands.draw(vertexCount, instanceCount, startVertex, startInstance);
+	flushCommandStream();
+
+	++numDrawCalls;
 }
 
 void dx_command_list::drawIndexed(uint32 indexCount, uint32 instanceCount, uint32 startIndex, int32 baseVertex, uint32 startInstance)
 {
-	flushResourceBarriers();
+	resourceStateTracker.flushResourceBarriers(recordedCommands);
 
 	for (int i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
 	{
 		dynamicDescriptorHeaps[i].commitStagedDescriptorsForDraw(this);
 	}
 
-	commandList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+	recordedCommands.drawIndexed(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+	flushCommandStream();
+
+	++numDrawCalls;
 }
 
 void dx_command_list::drawIndirect(ComPtr<ID3D12CommandSignature> commandSignature, uint32 numDraws, dx_buffer commandBuffer)
@@ -1240,6 +1342,7 @@ void dx_command_list::drawIndirect(ComPtr<ID3D12CommandSignature> commandSignatu
 		dynamicDescriptorHeaps[i].commitStagedDescriptorsForDraw(this);
 	}
 
+	flushCommandStream();
 	commandList->ExecuteIndirect(
 		commandSignature.Get(),
 		numDraws,
@@ -1247,6 +1350,11 @@ void dx_command_list::drawIndirect(ComPtr<ID3D12CommandSignature> commandSignatu
 		0,
 		nullptr,
 		0);
+
+	numIndirectDrawCalls += numDraws;
+
+	// The command signature may overwrite the vertex and index buffer bindings.
+	commandFilter.invalidateInputAssembly();
 }
 
 void dx_command_list::drawIndirect(ComPtr<ID3D12CommandSignature> commandSignature, uint32 maxNumDraws, dx_buffer numDrawsBuffer, dx_buffer commandBuffer)
@@ -1258,6 +1366,7 @@ void dx_command_list::drawIndirect(ComPtr<ID3D12CommandSignature> commandSignatu
 		dynamicDescriptorHeaps[i].commitStagedDescriptorsForDraw(this);
 	}
 
+	flushCommandStream();
 	commandList->ExecuteIndirect(
 		commandSignature.Get(),
 		maxNumDraws,
@@ -1265,40 +1374,64 @@ void dx_command_list::drawIndirect(ComPtr<ID3D12CommandSignature> commandSignatu
 		0,
 		numDrawsBuffer.resource.Get(),
 		0);
+
+	numIndirectDrawCalls += maxNumDraws;
+
+	// The command signature may overwrite the vertex and index buffer bindings.
+	commandFilter.invalidateInputAssembly();
 }
 
 void dx_command_list::dispatch(uint32 numGroupsX, uint32 numGroupsY, uint32 numGroupsZ)
 {
-	flushResourceBarriers();
+	resourceStateTracker.flushResourceBarriers(recordedCommands);
 
 	for (int i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
 	{
 		dynamicDescriptorHeaps[i].commitStagedDescriptorsForDispatch(this);
 	}
 
-	commandList->Dispatch(numGroupsX, numGroupsY, numGroupsZ);
+	recordedCommands.dispatch(numGroupsX, numGroupsY, numGroupsZ);
+	flushCommandStream();
 }
 
 void dx_command_list::reset()
 {
-	checkResult(commandAllocator->Reset());
-	checkResult(commandList->Reset(commandAllocator.Get(), nullptr));
+	// The allocator has been handed back to the pool by the command queue.
+	commandAllocator = nullptr;
+	numRecordedCommands = 0;
+	numDrawCalls = 0;
+	numIndirectDrawCalls = 0;
 
 	resourceStateTracker.reset();
+	resourceStateTracker.resetStatistics();
 	trackedObjects.clear();
 	uploadBuffer.reset();
+	uploadToken = 0;
+
+	recordedCommands.clear();
+	filteredCommands.clear();
+	commandFilter.invalidate();
+	commandFilter.resetStatistics();
 
 	for (int i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
 	{
 		dynamicDescriptorHeaps[i].reset();
+		dynamicDescriptorHeaps[i].resetStatistics();
 		descriptorHeaps[i] = nullptr;
 	}
 
 	computeCommandList = nullptr;
 }
 
+void dx_command_list::begin(dx_command_allocator* allocator)
+{
+	commandAllocator = allocator;
+	checkResult(commandList->Reset(allocator->allocator.Get(), nullptr));
+}
+
 bool dx_command_list::close(ComPtr<ID3D12GraphicsCommandList2> pendingCommandList)
 {
+	resourceStateTracker.endSplitBarriers();
 	flushResourceBarriers();
 
 	checkResult(commandList->Close());
@@ -1306,14 +1439,55 @@ bool dx_command_list::close(ComPtr<ID3D12GraphicsCommandList2> pendingCommandLis
 	uint32 numPendingBarriers = resourceStateTracker.flushPendingResourceBarriers(pendingCommandList);
 	resourceStateTracker.commitFinalResourceStates();
 
+	accumulateFrameStatistics();
+
 	return numPendingBarriers > 0;
 }
 
 void dx_command_list::close()
 {
+	resourceStateTracker.endSplitBarriers();
 	flushResourceBarriers();
 
 	checkResult(commandList->Close());
+
+	accumulateFrameStatistics();
+}
+
+void dx_command_list::accumulateFrameStatistics()
+{
+	command_stream_filter::accumulateFrameStatistics(commandFilter.getStatistics());
+	commandFilter.resetStatistics();
+
+	for (int i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
+	{
+		dx_dynamic_descriptor_heap::accumulateFrameStatistics(dynamicDescriptorHeaps[i].getStatistics());
+		dynamicDescriptorHeaps[i].resetStatistics();
+	}
+
+	uint32 numBarriers = resourceStateTracker.getStatistics().numEmittedBarriers;
+	if (numBarriers > 0)
+	{
+		PROFILE_COUNTER_ADD("Resource barriers", numBarriers);
+	}
+	dx_resource_state_tracker::accumulateFrameStatistics(resourceStateTracker.getStatistics());
+	resourceStateTracker.resetStatistics();
+
+	if (numDrawCalls > 0)
+	{
+		PROFILE_COUNTER_ADD("Draw calls", numDrawCalls);
+	}
+	if (numIndirectDrawCalls > 0)
+	{
+		PROFILE_COUNTER_ADD("Indirect draw calls (max)", numIndirectDrawCalls);
+	}
+	numDrawCalls = 0;
+	numIndirectDrawCalls = 0;
+}
+
+void dx_command_list::submitted(uint64 fenceValue)
+{
+	uploadBuffer.submit(fenceValue);
 }
 
 void dx_command_list::trackObject(ComPtr<ID3D12Object> object)
@@ -1323,7 +1497,104 @@ void dx_command_list::trackObject(ComPtr<ID3D12Object> object)
 
 void dx_command_list::flushResourceBarriers()
 {
-	resourceStateTracker.flushResourceBarriers(commandList);
+	resourceStateTracker.flushResourceBarriers(recordedCommands);
+	flushCommandStream();
+}
+
+void dx_command_list::flushCommandStream()
+{
+	if (!recordedCommands.empty())
+	{
+		commandFilter.filter(recordedCommands, filteredCommands);
+		replayCommandStream(filteredCommands);
+		numRecordedCommands += filteredCommands.size();
+
+		recordedCommands.clear();
+		filteredCommands.clear();
+	}
+}
+
+void dx_command_list::replayCommandStream(const command_stream& stream)
+{
+	static_assert(sizeof(D3D12_RESOURCE_BARRIER) == COMMAND_STREAM_BARRIER_SIZE, "Barrier size does not match.");
+	static_assert(sizeof(D3D12_VERTEX_BUFFER_VIEW) == sizeof(command_vertex_buffer_view), "Vertex buffer view size does not match.");
+	static_assert(sizeof(D3D12_INDEX_BUFFER_VIEW) == sizeof(command_index_buffer_view), "Index buffer view size does not match.");
+	static_assert(sizeof(D3D12_VIEWPORT) == sizeof(command_viewport), "Viewport size does not match.");
+	static_assert(sizeof(D3D12_RECT) == sizeof(command_rect), "Rect size does not match.");
+
+	ID3D12GraphicsCommandList2* list = commandList.Get();
+
+	stream.forEach([list](const command_header* command)
+	{
+		switch (command->type)
+		{
+			case command_type_set_pipeline_state:
+				list->SetPipelineState((ID3D12PipelineState*)((const command_set_object*)command)->object); break;
+			case command_type_set_graphics_root_signature:
+				list->SetGraphicsRootSignature((ID3D12RootSignature*)((const command_set_object*)command)->object); break;
+			case command_type_set_compute_root_signature:
+				list->SetComputeRootSignature((ID3D12RootSignature*)((const command_set_object*)command)->object); break;
+			case command_type_set_primitive_topology:
+				list->IASetPrimitiveTopology((D3D_PRIMITIVE_TOPOLOGY)((const command_set_primitive_topology*)command)->topology); break;
+			case command_type_set_vertex_buffer:
+			{
+				const command_set_vertex_buffer* c = (const command_set_vertex_buffer*)command;
+				list->IASetVertexBuffers(c->slot, 1, (const D3D12_VERTEX_BUFFER_VIEW*)&c->view);
+			} break;
+			case command_type_set_index_buffer:
+				list->IASetIndexBuffer((const D3D12_INDEX_BUFFER_VIEW*)&((const command_set_index_buffer*)command)->view); break;
+			case command_type_set_viewport:
+				list->RSSetViewports(1, (const D3D12_VIEWPORT*)&((const command_set_viewport*)command)->viewport); break;
+			case command_type_set_scissor:
+				list->RSSetScissorRects(1, (const D3D12_RECT*)&((const command_set_scissor*)command)->scissor); break;
+			case command_type_set_descriptor_heaps:
+			{
+				const command_set_descriptor_heaps* c = (const command_set_descriptor_heaps*)command;
+				list->SetDescriptorHeaps(c->numDescriptorHeaps, (ID3D12DescriptorHeap* const*)c->descriptorHeaps);
+			} break;
+			case command_type_barriers:
+			{
+				const command_barriers* c = (const command_barriers*)command;
+				list->ResourceBarrier(c->numBarriers, (const D3D12_RESOURCE_BARRIER*)c->barriers());
+			} break;
+			case command_type_set_graphics_32bit_constants:
+			{
+				const command_set_32bit_constants* c = (const command_set_32bit_constants*)command;
+				list->SetGraphicsRoot32BitConstants(c->rootParameterIndex, c->numConstants, c->constants(), 0);
+			} break;
+			case command_type_set_compute_32bit_constants:
+			{
+				const command_set_32bit_constants* c = (const command_set_32bit_constants*)command;
+				list->SetComputeRoot32BitConstants(c->rootParameterIndex, c->numConstants, c->constants(), 0);
+			} break;
+			case command_type_set_graphics_constant_buffer:
+			{
+				const command_set_constant_buffer* c = (const command_set_constant_buffer*)command;
+				list->SetGraphicsRootConstantBufferView(c->rootParameterIndex, c->address);
+			} break;
+			case command_type_set_compute_constant_buffer:
+			{
+				const command_set_constant_buffer* c = (const command_set_constant_buffer*)command;
+				list->SetComputeRootConstantBufferView(c->rootParameterIndex, c->address);
+			} break;
+			case command_type_draw:
+			{
+				const command_draw* c = (const command_draw*)command;
+				list->DrawInstanced(c->vertexCount, c->instanceCount, c->startVertex, c->startInstance);
+			} break;
+			case command_type_draw_indexed:
+			{
+				const command_draw_indexed* c = (const command_draw_indexed*)command;
+				list->DrawIndexedInstanced(c->indexCount, c->instanceCount, c->startIndex, c->baseVertex, c->startInstance);
+			} break;
+			case command_type_dispatch:
+			{
+				const command_dispatch* c = (const command_dispatch*)command;
+				list->Dispatch(c->numGroupsX, c->numGroupsY, c->numGroupsZ);
+			} break;
+			default: assert(false); break;
+		}
+	});
 }
 
 void dx_command_list::setDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE heapType, ComPtr<ID3D12DescriptorHeap> heap)
@@ -1347,7 +1618,7 @@ void dx_command_list::setDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE heapType, Com
 			}
 		}
 
-		commandList->SetDescriptorHeaps(numDescriptorHeaps, descriptorHeaps);
+		recordedCommands.setDescriptorHeaps(numDescriptorHeaps, (void* const*)descriptorHeaps);
 
 		trackObject(heap);
 	}
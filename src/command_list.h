@@ -6,19 +6,28 @@
 #include "resource_state_tracker.h"
 #include "dynamic_descriptor_heap.h"
 #include "upload_buffer.h"
+#include "command_stream.h"
 #include "generate_mips.h"
 #include "brdf.h"
 #include "model.h"
 #include "render_target.h"
+#include "upload_queue.h"
+#include "command_allocator_pool.h"
 
 class dx_command_list
 {
 public:
-	void initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType);
+	void initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType, dx_upload_ring* uploadRing, dx_command_allocator* allocator);
 	
 	// Barriers.
 	void transitionBarrier(ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES afterState, uint32 subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, bool flushBarriers = false);
 	void transitionBarrier(const dx_resource& resource, D3D12_RESOURCE_STATES afterState, uint32 subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, bool flushBarriers = false);
+	void transitionBarrier(const dx_buffer& buffer, D3D12_RESOURCE_STATES afterState, uint32 subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, bool flushBarriers = false);
+
+	// Split barrier, for resources which are not needed for a while. The transition is finished by the next transitionBarrier
+	// call of this resource, which must come before it is used again.
+	void beginTransitionBarrier(ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES afterState);
+	void beginTransitionBarrier(const dx_resource& resource, D3D12_RESOURCE_STATES afterState);
 
 	void uavBarrier(ComPtr<ID3D12Resource> resource, bool flushBarriers = false);
 	void uavBarrier(const dx_resource& resource, bool flushBarriers = false);
@@ -31,6 +40,7 @@ public:
 	void copyResource(ComPtr<ID3D12Resource> dstRes, ComPtr<ID3D12Resource> srcRes, bool transitionDst = true);
 	void copyResource(dx_resource& dstRes, const dx_resource& srcRes, bool transitionDst = true);
 
+	// On copy lists, this and the texture uploads go through dx_upload_queue. The queue executing the list waits for them.
 	void uploadBufferData(ComPtr<ID3D12Resource> destinationResource, const void* bufferData, uint32 bufferSize);
 	void updateBufferDataRange(ComPtr<ID3D12Resource> destinationResource, const void* data, uint32 offset, uint32 size);
 
@@ -150,6 +160,10 @@ public:
 	void clearDepthAndStencil(D3D12_CPU_DESCRIPTOR_HANDLE dsv, float depth = 1.f, uint32 stencil = 0);
 	void setStencilReference(uint32 stencilReference);
 
+	// Tells the driver that the contents of the resource are not needed anymore, e.g. when an aliased texture is activated.
+	// Render targets and depth buffers must be in their write state, other textures in the unordered access state.
+	void discardResource(const dx_resource& resource);
+
 	const dx_render_target* getCurrentRenderTarget() const { return currentRenderTarget; }
 
 	// Draw.
@@ -163,29 +177,56 @@ public:
 
 
 	// End frame.
+	// Reset leaves the native list closed. It is reopened with a (possibly different) allocator in begin.
 	void reset();
+	void begin(dx_command_allocator* allocator);
 	bool close(ComPtr<ID3D12GraphicsCommandList2> pendingCommandList);
 	void close();
 
-	inline ComPtr<ID3D12GraphicsCommandList2> getD3D12CommandList() const { return commandList; }
+	// Called by the command queue after the list has been submitted. Memory used by this list is recycled once the fence value has completed.
+	void submitted(uint64 fenceValue);
+
+	// State changes and barriers are recorded into a command stream and only replayed when needed. Everybody who writes
+	// to the native command list directly must go through this function, so that the recorded commands land before theirs.
+	inline ComPtr<ID3D12GraphicsCommandList2> getD3D12CommandList() { flushCommandStream(); ++numRecordedCommands; return commandList; }
 	inline dx_command_list* getComputeCommandList() const { return computeCommandList; }
+	inline uint32 getResourceStateShardMask() const { return resourceStateTracker.getShardMask(); }
+	inline upload_token getUploadToken() const { return uploadToken; } // 0 if nothing went through dx_upload_queue.
+	inline dx_command_allocator* getCommandAllocator() const { return commandAllocator; }
+	inline uint32 getNumRecordedCommands() const { return numRecordedCommands; } // Native commands. Direct writes count as one.
 
 	void flushResourceBarriers();
 
 private:
 	void trackObject(ComPtr<ID3D12Object> object);
 
+	// Hands the statistics of this list over to the per-frame totals and resets them. Called when the list is closed.
+	void accumulateFrameStatistics();
+
+	void flushCommandStream();
+	void replayCommandStream(const command_stream& stream);
+
 	void copyTextureSubresource(dx_texture& texture, uint32 firstSubresource, uint32 numSubresources, D3D12_SUBRESOURCE_DATA* subresourceData);
 
 
 	D3D12_COMMAND_LIST_TYPE				commandListType;
 	ComPtr<ID3D12Device2>				device;
-	ComPtr<ID3D12CommandAllocator>		commandAllocator;
+	dx_command_allocator*				commandAllocator;
 	ComPtr<ID3D12GraphicsCommandList2>	commandList;
+	uint32								numRecordedCommands;
+
+	// Recorded as profiler counters once per list, since one event per draw would flood the profiler's thread buffers.
+	uint32								numDrawCalls;
+	uint32								numIndirectDrawCalls;	// Maximum number of draws.
 
 	std::vector<ComPtr<ID3D12Object>>	trackedObjects;
 
+	command_stream						recordedCommands;
+	command_stream						filteredCommands;
+	command_stream_filter				commandFilter;
+
 	dx_upload_buffer					uploadBuffer;
+	upload_token						uploadToken;
 	dx_resource_state_tracker			resourceStateTracker;
 	dx_dynamic_descriptor_heap			dynamicDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 	ID3D12DescriptorHeap*				descriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
@@ -9,12 +9,31 @@ dx_command_queue dx_command_queue::renderCommandQueue;
 dx_command_queue dx_command_queue::computeCommandQueue;
 dx_command_queue dx_command_queue::copyCommandQueue;
 
+static float millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 void dx_command_queue::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type)
 {
 	fenceValue = 0;
+	numInFlightCommandLists = 0;
 	commandListType = type;
 	this->device = device;
 
+	switch (type)
+	{
+		case D3D12_COMMAND_LIST_TYPE_DIRECT: name = "Render"; break;
+		case D3D12_COMMAND_LIST_TYPE_COMPUTE: name = "Compute"; break;
+		case D3D12_COMMAND_LIST_TYPE_COPY: name = "Copy"; break;
+		default: name = "Unknown"; break;
+	}
+
+	statistics = {};
+	statistics.queue = name;
+	lastFrameStatistics = statistics;
+	allocatorReuseLatencySum = 0.0;
+
 	D3D12_COMMAND_QUEUE_DESC desc = {};
 	desc.Type = type;
 	desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
@@ -24,6 +43,9 @@ void dx_command_queue::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LI
 	checkResult(device->CreateCommandQueue(&desc, IID_PPV_ARGS(&commandQueue)));
 	checkResult(device->CreateFence(fenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
 
+	uploadRing.initialize(device, fence, this);
+	allocatorPool.initialize(device, type);
+
 	processInFlightCommandListsThread = std::thread(&dx_command_queue::processInFlightCommandLists, this);
 }
 
@@ -39,16 +61,22 @@ dx_command_queue::~dx_command_queue()
 	}
 }
 
-dx_command_list* dx_command_queue::getAvailableCommandList()
+dx_command_list* dx_command_queue::getAvailableCommandList(command_allocator_size_class sizeClass)
 {
 	PROFILE_FUNCTION();
 
+	dx_command_allocator* allocator = allocatorPool.acquire(sizeClass);
+
 	dx_command_list* result;
 
-	if (!freeCommandLists.tryPop(result))
+	if (freeCommandLists.tryPop(result))
+	{
+		result->begin(allocator);
+	}
+	else
 	{
 		result = new dx_command_list;
-		result->initialize(device, commandListType);
+		result->initialize(device, commandListType, &uploadRing, allocator);
 		commandLists.pushBack(result);
 	}
 
@@ -57,15 +85,24 @@ dx_command_list* dx_command_queue::getAvailableCommandList()
 
 dx_command_queue::dx_transition_command_list* dx_command_queue::getAvailableTransitionCommandList()
 {
+	// Transition lists only ever hold one barrier batch.
+	dx_command_allocator* allocator = allocatorPool.acquire(command_allocator_size_small);
+
 	dx_transition_command_list* result;
 
-	if (!freeTransitionCommandLists.tryPop(result))
+	if (freeTransitionCommandLists.tryPop(result))
+	{
+		result->commandAllocator = allocator;
+		checkResult(result->commandList->Reset(allocator->allocator.Get(), nullptr));
+	}
+	else
 	{
 		result = new dx_transition_command_list;
-		result->initialize(device, commandListType);
+		result->initialize(device, commandListType, allocator);
 		transitionCommandLists.pushBack(result);
 	}
 
+	result->numBarriers = 0;
 	return result;
 }
 
@@ -78,7 +115,22 @@ uint64 dx_command_queue::executeCommandLists(dx_command_list** commandLists, uin
 {
 	PROFILE_FUNCTION();
 
-	dx_resource_state_tracker::lock();
+	// Only the global states of resources used by these lists need to stay untouched until they are executed.
+	uint32 shardMask = 0;
+	upload_token uploadToken = 0;
+	for (uint32 i = 0; i < numCommandLists; ++i)
+	{
+		shardMask |= commandLists[i]->getResourceStateShardMask();
+		uploadToken = max(uploadToken, commandLists[i]->getUploadToken());
+	}
+
+	// Uploads these lists handed to the upload queue must land first. This submits the batch, if it is still open.
+	if (uploadToken)
+	{
+		dx_upload_queue::waitForUploadOnQueue(*this, uploadToken);
+	}
+
+	dx_resource_state_tracker::lockShards(shardMask);
 
 	command_list_entry toBeQueued[128];
 	uint32 numToBeQueued = 0;
@@ -99,16 +151,17 @@ uint64 dx_command_queue::executeCommandLists(dx_command_list** commandLists, uin
 			dx_transition_command_list* pendingCommandList = getAvailableTransitionCommandList();
 			bool hasPendingBarriers = list->close(pendingCommandList->commandList);
 
+			checkResult(pendingCommandList->commandList->Close());
 			if (hasPendingBarriers)
 			{
-				checkResult(pendingCommandList->commandList->Close());
+				pendingCommandList->numBarriers = 1;
 				d3d12CommandLists[numD3D12CommandLists++] = pendingCommandList->commandList.Get();
 				toBeQueued[numToBeQueued++] = pendingCommandList;
 			}
 			else
 			{
-				checkResult(pendingCommandList->commandAllocator->Reset());
-				checkResult(pendingCommandList->commandList->Reset(pendingCommandList->commandAllocator.Get(), nullptr));
+				// Never submitted, so the allocator can go back right away.
+				allocatorPool.release(pendingCommandList->commandAllocator, 0);
 				freeTransitionCommandLists.pushBack(pendingCommandList);
 			}
 
@@ -123,20 +176,37 @@ uint64 dx_command_queue::executeCommandLists(dx_command_list** commandLists, uin
 		}
 	}
 
+	uint64 fenceValue;
 	{
 		PROFILE_BLOCK("Execute");
+		std::lock_guard<std::mutex> lock(executeMutex);
 		commandQueue->ExecuteCommandLists(numD3D12CommandLists, d3d12CommandLists);
+		fenceValue = signal();
 	}
-	uint64 fenceValue = signal();
 
-	dx_resource_state_tracker::unlock();
+	dx_resource_state_tracker::unlockShards(shardMask);
+
+	auto submitTime = std::chrono::high_resolution_clock::now();
+	uint32 inFlight = (numInFlightCommandLists += numToBeQueued);
 
 	for (uint32 i = 0; i < numToBeQueued; ++i)
 	{
+		if (!toBeQueued[i].isTransition)
+		{
+			toBeQueued[i].commandList->submitted(fenceValue);
+		}
+
 		toBeQueued[i].fenceValue = fenceValue;
+		toBeQueued[i].submitTime = submitTime;
 		inFlightCommandLists.pushBack(toBeQueued[i]);
 	}
 
+	{
+		std::lock_guard<std::mutex> lock(statisticsMutex);
+		++statistics.numSubmissions;
+		statistics.maxInFlightCommandLists = max(statistics.maxInFlightCommandLists, inFlight);
+	}
+
 	if (numExtraComputeCommandLists)
 	{
 		PROFILE_BLOCK("Execute extra compute lists");
@@ -161,7 +231,19 @@ bool dx_command_queue::isFenceComplete(uint64 fenceValue)
 	return fence->GetCompletedValue() >= fenceValue;
 }
 
-void dx_command_queue::waitForFenceValue(uint64 fenceValue)
+void dx_command_queue::waitForFenceValue(uint64 fenceValue, const char* callSite)
+{
+	if (!isFenceComplete(fenceValue))
+	{
+		PROFILE_BLOCK("Wait for fence");
+
+		auto start = std::chrono::high_resolution_clock::now();
+		blockUntilFenceValue(fenceValue);
+		recordCpuWait(callSite, fenceValue, millisecondsSince(start));
+	}
+}
+
+void dx_command_queue::blockUntilFenceValue(uint64 fenceValue)
 {
 	if (!isFenceComplete(fenceValue))
 	{
@@ -177,6 +259,10 @@ void dx_command_queue::waitForFenceValue(uint64 fenceValue)
 
 void dx_command_queue::flush()
 {
+	PROFILE_FUNCTION();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
 	std::unique_lock<std::mutex> lock(inFlightCommandListsMutex);
 
 	struct wait_condition
@@ -190,7 +276,18 @@ void dx_command_queue::flush()
 	};
 
 	processInFlightCommandListsCondition.wait(lock, wait_condition{ inFlightCommandLists });
-	waitForFenceValue(signal());
+
+	uint64 flushFenceValue;
+	{
+		std::lock_guard<std::mutex> executeLock(executeMutex);
+		flushFenceValue = signal();
+	}
+	blockUntilFenceValue(flushFenceValue);
+
+	recordCpuWait("Flush", flushFenceValue, millisecondsSince(start));
+
+	std::lock_guard<std::mutex> statisticsLock(statisticsMutex);
+	++statistics.numFlushes;
 }
 
 ComPtr<ID3D12CommandQueue> dx_command_queue::getD3D12CommandQueue() const
@@ -211,21 +308,31 @@ void dx_command_queue::processInFlightCommandLists()
 		{
 			uint64 fenceValue = commandListEntry.fenceValue;
 
-			waitForFenceValue(fenceValue);
+			// This is the background thread, so this is not a stall. How long lists stay in flight shows up in the reuse latency.
+			blockUntilFenceValue(fenceValue);
 
 			if (commandListEntry.isTransition)
 			{
 				dx_transition_command_list* commandList = commandListEntry.transition;
-				checkResult(commandList->commandAllocator->Reset());
-				checkResult(commandList->commandList->Reset(commandList->commandAllocator.Get(), nullptr));
+				allocatorPool.release(commandList->commandAllocator, commandList->numBarriers);
 				freeTransitionCommandLists.pushBack(commandList);
 			}
 			else
 			{
 				dx_command_list* commandList = commandListEntry.commandList;
+				allocatorPool.release(commandList->getCommandAllocator(), commandList->getNumRecordedCommands());
 				commandList->reset();
 				freeCommandLists.pushBack(commandList);
 			}
+
+			--numInFlightCommandLists;
+
+			float latency = millisecondsSince(commandListEntry.submitTime);
+
+			std::lock_guard<std::mutex> statisticsLock(statisticsMutex);
+			++statistics.numAllocatorResets;
+			allocatorReuseLatencySum += latency;
+			statistics.maxAllocatorReuseLatencyInMilliseconds = max(statistics.maxAllocatorReuseLatencyInMilliseconds, latency);
 		}
 
 		lock.unlock();
@@ -237,13 +344,101 @@ void dx_command_queue::processInFlightCommandLists()
 
 void dx_command_queue::waitForOtherQueue(dx_command_queue& other)
 {
-	commandQueue->Wait(other.fence.Get(), other.signal());
+	uint64 fenceValue;
+	{
+		std::lock_guard<std::mutex> lock(other.executeMutex);
+		fenceValue = other.signal();
+	}
+	waitForOtherQueue(other, fenceValue);
+}
+
+void dx_command_queue::waitForOtherQueue(dx_command_queue& other, uint64 fenceValue)
+{
+	checkResult(commandQueue->Wait(other.fence.Get(), fenceValue));
+
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	++statistics.numGpuWaits;
+}
+
+void dx_command_queue::recordCpuWait(const char* callSite, uint64 fenceValue, float timeInMilliseconds)
+{
+	command_queue_wait wait = { name, callSite, fenceValue, timeInMilliseconds };
+
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+
+	++statistics.numCpuWaits;
+	statistics.cpuWaitTimeInMilliseconds += timeInMilliseconds;
+	if (timeInMilliseconds > statistics.longestCpuWait.timeInMilliseconds)
+	{
+		statistics.longestCpuWait = wait;
+	}
+
+	// Bounded, in case something waits in a loop.
+	if (waits.size() < 256)
+	{
+		waits.push_back(wait);
+	}
+}
+
+void dx_command_queue::rolloverStatistics(uint64 frameID)
+{
+	allocatorPool.beginFrame(frameID);
+	uploadRing.beginFrame(frameID);
+
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+
+	statistics.numInFlightCommandLists = numInFlightCommandLists;
+	statistics.averageAllocatorReuseLatencyInMilliseconds = statistics.numAllocatorResets ? 
+		(float)(allocatorReuseLatencySum / statistics.numAllocatorResets) : 0.f;
+
+	lastFrameStatistics = statistics;
+	lastFrameWaits.swap(waits);
+
+	statistics = {};
+	statistics.queue = name;
+	statistics.maxInFlightCommandLists = numInFlightCommandLists;
+	waits.clear();
+	allocatorReuseLatencySum = 0.0;
 }
 
-void dx_command_queue::dx_transition_command_list::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType)
+void dx_command_queue::beginFrame(uint64 frameID)
 {
-	checkResult(device->CreateCommandAllocator(commandListType, IID_PPV_ARGS(&commandAllocator)));
-	checkResult(device->CreateCommandList(0, commandListType, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
+	renderCommandQueue.rolloverStatistics(frameID);
+	computeCommandQueue.rolloverStatistics(frameID);
+	copyCommandQueue.rolloverStatistics(frameID);
+
+	// Counters are bound to their call site by name, so every queue needs its own lines.
+	command_queue_statistics render = renderCommandQueue.getStatistics();
+	command_queue_statistics compute = computeCommandQueue.getStatistics();
+	command_queue_statistics copy = copyCommandQueue.getStatistics();
+
+	PROFILE_COUNTER_SET("Render queue CPU wait (ms)", render.cpuWaitTimeInMilliseconds);
+	PROFILE_COUNTER_SET("Render queue lists in flight", render.numInFlightCommandLists);
+	PROFILE_COUNTER_SET("Render queue allocator reuse latency (ms)", render.averageAllocatorReuseLatencyInMilliseconds);
+
+	PROFILE_COUNTER_SET("Compute queue CPU wait (ms)", compute.cpuWaitTimeInMilliseconds);
+	PROFILE_COUNTER_SET("Compute queue lists in flight", compute.numInFlightCommandLists);
+	PROFILE_COUNTER_SET("Compute queue allocator reuse latency (ms)", compute.averageAllocatorReuseLatencyInMilliseconds);
+
+	PROFILE_COUNTER_SET("Copy queue CPU wait (ms)", copy.cpuWaitTimeInMilliseconds);
+	PROFILE_COUNTER_SET("Copy queue lists in flight", copy.numInFlightCommandLists);
+	PROFILE_COUNTER_SET("Copy queue allocator reuse latency (ms)", copy.averageAllocatorReuseLatencyInMilliseconds);
+}
+
+command_queue_statistics dx_command_queue::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	return lastFrameStatistics;
+}
 
-	checkResult(commandList->SetPrivateDataInterface(__uuidof(ID3D12CommandAllocator), commandAllocator.Get()));
+void dx_command_queue::getWaits(std::vector<command_queue_wait>& outWaits)
+{
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	outWaits.insert(outWaits.end(), lastFrameWaits.begin(), lastFrameWaits.end());
+}
+
+void dx_command_queue::dx_transition_command_list::initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType, dx_command_allocator* allocator)
+{
+	commandAllocator = allocator;
+	checkResult(device->CreateCommandList(0, commandListType, allocator->allocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
 }
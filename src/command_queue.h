@@ -2,10 +2,40 @@
 
 #include "common.h"
 #include "command_list.h"
+#include "command_allocator_pool.h"
 #include "thread_safe_queue.h"
 #include "thread_safe_vector.h"
 
 
+struct command_queue_wait
+{
+	const char* queue;
+	const char* callSite;
+	uint64 fenceValue;
+	float timeInMilliseconds;
+};
+
+// Summary of one frame. CPU waits are flushes and waitForFenceValue calls which actually blocked.
+struct command_queue_statistics
+{
+	const char* queue;
+
+	uint32 numSubmissions;
+	uint32 numCpuWaits;
+	uint32 numFlushes;
+	float cpuWaitTimeInMilliseconds;
+	command_queue_wait longestCpuWait;
+	uint32 numGpuWaits;						// waitForOtherQueue on this queue.
+
+	uint32 numInFlightCommandLists;			// At the end of the frame.
+	uint32 maxInFlightCommandLists;
+
+	// Time from submission until the background thread has reset a command allocator for reuse.
+	uint32 numAllocatorResets;
+	float averageAllocatorReuseLatencyInMilliseconds;
+	float maxAllocatorReuseLatencyInMilliseconds;
+};
+
 class dx_command_queue
 {
 public:
@@ -19,7 +49,9 @@ public:
 	dx_command_queue& operator=(const dx_command_queue&) = delete;
 	dx_command_queue& operator=(dx_command_queue&&) = delete;
 
-	dx_command_list* getAvailableCommandList();
+	// The size class only picks the allocator. Lists which record a lot (e.g. the main frame) should say so, so that they
+	// reuse an allocator which has already grown to their size instead of growing a small one.
+	dx_command_list* getAvailableCommandList(command_allocator_size_class sizeClass = command_allocator_size_small);
 
 	// Execute a command list.
 	// Returns the fence value to wait for for this command list.
@@ -27,13 +59,30 @@ public:
 	uint64 executeCommandLists(dx_command_list** commandLists, uint32 numCommandLists);
 
 	bool isFenceComplete(uint64 fenceValue);
-	void waitForFenceValue(uint64 fenceValue);
+
+	// The call site shows up in the wait statistics. It should match the name of the enclosing profile block, if there is one.
+	void waitForFenceValue(uint64 fenceValue, const char* callSite = "Unspecified");
 	void waitForOtherQueue(dx_command_queue& other);
+
+	// GPU-side wait for a fence value returned by executeCommandList(s) on the other queue. Only affects work submitted to
+	// this queue afterwards.
+	void waitForOtherQueue(dx_command_queue& other, uint64 fenceValue);
 	
 	void flush();
 
 	ComPtr<ID3D12CommandQueue> getD3D12CommandQueue() const;
 
+	// Statistics of the last completed frame.
+	command_queue_statistics getStatistics();
+	command_allocator_pool_statistics getAllocatorStatistics() { return allocatorPool.getStatistics(); }
+	void getWaits(std::vector<command_queue_wait>& outWaits);
+
+	// Must be called at the start of each frame. Closes the statistics of the previous frame, records them as profiler
+	// counters, and trims idle command allocators and upload overflow buffers on all queues.
+	static void beginFrame(uint64 frameID);
+
+	// Shared upload memory of all command lists executed on this queue.
+	dx_upload_ring& getUploadRing() { return uploadRing; }
 
 
 	static dx_command_queue						renderCommandQueue;
@@ -41,30 +90,46 @@ public:
 	static dx_command_queue						copyCommandQueue;
 
 protected:
+	// Must be called with executeMutex held, or a concurrent submission could signal a smaller value after this one.
 	uint64 signal();
 	void processInFlightCommandLists();
 
+	// Blocks without recording anything.
+	void blockUntilFenceValue(uint64 fenceValue);
+
 private:
 	
 	struct dx_transition_command_list
 	{
-		void initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType);
+		void initialize(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE commandListType, dx_command_allocator* allocator);
 
-		ComPtr<ID3D12CommandAllocator>		commandAllocator;
+		dx_command_allocator*				commandAllocator;
 		ComPtr<ID3D12GraphicsCommandList2>	commandList;
+		uint32								numBarriers;
 	};
 
 	dx_transition_command_list* getAvailableTransitionCommandList();
 
+	void recordCpuWait(const char* callSite, uint64 fenceValue, float timeInMilliseconds);
+	void rolloverStatistics(uint64 frameID);
+
 	D3D12_COMMAND_LIST_TYPE                     commandListType;
+	const char*									name;
 	ComPtr<ID3D12Device2>						device;
 	ComPtr<ID3D12CommandQueue>					commandQueue;
 	ComPtr<ID3D12Fence>							fence;
 	std::atomic_uint64_t	                    fenceValue;
 
+	// Keeps executions and their fence signals in the same order, now that submissions with disjoint resources can run concurrently.
+	std::mutex									executeMutex;
+
+	dx_upload_ring								uploadRing;
+	dx_command_allocator_pool					allocatorPool;
+
 	struct command_list_entry
 	{
 		uint64				fenceValue;
+		std::chrono::high_resolution_clock::time_point submitTime;
 
 		union
 		{
@@ -86,11 +151,19 @@ private:
 	thread_safe_queue<dx_transition_command_list*>	freeTransitionCommandLists;
 
 	thread_safe_queue<command_list_entry>		inFlightCommandLists;
+	std::atomic_uint32_t						numInFlightCommandLists;
 
 	bool										continueProcessingInFlightCommandLists = true;
 	std::mutex									inFlightCommandListsMutex;
 	std::condition_variable						processInFlightCommandListsCondition;
 	std::thread									processInFlightCommandListsThread;
 
+	// Statistics of the current frame are accumulated here and moved to lastFrameStatistics in beginFrame.
+	std::mutex									statisticsMutex;
+	command_queue_statistics					statistics;
+	std::vector<command_queue_wait>				waits;
+	double										allocatorReuseLatencySum;
+	command_queue_statistics					lastFrameStatistics;
+	std::vector<command_queue_wait>				lastFrameWaits;
 };
 
@@ -0,0 +1,345 @@
+#include "pch.h"
+#include "command_stream.h"
+
+#include <cstring>
+
+std::atomic_uint32_t command_stream_filter::frameRecordedCommands;
+std::atomic_uint32_t command_stream_filter::frameReplayedCommands;
+std::atomic_uint32_t command_stream_filter::frameRedundantCommands;
+std::atomic_uint32_t command_stream_filter::frameMergedBarrierBatches;
+
+
+command_header* command_stream::push(command_type type, uint32 size)
+{
+	size = alignTo(size, sizeof(uint64));
+
+	uint32 requiredBytes = numBytes + size;
+	if (requiredBytes > (uint32)(storage.size() * sizeof(uint64)))
+	{
+		uint32 requiredElements = requiredBytes / sizeof(uint64);
+		storage.resize(max((uint32)storage.size() * 2, max(requiredElements, 512u)));
+	}
+
+	command_header* result = (command_header*)((uint8*)storage.data() + numBytes);
+	result->type = type;
+	result->size = size;
+
+	numBytes += size;
+	++numCommands;
+
+	return result;
+}
+
+void command_stream::append(const command_header* command)
+{
+	command_header* result = push(command->type, command->size);
+	memcpy(result, command, command->size);
+}
+
+void command_stream::setPipelineState(void* pipelineState)
+{
+	command_set_object* command = (command_set_object*)push(command_type_set_pipeline_state, sizeof(command_set_object));
+	command->object = pipelineState;
+}
+
+void command_stream::setGraphicsRootSignature(void* rootSignature)
+{
+	command_set_object* command = (command_set_object*)push(command_type_set_graphics_root_signature, sizeof(command_set_object));
+	command->object = rootSignature;
+}
+
+void command_stream::setComputeRootSignature(void* rootSignature)
+{
+	command_set_object* command = (command_set_object*)push(command_type_set_compute_root_signature, sizeof(command_set_object));
+	command->object = rootSignature;
+}
+
+void command_stream::setPrimitiveTopology(uint32 topology)
+{
+	command_set_primitive_topology* command = (command_set_primitive_topology*)push(command_type_set_primitive_topology, sizeof(command_set_primitive_topology));
+	command->topology = topology;
+}
+
+void command_stream::setVertexBuffer(uint32 slot, const command_vertex_buffer_view& view)
+{
+	assert(slot < COMMAND_STREAM_MAX_VERTEX_BUFFERS);
+
+	command_set_vertex_buffer* command = (command_set_vertex_buffer*)push(command_type_set_vertex_buffer, sizeof(command_set_vertex_buffer));
+	command->slot = slot;
+	command->view = view;
+}
+
+void command_stream::setIndexBuffer(const command_index_buffer_view& view)
+{
+	command_set_index_buffer* command = (command_set_index_buffer*)push(command_type_set_index_buffer, sizeof(command_set_index_buffer));
+	command->view = view;
+}
+
+void command_stream::setViewport(const command_viewport& viewport)
+{
+	command_set_viewport* command = (command_set_viewport*)push(command_type_set_viewport, sizeof(command_set_viewport));
+	command->viewport = viewport;
+}
+
+void command_stream::setScissor(const command_rect& scissor)
+{
+	command_set_scissor* command = (command_set_scissor*)push(command_type_set_scissor, sizeof(command_set_scissor));
+	command->scissor = scissor;
+}
+
+void command_stream::setDescriptorHeaps(uint32 numDescriptorHeaps, void* const* descriptorHeaps)
+{
+	assert(numDescriptorHeaps <= COMMAND_STREAM_MAX_DESCRIPTOR_HEAPS);
+
+	command_set_descriptor_heaps* command = (command_set_descriptor_heaps*)push(command_type_set_descriptor_heaps, sizeof(command_set_descriptor_heaps));
+	command->numDescriptorHeaps = numDescriptorHeaps;
+	for (uint32 i = 0; i < COMMAND_STREAM_MAX_DESCRIPTOR_HEAPS; ++i)
+	{
+		command->descriptorHeaps[i] = (i < numDescriptorHeaps) ? descriptorHeaps[i] : nullptr;
+	}
+}
+
+void command_stream::barriers(uint32 numBarriers, const void* barriers)
+{
+	if (numBarriers == 0)
+	{
+		return;
+	}
+
+	command_barriers* command = (command_barriers*)push(command_type_barriers, sizeof(command_barriers) + numBarriers * sizeof(command_barrier));
+	command->numBarriers = numBarriers;
+	memcpy(command->barriers(), barriers, numBarriers * sizeof(command_barrier));
+}
+
+void command_stream::setGraphics32BitConstants(uint32 rootParameterIndex, uint32 numConstants, const void* constants)
+{
+	command_set_32bit_constants* command = (command_set_32bit_constants*)push(command_type_set_graphics_32bit_constants, sizeof(command_set_32bit_constants) + numConstants * sizeof(uint32));
+	command->rootParameterIndex = rootParameterIndex;
+	command->numConstants = numConstants;
+	memcpy((uint32*)command->constants(), constants, numConstants * sizeof(uint32));
+}
+
+void command_stream::setCompute32BitConstants(uint32 rootParameterIndex, uint32 numConstants, const void* constants)
+{
+	command_set_32bit_constants* command = (command_set_32bit_constants*)push(command_type_set_compute_32bit_constants, sizeof(command_set_32bit_constants) + numConstants * sizeof(uint32));
+	command->rootParameterIndex = rootParameterIndex;
+	command->numConstants = numConstants;
+	memcpy((uint32*)command->constants(), constants, numConstants * sizeof(uint32));
+}
+
+void command_stream::setGraphicsConstantBuffer(uint32 rootParameterIndex, uint64 address)
+{
+	command_set_constant_buffer* command = (command_set_constant_buffer*)push(command_type_set_graphics_constant_buffer, sizeof(command_set_constant_buffer));
+	command->rootParameterIndex = rootParameterIndex;
+	command->address = address;
+}
+
+void command_stream::setComputeConstantBuffer(uint32 rootParameterIndex, uint64 address)
+{
+	command_set_constant_buffer* command = (command_set_constant_buffer*)push(command_type_set_compute_constant_buffer, sizeof(command_set_constant_buffer));
+	command->rootParameterIndex = rootParameterIndex;
+	command->address = address;
+}
+
+void command_stream::draw(uint32 vertexCount, uint32 instanceCount, uint32 startVertex, uint32 startInstance)
+{
+	command_draw* command = (command_draw*)push(command_type_draw, sizeof(command_draw));
+	command->vertexCount = vertexCount;
+	command->instanceCount = instanceCount;
+	command->startVertex = startVertex;
+	command->startInstance = startInstance;
+}
+
+void command_stream::drawIndexed(uint32 indexCount, uint32 instanceCount, uint32 startIndex, int32 baseVertex, uint32 startInstance)
+{
+	command_draw_indexed* command = (command_draw_indexed*)push(command_type_draw_indexed, sizeof(command_draw_indexed));
+	command->indexCount = indexCount;
+	command->instanceCount = instanceCount;
+	command->startIndex = startIndex;
+	command->baseVertex = baseVertex;
+	command->startInstance = startInstance;
+}
+
+void command_stream::dispatch(uint32 numGroupsX, uint32 numGroupsY, uint32 numGroupsZ)
+{
+	command_dispatch* command = (command_dispatch*)push(command_type_dispatch, sizeof(command_dispatch));
+	command->numGroupsX = numGroupsX;
+	command->numGroupsY = numGroupsY;
+	command->numGroupsZ = numGroupsZ;
+}
+
+void command_stream_filter::filter(const command_stream& in, command_stream& out)
+{
+	in.forEach([this, &out](const command_header* command)
+	{
+		++stats.numRecordedCommands;
+
+		switch (command->type)
+		{
+			case command_type_barriers:
+			{
+				const command_barriers* barriers = (const command_barriers*)command;
+				pendingBarriers.insert(pendingBarriers.end(), barriers->barriers(), barriers->barriers() + barriers->numBarriers);
+				++numPendingBarrierBatches;
+			} break;
+
+			case command_type_draw:
+			case command_type_draw_indexed:
+			case command_type_dispatch:
+			{
+				flushPendingBarriers(out);
+				out.append(command);
+				++stats.numReplayedCommands;
+			} break;
+
+			default:
+			{
+				if (isRedundant(command))
+				{
+					++stats.numRedundantCommands;
+				}
+				else
+				{
+					out.append(command);
+					++stats.numReplayedCommands;
+				}
+			} break;
+		}
+	});
+
+	flushPendingBarriers(out);
+}
+
+void command_stream_filter::flushPendingBarriers(command_stream& out)
+{
+	if (numPendingBarrierBatches > 0)
+	{
+		out.barriers((uint32)pendingBarriers.size(), pendingBarriers.data());
+		++stats.numReplayedCommands;
+		stats.numMergedBarrierBatches += numPendingBarrierBatches - 1;
+
+		pendingBarriers.clear();
+		numPendingBarrierBatches = 0;
+	}
+}
+
+bool command_stream_filter::isRedundant(const command_header* command)
+{
+	switch (command->type)
+	{
+		case command_type_set_pipeline_state:
+		{
+			void* object = ((const command_set_object*)command)->object;
+			if (object == pipelineState) { return true; }
+			pipelineState = object;
+		} break;
+
+		case command_type_set_graphics_root_signature:
+		{
+			// Setting the same root signature again does not invalidate the root arguments, so this is safe to drop.
+			void* object = ((const command_set_object*)command)->object;
+			if (object == graphicsRootSignature) { return true; }
+			graphicsRootSignature = object;
+		} break;
+
+		case command_type_set_compute_root_signature:
+		{
+			void* object = ((const command_set_object*)command)->object;
+			if (object == computeRootSignature) { return true; }
+			computeRootSignature = object;
+		} break;
+
+		case command_type_set_primitive_topology:
+		{
+			uint32 topology = ((const command_set_primitive_topology*)command)->topology;
+			if (topology == primitiveTopology) { return true; }
+			primitiveTopology = topology;
+		} break;
+
+		case command_type_set_vertex_buffer:
+		{
+			const command_set_vertex_buffer* c = (const command_set_vertex_buffer*)command;
+			uint32 bit = (1 << c->slot);
+			if ((validVertexBufferMask & bit) && memcmp(&vertexBuffers[c->slot], &c->view, sizeof(c->view)) == 0) { return true; }
+			vertexBuffers[c->slot] = c->view;
+			validVertexBufferMask |= bit;
+		} break;
+
+		case command_type_set_index_buffer:
+		{
+			const command_set_index_buffer* c = (const command_set_index_buffer*)command;
+			if (indexBufferValid && memcmp(&indexBuffer, &c->view, sizeof(c->view)) == 0) { return true; }
+			indexBuffer = c->view;
+			indexBufferValid = true;
+		} break;
+
+		case command_type_set_viewport:
+		{
+			const command_set_viewport* c = (const command_set_viewport*)command;
+			if (viewportValid && memcmp(&viewport, &c->viewport, sizeof(c->viewport)) == 0) { return true; }
+			viewport = c->viewport;
+			viewportValid = true;
+		} break;
+
+		case command_type_set_scissor:
+		{
+			const command_set_scissor* c = (const command_set_scissor*)command;
+			if (scissorValid && memcmp(&scissor, &c->scissor, sizeof(c->scissor)) == 0) { return true; }
+			scissor = c->scissor;
+			scissorValid = true;
+		} break;
+
+		case command_type_set_descriptor_heaps:
+		{
+			const command_set_descriptor_heaps* c = (const command_set_descriptor_heaps*)command;
+			if (c->numDescriptorHeaps == numDescriptorHeaps && memcmp(descriptorHeaps, c->descriptorHeaps, sizeof(descriptorHeaps)) == 0) { return true; }
+			numDescriptorHeaps = c->numDescriptorHeaps;
+			memcpy(descriptorHeaps, c->descriptorHeaps, sizeof(descriptorHeaps));
+		} break;
+
+		default: break;
+	}
+
+	// Root arguments are not filtered, since they are invalidated by root signature changes.
+	return false;
+}
+
+void command_stream_filter::invalidate()
+{
+	pipelineState = nullptr;
+	graphicsRootSignature = nullptr;
+	computeRootSignature = nullptr;
+	primitiveTopology = (uint32)-1;
+	viewportValid = false;
+	scissorValid = false;
+	numDescriptorHeaps = (uint32)-1;
+
+	pendingBarriers.clear();
+	numPendingBarrierBatches = 0;
+
+	invalidateInputAssembly();
+}
+
+void command_stream_filter::invalidateInputAssembly()
+{
+	validVertexBufferMask = 0;
+	indexBufferValid = false;
+}
+
+void command_stream_filter::accumulateFrameStatistics(const command_stream_statistics& stats)
+{
+	frameRecordedCommands += stats.numRecordedCommands;
+	frameReplayedCommands += stats.numReplayedCommands;
+	frameRedundantCommands += stats.numRedundantCommands;
+	frameMergedBarrierBatches += stats.numMergedBarrierBatches;
+}
+
+command_stream_statistics command_stream_filter::endFrame()
+{
+	command_stream_statistics result;
+	result.numRecordedCommands = frameRecordedCommands.exchange(0);
+	result.numReplayedCommands = frameReplayedCommands.exchange(0);
+	result.numRedundantCommands = frameRedundantCommands.exchange(0);
+	result.numMergedBarrierBatches = frameMergedBarrierBatches.exchange(0);
+	return result;
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+#include <atomic>
+
+// API-agnostic recording of command list state changes, barriers and draw calls.
+// Commands are written into a flat byte buffer. Before replaying them onto the native command list, the stream is run
+// through a command_stream_filter, which drops state changes that would not change anything and merges adjacent barrier batches.
+// All objects (pipeline states, root signatures, descriptor heaps) are stored as opaque pointers. Barriers are stored as opaque
+// blobs of the native barrier size. This keeps this file free of any graphics API headers.
+
+#define COMMAND_STREAM_BARRIER_SIZE 32
+#define COMMAND_STREAM_MAX_VERTEX_BUFFERS 16
+#define COMMAND_STREAM_MAX_DESCRIPTOR_HEAPS 2
+
+enum command_type : uint32
+{
+	command_type_set_pipeline_state,
+	command_type_set_graphics_root_signature,
+	command_type_set_compute_root_signature,
+	command_type_set_primitive_topology,
+	command_type_set_vertex_buffer,
+	command_type_set_index_buffer,
+	command_type_set_viewport,
+	command_type_set_scissor,
+	command_type_set_descriptor_heaps,
+	command_type_barriers,
+	command_type_set_graphics_32bit_constants,
+	command_type_set_compute_32bit_constants,
+	command_type_set_graphics_constant_buffer,
+	command_type_set_compute_constant_buffer,
+	command_type_draw,
+	command_type_draw_indexed,
+	command_type_dispatch,
+
+	command_type_count,
+};
+
+struct command_header
+{
+	command_type type;
+	uint32 size; // Including this header. Always a multiple of 8.
+};
+
+// Same layouts as the D3D12 structures.
+struct command_vertex_buffer_view
+{
+	uint64 bufferLocation;
+	uint32 sizeInBytes;
+	uint32 strideInBytes;
+};
+
+struct command_index_buffer_view
+{
+	uint64 bufferLocation;
+	uint32 sizeInBytes;
+	uint32 format;
+};
+
+struct command_viewport
+{
+	float topLeftX;
+	float topLeftY;
+	float width;
+	float height;
+	float minDepth;
+	float maxDepth;
+};
+
+struct command_rect
+{
+	int32 left;
+	int32 top;
+	int32 right;
+	int32 bottom;
+};
+
+struct command_barrier
+{
+	uint64 data[COMMAND_STREAM_BARRIER_SIZE / sizeof(uint64)];
+};
+
+
+struct command_set_object
+{
+	command_header header;
+	void* object;
+};
+
+struct command_set_primitive_topology
+{
+	command_header header;
+	uint32 topology;
+};
+
+struct command_set_vertex_buffer
+{
+	command_header header;
+	uint32 slot;
+	command_vertex_buffer_view view;
+};
+
+struct command_set_index_buffer
+{
+	command_header header;
+	command_index_buffer_view view;
+};
+
+struct command_set_viewport
+{
+	command_header header;
+	command_viewport viewport;
+};
+
+struct command_set_scissor
+{
+	command_header header;
+	command_rect scissor;
+};
+
+struct command_set_descriptor_heaps
+{
+	command_header header;
+	uint32 numDescriptorHeaps;
+	void* descriptorHeaps[COMMAND_STREAM_MAX_DESCRIPTOR_HEAPS];
+};
+
+struct command_barriers
+{
+	command_header header;
+	uint32 numBarriers;
+	uint32 padding;
+	// Followed by numBarriers command_barriers.
+
+	command_barrier* barriers() { return (command_barrier*)(this + 1); }
+	const command_barrier* barriers() const { return (const command_barrier*)(this + 1); }
+};
+
+struct command_set_32bit_constants
+{
+	command_header header;
+	uint32 rootParameterIndex;
+	uint32 numConstants;
+	// Followed by numConstants uint32s.
+
+	const uint32* constants() const { return (const uint32*)(this + 1); }
+};
+
+struct command_set_constant_buffer
+{
+	command_header header;
+	uint32 rootParameterIndex;
+	uint64 address;
+};
+
+struct command_draw
+{
+	command_header header;
+	uint32 vertexCount;
+	uint32 instanceCount;
+	uint32 startVertex;
+	uint32 startInstance;
+};
+
+struct command_draw_indexed
+{
+	command_header header;
+	uint32 indexCount;
+	uint32 instanceCount;
+	uint32 startIndex;
+	int32 baseVertex;
+	uint32 startInstance;
+};
+
+struct command_dispatch
+{
+	command_header header;
+	uint32 numGroupsX;
+	uint32 numGroupsY;
+	uint32 numGroupsZ;
+};
+
+
+class command_stream
+{
+public:
+	void setPipelineState(void* pipelineState);
+	void setGraphicsRootSignature(void* rootSignature);
+	void setComputeRootSignature(void* rootSignature);
+	void setPrimitiveTopology(uint32 topology);
+	void setVertexBuffer(uint32 slot, const command_vertex_buffer_view& view);
+	void setIndexBuffer(const command_index_buffer_view& view);
+	void setViewport(const command_viewport& viewport);
+	void setScissor(const command_rect& scissor);
+	void setDescriptorHeaps(uint32 numDescriptorHeaps, void* const* descriptorHeaps);
+	void barriers(uint32 numBarriers, const void* barriers);
+	void setGraphics32BitConstants(uint32 rootParameterIndex, uint32 numConstants, const void* constants);
+	void setCompute32BitConstants(uint32 rootParameterIndex, uint32 numConstants, const void* constants);
+	void setGraphicsConstantBuffer(uint32 rootParameterIndex, uint64 address);
+	void setComputeConstantBuffer(uint32 rootParameterIndex, uint64 address);
+	void draw(uint32 vertexCount, uint32 instanceCount, uint32 startVertex, uint32 startInstance);
+	void drawIndexed(uint32 indexCount, uint32 instanceCount, uint32 startIndex, int32 baseVertex, uint32 startInstance);
+	void dispatch(uint32 numGroupsX, uint32 numGroupsY, uint32 numGroupsZ);
+
+	// Appends an already encoded command. Used by the filter.
+	void append(const command_header* command);
+
+	void clear() { numBytes = 0; numCommands = 0; }
+	bool empty() const { return numCommands == 0; }
+	uint32 size() const { return numCommands; }
+
+	template <typename func_t>
+	void forEach(func_t func) const
+	{
+		const uint8* begin = (const uint8*)storage.data();
+		uint32 offset = 0;
+		while (offset < numBytes)
+		{
+			const command_header* command = (const command_header*)(begin + offset);
+			func(command);
+			offset += command->size;
+		}
+	}
+
+private:
+	command_header* push(command_type type, uint32 size);
+
+	std::vector<uint64> storage; // uint64 to keep all commands 8 byte aligned. Never shrinks, so that recording does not allocate in steady state.
+	uint32 numBytes = 0;
+	uint32 numCommands = 0;
+};
+
+struct command_stream_statistics
+{
+	uint32 numRecordedCommands;
+	uint32 numReplayedCommands;
+	uint32 numRedundantCommands; // State changes dropped by the filter.
+	uint32 numMergedBarrierBatches;
+};
+
+// Tracks the state which was last set on the native command list and drops commands which would not change it.
+// The state persists across filter calls and must be invalidated whenever the native command list is reset or
+// when state is changed behind the filter's back (e.g. by ExecuteIndirect).
+// Barriers are held back until the next draw or dispatch (or the end of the stream), so that all barrier batches
+// recorded between two pieces of GPU work end up in a single ResourceBarrier call.
+class command_stream_filter
+{
+public:
+	void filter(const command_stream& in, command_stream& out);
+
+	void invalidate();
+	void invalidateInputAssembly();
+
+	const command_stream_statistics& getStatistics() const { return stats; }
+	void resetStatistics() { stats = {}; }
+
+	// Per frame statistics, accumulated over all command lists.
+	static void accumulateFrameStatistics(const command_stream_statistics& stats);
+	static command_stream_statistics endFrame();
+
+private:
+	bool isRedundant(const command_header* command);
+	void flushPendingBarriers(command_stream& out);
+
+	void* pipelineState = nullptr;
+	void* graphicsRootSignature = nullptr;
+	void* computeRootSignature = nullptr;
+	uint32 primitiveTopology = (uint32)-1;
+
+	uint32 validVertexBufferMask = 0;
+	command_vertex_buffer_view vertexBuffers[COMMAND_STREAM_MAX_VERTEX_BUFFERS];
+
+	bool indexBufferValid = false;
+	command_index_buffer_view indexBuffer;
+
+	bool viewportValid = false;
+	command_viewport viewport;
+
+	bool scissorValid = false;
+	command_rect scissor;
+
+	uint32 numDescriptorHeaps = (uint32)-1;
+	void* descriptorHeaps[COMMAND_STREAM_MAX_DESCRIPTOR_HEAPS];
+
+	std::vector<command_barrier> pendingBarriers;
+	uint32 numPendingBarrierBatches = 0;
+
+	command_stream_statistics stats = {};
+
+	static std::atomic_uint32_t frameRecordedCommands;
+	static std::atomic_uint32_t frameReplayedCommands;
+	static std::atomic_uint32_t frameRedundantCommands;
+	static std::atomic_uint32_t frameMergedBarrierBatches;
+};
@@ -0,0 +1,234 @@
+#include "pch.h"
+#include "tests.h"
+#include "command_stream.h"
+
+
+// Objects are opaque to the stream and the filter, so any distinct pointers will do.
+static int fakePipelineStates[2];
+static int fakeRootSignatures[2];
+static int fakeDescriptorHeaps[2];
+
+static std::vector<command_type> getCommandTypes(const command_stream& stream)
+{
+	std::vector<command_type> result;
+	stream.forEach([&result](const command_header* command)
+	{
+		result.push_back(command->type);
+	});
+	return result;
+}
+
+static command_barrier makeBarrier(uint64 value)
+{
+	command_barrier barrier = {};
+	barrier.data[0] = value;
+	return barrier;
+}
+
+static void testRedundantStateIsDropped()
+{
+	command_viewport viewport = { 0.f, 0.f, 1280.f, 720.f, 0.f, 1.f };
+	command_rect scissor = { 0, 0, 1280, 720 };
+
+	command_stream in;
+	in.setPipelineState(&fakePipelineStates[0]);
+	in.setGraphicsRootSignature(&fakeRootSignatures[0]);
+	in.setPrimitiveTopology(4);
+	in.setViewport(viewport);
+	in.setScissor(scissor);
+	in.draw(3, 1, 0, 0);
+
+	in.setPipelineState(&fakePipelineStates[0]);
+	in.setGraphicsRootSignature(&fakeRootSignatures[0]);
+	in.setPrimitiveTopology(4);
+	in.setViewport(viewport);
+	in.setScissor(scissor);
+	in.draw(3, 1, 0, 0);
+
+	in.setPipelineState(&fakePipelineStates[1]);
+	viewport.width = 640.f;
+	in.setViewport(viewport);
+	in.draw(3, 1, 0, 0);
+
+	command_stream out;
+	command_stream_filter filter;
+	filter.filter(in, out);
+
+	std::vector<command_type> expected =
+	{
+		command_type_set_pipeline_state,
+		command_type_set_graphics_root_signature,
+		command_type_set_primitive_topology,
+		command_type_set_viewport,
+		command_type_set_scissor,
+		command_type_draw,
+		command_type_draw,
+		command_type_set_pipeline_state,
+		command_type_set_viewport,
+		command_type_draw,
+	};
+	CHECK(getCommandTypes(out) == expected);
+
+	const command_stream_statistics& stats = filter.getStatistics();
+	CHECK(stats.numRecordedCommands == in.size());
+	CHECK(stats.numReplayedCommands == out.size());
+	CHECK(stats.numRedundantCommands == 5);
+	CHECK(stats.numMergedBarrierBatches == 0);
+}
+
+static void testInputAssemblyIsComparedPerSlot()
+{
+	command_vertex_buffer_view positions = { 0x1000, 256, 12 };
+	command_vertex_buffer_view others = { 0x2000, 512, 32 };
+	command_index_buffer_view indices = { 0x3000, 128, 42 };
+
+	command_stream in;
+	in.setVertexBuffer(0, positions);
+	in.setVertexBuffer(1, others);
+	in.setIndexBuffer(indices);
+	in.drawIndexed(64, 1, 0, 0, 0);
+
+	// Same views in the same slots are dropped. The same view in a different slot is not.
+	in.setVertexBuffer(0, positions);
+	in.setVertexBuffer(1, positions);
+	in.setIndexBuffer(indices);
+	in.drawIndexed(64, 1, 0, 0, 0);
+
+	command_stream out;
+	command_stream_filter filter;
+	filter.filter(in, out);
+
+	std::vector<command_type> expected =
+	{
+		command_type_set_vertex_buffer,
+		command_type_set_vertex_buffer,
+		command_type_set_index_buffer,
+		command_type_draw_indexed,
+		command_type_set_vertex_buffer,
+		command_type_draw_indexed,
+	};
+	CHECK(getCommandTypes(out) == expected);
+	CHECK(filter.getStatistics().numRedundantCommands == 2);
+}
+
+static void testRootArgumentsAreNeverDropped()
+{
+	uint32 constants[2] = { 1, 2 };
+
+	command_stream in;
+	in.setComputeRootSignature(&fakeRootSignatures[0]);
+	in.setCompute32BitConstants(0, 2, constants);
+	in.setComputeConstantBuffer(1, 0x4000);
+	in.dispatch(8, 8, 1);
+	in.setComputeRootSignature(&fakeRootSignatures[0]);
+	in.setCompute32BitConstants(0, 2, constants);
+	in.setComputeConstantBuffer(1, 0x4000);
+	in.dispatch(8, 8, 1);
+
+	command_stream out;
+	command_stream_filter filter;
+	filter.filter(in, out);
+
+	CHECK(out.size() == in.size() - 1);
+	CHECK(filter.getStatistics().numRedundantCommands == 1);
+}
+
+static void testBarrierBatchesAreMerged()
+{
+	command_barrier first[1] = { makeBarrier(1) };
+	command_barrier second[2] = { makeBarrier(2), makeBarrier(3) };
+	command_barrier last[1] = { makeBarrier(4) };
+
+	command_stream in;
+	in.barriers(1, first);
+	in.setPipelineState(&fakePipelineStates[0]);
+	in.barriers(2, second);
+	in.draw(3, 1, 0, 0);
+	in.barriers(1, last);
+
+	command_stream out;
+	command_stream_filter filter;
+	filter.filter(in, out);
+
+	// Barriers are held back until the draw, state changes in between are not.
+	std::vector<command_type> expected =
+	{
+		command_type_set_pipeline_state,
+		command_type_barriers,
+		command_type_draw,
+		command_type_barriers,
+	};
+	CHECK(getCommandTypes(out) == expected);
+
+	std::vector<uint64> barrierValues;
+	out.forEach([&barrierValues](const command_header* command)
+	{
+		if (command->type == command_type_barriers)
+		{
+			const command_barriers* barriers = (const command_barriers*)command;
+			for (uint32 i = 0; i < barriers->numBarriers; ++i)
+			{
+				barrierValues.push_back(barriers->barriers()[i].data[0]);
+			}
+			barrierValues.push_back(0); // Batch separator.
+		}
+	});
+	CHECK(barrierValues == std::vector<uint64>({ 1, 2, 3, 0, 4, 0 }));
+
+	const command_stream_statistics& stats = filter.getStatistics();
+	CHECK(stats.numMergedBarrierBatches == 1);
+	CHECK(stats.numReplayedCommands == out.size());
+}
+
+static void testStatePersistsUntilInvalidated()
+{
+	command_vertex_buffer_view positions = { 0x1000, 256, 12 };
+	void* heaps[2] = { &fakeDescriptorHeaps[0], &fakeDescriptorHeaps[1] };
+
+	command_stream in;
+	in.setDescriptorHeaps(2, heaps);
+	in.setPipelineState(&fakePipelineStates[0]);
+	in.setVertexBuffer(0, positions);
+	in.draw(3, 1, 0, 0);
+
+	command_stream_filter filter;
+	command_stream out;
+	filter.filter(in, out);
+	CHECK(out.size() == 4);
+
+	// A second command list replayed through the same filter starts with the state of the first.
+	out.clear();
+	filter.filter(in, out);
+	CHECK(getCommandTypes(out) == std::vector<command_type>({ command_type_draw }));
+
+	// E.g. after ExecuteIndirect, which sets its own vertex buffers.
+	out.clear();
+	filter.invalidateInputAssembly();
+	filter.filter(in, out);
+	CHECK(getCommandTypes(out) == std::vector<command_type>({ command_type_set_vertex_buffer, command_type_draw }));
+
+	// E.g. after the native command list has been reset.
+	out.clear();
+	filter.invalidate();
+	filter.filter(in, out);
+	CHECK(out.size() == 4);
+
+	const command_stream_statistics& stats = filter.getStatistics();
+	CHECK(stats.numRecordedCommands == 16);
+	CHECK(stats.numRedundantCommands == 5);
+
+	filter.resetStatistics();
+	CHECK(filter.getStatistics().numRecordedCommands == 0);
+}
+
+std::vector<unit_test> getCommandStreamTests()
+{
+	return
+	{
+		{ "command_stream/redundant_state_is_dropped", testRedundantStateIsDropped },
+		{ "command_stream/input_assembly_is_compared_per_slot", testInputAssemblyIsComparedPerSlot },
+		{ "command_stream/root_arguments_are_never_dropped", testRootArgumentsAreNeverDropped },
+		{ "command_stream/barrier_batches_are_merged", testBarrierBatchesAreMerged },
+		{ "command_stream/state_persists_until_invalidated", testStatePersistsUntilInvalidated },
+	};
+}
@@ -0,0 +1,710 @@
+#include "pch.h"
+#include "cpu_benchmarks.h"
+#include "camera.h"
+#include "skeleton.h"
+#include "particle_simulation.h"
+#include "light_probe_tetrahedra.h"
+#include "ring_allocator.h"
+#include "free_list_allocator.h"
+#include "bindless_slot_allocator.h"
+#include "tlsf_allocator.h"
+#include "thread_safe_queue.h"
+#include "input_recording.h"
+
+#include <algorithm>
+
+
+// Results are written here, so that the compiler cannot drop the work.
+static volatile uint64 benchmarkSink;
+
+// Same sequence on every platform, unlike rand().
+struct benchmark_random
+{
+	uint32 state;
+
+	benchmark_random(uint32 seed) : state(seed) {}
+
+	uint32 next()
+	{
+		state = state * 1664525 + 1013904223;
+		return state >> 8;
+	}
+
+	float nextFloat(float lo, float hi)
+	{
+		return lo + (hi - lo) * ((next() & 0xFFFF) / 65535.f);
+	}
+};
+
+benchmark_result benchmarkFrustumCulling(uint32 numIterations, uint32 numBoxes, bool modelSpace)
+{
+	const uint32 numCameraPositions = 16;
+
+	benchmark_random random(1337);
+
+	uint32 gridSize = (uint32)ceilf(sqrtf((float)numBoxes));
+
+	std::vector<bounding_box> worldSpaceBoxes(numBoxes);
+	std::vector<mat4> transforms(numBoxes);
+	for (uint32 i = 0; i < numBoxes; ++i)
+	{
+		vec3 center(((i % gridSize) - gridSize * 0.5f) * 4.f, random.nextFloat(0.f, 8.f), ((i / gridSize) - gridSize * 0.5f) * 4.f);
+		float radius = random.nextFloat(0.5f, 1.5f);
+
+		worldSpaceBoxes[i] = { center - vec3(radius, radius, radius), center + vec3(radius, radius, radius) };
+		transforms[i] = createModelMatrix(center, createQuaternionFromAxisAngle(comp_vec(0.f, 1.f, 0.f), random.nextFloat(0.f, 6.28f)), radius);
+	}
+
+	bounding_box unitBox = { vec3(-1.f, -1.f, -1.f), vec3(1.f, 1.f, 1.f) };
+
+	camera_frustum_planes frustums[numCameraPositions];
+	for (uint32 i = 0; i < numCameraPositions; ++i)
+	{
+		render_camera camera;
+		camera.fovY = DirectX::XMConvertToRadians(70.f);
+		camera.nearPlane = 0.1f;
+		camera.farPlane = 500.f;
+		camera.position = vec3(0.f, 10.f, 0.f);
+		camera.rotation = createQuaternionFromAxisAngle(comp_vec(0.f, 1.f, 0.f), i * 6.28f / numCameraPositions);
+		camera.updateMatrices(1920, 1080);
+		frustums[i] = camera.getWorldSpaceFrustumPlanes();
+	}
+
+	uint64 numVisible = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+		{
+			const camera_frustum_planes& frustum = frustums[iteration % numCameraPositions];
+			for (uint32 i = 0; i < numBoxes; ++i)
+			{
+				bool culled = modelSpace ? frustum.cullModelSpaceAABB(unitBox, transforms[i]) : frustum.cullWorldSpaceAABB(worldSpaceBoxes[i]);
+				numVisible += !culled;
+			}
+		}
+	});
+
+	benchmarkSink = numVisible;
+
+	benchmark_result result;
+	result.name = modelSpace ? "Frustum culling (model space AABBs)" : "Frustum culling (world space AABBs)";
+	result.numThreads = 1;
+	result.numOperations = (uint64)numIterations * numBoxes;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkSkeletonEvaluation(uint32 numIterations, uint32 numSkeletons, uint32 numJoints)
+{
+	benchmark_random random(4711);
+
+	// A binary tree of joints, so that parents always come before their children.
+	animation_skeleton skeleton;
+	skeleton.skeletonJoints.resize(numJoints);
+	for (uint32 i = 0; i < numJoints; ++i)
+	{
+		skeleton_joint& joint = skeleton.skeletonJoints[i];
+		joint.name = "Joint " + std::to_string(i);
+		joint.parentID = (i == 0) ? NO_PARENT : (i - 1) / 2;
+		joint.bindTransform = trs(vec3(0.f, (float)i * 0.1f, 0.f), quat::identity);
+		joint.invBindMatrix = createTranslationMatrix(0.f, -(float)i * 0.1f, 0.f);
+	}
+
+	std::vector<trs> localTransforms(numSkeletons * numJoints);
+	for (trs& t : localTransforms)
+	{
+		vec3 axis(random.nextFloat(-1.f, 1.f), random.nextFloat(-1.f, 1.f), random.nextFloat(-1.f, 1.f) + 2.f);
+		t = trs(vec3(0.f, 0.1f, 0.f), createQuaternionFromAxisAngle(comp_vec(axis).normalize(), random.nextFloat(-0.5f, 0.5f)));
+	}
+
+	std::vector<trs> globalTransforms(numJoints);
+	std::vector<mat4> skinningMatrices(numJoints);
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 iteration = 0; iteration < numIterations; ++iteration)
+		{
+			for (uint32 i = 0; i < numSkeletons; ++i)
+			{
+				trs transform(vec3((float)i, 0.f, (float)iteration), quat::identity);
+				skeleton.getGlobalTransforms(localTransforms.data() + i * numJoints, globalTransforms.data(), transform);
+				skeleton.getSkinningMatrices(globalTransforms.data(), skinningMatrices.data());
+			}
+		}
+	});
+
+	benchmarkSink = (uint64)skinningMatrices[numJoints - 1].m03;
+
+	benchmark_result result;
+	result.name = "Skeleton evaluation";
+	result.numThreads = 1;
+	result.numOperations = (uint64)numIterations * numSkeletons * numJoints;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkParticleUpdate(uint32 numFrames, uint32 numParticles)
+{
+	const float dt = 1.f / 60.f;
+
+	// The particle properties use rand().
+	srand(2020);
+
+	particle_simulation simulation;
+	simulation.initialize(numParticles);
+	simulation.spawnPosition = vec3(0.f, 10.f, 0.f);
+	simulation.gravityFactor = 1.f;
+	simulation.color.initializeAsLinear(vec4(1.f, 0.8f, 0.2f, 1.f), vec4(0.2f, 0.2f, 0.2f, 0.f));
+	simulation.maxLifetime.initializeAsRandom(2.f, 4.f);
+	simulation.startVelocity.initializeAsRandom(vec3(-2.f, 4.f, -2.f), vec3(2.f, 8.f, 2.f));
+
+	// Spawns faster than particles die, so the system runs at capacity.
+	simulation.spawnRate = numParticles * 0.5f;
+
+	for (uint32 frame = 0; frame < 300; ++frame)
+	{
+		simulation.update(dt, 4, 4);
+	}
+
+	uint64 numUpdatedParticles = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 frame = 0; frame < numFrames; ++frame)
+		{
+			numUpdatedParticles += simulation.particles.size();
+			simulation.update(dt, 4, 4);
+		}
+	});
+
+	benchmarkSink = simulation.particles.size();
+
+	benchmark_result result;
+	result.name = "Particle update";
+	result.numThreads = 1;
+	result.numOperations = numUpdatedParticles;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkInputReplay(const input_recording& recording, float fixedDt)
+{
+	const uint32 numBoxes = 10000;
+	const uint32 gridSize = 100;
+
+	uint32 width = max(recording.width, 1u);
+	uint32 height = max(recording.height, 1u);
+
+	benchmark_random random(1337);
+
+	std::vector<bounding_box> boxes(numBoxes);
+	for (uint32 i = 0; i < numBoxes; ++i)
+	{
+		vec3 center(((i % gridSize) - gridSize * 0.5f) * 4.f, random.nextFloat(0.f, 8.f), ((i / gridSize) - gridSize * 0.5f) * 4.f);
+		float radius = random.nextFloat(0.5f, 1.5f);
+		boxes[i] = { center - vec3(radius, radius, radius), center + vec3(radius, radius, radius) };
+	}
+
+	// Same start as the game.
+	render_camera camera;
+	camera.fovY = DirectX::XMConvertToRadians(70.f);
+	camera.nearPlane = 0.1f;
+	camera.farPlane = 10000.f;
+	camera.position = vec3(0.f, 5.f, 5.f);
+	camera.rotation = quat::identity;
+	camera.pitch = 0.f;
+	camera.yaw = 0.f;
+	camera.updateMatrices(width, height);
+
+	camera_controller controller;
+
+	particle_simulation particles;
+	particles.initialize(10000);
+	particles.spawnRate = 2000.f;
+	particles.gravityFactor = 1.f;
+	particles.color.initializeAsLinear(vec4(0.7f, 0.3f, 0.1f, 1.f), vec4(0.1f, 0.1f, 0.1f, 1.f));
+	particles.maxLifetime.initializeAsRandom(1.5f, 3.f);
+	particles.startVelocity.initializeAsRandom(vec3(-1.f, -1.f, -1.f), vec3(1.f, 1.f, 1.f));
+
+	float time = 0.f;
+	uint64 numVisible = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (const recorded_frame& frame : recording.frames)
+		{
+			for (uint32 i = 0; i < frame.numEvents; ++i)
+			{
+				const recorded_input_event& e = recording.events[frame.firstEvent + i];
+				switch (e.type)
+				{
+				case input_event_key_down: controller.keyDown(e.keyboard.key); break;
+				case input_event_key_up: controller.keyUp(e.keyboard.key); break;
+				case input_event_mouse_move: controller.mouseMove(camera, e.mouseMove); break;
+				}
+			}
+
+			srand(frame.randomSeed);
+			float dt = (fixedDt > 0.f) ? fixedDt : frame.dt;
+
+			controller.update(camera, dt, width, height);
+
+			camera_frustum_planes frustum = camera.getWorldSpaceFrustumPlanes();
+			for (uint32 i = 0; i < numBoxes; ++i)
+			{
+				numVisible += !frustum.cullWorldSpaceAABB(boxes[i]);
+			}
+
+			time += dt;
+			particles.spawnPosition = vec3(cos(time) * 20.f, sin(time) * 15.f + 20.f, 0.f);
+			particles.update(dt, 4, 4);
+		}
+	});
+
+	benchmarkSink = numVisible + particles.particles.size();
+
+	benchmark_result result;
+	result.name = "Input replay (camera, culling, particles)";
+	result.numThreads = 1;
+	result.numOperations = recording.frames.size();
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+// Splits every cell of a regular grid into the six tetrahedra around its main diagonal. Neighboring cells share the faces of
+// their tetrahedra, so this is a valid tetrahedralization of the box.
+static void createLightProbeGrid(uint32 sizeX, uint32 sizeY, uint32 sizeZ, float spacing,
+	std::vector<vec4>& outPositions, std::vector<light_probe_tetrahedron>& outTetrahedra)
+{
+	benchmark_random random(31337);
+
+	auto index = [=](uint32 x, uint32 y, uint32 z) { return (int)((z * sizeY + y) * sizeX + x); };
+
+	outPositions.resize(sizeX * sizeY * sizeZ);
+	for (uint32 z = 0; z < sizeZ; ++z)
+	{
+		for (uint32 y = 0; y < sizeY; ++y)
+		{
+			for (uint32 x = 0; x < sizeX; ++x)
+			{
+				// Slightly jittered, like placed probes.
+				float jitter = spacing * 0.1f;
+				outPositions[index(x, y, z)] = vec4(
+					x * spacing + random.nextFloat(-jitter, jitter),
+					y * spacing + random.nextFloat(-jitter, jitter),
+					z * spacing + random.nextFloat(-jitter, jitter),
+					1.f);
+			}
+		}
+	}
+
+	const uint32 permutations[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+
+	outTetrahedra.clear();
+	for (uint32 z = 0; z < sizeZ - 1; ++z)
+	{
+		for (uint32 y = 0; y < sizeY - 1; ++y)
+		{
+			for (uint32 x = 0; x < sizeX - 1; ++x)
+			{
+				for (uint32 p = 0; p < 6; ++p)
+				{
+					uint32 v[3] = { x, y, z };
+
+					light_probe_tetrahedron tet;
+					tet.indices[0] = index(v[0], v[1], v[2]);
+					for (uint32 i = 0; i < 3; ++i)
+					{
+						++v[permutations[p][i]];
+						tet.indices[i + 1] = index(v[0], v[1], v[2]);
+					}
+					outTetrahedra.push_back(tet);
+				}
+			}
+		}
+	}
+
+	// Tetrahedra sharing a face are neighbors. Vertex indices are below 2^21, so a sorted face fits into 64 bits.
+	std::unordered_map<uint64, uint32> openFaces;
+	for (uint32 t = 0; t < (uint32)outTetrahedra.size(); ++t)
+	{
+		light_probe_tetrahedron& tet = outTetrahedra[t];
+		computeLightProbeTetrahedronMatrix(outPositions.data(), tet);
+
+		for (uint32 i = 0; i < 4; ++i)
+		{
+			tet.neighbors[i] = -1;
+
+			uint64 face[3];
+			uint32 numFaceVertices = 0;
+			for (uint32 j = 0; j < 4; ++j)
+			{
+				if (j != i)
+				{
+					face[numFaceVertices++] = (uint64)tet.indices[j];
+				}
+			}
+			std::sort(face, face + 3);
+			uint64 key = (face[0] << 42) | (face[1] << 21) | face[2];
+
+			auto it = openFaces.find(key);
+			if (it == openFaces.end())
+			{
+				openFaces[key] = t * 4 + i;
+			}
+			else
+			{
+				uint32 other = it->second / 4;
+				uint32 otherFace = it->second % 4;
+				tet.neighbors[i] = (int)other;
+				outTetrahedra[other].neighbors[otherFace] = (int)t;
+				openFaces.erase(it);
+			}
+		}
+	}
+}
+
+benchmark_result benchmarkLightProbeLookup(uint32 numQueries, bool coherent)
+{
+	const uint32 sizeX = 32, sizeY = 8, sizeZ = 32;
+	const float spacing = 2.f;
+
+	std::vector<vec4> positions;
+	std::vector<light_probe_tetrahedron> tetrahedra;
+	createLightProbeGrid(sizeX, sizeY, sizeZ, spacing, positions, tetrahedra);
+
+	benchmark_random random(271828);
+
+	vec3 center((sizeX - 1) * spacing * 0.5f, (sizeY - 1) * spacing * 0.5f, (sizeZ - 1) * spacing * 0.5f);
+	vec3 extent = center * 0.9f;
+
+	std::vector<vec3> queries(numQueries);
+	for (uint32 i = 0; i < numQueries; ++i)
+	{
+		if (coherent)
+		{
+			// A camera flying figure eights through the volume.
+			float t = i * (1.f / 60.f) * 0.2f;
+			queries[i] = center + vec3(sinf(t) * extent.x, sinf(t * 3.f) * extent.y, sinf(t * 2.f) * extent.z);
+		}
+		else
+		{
+			queries[i] = center + vec3(random.nextFloat(-extent.x, extent.x), random.nextFloat(-extent.y, extent.y), random.nextFloat(-extent.z, extent.z));
+		}
+	}
+
+	uint64 checksum = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		uint32 lastTetrahedron = 0;
+		for (uint32 i = 0; i < numQueries; ++i)
+		{
+			vec4 barycentric;
+			lastTetrahedron = findEnclosingLightProbeTetrahedron(positions.data(), tetrahedra.data(), queries[i], lastTetrahedron, barycentric);
+			checksum += lastTetrahedron;
+		}
+	});
+
+	benchmarkSink = checksum;
+
+	benchmark_result result;
+	result.name = coherent ? "Light probe lookup (coherent)" : "Light probe lookup (incoherent)";
+	result.numThreads = 1;
+	result.numOperations = numQueries;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkUploadRingAllocation(uint32 numFrames, uint32 numAllocationsPerFrame)
+{
+	const uint32 numFramesInFlight = 2;
+
+	benchmark_random random(1234);
+
+	// Large enough for all frames in flight, so that allocations never wait.
+	ring_allocator ring;
+	ring.initialize((uint64)numAllocationsPerFrame * KB(64) * (numFramesInFlight + 1));
+
+	uint64 numAllocations = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint64 frame = numFramesInFlight; frame < numFrames + numFramesInFlight; ++frame)
+		{
+			ring.retire(frame - numFramesInFlight);
+
+			for (uint32 i = 0; i < numAllocationsPerFrame; ++i)
+			{
+				uint64 size = alignTo(256 + random.next() % KB(64), 256);
+
+				uint64 blockID, offset;
+				if (ring.allocateBlock(size, blockID, offset))
+				{
+					ring.submitBlock(blockID, frame);
+					++numAllocations;
+				}
+			}
+		}
+	});
+
+	benchmarkSink = ring.getUsedSize();
+
+	benchmark_result result;
+	result.name = "Upload ring allocation";
+	result.numThreads = 1;
+	result.numOperations = numAllocations;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkDescriptorPageAllocation(uint32 numFrames, uint32 numAllocationsPerFrame)
+{
+	const uint32 numFramesInFlight = 2;
+
+	struct descriptor_range
+	{
+		uint32 offset;
+		uint32 count;
+	};
+
+	benchmark_random random(5678);
+
+	free_list_allocator page;
+	page.initialize(65536);
+
+	std::vector<descriptor_range> previousFrame;
+	std::vector<descriptor_range> currentFrame;
+	previousFrame.reserve(numAllocationsPerFrame);
+	currentFrame.reserve(numAllocationsPerFrame);
+
+	uint64 numOperations = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint64 frame = 0; frame < numFrames; ++frame)
+		{
+			page.releaseStale(frame);
+
+			currentFrame.clear();
+			for (uint32 i = 0; i < numAllocationsPerFrame; ++i)
+			{
+				descriptor_range range;
+				range.count = 1 + random.next() % 8;
+				if (page.allocate(range.count, range.offset))
+				{
+					currentFrame.push_back(range);
+					++numOperations;
+				}
+			}
+
+			// Transient descriptors live for one frame, and the GPU might still read them for the frames in flight.
+			for (const descriptor_range& range : previousFrame)
+			{
+				page.freeDeferred(range.offset, range.count, frame + numFramesInFlight);
+				++numOperations;
+			}
+			std::swap(previousFrame, currentFrame);
+		}
+	});
+
+	benchmarkSink = page.getNumFree();
+
+	benchmark_result result;
+	result.name = "Descriptor page allocation";
+	result.numThreads = 1;
+	result.numOperations = numOperations;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkBindlessSlotAllocation(uint32 numFrames, uint32 numAllocationsPerFrame)
+{
+	const uint32 numFramesInFlight = 2;
+
+	bindless_slot_allocator slots;
+	slots.initialize(65536);
+
+	std::vector<bindless_handle> previousFrame;
+	std::vector<bindless_handle> currentFrame;
+	previousFrame.reserve(numAllocationsPerFrame);
+	currentFrame.reserve(numAllocationsPerFrame);
+
+	uint64 numOperations = 0;
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint64 frame = 0; frame < numFrames; ++frame)
+		{
+			slots.releaseStale(frame);
+
+			currentFrame.clear();
+			for (uint32 i = 0; i < numAllocationsPerFrame; ++i)
+			{
+				bindless_handle handle;
+				if (slots.allocate(handle))
+				{
+					currentFrame.push_back(handle);
+					++numOperations;
+				}
+			}
+
+			for (bindless_handle handle : previousFrame)
+			{
+				slots.freeDeferred(handle, frame + numFramesInFlight);
+				++numOperations;
+			}
+			std::swap(previousFrame, currentFrame);
+		}
+	});
+
+	benchmarkSink = slots.getNumAllocated();
+
+	benchmark_result result;
+	result.name = "Bindless slot allocation";
+	result.numThreads = 1;
+	result.numOperations = numOperations;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkHeapAllocation(uint32 numOperations, bool useTLSF)
+{
+	const uint64 granularity = KB(64);
+	const uint32 numGranules = 4096;
+	const uint32 maxLiveAllocations = 256;
+
+	struct live_allocation
+	{
+		tlsf_allocator::allocation allocation;
+		uint32 offset;
+		uint32 size;
+	};
+
+	tlsf_allocator tlsf;
+	tlsf.initialize(numGranules * granularity, granularity);
+
+	free_list_allocator freeList;
+	freeList.initialize(numGranules);
+
+	std::vector<live_allocation> live;
+	live.reserve(maxLiveAllocations);
+
+	// Same sequence for both allocators.
+	uint32 random = 12345;
+	auto nextRandom = [&random]() { random = random * 1664525 + 1013904223; return random >> 8; };
+
+	double milliseconds = runThreads(1, [&](uint32 threadIndex)
+	{
+		for (uint32 i = 0; i < numOperations; ++i)
+		{
+			bool allocate = live.size() < maxLiveAllocations / 2 || (live.size() < maxLiveAllocations && (nextRandom() & 1));
+			if (allocate)
+			{
+				// Mostly small buffers, some larger textures.
+				uint32 size = (nextRandom() % 8 == 0) ? (16 + nextRandom() % 48) : (1 + nextRandom() % 8);
+
+				live_allocation a = {};
+				a.size = size;
+				bool success;
+				if (useTLSF)
+				{
+					a.allocation = tlsf.allocate(size * granularity);
+					success = a.allocation.isValid();
+				}
+				else
+				{
+					success = freeList.allocate(size, a.offset);
+				}
+				if (success)
+				{
+					live.push_back(a);
+				}
+			}
+			else if (!live.empty())
+			{
+				uint32 index = nextRandom() % (uint32)live.size();
+				if (useTLSF)
+				{
+					tlsf.free(live[index].allocation);
+				}
+				else
+				{
+					freeList.free(live[index].offset, live[index].size);
+				}
+				live[index] = live.back();
+				live.pop_back();
+			}
+		}
+	});
+
+	assert(!useTLSF || tlsf.validate());
+
+	benchmark_result result;
+	result.name = useTLSF ? "Heap allocation (TLSF)" : "Heap allocation (best-fit free list)";
+	result.numThreads = 1;
+	result.numOperations = numOperations;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+benchmark_result benchmarkThreadSafeQueue(uint32 numThreads, uint32 numOperationsPerThread)
+{
+	const uint32 batchSize = 64;
+
+	thread_safe_queue<uint64> queue;
+
+	double milliseconds = runThreads(numThreads, [&](uint32 threadIndex)
+	{
+		uint64 sum = 0;
+		for (uint32 i = 0; i < numOperationsPerThread; i += batchSize)
+		{
+			uint32 count = min(batchSize, numOperationsPerThread - i);
+			for (uint32 j = 0; j < count; ++j)
+			{
+				queue.pushBack(i + j);
+			}
+
+			// Every thread has pushed at least as much as it has popped, so the queue cannot run dry while we still wait for items.
+			for (uint32 j = 0; j < count; )
+			{
+				uint64 value;
+				if (queue.tryPop(value))
+				{
+					sum += value;
+					++j;
+				}
+			}
+		}
+		benchmarkSink = sum;
+	});
+
+	benchmark_result result;
+	result.name = "Thread safe queue";
+	result.numThreads = numThreads;
+	result.numOperations = (uint64)numThreads * numOperationsPerThread * 2;
+	result.milliseconds = milliseconds;
+	return result;
+}
+
+std::vector<cpu_benchmark> getCPUBenchmarks()
+{
+	return
+	{
+		{ "frustum_culling/world_space", []() { return benchmarkFrustumCulling(100, 10000, false); } },
+		{ "frustum_culling/model_space", []() { return benchmarkFrustumCulling(100, 10000, true); } },
+		{ "skeleton_evaluation/64_joints", []() { return benchmarkSkeletonEvaluation(100, 100, 64); } },
+		{ "particle_update/10k", []() { return benchmarkParticleUpdate(600, 10000); } },
+		{ "light_probe_lookup/coherent", []() { return benchmarkLightProbeLookup(100000, true); } },
+		{ "light_probe_lookup/incoherent", []() { return benchmarkLightProbeLookup(10000, false); } },
+		{ "upload_ring_allocation", []() { return benchmarkUploadRingAllocation(1000, 256); } },
+		{ "descriptor_page_allocation", []() { return benchmarkDescriptorPageAllocation(1000, 256); } },
+		{ "bindless_slot_allocation", []() { return benchmarkBindlessSlotAllocation(1000, 256); } },
+		{ "heap_allocation/free_list", []() { return benchmarkHeapAllocation(1 << 20, false); } },
+		{ "heap_allocation/tlsf", []() { return benchmarkHeapAllocation(1 << 20, true); } },
+		{ "thread_safe_queue/1_thread", []() { return benchmarkThreadSafeQueue(1, 1 << 18); } },
+		{ "thread_safe_queue/4_threads", []() { return benchmarkThreadSafeQueue(4, 1 << 18); } },
+		{ "thread_safe_queue/8_threads", []() { return benchmarkThreadSafeQueue(8, 1 << 18); } },
+	};
+}
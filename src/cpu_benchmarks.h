@@ -0,0 +1,56 @@
+#pragma once
+
+#include "benchmark.h"
+
+struct input_recording;
+
+// Benchmarks of the renderer's CPU hot paths which do not need a device. They are compiled into the renderer (see the
+// benchmark section of the debug GUI) and into the headless benchmark executable (benchmark_main.cpp), which also builds on
+// Linux. All inputs are synthetic and generated from fixed seeds, so runs on different machines or builds are comparable.
+
+// Culls a grid of boxes against the frustum of a camera flying over it. Either the world space boxes are tested directly, or
+// model space boxes are transformed by their instance matrix first, like the shadow and placement passes do.
+benchmark_result benchmarkFrustumCulling(uint32 numIterations, uint32 numBoxes, bool modelSpace);
+
+// Evaluates global transforms and skinning matrices for a number of skeletons with the given joint count.
+benchmark_result benchmarkSkeletonEvaluation(uint32 numIterations, uint32 numSkeletons, uint32 numJoints);
+
+// Simulates a particle system with the given capacity at 60 Hz. The system runs for a few simulated seconds before the
+// measurement starts, so it is filled to its steady state.
+benchmark_result benchmarkParticleUpdate(uint32 numFrames, uint32 numParticles);
+
+// Replays a recorded session headlessly: the recorded events steer the camera like in the game, and every frame culls a grid of
+// 10000 boxes against the camera and steps a particle system, with the recorded random seed. The device-bound parts of a frame
+// are not covered. With a fixed dt greater than zero, the recorded frame times are ignored. One operation is one frame.
+benchmark_result benchmarkInputReplay(const input_recording& recording, float fixedDt);
+
+// Finds the enclosing tetrahedron in a grid of 32x8x32 light probes. Coherent queries follow a moving camera and start at the
+// previous result, like light_probe_system does. Incoherent queries jump to random positions, which needs long walks.
+benchmark_result benchmarkLightProbeLookup(uint32 numQueries, bool coherent);
+
+// Allocates blocks of 256 bytes to 64KB from the upload ring every frame, and retires them two frames later.
+benchmark_result benchmarkUploadRingAllocation(uint32 numFrames, uint32 numAllocationsPerFrame);
+
+// Allocates and frees descriptor ranges of 1 to 8 descriptors from a 64K descriptor page, deferring the frees by two frames.
+benchmark_result benchmarkDescriptorPageAllocation(uint32 numFrames, uint32 numAllocationsPerFrame);
+
+// Allocates and frees bindless slots, deferring the frees by two frames.
+benchmark_result benchmarkBindlessSlotAllocation(uint32 numFrames, uint32 numAllocationsPerFrame);
+
+// Randomly allocates and frees ranges of 64KB to 4MB in a 256MB heap, like placed resources do, either with the TLSF
+// allocator of the GPU heaps or the best-fit free list allocator. Debug builds check the TLSF invariants at the end.
+benchmark_result benchmarkHeapAllocation(uint32 numOperations, bool useTLSF);
+
+// Every thread pushes batches of jobs into one shared queue and pops the same number again.
+benchmark_result benchmarkThreadSafeQueue(uint32 numThreads, uint32 numOperationsPerThread);
+
+
+struct cpu_benchmark
+{
+	const char* name;				// Unique, including the configuration.
+	std::function<benchmark_result()> run;
+};
+
+// The standard set with the sizes used for comparisons between runs. Adding entries is fine; changing the sizes of existing
+// ones makes older results incomparable.
+std::vector<cpu_benchmark> getCPUBenchmarks();
@@ -3,18 +3,18 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <pix3.h>
 
 void debug_display::initialize(ComPtr<ID3D12Device2> device, dx_command_list* commandList, const dx_render_target& renderTarget)
 {
 	{
-		ComPtr<ID3DBlob> vertexShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/unlit_textured_vs.cso", &vertexShaderBlob));
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/unlit_textured_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/unlit_textured_vs.cso");
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/unlit_textured_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 			{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
@@ -60,30 +60,24 @@ void debug_display::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 		pipelineStateStream.rootSignature = unlitTexturedRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 		pipelineStateStream.blend = alphaBlendDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&unlitTexturedPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, unlitTexturedPipelineState, L"Unlit Textured Pipeline");
 
 		SET_NAME(unlitTexturedRootSignature.rootSignature, "Unlit Textured Root Signature");
-		SET_NAME(unlitTexturedPipelineState, "Unlit Textured Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> vertexShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/unlit_flat_vs.cso", &vertexShaderBlob));
+		D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/unlit_flat_vs.cso");
 
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/unlit_flat_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/unlit_flat_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
 
@@ -125,30 +119,22 @@ void debug_display::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 		pipelineStateStream.rootSignature = unlitFlatRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
 		{
-			D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-				sizeof(pipeline_state_stream), &pipelineStateStream
-			};
-			checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&unlitLinePipelineState)));
+			dx_pipeline_factory::createPipelineState(pipelineStateStream, unlitLinePipelineState, L"Unlit Line Pipeline");
 		}
 
 		{
 			pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-			D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-				sizeof(pipeline_state_stream), &pipelineStateStream
-			};
-			checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&unlitFlatPipelineState)));
+			dx_pipeline_factory::createPipelineState(pipelineStateStream, unlitFlatPipelineState, L"Unlit Flat Pipeline");
 		}
 
 		SET_NAME(unlitFlatRootSignature.rootSignature, "Unlit Line Root Signature");
-		SET_NAME(unlitLinePipelineState, "Unlit Line Pipeline");
-		SET_NAME(unlitFlatPipelineState, "Unlit Flat Pipeline");
 	}
 
 	uint16 frustumIndices[] = {
@@ -2,6 +2,8 @@
 #include "debug_gui.h"
 #include "error.h"
 #include "graphics.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 static bool pointInRectangle(vec2 p, vec2 topLeft, vec2 bottomRight)
 {
@@ -28,12 +30,10 @@ void debug_gui::initialize(ComPtr<ID3D12Device2> device, dx_command_list* comman
 	mousePosition = vec2(0.f, 0.f);
 
 	{
-		ComPtr<ID3DBlob> vertexShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/font_vs.cso", &vertexShaderBlob));
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/font_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/font_vs.cso");
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/font_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 			{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 			{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -80,8 +80,8 @@ void debug_gui::initialize(ComPtr<ID3D12Device2> device, dx_command_list* comman
 		pipelineStateStream.rootSignature = fontRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.rtvFormats = rtvFormats;
 
 		CD3DX12_DEPTH_STENCIL_DESC1 depthDesc(D3D12_DEFAULT);
@@ -91,19 +91,14 @@ void debug_gui::initialize(ComPtr<ID3D12Device2> device, dx_command_list* comman
 
 		pipelineStateStream.blend = alphaBlendDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&fontPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, fontPipelineState);
 	}
 
 	{
-		ComPtr<ID3DBlob> vertexShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/flat_2d_vs.cso", &vertexShaderBlob));
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/flat_2d_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/flat_2d_vs.cso");
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/flat_2d_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 			{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
@@ -147,8 +142,8 @@ void debug_gui::initialize(ComPtr<ID3D12Device2> device, dx_command_list* comman
 		pipelineStateStream.rootSignature = shapeRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.rtvFormats = rtvFormats;
 
 		CD3DX12_DEPTH_STENCIL_DESC1 depthDesc(D3D12_DEFAULT);
@@ -158,10 +153,7 @@ void debug_gui::initialize(ComPtr<ID3D12Device2> device, dx_command_list* comman
 
 		pipelineStateStream.blend = alphaBlendDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&shapePipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, shapePipelineState);
 	}
 
 	registerMouseButtonDownCallback(BIND(mouseDownCallback));
@@ -1,8 +1,15 @@
 #include "pch.h"
 #include "descriptor_allocator.h"
 #include "error.h"
+#include "memory_tracking.h"
+#include "profiling.h"
+
+#include <algorithm>
 
 dx_descriptor_allocator dx_descriptor_allocator::allocators[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+std::atomic_uint64_t dx_descriptor_allocator::currentFrameNumber;
+thread_local dx_descriptor_allocator::thread_cache dx_descriptor_allocator::threadCaches[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+bool dx_descriptor_allocator::enableThreadCaches = true;
 
 void dx_descriptor_allocator::initializeInternal(ComPtr<ID3D12Device2> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32 numDescriptorsPerHeap)
 {
@@ -17,24 +24,29 @@ dx_descriptor_allocation dx_descriptor_allocator::allocateDescriptorsInternal(ui
 
 	dx_descriptor_allocation allocation;
 
-	for (auto iter = freePages.begin(); iter != freePages.end(); ++iter)
+	for (auto iter = freePages.begin(); iter != freePages.end(); )
 	{
-		dx_descriptor_allocator_page& page = pages[*iter];
+		dx_descriptor_allocator_page& page = *pages[*iter];
 
-		if (page.numFreeHandles >= count)
+		if (page.numFreeHandles() >= count)
 		{
+			// The page might still fail, if it is fragmented.
 			allocation = page.allocateDescriptors(count);
+		}
 
-			if (page.numFreeHandles == 0)
-			{
-				iter = freePages.erase(iter);
-			}
+		if (page.numFreeHandles() == 0)
+		{
+			iter = freePages.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
 
-			// A valid allocation has been found.
-			if (!allocation.isNull())
-			{
-				break;
-			}
+		// A valid allocation has been found.
+		if (!allocation.isNull())
+		{
+			break;
 		}
 	}
 
@@ -50,17 +62,162 @@ dx_descriptor_allocation dx_descriptor_allocator::allocateDescriptorsInternal(ui
 	return allocation;
 }
 
+void dx_descriptor_allocator::beginFrame(uint64 frameNumber)
+{
+	currentFrameNumber = frameNumber;
+
+	uint32 numDescriptorsInUse = 0;
+	for (uint32 i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
+	{
+		dx_descriptor_allocator& allocator = allocators[i];
+
+		{
+			std::lock_guard<std::mutex> lock(allocator.threadCacheRegistryMutex);
+			for (thread_cache* cache : allocator.threadCacheRegistry)
+			{
+				allocator.flushPendingFrees(*cache);
+			}
+		}
+
+		// Includes the unused rest of the per-thread blocks and descriptors which wait for the GPU.
+		std::lock_guard<std::mutex> lock(allocator.allocationMutex);
+		for (auto& page : allocator.pages)
+		{
+			numDescriptorsInUse += page->numDescriptors - page->numFreeHandles();
+		}
+	}
+	PROFILE_COUNTER_SET("Descriptors in use", numDescriptorsInUse);
+}
+
+void dx_descriptor_allocator::registerThreadCache(thread_cache& cache)
+{
+	if (!cache.allocator)
+	{
+		cache.allocator = this;
+
+		std::lock_guard<std::mutex> lock(threadCacheRegistryMutex);
+		threadCacheRegistry.push_back(&cache);
+	}
+}
+
+dx_descriptor_allocation dx_descriptor_allocator::allocateFromThreadCache()
+{
+	thread_cache& cache = threadCaches[type];
+	registerThreadCache(cache);
+
+	if (cache.block.isNull() || cache.numUsed == cache.block.count)
+	{
+		// The previous block has been handed out completely, so there is nothing to give back.
+		cache.block = allocateDescriptorsInternal(threadCacheBlockSize);
+		cache.numUsed = 0;
+	}
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(cache.block.getDescriptorHandle(cache.numUsed++));
+	return dx_descriptor_allocation(handle, 1, cache.block.descriptorSize, cache.block.page);
+}
+
+void dx_descriptor_allocator::freeDescriptorsBatched(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count)
+{
+	uint64 frameNumber = currentFrameNumber;
+
+	if (!enableThreadCaches)
+	{
+		std::lock_guard<std::mutex> lock(allocationMutex);
+		pages[findPage(handle)]->free(handle, count, frameNumber);
+		return;
+	}
+
+	thread_cache& cache = threadCaches[type];
+	registerThreadCache(cache);
+
+	bool flush;
+	{
+		std::lock_guard<std::mutex> lock(cache.pendingFreesMutex);
+		cache.pendingFrees.push_back({ handle, count, frameNumber });
+		flush = cache.pendingFrees.size() >= maxPendingFrees || cache.pendingFrees.front().frameNumber != frameNumber;
+	}
+
+	if (flush)
+	{
+		flushPendingFrees(cache);
+	}
+}
+
+void dx_descriptor_allocator::flushPendingFrees(thread_cache& cache)
+{
+	std::lock_guard<std::mutex> cacheLock(cache.pendingFreesMutex);
+	if (cache.pendingFrees.empty())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(allocationMutex);
+
+	for (const pending_free& f : cache.pendingFrees)
+	{
+		pages[findPage(f.handle)]->free(f.handle, f.count, f.frameNumber);
+	}
+	cache.pendingFrees.clear();
+}
+
+void dx_descriptor_allocator::flushThreadCache(thread_cache& cache, bool releaseBlock)
+{
+	flushPendingFrees(cache);
+
+	bool hasBlock = releaseBlock && !cache.block.isNull() && cache.numUsed < cache.block.count;
+	if (hasBlock)
+	{
+		std::lock_guard<std::mutex> lock(allocationMutex);
+
+		// The rest of the block was never handed out, so it can be reused right away.
+		uint32 pageIndex = findPage(cache.block.baseHandle);
+		pages[pageIndex]->freeUnused(cache.block.getDescriptorHandle(cache.numUsed), cache.block.count - cache.numUsed);
+		freePages.insert(pageIndex);
+	}
+
+	if (releaseBlock)
+	{
+		cache.block = dx_descriptor_allocation();
+		cache.numUsed = 0;
+	}
+}
+
+dx_descriptor_allocator::thread_cache::~thread_cache()
+{
+	if (allocator)
+	{
+		allocator->flushThreadCache(*this, true);
+
+		std::lock_guard<std::mutex> lock(allocator->threadCacheRegistryMutex);
+		std::vector<thread_cache*>& registry = allocator->threadCacheRegistry;
+		registry.erase(std::find(registry.begin(), registry.end(), this));
+	}
+}
+
+uint32 dx_descriptor_allocator::findPage(D3D12_CPU_DESCRIPTOR_HANDLE handle) const
+{
+	// Last page starting at or before the handle.
+	auto it = pagesByBaseHandle.upper_bound(handle.ptr);
+	if (it != pagesByBaseHandle.begin() && pages[std::prev(it)->second]->ownsHandle(handle))
+	{
+		return std::prev(it)->second;
+	}
+
+	assert(!"Descriptor handle does not belong to this allocator.");
+	return 0;
+}
+
 void dx_descriptor_allocator::releaseStaleDescriptorsInternal(uint64 frameNumber)
 {
 	std::lock_guard<std::mutex> lock(allocationMutex);
 
 	for (uint32 i = 0; i < (uint32)pages.size(); ++i)
 	{
-		dx_descriptor_allocator_page& page = pages[i];
+		dx_descriptor_allocator_page& page = *pages[i];
 
 		page.releaseStaleDescriptors(frameNumber);
 
-		if (page.numFreeHandles > 0)
+		if (page.numFreeHandles() > 0)
 		{
 			freePages.insert(i);
 		}
@@ -69,16 +226,17 @@ void dx_descriptor_allocator::releaseStaleDescriptorsInternal(uint64 frameNumber
 
 dx_descriptor_allocator_page& dx_descriptor_allocator::createPage()
 {
-	pages.emplace_back(device, type, numDescriptorsPerHeap);
-	dx_descriptor_allocator_page& result = pages.back();
+	pages.push_back(std::make_unique<dx_descriptor_allocator_page>(device, type, numDescriptorsPerHeap));
+	dx_descriptor_allocator_page& result = *pages.back();
 	freePages.insert((uint32)pages.size() - 1);
+	pagesByBaseHandle.emplace(result.baseDescriptor.ptr, (uint32)pages.size() - 1);
 	return result;
 }
 
 dx_descriptor_allocator_page::dx_descriptor_allocator_page(ComPtr<ID3D12Device2> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32 numDescriptors)
 {
 	this->type = type;
-	this->numFreeHandles = numDescriptors;
+	this->numDescriptors = numDescriptors;
 
 	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
 	heapDesc.Type = type;
@@ -88,27 +246,43 @@ dx_descriptor_allocator_page::dx_descriptor_allocator_page(ComPtr<ID3D12Device2>
 
 	baseDescriptor = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
 	descriptorHandleIncrementSize = device->GetDescriptorHandleIncrementSize(type);
+	trackGPUMemory(descriptorHeap.Get(), (uint64)numDescriptors * descriptorHandleIncrementSize, memory_tag_descriptors);
 
-	// Initialize the free lists
-	//AddNewBlock(0, m_NumFreeHandles);
-
-
-	currentOffset = 0;
+	freeList.initialize(numDescriptors);
 }
 
 dx_descriptor_allocation dx_descriptor_allocator_page::allocateDescriptors(uint32 count)
 {
-	numFreeHandles -= count;
-	uint32 offset = currentOffset;
-	currentOffset += count;
+	uint32 offset;
+	if (!freeList.allocate(count, offset))
+	{
+		return dx_descriptor_allocation();
+	}
 
 	return dx_descriptor_allocation(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE(baseDescriptor, offset, descriptorHandleIncrementSize),
 		count, descriptorHandleIncrementSize, this);
 }
 
+void dx_descriptor_allocator_page::free(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count, uint64 frameNumber)
+{
+	assert(ownsHandle(handle));
+
+	uint32 offset = (uint32)((handle.ptr - baseDescriptor.ptr) / descriptorHandleIncrementSize);
+	freeList.freeDeferred(offset, count, frameNumber);
+}
+
+void dx_descriptor_allocator_page::freeUnused(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count)
+{
+	assert(ownsHandle(handle));
+
+	uint32 offset = (uint32)((handle.ptr - baseDescriptor.ptr) / descriptorHandleIncrementSize);
+	freeList.free(offset, count);
+}
+
 void dx_descriptor_allocator_page::releaseStaleDescriptors(uint64 frameNumber)
 {
+	freeList.releaseStale(frameNumber);
 }
 
 dx_descriptor_allocation::dx_descriptor_allocation()
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "free_list_allocator.h"
 
 struct dx_descriptor_allocator_page;
 
@@ -23,19 +24,26 @@ struct dx_descriptor_allocator_page
 	dx_descriptor_allocator_page(ComPtr<ID3D12Device2> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32 numDescriptors);
 
 	dx_descriptor_allocation allocateDescriptors(uint32 count);
+	void free(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count, uint64 frameNumber);
+	void freeUnused(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count); // For descriptors which have never been handed out.
 	void releaseStaleDescriptors(uint64 frameNumber);
 
+	bool ownsHandle(D3D12_CPU_DESCRIPTOR_HANDLE handle) const
+	{
+		return handle.ptr >= baseDescriptor.ptr && handle.ptr < baseDescriptor.ptr + (SIZE_T)numDescriptors * descriptorHandleIncrementSize;
+	}
+
+	uint32 numFreeHandles() const { return freeList.getNumFree(); }
+
 
-	uint32 numFreeHandles;
 	D3D12_DESCRIPTOR_HEAP_TYPE type;
+	uint32 numDescriptors;
 
 	ComPtr<ID3D12DescriptorHeap> descriptorHeap;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE baseDescriptor;
 	uint32 descriptorHandleIncrementSize;
 
-
-	// tmp
-	uint32 currentOffset;
+	free_list_allocator freeList;
 };
 
 class dx_descriptor_allocator
@@ -50,35 +58,102 @@ public:
 		}
 	}
 
+	// Single descriptors are served from a per-thread block without taking the lock. Larger ranges always go to the pages.
 	static dx_descriptor_allocation allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32 count = 1)
 	{
+		if (count == 1 && enableThreadCaches)
+		{
+			return allocators[type].allocateFromThreadCache();
+		}
 		return allocators[type].allocateDescriptorsInternal(count);
 	}
 
+	// Descriptors are not returned right away, since they might still be referenced by command lists in flight.
+	// They become available again once releaseStaleDescriptors has been called with the current frame number (or a later one).
+	// Frees are collected per thread and handed to the pages in batches. A batch is flushed when it is full, when the
+	// thread frees descriptors in a later frame, when the thread calls releaseStaleDescriptors, and when the thread exits.
+	// beginFrame flushes the batches of all threads, so frees of threads which have gone idle are not held back.
+	static void freeDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE type, D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count = 1)
+	{
+		allocators[type].freeDescriptorsBatched(handle, count);
+	}
+
+	static void freeDescriptors(const dx_descriptor_allocation& allocation)
+	{
+		if (!allocation.isNull())
+		{
+			allocators[allocation.page->type].freeDescriptorsBatched(allocation.baseHandle, allocation.count);
+		}
+	}
+
+	// Must be called at the start of each frame. Freed descriptors are tagged with this number.
+	static void beginFrame(uint64 frameNumber);
+
+	// Returns all descriptors which were freed in frames <= frameNumber.
 	static void releaseStaleDescriptors(uint64 frameNumber)
 	{
 		for (uint32 i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
 		{
+			allocators[i].flushThreadCache(threadCaches[i], false);
 			allocators[i].releaseStaleDescriptorsInternal(frameNumber);
 		}
 	}
 
+	// Only for comparisons. Must not be changed while other threads allocate or free descriptors.
+	static bool enableThreadCaches;
+
 private:
+	struct pending_free
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE handle;
+		uint32 count;
+		uint64 frameNumber;
+	};
+
+	struct thread_cache
+	{
+		~thread_cache();
+
+		dx_descriptor_allocator* allocator = nullptr;
+		dx_descriptor_allocation block;
+		uint32 numUsed = 0;
+
+		// Only contended while beginFrame flushes the batch from another thread.
+		std::mutex pendingFreesMutex;
+		std::vector<pending_free> pendingFrees;
+	};
+
+	static const uint32 threadCacheBlockSize = 32;
+	static const uint32 maxPendingFrees = 64;
+
 	void initializeInternal(ComPtr<ID3D12Device2> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32 numDescriptorsPerHeap);
 	dx_descriptor_allocation allocateDescriptorsInternal(uint32 count);
+	dx_descriptor_allocation allocateFromThreadCache();
+	void freeDescriptorsBatched(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint32 count);
+	void flushThreadCache(thread_cache& cache, bool releaseBlock);
+	void flushPendingFrees(thread_cache& cache);
+	void registerThreadCache(thread_cache& cache);
 	void releaseStaleDescriptorsInternal(uint64 frameNumber);
+	uint32 findPage(D3D12_CPU_DESCRIPTOR_HANDLE handle) const;
 	dx_descriptor_allocator_page& createPage();
 
 
 	uint32 numDescriptorsPerHeap;
 	D3D12_DESCRIPTOR_HEAP_TYPE type;
 
-	std::vector<dx_descriptor_allocator_page> pages;
+	std::vector<std::unique_ptr<dx_descriptor_allocator_page>> pages; // Pointers, because allocations store a pointer to their page.
 	std::set<uint32> freePages;
+	std::map<SIZE_T, uint32> pagesByBaseHandle; // For finding the page of a freed handle.
 
 	ComPtr<ID3D12Device2> device;
 
 	std::mutex allocationMutex;
 
+	// All thread caches which have been used with this allocator, so that beginFrame can reach them.
+	std::vector<thread_cache*> threadCacheRegistry;
+	std::mutex threadCacheRegistryMutex;
+
 	static dx_descriptor_allocator allocators[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+	static std::atomic_uint64_t currentFrameNumber;
+	static thread_local thread_cache threadCaches[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 };
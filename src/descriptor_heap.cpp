@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "descriptor_heap.h"
 #include "error.h"
+#include "memory_tracking.h"
 
 void dx_descriptor_heap::initialize(ComPtr<ID3D12Device2> device, uint32 numDescriptors)
 {
@@ -13,11 +14,23 @@ void dx_descriptor_heap::initialize(ComPtr<ID3D12Device2> device, uint32 numDesc
 	checkResult(device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&descriptorHeap)));
 
 	descriptorHandleIncrementSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	trackGPUMemory(descriptorHeap.Get(), (uint64)numDescriptors * descriptorHandleIncrementSize, memory_tag_descriptors);
 
 	cpuHandle = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
 	gpuHandle = descriptorHeap->GetGPUDescriptorHandleForHeapStart();
 }
 
+void dx_descriptor_heap::initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12DescriptorHeap> descriptorHeap, uint32 offset)
+{
+	this->device = device;
+	this->descriptorHeap = descriptorHeap;
+
+	descriptorHandleIncrementSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	cpuHandle = CD3DX12_CPU_DESCRIPTOR_HANDLE(descriptorHeap->GetCPUDescriptorHandleForHeapStart(), offset, descriptorHandleIncrementSize);
+	gpuHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(descriptorHeap->GetGPUDescriptorHandleForHeapStart(), offset, descriptorHandleIncrementSize);
+}
+
 CD3DX12_GPU_DESCRIPTOR_HANDLE dx_descriptor_heap::push2DTexture(dx_texture& texture)
 {
 	CD3DX12_GPU_DESCRIPTOR_HANDLE result = gpuHandle;
@@ -8,6 +8,9 @@ struct dx_descriptor_heap
 {
 	void initialize(ComPtr<ID3D12Device2> device, uint32 numDescriptors);
 
+	// Pushes into an existing heap, starting at the given descriptor offset.
+	void initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12DescriptorHeap> descriptorHeap, uint32 offset);
+
 	CD3DX12_GPU_DESCRIPTOR_HANDLE push2DTexture(dx_texture& texture);
 	CD3DX12_GPU_DESCRIPTOR_HANDLE pushCubemap(dx_texture& texture);
 	CD3DX12_GPU_DESCRIPTOR_HANDLE pushDepthTexture(dx_texture& texture);
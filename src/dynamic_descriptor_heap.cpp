@@ -3,6 +3,13 @@
 #include "command_list.h"
 #include "root_signature.h"
 #include "error.h"
+#include "memory_tracking.h"
+
+std::atomic_uint32_t dx_dynamic_descriptor_heap::frameCommittedTables;
+std::atomic_uint32_t dx_dynamic_descriptor_heap::frameCopiedTables;
+std::atomic_uint32_t dx_dynamic_descriptor_heap::frameCopiedDescriptors;
+std::atomic_uint32_t dx_dynamic_descriptor_heap::frameReusedTables;
+std::atomic_uint32_t dx_dynamic_descriptor_heap::frameAvoidedDescriptorCopies;
 
 void dx_dynamic_descriptor_heap::initialize(ComPtr<ID3D12Device2> device, D3D12_DESCRIPTOR_HEAP_TYPE heapType, uint32 numDescriptorsPerHeap)
 {
@@ -37,7 +44,8 @@ void dx_dynamic_descriptor_heap::stageDescriptors(uint32 rootParameterIndex, uin
 	staleDescriptorTableBitMask |= (1 << rootParameterIndex);
 }
 
-void dx_dynamic_descriptor_heap::commitStagedDescriptors(dx_command_list* commandList, std::function<void(ID3D12GraphicsCommandList*, uint32, D3D12_GPU_DESCRIPTOR_HANDLE)> setFunc)
+template <bool compute>
+void dx_dynamic_descriptor_heap::commitStagedDescriptors(dx_command_list* commandList)
 {
 	uint32 numDescriptorsToCommit = computeStaleDescriptorCount();
 
@@ -46,58 +54,90 @@ void dx_dynamic_descriptor_heap::commitStagedDescriptors(dx_command_list* comman
 		ID3D12GraphicsCommandList2* d3d12CommandList = commandList->getD3D12CommandList().Get();
 		assert(d3d12CommandList != nullptr);
 
+		// Conservative, since some of the tables might already be in the current heap.
 		if (!currentDescriptorHeap || numFreeHandles < numDescriptorsToCommit)
 		{
-			currentDescriptorHeap = requestDescriptorHeap();
-			currentCPUDescriptorHandle = currentDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-			currentGPUDescriptorHandle = currentDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-			numFreeHandles = numDescriptorsPerHeap;
-
-			commandList->setDescriptorHeap(descriptorHeapType, currentDescriptorHeap);
-
-			// When updating the descriptor heap on the command list, all descriptor
-			// tables must be (re)recopied to the new descriptor heap (not just
-			// the stale descriptor tables).
-			staleDescriptorTableBitMask = descriptorTableBitMask;
+			switchToNewDescriptorHeap(commandList);
 		}
 
 		DWORD rootIndex;
 		while (_BitScanForward(&rootIndex, staleDescriptorTableBitMask))
 		{
-			UINT numSrcDescriptors = descriptorTableCache[rootIndex].numDescriptors;
-			D3D12_CPU_DESCRIPTOR_HANDLE* srcDescriptorHandles = descriptorTableCache[rootIndex].baseDescriptor;
+			const descriptor_table_cache& table = descriptorTableCache[rootIndex];
+			D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = copyDescriptorTable(table.baseDescriptor, table.numDescriptors);
 
-			D3D12_CPU_DESCRIPTOR_HANDLE destDescriptorRangeStarts[] =
+			if constexpr (compute)
 			{
-				currentCPUDescriptorHandle
-			};
-			UINT destDescriptorRangeSizes[] =
+				d3d12CommandList->SetComputeRootDescriptorTable(rootIndex, gpuHandle);
+			}
+			else
 			{
-				numSrcDescriptors
-			};
+				d3d12CommandList->SetGraphicsRootDescriptorTable(rootIndex, gpuHandle);
+			}
 
-			device->CopyDescriptors(1, destDescriptorRangeStarts, destDescriptorRangeSizes,
-				numSrcDescriptors, srcDescriptorHandles, nullptr, descriptorHeapType);
+			staleDescriptorTableBitMask ^= (1 << rootIndex);
+		}
+	}
+}
 
-			setFunc(d3d12CommandList, rootIndex, currentGPUDescriptorHandle);
+D3D12_GPU_DESCRIPTOR_HANDLE dx_dynamic_descriptor_heap::copyDescriptorTable(const D3D12_CPU_DESCRIPTOR_HANDLE* srcDescriptorHandles, uint32 numSrcDescriptors)
+{
+	++stats.numCommittedTables;
 
-			currentCPUDescriptorHandle.Offset(numSrcDescriptors, descriptorHandleIncrementSize);
-			currentGPUDescriptorHandle.Offset(numSrcDescriptors, descriptorHandleIncrementSize);
-			numFreeHandles -= numSrcDescriptors;
+	size_t hash = numSrcDescriptors;
+	for (uint32 i = 0; i < numSrcDescriptors; ++i)
+	{
+		hash_combine(hash, srcDescriptorHandles[i].ptr);
+	}
 
-			staleDescriptorTableBitMask ^= (1 << rootIndex);
-		}
+	auto it = copiedTables.find(hash);
+	if (it != copiedTables.end() && it->second.numDescriptors == numSrcDescriptors
+		&& memcmp(&copiedTableHandles[it->second.firstHandle], srcDescriptorHandles, sizeof(D3D12_CPU_DESCRIPTOR_HANDLE) * numSrcDescriptors) == 0)
+	{
+		++stats.numReusedTables;
+		stats.numAvoidedDescriptorCopies += numSrcDescriptors;
+		return it->second.gpuHandle;
 	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE destDescriptorRangeStarts[] =
+	{
+		currentCPUDescriptorHandle
+	};
+	UINT destDescriptorRangeSizes[] =
+	{
+		numSrcDescriptors
+	};
+
+	device->CopyDescriptors(1, destDescriptorRangeStarts, destDescriptorRangeSizes,
+		numSrcDescriptors, srcDescriptorHandles, nullptr, descriptorHeapType);
+
+	D3D12_GPU_DESCRIPTOR_HANDLE result = currentGPUDescriptorHandle;
+
+	currentCPUDescriptorHandle.Offset(numSrcDescriptors, descriptorHandleIncrementSize);
+	currentGPUDescriptorHandle.Offset(numSrcDescriptors, descriptorHandleIncrementSize);
+	numFreeHandles -= numSrcDescriptors;
+
+	// On a hash collision the older table is simply replaced.
+	copied_table& entry = copiedTables[hash];
+	entry.firstHandle = (uint32)copiedTableHandles.size();
+	entry.numDescriptors = numSrcDescriptors;
+	entry.gpuHandle = result;
+	copiedTableHandles.insert(copiedTableHandles.end(), srcDescriptorHandles, srcDescriptorHandles + numSrcDescriptors);
+
+	++stats.numCopiedTables;
+	stats.numCopiedDescriptors += numSrcDescriptors;
+
+	return result;
 }
 
 void dx_dynamic_descriptor_heap::commitStagedDescriptorsForDraw(dx_command_list* commandList)
 {
-	commitStagedDescriptors(commandList, &ID3D12GraphicsCommandList::SetGraphicsRootDescriptorTable);
+	commitStagedDescriptors<false>(commandList);
 }
 
 void dx_dynamic_descriptor_heap::commitStagedDescriptorsForDispatch(dx_command_list* commandList)
 {
-	commitStagedDescriptors(commandList, &ID3D12GraphicsCommandList::SetComputeRootDescriptorTable);
+	commitStagedDescriptors<true>(commandList);
 }
 
 void dx_dynamic_descriptor_heap::setCurrentDescriptorHeap(dx_command_list* commandList)
@@ -109,17 +149,7 @@ D3D12_GPU_DESCRIPTOR_HANDLE dx_dynamic_descriptor_heap::copyDescriptor(dx_comman
 {
 	if (!currentDescriptorHeap || numFreeHandles < 1)
 	{
-		currentDescriptorHeap = requestDescriptorHeap();
-		currentCPUDescriptorHandle = currentDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-		currentGPUDescriptorHandle = currentDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-		numFreeHandles = numDescriptorsPerHeap;
-
-		comandList->setDescriptorHeap(descriptorHeapType, currentDescriptorHeap.Get());
-
-		// When updating the descriptor heap on the command list, all descriptor
-		// tables must be (re)recopied to the new descriptor heap (not just
-		// the stale descriptor tables).
-		staleDescriptorTableBitMask = descriptorTableBitMask;
+		switchToNewDescriptorHeap(comandList);
 	}
 
 	D3D12_GPU_DESCRIPTOR_HANDLE hGPU = currentGPUDescriptorHandle;
@@ -175,6 +205,48 @@ void dx_dynamic_descriptor_heap::reset()
 	{
 		descriptorTableCache[i].reset();
 	}
+
+	copiedTables.clear();
+	copiedTableHandles.clear();
+}
+
+void dx_dynamic_descriptor_heap::switchToNewDescriptorHeap(dx_command_list* commandList)
+{
+	currentDescriptorHeap = requestDescriptorHeap();
+	currentCPUDescriptorHandle = currentDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	currentGPUDescriptorHandle = currentDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+	numFreeHandles = numDescriptorsPerHeap;
+
+	commandList->setDescriptorHeap(descriptorHeapType, currentDescriptorHeap);
+
+	// When updating the descriptor heap on the command list, all descriptor
+	// tables must be (re)recopied to the new descriptor heap (not just
+	// the stale descriptor tables).
+	staleDescriptorTableBitMask = descriptorTableBitMask;
+
+	// Tables in the previous heap cannot be referenced anymore.
+	copiedTables.clear();
+	copiedTableHandles.clear();
+}
+
+void dx_dynamic_descriptor_heap::accumulateFrameStatistics(const descriptor_table_statistics& stats)
+{
+	frameCommittedTables += stats.numCommittedTables;
+	frameCopiedTables += stats.numCopiedTables;
+	frameCopiedDescriptors += stats.numCopiedDescriptors;
+	frameReusedTables += stats.numReusedTables;
+	frameAvoidedDescriptorCopies += stats.numAvoidedDescriptorCopies;
+}
+
+descriptor_table_statistics dx_dynamic_descriptor_heap::endFrame()
+{
+	descriptor_table_statistics result;
+	result.numCommittedTables = frameCommittedTables.exchange(0);
+	result.numCopiedTables = frameCopiedTables.exchange(0);
+	result.numCopiedDescriptors = frameCopiedDescriptors.exchange(0);
+	result.numReusedTables = frameReusedTables.exchange(0);
+	result.numAvoidedDescriptorCopies = frameAvoidedDescriptorCopies.exchange(0);
+	return result;
 }
 
 ComPtr<ID3D12DescriptorHeap> dx_dynamic_descriptor_heap::requestDescriptorHeap()
@@ -203,6 +275,7 @@ ComPtr<ID3D12DescriptorHeap> dx_dynamic_descriptor_heap::createDescriptorHeap()
 
 	ComPtr<ID3D12DescriptorHeap> descriptorHeap;
 	checkResult(device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&descriptorHeap)));
+	trackGPUMemory(descriptorHeap.Get(), (uint64)numDescriptorsPerHeap * device->GetDescriptorHandleIncrementSize(descriptorHeapType), memory_tag_descriptors);
 
 	return descriptorHeap;
 }
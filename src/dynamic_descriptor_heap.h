@@ -6,6 +6,20 @@
 class dx_command_list;
 struct dx_root_signature;
 
+struct descriptor_table_statistics
+{
+	uint32 numCommittedTables;
+	uint32 numCopiedTables;
+	uint32 numCopiedDescriptors;
+	uint32 numReusedTables; // Tables which were already copied to the current shader visible heap.
+	uint32 numAvoidedDescriptorCopies;
+};
+
+// Copies the descriptor tables staged by the command list into shader visible heaps.
+// Tables with the same sequence of CPU handles are only copied once per shader visible heap. The copies stay valid until
+// reset is called, i.e. until the command list is reset. This requires that descriptors are not overwritten in place
+// while a command list is being recorded, which holds as long as descriptors are only recycled through the
+// (frame deferred) dx_descriptor_allocator.
 class dx_dynamic_descriptor_heap
 {
 public:
@@ -24,14 +38,25 @@ public:
 
 	void reset();
 
+	const descriptor_table_statistics& getStatistics() const { return stats; }
+	void resetStatistics() { stats = {}; }
+
+	// Per frame statistics, accumulated over all command lists.
+	static void accumulateFrameStatistics(const descriptor_table_statistics& stats);
+	static descriptor_table_statistics endFrame();
+
 private:
 	ComPtr<ID3D12Device2> device;
 	ComPtr<ID3D12DescriptorHeap> requestDescriptorHeap();
 	ComPtr<ID3D12DescriptorHeap> createDescriptorHeap();
+	void switchToNewDescriptorHeap(dx_command_list* commandList);
 
 	uint32 computeStaleDescriptorCount() const;
 
-	void commitStagedDescriptors(dx_command_list* commandList, std::function<void(ID3D12GraphicsCommandList*, uint32, D3D12_GPU_DESCRIPTOR_HANDLE)> setFunc);
+	template <bool compute>
+	void commitStagedDescriptors(dx_command_list* commandList);
+
+	D3D12_GPU_DESCRIPTOR_HANDLE copyDescriptorTable(const D3D12_CPU_DESCRIPTOR_HANDLE* srcDescriptorHandles, uint32 numSrcDescriptors);
 
 	static const uint32 maxDescriptorTables = 32;
 
@@ -78,4 +103,23 @@ private:
 	CD3DX12_CPU_DESCRIPTOR_HANDLE currentCPUDescriptorHandle;
 
 	uint32 numFreeHandles;
+
+	struct copied_table
+	{
+		uint32 firstHandle; // Index into copiedTableHandles.
+		uint32 numDescriptors;
+		D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle;
+	};
+
+	// Tables copied to the current descriptor heap, by hash of their CPU handles.
+	std::unordered_map<uint64, copied_table> copiedTables;
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> copiedTableHandles;
+
+	descriptor_table_statistics stats = {};
+
+	static std::atomic_uint32_t frameCommittedTables;
+	static std::atomic_uint32_t frameCopiedTables;
+	static std::atomic_uint32_t frameCopiedDescriptors;
+	static std::atomic_uint32_t frameReusedTables;
+	static std::atomic_uint32_t frameAvoidedDescriptorCopies;
 };
@@ -0,0 +1,124 @@
+#include "pch.h"
+#include "fixed_step_simulation.h"
+#include "profiling.h"
+#include "scratch_arena.h"
+
+
+void fixed_step_simulation::initialize(float tickLength, std::function<void(uint64 tickIndex, float dt)> tick)
+{
+	assert(!isThreaded());
+
+	this->tickLength = tickLength;
+	this->tick = tick;
+	numTicks = 0;
+	inlineTime = 0.0;
+}
+
+void fixed_step_simulation::startThread()
+{
+	if (isThreaded())
+	{
+		return;
+	}
+
+	threadStartTime = inlineTime;
+	threadStart = std::chrono::high_resolution_clock::now();
+	running = true;
+	thread = std::thread([this]() { threadLoop(); });
+}
+
+void fixed_step_simulation::stopThread()
+{
+	if (!isThreaded())
+	{
+		return;
+	}
+
+	running = false;
+	thread.join();
+
+	inlineTime = threadStartTime + std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - threadStart).count();
+}
+
+void fixed_step_simulation::advance(float dt)
+{
+	if (isThreaded())
+	{
+		return;
+	}
+
+	runCommands();
+
+	inlineTime += dt;
+	while (getNumTicks() * (double)tickLength <= inlineTime)
+	{
+		runTick();
+	}
+}
+
+void fixed_step_simulation::submit(std::function<void()> command)
+{
+	commands.pushBack(std::move(command));
+}
+
+float fixed_step_simulation::getInterpolationFactor(uint64 numTicksInSnapshot) const
+{
+	if (numTicksInSnapshot == 0)
+	{
+		return 1.f;
+	}
+
+	double tickStart = (numTicksInSnapshot - 1) * (double)tickLength;
+	return clamp((float)((getCurrentTime() - tickStart) / tickLength), 0.f, 1.f);
+}
+
+void fixed_step_simulation::runCommands()
+{
+	std::function<void()> command;
+	while (commands.tryPop(command))
+	{
+		command();
+	}
+}
+
+void fixed_step_simulation::runTick()
+{
+	PROFILE_BLOCK("Simulation tick");
+
+	uint64 index = numTicks.load(std::memory_order_relaxed);
+	tick(index, tickLength);
+	numTicks.store(index + 1, std::memory_order_relaxed);
+}
+
+double fixed_step_simulation::getCurrentTime() const
+{
+	// Not isThreaded, because the thread object is only written by the main thread.
+	if (running.load(std::memory_order_relaxed))
+	{
+		return threadStartTime + std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - threadStart).count();
+	}
+	return inlineTime;
+}
+
+void fixed_step_simulation::threadLoop()
+{
+	while (running)
+	{
+		// The thread's scratch memory lives for one iteration.
+		getThreadScratchArena().reset();
+
+		runCommands();
+
+		// A tick is simulated as soon as the interval it ends starts, so its state is ready before the renderer needs it.
+		while (getNumTicks() * (double)tickLength <= getCurrentTime())
+		{
+			runTick();
+		}
+
+		double secondsToWait = getNumTicks() * (double)tickLength - getCurrentTime();
+		if (secondsToWait > 0.0)
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double>(secondsToWait));
+		}
+	}
+}
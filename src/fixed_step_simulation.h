@@ -0,0 +1,95 @@
+#pragma once
+
+#include "common.h"
+#include "thread_safe_queue.h"
+
+#include <thread>
+
+
+// Hands the newest state from one producer thread to one consumer thread without locks. There are three slots: the producer
+// fills its own and swaps it with the shared one when publishing, the consumer swaps the shared one with its own if that is
+// newer. Neither side ever waits, and the consumer's slot stays untouched until it acquires again. States the consumer did
+// not pick up in time are overwritten.
+template <typename T>
+struct snapshot_exchange
+{
+	// Only called by the producer.
+	T& getWriteSlot() { return slots[writeIndex]; }
+	void publish()
+	{
+		writeIndex = shared.exchange(writeIndex | SNAPSHOT_NEW_BIT, std::memory_order_acq_rel) & SNAPSHOT_INDEX_MASK;
+	}
+
+	// Only called by the consumer. Returns true, if a newer state has been published since the last call.
+	bool acquire()
+	{
+		if (!(shared.load(std::memory_order_relaxed) & SNAPSHOT_NEW_BIT))
+		{
+			return false;
+		}
+		readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & SNAPSHOT_INDEX_MASK;
+		return true;
+	}
+	const T& getReadSlot() const { return slots[readIndex]; }
+
+private:
+	static const uint32 SNAPSHOT_NEW_BIT = 4;
+	static const uint32 SNAPSHOT_INDEX_MASK = 3;
+
+	T slots[3] = {};
+	std::atomic_uint32_t shared = 1;
+	uint32 writeIndex = 0;
+	uint32 readIndex = 2;
+};
+
+// Advances a simulation in ticks of constant length, either inline from the main loop or on its own thread.
+//
+// The simulation always runs one tick ahead: at time t the newest tick is the first one ending after t, so the renderer can
+// interpolate between the last two ticks with getInterpolationFactor. After the tick with index i, the simulation is at
+// (i + 1) * tickLength. On the thread, the ticks are paced by the wall clock, and rendering and simulation overlap. Inline,
+// the time is the sum of the frame times passed to advance, so the result only depends on that sequence (record and replay
+// rely on this).
+//
+// The tick function must only touch simulation state and hand everything the renderer needs over with a snapshot_exchange.
+// Input reaches the simulation as commands, which run before the next tick on the thread which simulates.
+class fixed_step_simulation
+{
+public:
+	~fixed_step_simulation() { stopThread(); }
+
+	void initialize(float tickLength, std::function<void(uint64 tickIndex, float dt)> tick);
+
+	void startThread();
+	void stopThread();
+	bool isThreaded() const { return thread.joinable(); }
+
+	// Runs the pending commands and all ticks which are due. Does nothing while the thread runs.
+	void advance(float dt);
+
+	void submit(std::function<void()> command);
+
+	// Where the current time lies between the states after numTicksInSnapshot - 1 (0) and numTicksInSnapshot (1) ticks.
+	float getInterpolationFactor(uint64 numTicksInSnapshot) const;
+
+	uint64 getNumTicks() const { return numTicks.load(std::memory_order_relaxed); }
+	float getTickLength() const { return tickLength; }
+
+private:
+	void runCommands();
+	void runTick();
+	double getCurrentTime() const;
+	void threadLoop();
+
+	std::function<void(uint64, float)> tick;
+	float tickLength = 1.f / 60.f;
+
+	thread_safe_queue<std::function<void()>> commands;
+	std::atomic_uint64_t numTicks = 0;
+
+	double inlineTime = 0.0;
+
+	std::thread thread;
+	std::atomic_bool running = false;
+	std::chrono::high_resolution_clock::time_point threadStart;
+	double threadStartTime = 0.0; // Simulated time when the thread was started.
+};
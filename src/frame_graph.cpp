@@ -0,0 +1,893 @@
+#include "pch.h"
+#include "frame_graph.h"
+#include "command_list.h"
+#include "command_queue.h"
+#include "resource_state_tracker.h"
+#include "error.h"
+#include "memory_tracking.h"
+
+#include <pix3.h>
+#include <algorithm>
+
+
+static const uint32 invalidIndex = (uint32)-1;
+
+static bool isDiscardableState(D3D12_RESOURCE_STATES state)
+{
+	return state == D3D12_RESOURCE_STATE_RENDER_TARGET || state == D3D12_RESOURCE_STATE_DEPTH_WRITE || state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+}
+
+static bool isComputeQueueState(D3D12_RESOURCE_STATES state)
+{
+	const D3D12_RESOURCE_STATES computeStates = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_COPY_DEST |
+		D3D12_RESOURCE_STATE_COPY_SOURCE;
+	return (state & ~computeStates) == 0;
+}
+
+void frame_graph::initialize(ComPtr<ID3D12Device2> device)
+{
+	this->device = device;
+}
+
+void frame_graph::reset()
+{
+	resources.clear();
+	passes.clear();
+	executionOrder.clear();
+	finalBarriers.clear();
+	report = {};
+}
+
+frame_graph_resource frame_graph::createTexture(const char* name, const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue)
+{
+	resource_node node = {};
+	node.name = name;
+	node.desc = desc;
+	node.hasClearValue = clearValue != nullptr;
+	if (clearValue)
+	{
+		node.clearValue = *clearValue;
+	}
+	node.heapType = (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) ? heap_type_rt_ds : heap_type_non_rt_ds;
+	node.imported = false;
+
+	resources.push_back(node);
+	return frame_graph_resource{ (uint32)resources.size() - 1 };
+}
+
+frame_graph_resource frame_graph::importTexture(const char* name, dx_texture& texture, D3D12_RESOURCE_STATES finalState)
+{
+	resource_node node = {};
+	node.name = name;
+	node.imported = true;
+	node.importedTexture = &texture;
+	node.finalState = finalState;
+
+	resources.push_back(node);
+	return frame_graph_resource{ (uint32)resources.size() - 1 };
+}
+
+frame_graph_resource frame_graph::importResource(const char* name, ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES finalState)
+{
+	resource_node node = {};
+	node.name = name;
+	node.imported = true;
+	node.importedResource = resource;
+	node.finalState = finalState;
+
+	resources.push_back(node);
+	return frame_graph_resource{ (uint32)resources.size() - 1 };
+}
+
+frame_graph::pass_builder& frame_graph::addPass(const char* name, const frame_graph_execute_func& execute)
+{
+	pass_builder& pass = passes.emplace_back();
+	pass.name = name;
+	pass.execute = execute;
+	pass.queue = frame_graph_queue_graphics;
+	pass.sideEffects = false;
+	pass.culled = false;
+	return pass;
+}
+
+frame_graph::pass_builder& frame_graph::pass_builder::read(frame_graph_resource resource, D3D12_RESOURCE_STATES state)
+{
+	return access(resource, state, false);
+}
+
+frame_graph::pass_builder& frame_graph::pass_builder::write(frame_graph_resource resource, D3D12_RESOURCE_STATES state)
+{
+	return access(resource, state, true);
+}
+
+frame_graph::pass_builder& frame_graph::pass_builder::access(frame_graph_resource resource, D3D12_RESOURCE_STATES state, bool write)
+{
+	assert(resource.isValid());
+
+	for (resource_access& access : accesses)
+	{
+		if (access.resource == resource.index)
+		{
+			if (!write && !access.write && dx_resource_state_tracker::isReadOnlyState(access.state) && dx_resource_state_tracker::isReadOnlyState(state))
+			{
+				access.state |= state;
+			}
+			else
+			{
+				assert(access.state == state && "A pass can only use a resource in one state.");
+				access.write |= write;
+			}
+			return *this;
+		}
+	}
+
+	accesses.push_back({ resource.index, state, write });
+	return *this;
+}
+
+void frame_graph::compile()
+{
+	report = {};
+	report.numPasses = (uint32)passes.size();
+
+	cullPasses();
+
+	executionOrder.clear();
+	for (uint32 i = 0; i < (uint32)passes.size(); ++i)
+	{
+		if (!passes[i].culled)
+		{
+			executionOrder.push_back(i);
+		}
+	}
+	report.numCulledPasses = report.numPasses - (uint32)executionOrder.size();
+
+	for (uint32 passIndex : executionOrder)
+	{
+		pass_builder& pass = passes[passIndex];
+		if (pass.queue == frame_graph_queue_compute)
+		{
+			for (pass_builder::resource_access& access : pass.accesses)
+			{
+				if (access.state & D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+				{
+					access.state = (access.state & ~D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+				}
+				assert(access.state != D3D12_RESOURCE_STATE_COMMON && isComputeQueueState(access.state) && "State is not supported on the compute queue.");
+			}
+			++report.numAsyncComputePasses;
+		}
+	}
+
+	computeLifetimes();
+	planQueues();
+	planAliasing();
+	planBarriers();
+}
+
+void frame_graph::cullPasses()
+{
+	// Walk backwards from the outputs. A pass survives if it has side effects or touches a resource which a later surviving
+	// pass (or the outside world, for imported resources) needs.
+	std::vector<bool> needed(resources.size());
+	for (uint32 i = 0; i < (uint32)resources.size(); ++i)
+	{
+		needed[i] = resources[i].imported;
+	}
+
+	for (uint32 i = (uint32)passes.size(); i-- > 0;)
+	{
+		pass_builder& pass = passes[i];
+
+		pass.culled = !pass.sideEffects;
+		for (uint32 j = 0; j < (uint32)pass.accesses.size() && pass.culled; ++j)
+		{
+			const pass_builder::resource_access& access = pass.accesses[j];
+			pass.culled = !(access.write && needed[access.resource]);
+		}
+
+		if (!pass.culled)
+		{
+			for (const pass_builder::resource_access& access : pass.accesses)
+			{
+				needed[access.resource] = true;
+			}
+		}
+	}
+}
+
+void frame_graph::computeLifetimes()
+{
+	for (resource_node& node : resources)
+	{
+		node.firstUse = invalidIndex;
+		node.lastUse = invalidIndex;
+		node.usedOnCompute = false;
+	}
+
+	for (uint32 order = 0; order < (uint32)executionOrder.size(); ++order)
+	{
+		const pass_builder& pass = passes[executionOrder[order]];
+		for (const pass_builder::resource_access& access : pass.accesses)
+		{
+			resource_node& node = resources[access.resource];
+			if (node.firstUse == invalidIndex)
+			{
+				assert((node.imported || access.write) && "Transient texture is read before it is written.");
+				node.firstUse = order;
+			}
+			node.lastUse = order;
+			node.usedOnCompute |= pass.queue == frame_graph_queue_compute;
+		}
+	}
+
+	for (const resource_node& node : resources)
+	{
+		if (node.imported)
+		{
+			++report.numImportedResources;
+		}
+		else if (node.firstUse != invalidIndex)
+		{
+			++report.numTransientTextures;
+		}
+	}
+}
+
+void frame_graph::planQueues()
+{
+	uint32 numExecutedPasses = (uint32)executionOrder.size();
+
+	// A pass has to wait for the other queue if it uses a resource whose previous use was there. This includes reads after
+	// reads, since the resource is handed over in the COMMON state. Everything which is not used yet comes from the graphics
+	// queue: imported resources from the work submitted before the graph, transient textures from the previous frame.
+	// Dependencies are stored as levels: 0 is the work before the graph, pass i is i + 1. Queues execute in order, so a pass
+	// only needs to wait if its latest dependency is above the level its queue has already waited for.
+	std::vector<int64> waitLevels(numExecutedPasses, -1);
+	std::vector<bool> signals(numExecutedPasses, false);
+	{
+		std::vector<frame_graph_queue> previousQueues(resources.size(), frame_graph_queue_graphics);
+		std::vector<int64> previousLevels(resources.size(), 0);
+		int64 waitedLevels[frame_graph_queue_count] = { -1, -1 };
+
+		for (uint32 order = 0; order < numExecutedPasses; ++order)
+		{
+			const pass_builder& pass = passes[executionOrder[order]];
+
+			int64 level = -1;
+			for (const pass_builder::resource_access& access : pass.accesses)
+			{
+				if (previousQueues[access.resource] != pass.queue)
+				{
+					level = max(level, previousLevels[access.resource]);
+				}
+				previousQueues[access.resource] = pass.queue;
+				previousLevels[access.resource] = order + 1;
+			}
+
+			if (level > waitedLevels[pass.queue])
+			{
+				waitLevels[order] = level;
+				waitedLevels[pass.queue] = level;
+				if (level > 0)
+				{
+					signals[level - 1] = true;
+				}
+			}
+		}
+	}
+
+	// Each queue's passes are split into segments, which start at a wait and end at a signal.
+	segments.clear();
+	passSegments.assign(numExecutedPasses, invalidIndex);
+
+	uint32 currentSegments[frame_graph_queue_count] = { invalidIndex, invalidIndex };
+	for (uint32 order = 0; order < numExecutedPasses; ++order)
+	{
+		frame_graph_queue queue = passes[executionOrder[order]].queue;
+		int64 level = waitLevels[order];
+
+		if (currentSegments[queue] == invalidIndex || level >= 0)
+		{
+			queue_segment& segment = segments.emplace_back();
+			segment.queue = queue;
+			segment.waitsForGraphicsBeforeGraph = level == 0;
+			segment.wait = (level > 0) ? passSegments[level - 1] : invalidIndex;
+			segment.waitedOn = false;
+			currentSegments[queue] = (uint32)segments.size() - 1;
+		}
+
+		passSegments[order] = currentSegments[queue];
+		segments[currentSegments[queue]].lastPass = order;
+
+		if (signals[order])
+		{
+			currentSegments[queue] = invalidIndex;
+		}
+	}
+
+	uint32 firstGraphicsSegment = invalidIndex;
+	executeBeforeGraph = false;
+	for (uint32 i = 0; i < frame_graph_queue_count; ++i)
+	{
+		lastSegments[i] = invalidIndex;
+	}
+	for (uint32 i = 0; i < (uint32)segments.size(); ++i)
+	{
+		const queue_segment& segment = segments[i];
+		if (segment.queue == frame_graph_queue_graphics && firstGraphicsSegment == invalidIndex)
+		{
+			firstGraphicsSegment = i;
+		}
+		lastSegments[segment.queue] = i;
+		executeBeforeGraph |= segment.waitsForGraphicsBeforeGraph;
+
+		if (segment.wait != invalidIndex)
+		{
+			segments[segment.wait].waitedOn = true;
+		}
+		if (segment.wait != invalidIndex || segment.waitsForGraphicsBeforeGraph)
+		{
+			++report.numCrossQueueWaits;
+		}
+	}
+
+	// The next frame's graphics work must not start before all compute work of this frame is done. This is implicit if a
+	// graphics pass already waited for the last compute segment.
+	joinComputeQueue = lastSegments[frame_graph_queue_compute] != invalidIndex;
+	for (const queue_segment& segment : segments)
+	{
+		if (segment.queue == frame_graph_queue_graphics && segment.wait == lastSegments[frame_graph_queue_compute])
+		{
+			joinComputeQueue = false;
+		}
+	}
+
+	// The last graphics segment is returned open, unless the final barriers have to wait for the compute queue, or a compute
+	// segment waits for it (e.g. async compute reading the last graphics pass's output).
+	uint32 lastGraphicsSegment = lastSegments[frame_graph_queue_graphics];
+	newFinalList = joinComputeQueue || (lastGraphicsSegment != invalidIndex && segments[lastGraphicsSegment].waitedOn);
+
+	// The first graphics segment is recorded into the list passed to execute, unless that list has to be executed before.
+	bool firstSegmentUsesGivenList = firstGraphicsSegment != invalidIndex && !executeBeforeGraph && segments[firstGraphicsSegment].wait == invalidIndex;
+	report.numCommandLists = (uint32)segments.size() + (firstSegmentUsesGivenList ? 0 : 1) + (newFinalList ? 1 : 0);
+	report.numCrossQueueWaits += joinComputeQueue ? 1 : 0;
+}
+
+void frame_graph::getAllocationInfo(resource_node& node)
+{
+	if (device)
+	{
+		D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &node.desc);
+		node.size = info.SizeInBytes;
+		node.alignment = info.Alignment;
+	}
+	else
+	{
+		// Rough estimate for checking the plan without a device: Linear layout, padded to the default placement alignment.
+		const D3D12_RESOURCE_DESC& desc = node.desc;
+
+		uint32 numMips = desc.MipLevels;
+		if (numMips == 0)
+		{
+			uint64 maxDimension = max(desc.Width, (uint64)desc.Height);
+			while ((maxDimension >> numMips) > 0)
+			{
+				++numMips;
+			}
+		}
+
+		uint64 formatSize = dx_texture::getFormatSize(desc.Format);
+		uint64 size = 0;
+		for (uint32 mip = 0; mip < numMips; ++mip)
+		{
+			uint64 width = max(desc.Width >> mip, (uint64)1);
+			uint64 height = max((uint64)desc.Height >> mip, (uint64)1);
+			size += width * height * formatSize;
+		}
+		size *= desc.DepthOrArraySize;
+
+		node.alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		node.size = alignTo(size, node.alignment);
+	}
+}
+
+void frame_graph::planAliasing()
+{
+	// Largest textures are placed first. Each texture goes into the lowest gap of its heap, which is not used by any texture
+	// whose lifetime overlaps its own.
+	std::vector<uint32> transients;
+	for (uint32 i = 0; i < (uint32)resources.size(); ++i)
+	{
+		resource_node& node = resources[i];
+		if (!node.imported && node.firstUse != invalidIndex)
+		{
+			getAllocationInfo(node);
+			transients.push_back(i);
+
+			report.unaliasedSizeInBytes += node.size;
+		}
+	}
+
+	std::sort(transients.begin(), transients.end(), [this](uint32 a, uint32 b)
+	{
+		const resource_node& nodeA = resources[a];
+		const resource_node& nodeB = resources[b];
+		if (nodeA.heapType != nodeB.heapType) { return nodeA.heapType < nodeB.heapType; }
+		if (nodeA.size != nodeB.size) { return nodeA.size > nodeB.size; }
+		return nodeA.firstUse < nodeB.firstUse;
+	});
+
+	for (uint32 i = 0; i < heap_type_count; ++i)
+	{
+		heapSizes[i] = 0;
+	}
+
+	std::vector<uint32> overlapping;
+	for (uint32 i = 0; i < (uint32)transients.size(); ++i)
+	{
+		resource_node& node = resources[transients[i]];
+
+		// All textures placed so far with the same heap type come before this one. Textures used on the compute queue overlap
+		// with everything.
+		overlapping.clear();
+		for (uint32 j = 0; j < i; ++j)
+		{
+			const resource_node& other = resources[transients[j]];
+			bool overlap = node.usedOnCompute || other.usedOnCompute || (other.firstUse <= node.lastUse && node.firstUse <= other.lastUse);
+			if (other.heapType == node.heapType && overlap)
+			{
+				overlapping.push_back(transients[j]);
+			}
+		}
+
+		std::sort(overlapping.begin(), overlapping.end(), [this](uint32 a, uint32 b)
+		{
+			return resources[a].heapOffset < resources[b].heapOffset;
+		});
+
+		uint64 offset = 0;
+		for (uint32 other : overlapping)
+		{
+			const resource_node& otherNode = resources[other];
+			if (alignTo(offset, node.alignment) + node.size <= otherNode.heapOffset)
+			{
+				break;
+			}
+			offset = max(offset, otherNode.heapOffset + otherNode.size);
+		}
+
+		node.heapOffset = alignTo(offset, node.alignment);
+		heapSizes[node.heapType] = max(heapSizes[node.heapType], node.heapOffset + node.size);
+	}
+
+	for (uint32 i = 0; i < heap_type_count; ++i)
+	{
+		report.aliasedSizeInBytes += heapSizes[i];
+	}
+
+	// The heaps are reused every frame, so any texture sharing memory with another one must be activated with an aliasing
+	// barrier, even if the other one is only used after it.
+	for (uint32 a : transients)
+	{
+		resource_node& node = resources[a];
+		node.aliased = false;
+		for (uint32 b : transients)
+		{
+			const resource_node& other = resources[b];
+			if (a != b && other.heapType == node.heapType &&
+				other.heapOffset < node.heapOffset + node.size && node.heapOffset < other.heapOffset + other.size)
+			{
+				node.aliased = true;
+				break;
+			}
+		}
+	}
+}
+
+void frame_graph::planBarriers()
+{
+	uint32 numExecutedPasses = (uint32)executionOrder.size();
+
+	barriersBefore.resize(max(numExecutedPasses, (uint32)barriersBefore.size()));
+	barriersAfter.resize(max(numExecutedPasses, (uint32)barriersAfter.size()));
+	for (uint32 i = 0; i < numExecutedPasses; ++i)
+	{
+		barriersBefore[i].clear();
+		barriersAfter[i].clear();
+	}
+
+	// The real states are known to the resource state tracker. These are only the states the graph asked for, to avoid
+	// redundant transitions and to know where to start split barriers.
+	const D3D12_RESOURCE_STATES unknownState = (D3D12_RESOURCE_STATES)-1;
+	std::vector<D3D12_RESOURCE_STATES> currentStates(resources.size(), unknownState);
+	std::vector<uint32> previousUses(resources.size(), invalidIndex);
+
+	auto queueOf = [this](uint32 order)
+	{
+		return passes[executionOrder[order]].queue;
+	};
+
+	auto transition = [&](uint32 resource, D3D12_RESOURCE_STATES state, uint32 order, uint32 segment, std::vector<planned_barrier>& outBarriers)
+	{
+		D3D12_RESOURCE_STATES currentState = currentStates[resource];
+		bool covered = currentState == state ||
+			(currentState != unknownState && dx_resource_state_tracker::isReadOnlyState(currentState) &&
+				dx_resource_state_tracker::isReadOnlyState(state) && (currentState & state) == state);
+		if (covered)
+		{
+			return;
+		}
+
+		// Start the transition right after the previous use, if there are other passes in between to hide it behind. Split
+		// barriers are kept within one command list.
+		uint32 previousUse = previousUses[resource];
+		if (previousUse != invalidIndex && previousUse + 1 < order && passSegments[previousUse] == segment)
+		{
+			barriersAfter[previousUse].push_back({ barrier_type_begin_transition, resource, state });
+			++report.numSplitBarriers;
+		}
+
+		outBarriers.push_back({ barrier_type_transition, resource, state });
+		++report.numTransitions;
+		currentStates[resource] = state;
+	};
+
+	// Hands the resource over to the other queue. The previous queue transitions it to COMMON after its last use there.
+	auto release = [&](uint32 resource)
+	{
+		uint32 previousUse = previousUses[resource];
+		transition(resource, D3D12_RESOURCE_STATE_COMMON, previousUse + 1, passSegments[previousUse], barriersAfter[previousUse]);
+		++report.numQueueTransfers;
+	};
+
+	for (uint32 order = 0; order < numExecutedPasses; ++order)
+	{
+		const pass_builder& pass = passes[executionOrder[order]];
+		std::vector<planned_barrier>& before = barriersBefore[order];
+
+		for (const pass_builder::resource_access& access : pass.accesses)
+		{
+			resource_node& node = resources[access.resource];
+			D3D12_RESOURCE_STATES state = access.state;
+
+			if (previousUses[access.resource] != invalidIndex && queueOf(previousUses[access.resource]) != pass.queue)
+			{
+				release(access.resource);
+			}
+
+			// Reads in the following passes on the same queue are combined into one state, so that the resource does not
+			// bounce between them.
+			if (!access.write && dx_resource_state_tracker::isReadOnlyState(state))
+			{
+				bool done = false;
+				for (uint32 next = order + 1; next < numExecutedPasses && !done; ++next)
+				{
+					for (const pass_builder::resource_access& nextAccess : passes[executionOrder[next]].accesses)
+					{
+						if (nextAccess.resource == access.resource)
+						{
+							if (nextAccess.write || !dx_resource_state_tracker::isReadOnlyState(nextAccess.state) || queueOf(next) != pass.queue)
+							{
+								done = true;
+							}
+							else
+							{
+								state |= nextAccess.state;
+							}
+							break;
+						}
+					}
+				}
+			}
+
+			bool firstUseOfTransient = !node.imported && node.firstUse == order;
+			if (firstUseOfTransient && node.aliased)
+			{
+				before.push_back({ barrier_type_aliasing, access.resource, state });
+				++report.numAliasingBarriers;
+			}
+
+			transition(access.resource, state, order, passSegments[order], before);
+
+			if (firstUseOfTransient && isDiscardableState(state))
+			{
+				before.push_back({ barrier_type_discard, access.resource, state });
+			}
+
+			previousUses[access.resource] = order;
+		}
+	}
+
+	// Final barriers are recorded on the graphics queue. Resources used on the compute queue always end up in COMMON, so that
+	// either queue can pick them up in the next frame.
+	uint32 finalSegment = newFinalList ? invalidIndex : lastSegments[frame_graph_queue_graphics];
+	finalBarriers.clear();
+	for (uint32 i = 0; i < (uint32)resources.size(); ++i)
+	{
+		const resource_node& node = resources[i];
+		if (node.firstUse == invalidIndex)
+		{
+			continue;
+		}
+
+		D3D12_RESOURCE_STATES finalState = node.imported ? node.finalState : unknownState;
+		if (node.usedOnCompute)
+		{
+			assert((finalState == unknownState || finalState == D3D12_RESOURCE_STATE_COMMON) && "Resources used on the compute queue end in the COMMON state.");
+			finalState = D3D12_RESOURCE_STATE_COMMON;
+
+			if (queueOf(node.lastUse) == frame_graph_queue_compute)
+			{
+				release(i);
+				continue;
+			}
+		}
+
+		if (finalState != unknownState)
+		{
+			transition(i, finalState, numExecutedPasses, finalSegment, finalBarriers);
+		}
+	}
+}
+
+void frame_graph::realizeTransientTextures()
+{
+	bool flushed = false;
+	auto flushOnce = [&flushed]()
+	{
+		// Heaps and placed textures are only replaced when the plan changes (e.g. on resize), so simply waiting for the GPU is fine.
+		if (!flushed)
+		{
+			dx_command_queue::renderCommandQueue.flush();
+			flushed = true;
+		}
+	};
+
+	for (physical_texture& physical : physicalTextures)
+	{
+		physical.used = false;
+	}
+
+	for (uint32 i = 0; i < heap_type_count; ++i)
+	{
+		if (heapSizes[i] > heaps[i].size)
+		{
+			flushOnce();
+
+			// All textures in the old heap go away with it.
+			for (const physical_texture& physical : physicalTextures)
+			{
+				if (physical.heapType == i)
+				{
+					dx_resource_state_tracker::removeGlobalResourceState(physical.texture->resource.Get());
+				}
+			}
+			physicalTextures.erase(std::remove_if(physicalTextures.begin(), physicalTextures.end(),
+				[i](const physical_texture& physical) { return physical.heapType == i; }), physicalTextures.end());
+
+			D3D12_HEAP_DESC heapDesc = {};
+			heapDesc.SizeInBytes = heapSizes[i];
+			heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+			heapDesc.Flags = (i == heap_type_rt_ds) ? D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES : D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+			heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+			heapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+			heapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+			heaps[i].heap.Reset();
+			checkResult(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heaps[i].heap)));
+			heaps[i].size = heapSizes[i];
+
+			// The transient textures alias each other inside the heap, so the heap is counted instead of the textures.
+			trackGPUMemory(heaps[i].heap.Get(), heapSizes[i], memory_tag_render_targets);
+		}
+	}
+
+	// Reuse the placed textures of the last frames, if they have the same description and location.
+	for (resource_node& node : resources)
+	{
+		node.texture = nullptr;
+		if (node.imported || node.firstUse == invalidIndex)
+		{
+			continue;
+		}
+
+		for (physical_texture& physical : physicalTextures)
+		{
+			if (!physical.used && physical.heapType == node.heapType && physical.heapOffset == node.heapOffset &&
+				memcmp(&physical.desc, &node.desc, sizeof(D3D12_RESOURCE_DESC)) == 0 &&
+				physical.hasClearValue == node.hasClearValue &&
+				(!node.hasClearValue || memcmp(&physical.clearValue, &node.clearValue, sizeof(D3D12_CLEAR_VALUE)) == 0))
+			{
+				physical.used = true;
+				node.texture = physical.texture.get();
+				break;
+			}
+		}
+	}
+
+	// Textures which are not part of the plan anymore.
+	auto unused = std::remove_if(physicalTextures.begin(), physicalTextures.end(), [](const physical_texture& physical) { return !physical.used; });
+	if (unused != physicalTextures.end())
+	{
+		flushOnce();
+		for (auto it = unused; it != physicalTextures.end(); ++it)
+		{
+			dx_resource_state_tracker::removeGlobalResourceState(it->texture->resource.Get());
+		}
+		physicalTextures.erase(unused, physicalTextures.end());
+	}
+
+	for (resource_node& node : resources)
+	{
+		if (node.imported || node.firstUse == invalidIndex || node.texture)
+		{
+			continue;
+		}
+
+		D3D12_RESOURCE_DESC desc = node.desc;
+		if (dx_texture::isDepthFormat(desc.Format))
+		{
+			desc.Format = dx_texture::getTypelessFormat(desc.Format);
+		}
+
+		ComPtr<ID3D12Resource> resource;
+		checkResult(device->CreatePlacedResource(heaps[node.heapType].heap.Get(), node.heapOffset, &desc,
+			D3D12_RESOURCE_STATE_COMMON, node.hasClearValue ? &node.clearValue : nullptr, IID_PPV_ARGS(&resource)));
+
+		physical_texture& physical = physicalTextures.emplace_back();
+		physical.desc = node.desc;
+		physical.clearValue = node.clearValue;
+		physical.hasClearValue = node.hasClearValue;
+		physical.heapType = node.heapType;
+		physical.heapOffset = node.heapOffset;
+		physical.used = true;
+		physical.texture = std::make_unique<dx_texture>();
+		physical.texture->initialize(device, resource);
+
+		node.texture = physical.texture.get();
+	}
+}
+
+void frame_graph::recordBarriers(dx_command_list* commandList, const std::vector<planned_barrier>& barriers)
+{
+	for (const planned_barrier& barrier : barriers)
+	{
+		resource_node& node = resources[barrier.resource];
+		dx_texture* texture = node.imported ? node.importedTexture : node.texture;
+
+		switch (barrier.type)
+		{
+			case barrier_type_transition:
+			{
+				if (texture)
+				{
+					commandList->transitionBarrier(*texture, barrier.state);
+				}
+				else
+				{
+					commandList->transitionBarrier(node.importedResource, barrier.state);
+				}
+			} break;
+			case barrier_type_begin_transition:
+			{
+				if (texture)
+				{
+					commandList->beginTransitionBarrier(*texture, barrier.state);
+				}
+				else
+				{
+					commandList->beginTransitionBarrier(node.importedResource, barrier.state);
+				}
+			} break;
+			case barrier_type_aliasing:
+			{
+				// Null before-resource, since any of the textures sharing this memory might have been active.
+				commandList->aliasingBarrier(nullptr, texture->resource);
+			} break;
+			case barrier_type_discard:
+			{
+				commandList->discardResource(*texture);
+			} break;
+		}
+	}
+}
+
+dx_command_list* frame_graph::execute(dx_command_list* commandList)
+{
+	assert(device && "Frame graph needs a device for execution.");
+
+	realizeTransientTextures();
+
+	dx_command_queue* queues[frame_graph_queue_count] = { &dx_command_queue::renderCommandQueue, &dx_command_queue::computeCommandQueue };
+	dx_command_list* lists[frame_graph_queue_count] = { commandList, nullptr };
+	uint32 currentSegments[frame_graph_queue_count] = { invalidIndex, invalidIndex };
+
+	segmentFenceValues.assign(segments.size(), 0);
+
+	if (executeBeforeGraph)
+	{
+		queues[frame_graph_queue_graphics]->executeCommandList(commandList);
+		queues[frame_graph_queue_compute]->waitForOtherQueue(*queues[frame_graph_queue_graphics]);
+		lists[frame_graph_queue_graphics] = nullptr;
+	}
+
+	for (uint32 order = 0; order < (uint32)executionOrder.size(); ++order)
+	{
+		pass_builder& pass = passes[executionOrder[order]];
+
+		uint32 segmentIndex = passSegments[order];
+		const queue_segment& segment = segments[segmentIndex];
+		frame_graph_queue queue = segment.queue;
+		frame_graph_queue otherQueue = (queue == frame_graph_queue_graphics) ? frame_graph_queue_compute : frame_graph_queue_graphics;
+
+		if (currentSegments[queue] != segmentIndex)
+		{
+			// Only the first graphics segment can find an open list here, the one passed in. Work recorded into it before
+			// the graph should not wait.
+			if (lists[queue] && segment.wait != invalidIndex)
+			{
+				queues[queue]->executeCommandList(lists[queue]);
+				lists[queue] = nullptr;
+			}
+			if (segment.wait != invalidIndex)
+			{
+				assert(segmentFenceValues[segment.wait] != 0 && "Segment waits for a segment which has not been executed.");
+				queues[queue]->waitForOtherQueue(*queues[otherQueue], segmentFenceValues[segment.wait]);
+			}
+			if (!lists[queue])
+			{
+				lists[queue] = queues[queue]->getAvailableCommandList(command_allocator_size_medium);
+			}
+			currentSegments[queue] = segmentIndex;
+		}
+
+		dx_command_list* list = lists[queue];
+
+		recordBarriers(list, barriersBefore[order]);
+
+		{
+			PIXScopedEvent(list->getD3D12CommandList().Get(), PIX_COLOR(0, 128, 255), pass.name);
+			pass.execute(list, *this);
+		}
+
+		recordBarriers(list, barriersAfter[order]);
+
+		// The last graphics segment stays open, unless the compute queue waits for it.
+		if (order == segment.lastPass && (segmentIndex != lastSegments[frame_graph_queue_graphics] || segment.waitedOn))
+		{
+			segmentFenceValues[segmentIndex] = queues[queue]->executeCommandList(list);
+			lists[queue] = nullptr;
+		}
+	}
+
+	dx_command_list* graphicsList = lists[frame_graph_queue_graphics];
+	if (joinComputeQueue)
+	{
+		if (graphicsList)
+		{
+			queues[frame_graph_queue_graphics]->executeCommandList(graphicsList);
+		}
+		assert(segmentFenceValues[lastSegments[frame_graph_queue_compute]] != 0);
+		queues[frame_graph_queue_graphics]->waitForOtherQueue(*queues[frame_graph_queue_compute],
+			segmentFenceValues[lastSegments[frame_graph_queue_compute]]);
+		graphicsList = nullptr;
+	}
+	if (!graphicsList)
+	{
+		graphicsList = queues[frame_graph_queue_graphics]->getAvailableCommandList(command_allocator_size_medium);
+	}
+
+	recordBarriers(graphicsList, finalBarriers);
+
+	return graphicsList;
+}
+
+dx_texture& frame_graph::getTexture(frame_graph_resource resource)
+{
+	resource_node& node = resources[resource.index];
+	dx_texture* texture = node.imported ? node.importedTexture : node.texture;
+	assert(texture && "Resource is not a texture, or not used by any pass.");
+	return *texture;
+}
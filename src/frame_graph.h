@@ -0,0 +1,246 @@
+#pragma once
+
+#include "common.h"
+#include "texture.h"
+
+#include <memory>
+
+class dx_command_list;
+class frame_graph;
+
+struct frame_graph_resource
+{
+	uint32 index = (uint32)-1;
+
+	bool isValid() const { return index != (uint32)-1; }
+};
+
+enum frame_graph_queue
+{
+	frame_graph_queue_graphics,
+	frame_graph_queue_compute,
+
+	frame_graph_queue_count,
+};
+
+struct frame_graph_report
+{
+	uint32 numPasses;
+	uint32 numCulledPasses;
+	uint32 numAsyncComputePasses;
+	uint32 numTransientTextures;
+	uint32 numImportedResources;
+
+	uint32 numCommandLists;		// Including the one passed to execute.
+	uint32 numCrossQueueWaits;
+	uint32 numQueueTransfers;	// Resources handed from one queue to the other.
+
+	uint32 numTransitions;
+	uint32 numSplitBarriers;
+	uint32 numAliasingBarriers;
+
+	// Memory of the transient textures, if each had its own allocation, and the size of the heaps they are aliased in.
+	uint64 unaliasedSizeInBytes;
+	uint64 aliasedSizeInBytes;
+};
+
+typedef std::function<void(dx_command_list* commandList, frame_graph& graph)> frame_graph_execute_func;
+
+// Passes declare which resources they read and write, and in which state. The graph is rebuilt every frame:
+//  - reset(),
+//  - create transient textures and import persistent resources,
+//  - add passes in the order they should execute. A pass sees the writes of all passes added before it,
+//  - compile(), which culls passes whose results are never used, plans the barriers and places the transient textures,
+//  - execute().
+// Passes marked as async compute run on the compute queue, overlapping with the graphics passes around them. The graph
+// splits each queue's passes into command lists wherever one queue has to wait for the other, which is the case whenever
+// a resource is used on one queue after it was last used on the other. Such resources are handed over in the COMMON state,
+// since the compute queue cannot transition from or to graphics-only states. Imported resources are assumed to come from
+// the graphics queue, so the first async compute pass which uses one waits for all graphics work submitted before execute.
+// Transient textures used by async compute passes are never aliased, since their lifetimes are not ordered with respect
+// to the graphics queue.
+// Transient textures only live between their first and last use in a frame. Textures with disjoint lifetimes share memory
+// in placed heaps. The first pass which uses a transient texture must write all of it (clear or overwrite); render targets,
+// depth buffers and UAVs are discarded before that pass.
+// Compilation does not touch the GPU. Without a device, allocation sizes are estimated from the descriptions, so the graph
+// and its aliasing plan can be checked on the CPU alone (see frame_graph_tests.cpp and benchmarkFrameGraphCompilation).
+class frame_graph
+{
+public:
+	struct pass_builder
+	{
+		pass_builder& read(frame_graph_resource resource,
+			D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+		// Writes are treated as read-modify-write, so earlier writers of the resource are kept as long as this pass is.
+		pass_builder& write(frame_graph_resource resource, D3D12_RESOURCE_STATES state);
+
+		// Passes with side effects (e.g. writes to resources the graph does not know about) are never culled.
+		pass_builder& setSideEffects() { sideEffects = true; return *this; }
+
+		// Only dispatches and copies. Read states are restricted to NON_PIXEL_SHADER_RESOURCE automatically.
+		pass_builder& setAsyncCompute() { queue = frame_graph_queue_compute; return *this; }
+
+	private:
+		friend class frame_graph;
+		friend struct frame_graph_test_access;
+
+		pass_builder& access(frame_graph_resource resource, D3D12_RESOURCE_STATES state, bool write);
+
+		struct resource_access
+		{
+			uint32 resource;
+			D3D12_RESOURCE_STATES state;
+			bool write;
+		};
+
+		const char* name;
+		frame_graph_execute_func execute;
+		std::vector<resource_access> accesses;
+		frame_graph_queue queue;
+		bool sideEffects;
+		bool culled;
+	};
+
+	void initialize(ComPtr<ID3D12Device2> device);
+
+	void reset();
+
+	frame_graph_resource createTexture(const char* name, const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue = nullptr);
+
+	// Imported resources live outside of the graph. They are always considered outputs, so passes writing them are never culled.
+	// If a final state is given, the resource is transitioned to it at the end of the graph.
+	frame_graph_resource importTexture(const char* name, dx_texture& texture, D3D12_RESOURCE_STATES finalState = (D3D12_RESOURCE_STATES)-1);
+	frame_graph_resource importResource(const char* name, ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES finalState = (D3D12_RESOURCE_STATES)-1);
+
+	// The returned reference is valid until the next call to addPass.
+	pass_builder& addPass(const char* name, const frame_graph_execute_func& execute);
+
+	void compile();
+
+	// The graphics passes are recorded into the given list, which may already contain other work. If the graph needs more
+	// than one graphics list, the earlier ones are executed by the graph, and the returned list is the one the caller has
+	// to continue with and execute. Async compute lists are always executed by the graph.
+	dx_command_list* execute(dx_command_list* commandList);
+
+	// Only valid during execute.
+	dx_texture& getTexture(frame_graph_resource resource);
+
+	const frame_graph_report& getReport() const { return report; }
+
+private:
+	// Inspects the plan of compiled graphs (frame_graph_tests.cpp).
+	friend struct frame_graph_test_access;
+
+	enum heap_type
+	{
+		heap_type_rt_ds,
+		heap_type_non_rt_ds,
+
+		heap_type_count,
+	};
+
+	enum barrier_type
+	{
+		barrier_type_transition,
+		barrier_type_begin_transition,
+		barrier_type_aliasing,
+		barrier_type_discard,
+	};
+
+	struct planned_barrier
+	{
+		barrier_type type;
+		uint32 resource;
+		D3D12_RESOURCE_STATES state;
+	};
+
+	struct resource_node
+	{
+		const char* name;
+
+		// Transient.
+		D3D12_RESOURCE_DESC desc;
+		D3D12_CLEAR_VALUE clearValue;
+		bool hasClearValue;
+		heap_type heapType;
+		uint64 size;
+		uint64 alignment;
+		uint64 heapOffset;
+		bool aliased;		// Shares memory with other transient textures.
+		uint32 firstUse;	// Index into executionOrder. Invalid if the resource is not used by any remaining pass.
+		uint32 lastUse;
+		bool usedOnCompute;
+		dx_texture* texture;
+
+		// Imported.
+		bool imported;
+		dx_texture* importedTexture;
+		ComPtr<ID3D12Resource> importedResource;
+		D3D12_RESOURCE_STATES finalState;
+	};
+
+	// Placed textures, which are reused across frames as long as the aliasing plan does not change.
+	struct physical_texture
+	{
+		D3D12_RESOURCE_DESC desc;
+		D3D12_CLEAR_VALUE clearValue;
+		bool hasClearValue;
+		heap_type heapType;
+		uint64 heapOffset;
+		bool used;
+
+		std::unique_ptr<dx_texture> texture;
+	};
+
+	struct transient_heap
+	{
+		ComPtr<ID3D12Heap> heap;
+		uint64 size = 0;
+	};
+
+	// Passes of one queue which go into the same command list.
+	struct queue_segment
+	{
+		frame_graph_queue queue;
+		uint32 lastPass;			// Index into executionOrder. The list is executed after this pass has been recorded.
+		uint32 wait;				// Segment of the other queue, which must have completed before this one starts. May be invalid.
+		bool waitsForGraphicsBeforeGraph;
+		bool waitedOn;				// A segment of the other queue waits for this one, so it has to be executed by the graph.
+	};
+
+	void cullPasses();
+	void computeLifetimes();
+	void planQueues();
+	void planAliasing();
+	void planBarriers();
+
+	void getAllocationInfo(resource_node& node);
+	void realizeTransientTextures();
+	void recordBarriers(dx_command_list* commandList, const std::vector<planned_barrier>& barriers);
+
+	ComPtr<ID3D12Device2> device;
+
+	std::vector<resource_node> resources;
+	std::vector<pass_builder> passes;
+	std::vector<uint32> executionOrder;
+
+	// Indexed like executionOrder.
+	std::vector<std::vector<planned_barrier>> barriersBefore;
+	std::vector<std::vector<planned_barrier>> barriersAfter;
+	std::vector<planned_barrier> finalBarriers;
+
+	std::vector<queue_segment> segments;
+	std::vector<uint32> passSegments;	// Indexed like executionOrder.
+	std::vector<uint64> segmentFenceValues;	// Zero for segments which have not been executed yet this frame.
+	uint32 lastSegments[frame_graph_queue_count];
+	bool executeBeforeGraph;			// The list passed to execute must be executed before the first compute segment.
+	bool joinComputeQueue;				// The final barriers have to wait for the last compute segment.
+	bool newFinalList;					// The last graphics segment is executed by the graph, so the final barriers go into a new list.
+
+	uint64 heapSizes[heap_type_count] = {};
+	frame_graph_report report = {};
+
+	std::vector<physical_texture> physicalTextures;
+	transient_heap heaps[heap_type_count];
+};
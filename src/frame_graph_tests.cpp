@@ -0,0 +1,344 @@
+#include "pch.h"
+#include "tests.h"
+#include "frame_graph.h"
+
+
+// The graphs are only compiled, never executed, so no device is needed. Allocation sizes are then estimated from the
+// descriptions (linear layout, padded to 64 KB).
+
+static const uint32 invalidIndex = (uint32)-1;
+
+static const D3D12_RESOURCE_STATES srv = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+struct frame_graph_test_access
+{
+	static uint32 getNumSegments(const frame_graph& graph)
+	{
+		return (uint32)graph.segments.size();
+	}
+
+	static const frame_graph::queue_segment& getSegment(const frame_graph& graph, uint32 segment)
+	{
+		return graph.segments[segment];
+	}
+
+	// Index of the segment the pass (in the order passes were added) was assigned to. Invalid for culled passes.
+	static uint32 getPassSegment(const frame_graph& graph, uint32 passIndex)
+	{
+		for (uint32 order = 0; order < (uint32)graph.executionOrder.size(); ++order)
+		{
+			if (graph.executionOrder[order] == passIndex)
+			{
+				return graph.passSegments[order];
+			}
+		}
+		return invalidIndex;
+	}
+
+	static bool executesBeforeGraph(const frame_graph& graph) { return graph.executeBeforeGraph; }
+	static bool joinsComputeQueue(const frame_graph& graph) { return graph.joinComputeQueue; }
+	static bool usesNewFinalList(const frame_graph& graph) { return graph.newFinalList; }
+
+	// First and last use are indices into the execution order, i.e. culled passes are skipped.
+	static uint32 getFirstUse(const frame_graph& graph, frame_graph_resource resource) { return graph.resources[resource.index].firstUse; }
+	static uint32 getLastUse(const frame_graph& graph, frame_graph_resource resource) { return graph.resources[resource.index].lastUse; }
+	static uint64 getSize(const frame_graph& graph, frame_graph_resource resource) { return graph.resources[resource.index].size; }
+	static bool isAliased(const frame_graph& graph, frame_graph_resource resource) { return graph.resources[resource.index].aliased; }
+
+	// State of the pass's first access of the resource, after compilation.
+	static D3D12_RESOURCE_STATES getAccessState(const frame_graph& graph, uint32 passIndex, frame_graph_resource resource)
+	{
+		for (const frame_graph::pass_builder::resource_access& a : graph.passes[passIndex].accesses)
+		{
+			if (a.resource == resource.index)
+			{
+				return a.state;
+			}
+		}
+		return D3D12_RESOURCE_STATE_COMMON;
+	}
+
+	static bool sharesMemory(const frame_graph& graph, frame_graph_resource a, frame_graph_resource b)
+	{
+		const frame_graph::resource_node& nodeA = graph.resources[a.index];
+		const frame_graph::resource_node& nodeB = graph.resources[b.index];
+		return nodeA.heapType == nodeB.heapType &&
+			nodeA.heapOffset < nodeB.heapOffset + nodeB.size && nodeB.heapOffset < nodeA.heapOffset + nodeA.size;
+	}
+};
+
+typedef frame_graph_test_access access;
+
+static void nop(dx_command_list*, frame_graph&) {}
+
+// 256x256 RGBA8, i.e. exactly 4 placement alignments.
+static frame_graph_resource createTarget(frame_graph& graph, const char* name, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+{
+	return graph.createTexture(name, CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 256, 256, 1, 1, 1, 0, flags));
+}
+
+static void testCulling()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource used = createTarget(graph, "Used");
+	frame_graph_resource unused = createTarget(graph, "Unused");
+	frame_graph_resource output = createTarget(graph, "Output");
+
+	graph.addPass("Writes used", nop).write(used, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Writes unused", nop).write(unused, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Side effects", nop).setSideEffects();
+	graph.addPass("Output", nop).read(used).write(output, D3D12_RESOURCE_STATE_RENDER_TARGET).setSideEffects();
+	graph.compile();
+
+	const frame_graph_report& report = graph.getReport();
+	CHECK(report.numPasses == 4);
+	CHECK(report.numCulledPasses == 1);
+	CHECK(report.numTransientTextures == 2);
+	CHECK(access::getPassSegment(graph, 1) == invalidIndex);
+	CHECK(access::getFirstUse(graph, unused) == invalidIndex);
+
+	// Everything on the graphics queue goes into the list passed to execute.
+	CHECK(access::getNumSegments(graph) == 1);
+	CHECK(report.numCommandLists == 1);
+	CHECK(report.numCrossQueueWaits == 0);
+	CHECK(!access::usesNewFinalList(graph));
+}
+
+static void testTransientLifetimes()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource a = createTarget(graph, "A");
+	frame_graph_resource b = createTarget(graph, "B");
+	frame_graph_resource c = createTarget(graph, "C");
+	frame_graph_resource unused = createTarget(graph, "Unused");
+
+	graph.addPass("Write A", nop).write(a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Culled", nop).read(a).write(unused, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("A to B", nop).read(a).write(b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("B to C", nop).read(b).write(c, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Read C", nop).read(c).setSideEffects();
+	graph.compile();
+
+	// The culled pass does not take a slot in the execution order, and does not extend A's lifetime.
+	CHECK(access::getFirstUse(graph, a) == 0 && access::getLastUse(graph, a) == 1);
+	CHECK(access::getFirstUse(graph, b) == 1 && access::getLastUse(graph, b) == 2);
+	CHECK(access::getFirstUse(graph, c) == 2 && access::getLastUse(graph, c) == 3);
+	CHECK(access::getFirstUse(graph, unused) == invalidIndex);
+}
+
+static void testAliasingOfDisjointLifetimes()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource a = createTarget(graph, "A");
+	frame_graph_resource b = createTarget(graph, "B");
+	frame_graph_resource c = createTarget(graph, "C");
+
+	graph.addPass("Write A", nop).write(a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("A to B", nop).read(a).write(b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("B to C", nop).read(b).write(c, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Read C", nop).read(c).setSideEffects();
+	graph.compile();
+
+	uint64 size = access::getSize(graph, a);
+	CHECK(size == 256 * 256 * 4);
+
+	// B overlaps both neighbours, but A is dead by the time C is written.
+	CHECK(access::sharesMemory(graph, a, c));
+	CHECK(!access::sharesMemory(graph, a, b));
+	CHECK(!access::sharesMemory(graph, b, c));
+	CHECK(access::isAliased(graph, a) && access::isAliased(graph, c) && !access::isAliased(graph, b));
+
+	const frame_graph_report& report = graph.getReport();
+	CHECK(report.unaliasedSizeInBytes == 3 * size);
+	CHECK(report.aliasedSizeInBytes == 2 * size);
+	CHECK(report.numAliasingBarriers == 2);
+}
+
+static void testNoAliasingAcrossHeapTypesOrWithCompute()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource renderTarget = createTarget(graph, "Render target");
+	frame_graph_resource uav = createTarget(graph, "UAV", D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	frame_graph_resource computeOutput = createTarget(graph, "Compute output", D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	frame_graph_resource late = createTarget(graph, "Late", D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+	graph.addPass("Render", nop).write(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Render to UAV", nop).read(renderTarget).write(uav, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	graph.addPass("Compute", nop).read(uav).write(computeOutput, D3D12_RESOURCE_STATE_UNORDERED_ACCESS).setAsyncCompute();
+	graph.addPass("Late", nop).read(computeOutput).write(late, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	graph.addPass("Read late", nop).read(late).setSideEffects();
+	graph.compile();
+
+	// Different heap types never share memory. Textures used on the compute queue get their own memory, even though the
+	// lifetimes of the UAV and the late texture are disjoint.
+	CHECK(!access::isAliased(graph, renderTarget));
+	CHECK(!access::isAliased(graph, uav));
+	CHECK(!access::isAliased(graph, computeOutput));
+	CHECK(!access::isAliased(graph, late));
+
+	const frame_graph_report& report = graph.getReport();
+	CHECK(report.aliasedSizeInBytes == report.unaliasedSizeInBytes);
+	CHECK(report.numAliasingBarriers == 0);
+}
+
+static void testAsyncComputeSegments()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource depth = graph.createTexture("Depth",
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, 256, 256, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL));
+	frame_graph_resource ao = createTarget(graph, "AO", D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	frame_graph_resource shadowMap = graph.createTexture("Shadow map",
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, 256, 256, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL));
+	frame_graph_resource hdr = createTarget(graph, "HDR");
+
+	graph.addPass("Depth prepass", nop).write(depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	graph.addPass("AO", nop).read(depth, srv).write(ao, D3D12_RESOURCE_STATE_UNORDERED_ACCESS).setAsyncCompute();
+	graph.addPass("Shadow map", nop).write(shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	graph.addPass("Lighting", nop).read(shadowMap).read(ao).read(depth, D3D12_RESOURCE_STATE_DEPTH_READ | srv)
+		.write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET).setSideEffects();
+	graph.compile();
+
+	// The depth prepass ends its segment, since the AO waits for it. The shadow map overlaps with the AO, and the lighting
+	// waits for the AO.
+	CHECK(access::getNumSegments(graph) == 4);
+	uint32 prepassSegment = access::getPassSegment(graph, 0);
+	uint32 aoSegment = access::getPassSegment(graph, 1);
+	uint32 shadowSegment = access::getPassSegment(graph, 2);
+	uint32 lightingSegment = access::getPassSegment(graph, 3);
+
+	CHECK(access::getSegment(graph, prepassSegment).queue == frame_graph_queue_graphics);
+	CHECK(access::getSegment(graph, prepassSegment).waitedOn);
+
+	CHECK(access::getSegment(graph, aoSegment).queue == frame_graph_queue_compute);
+	CHECK(access::getSegment(graph, aoSegment).wait == prepassSegment);
+	CHECK(access::getSegment(graph, aoSegment).waitedOn);
+	CHECK(!access::getSegment(graph, aoSegment).waitsForGraphicsBeforeGraph);
+
+	CHECK(access::getSegment(graph, shadowSegment).queue == frame_graph_queue_graphics);
+	CHECK(access::getSegment(graph, shadowSegment).wait == invalidIndex);
+
+	CHECK(access::getSegment(graph, lightingSegment).queue == frame_graph_queue_graphics);
+	CHECK(access::getSegment(graph, lightingSegment).wait == aoSegment);
+	CHECK(!access::getSegment(graph, lightingSegment).waitedOn);
+
+	// The lighting already waited for the last compute segment, so the last graphics segment is returned open.
+	CHECK(!access::executesBeforeGraph(graph));
+	CHECK(!access::joinsComputeQueue(graph));
+	CHECK(!access::usesNewFinalList(graph));
+
+	const frame_graph_report& report = graph.getReport();
+	CHECK(report.numAsyncComputePasses == 1);
+	CHECK(report.numCommandLists == 4);
+	CHECK(report.numCrossQueueWaits == 2);
+	CHECK(report.numQueueTransfers == 3);	// Depth to compute and back, AO to graphics.
+}
+
+static void testAsyncComputeReadStates()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource hdr = createTarget(graph, "HDR");
+	frame_graph_resource depth = graph.createTexture("Depth",
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, 256, 256, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL));
+	frame_graph_resource histogram = createTarget(graph, "Histogram", D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+	graph.addPass("Lighting", nop).write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET).write(depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	graph.addPass("Histogram", nop).read(hdr, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE).read(depth, srv)
+		.write(histogram, D3D12_RESOURCE_STATE_UNORDERED_ACCESS).setAsyncCompute().setSideEffects();
+	graph.compile();
+
+	// Pixel shader reads, alone or combined, become non-pixel shader reads on the compute queue.
+	CHECK(access::getAccessState(graph, 1, hdr) == D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	CHECK(access::getAccessState(graph, 1, depth) == D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	CHECK(access::getAccessState(graph, 1, histogram) == D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+static void testComputeWaitsForLastGraphicsSegment()
+{
+	frame_graph graph;
+	graph.reset();
+
+	frame_graph_resource hdr = createTarget(graph, "HDR");
+	frame_graph_resource histogram = createTarget(graph, "Histogram", D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+	graph.addPass("Lighting", nop).write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.addPass("Histogram", nop).read(hdr).write(histogram, D3D12_RESOURCE_STATE_UNORDERED_ACCESS).setAsyncCompute().setSideEffects();
+	graph.compile();
+
+	CHECK(access::getNumSegments(graph) == 2);
+	uint32 graphicsSegment = access::getPassSegment(graph, 0);
+	uint32 computeSegment = access::getPassSegment(graph, 1);
+
+	// The only graphics segment is also the last one. It must be executed by the graph for the compute queue to wait on it,
+	// so the final barriers (after joining the compute queue) go into a new list.
+	CHECK(access::getSegment(graph, graphicsSegment).waitedOn);
+	CHECK(access::getSegment(graph, computeSegment).wait == graphicsSegment);
+	CHECK(access::joinsComputeQueue(graph));
+	CHECK(access::usesNewFinalList(graph));
+
+	const frame_graph_report& report = graph.getReport();
+	CHECK(report.numCommandLists == 3);
+	CHECK(report.numCrossQueueWaits == 2);
+}
+
+static void testComputeWaitsForWorkBeforeGraph()
+{
+	frame_graph graph;
+	graph.reset();
+
+	// Never touched, since the graph is not executed.
+	ComPtr<ID3D12Resource> nullResource;
+	frame_graph_resource particles = graph.importResource("Particles", nullResource, D3D12_RESOURCE_STATE_COMMON);
+	frame_graph_resource target = createTarget(graph, "Target");
+
+	graph.addPass("Simulate", nop).write(particles, D3D12_RESOURCE_STATE_UNORDERED_ACCESS).setAsyncCompute();
+	graph.addPass("Render", nop).write(target, D3D12_RESOURCE_STATE_RENDER_TARGET).setSideEffects();
+	graph.addPass("Draw particles", nop).read(particles, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)
+		.write(target, D3D12_RESOURCE_STATE_RENDER_TARGET).setSideEffects();
+	graph.compile();
+
+	// Imported resources come from the graphics work before the graph, so the given list is executed up front.
+	CHECK(access::executesBeforeGraph(graph));
+	uint32 simulateSegment = access::getPassSegment(graph, 0);
+	CHECK(access::getSegment(graph, simulateSegment).waitsForGraphicsBeforeGraph);
+	CHECK(access::getSegment(graph, simulateSegment).wait == invalidIndex);
+
+	// Rendering does not wait for the simulation, drawing the particles does.
+	uint32 renderSegment = access::getPassSegment(graph, 1);
+	uint32 drawSegment = access::getPassSegment(graph, 2);
+	CHECK(renderSegment != drawSegment);
+	CHECK(access::getSegment(graph, renderSegment).wait == invalidIndex);
+	CHECK(access::getSegment(graph, drawSegment).wait == simulateSegment);
+	CHECK(!access::usesNewFinalList(graph));
+
+	const frame_graph_report& report = graph.getReport();
+	CHECK(report.numImportedResources == 1);
+	CHECK(report.numCommandLists == 4);
+	CHECK(report.numCrossQueueWaits == 2);
+}
+
+std::vector<unit_test> getFrameGraphTests()
+{
+	return
+	{
+		{ "frame_graph/culling", testCulling },
+		{ "frame_graph/transient_lifetimes", testTransientLifetimes },
+		{ "frame_graph/aliasing_of_disjoint_lifetimes", testAliasingOfDisjointLifetimes },
+		{ "frame_graph/no_aliasing_across_heap_types_or_with_compute", testNoAliasingAcrossHeapTypesOrWithCompute },
+		{ "frame_graph/async_compute_segments", testAsyncComputeSegments },
+		{ "frame_graph/async_compute_read_states", testAsyncComputeReadStates },
+		{ "frame_graph/compute_waits_for_last_graphics_segment", testComputeWaitsForLastGraphicsSegment },
+		{ "frame_graph/compute_waits_for_work_before_graph", testComputeWaitsForWorkBeforeGraph },
+	};
+}
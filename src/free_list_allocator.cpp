@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "free_list_allocator.h"
+
+
+void free_list_allocator::initialize(uint32 capacity)
+{
+	this->capacity = capacity;
+	numFree = 0;
+	numStale = 0;
+
+	freeListByOffset.clear();
+	freeListBySize.clear();
+	staleRanges.clear();
+
+	free(0, capacity);
+}
+
+void free_list_allocator::addFreeBlock(uint32 offset, uint32 size)
+{
+	auto offsetIt = freeListByOffset.emplace(offset, free_block{ size, freeListBySize.end() }).first;
+	auto sizeIt = freeListBySize.emplace(size, offsetIt);
+	offsetIt->second.sizeIterator = sizeIt;
+}
+
+bool free_list_allocator::allocate(uint32 count, uint32& outOffset)
+{
+	// Smallest block which is large enough.
+	auto sizeIt = freeListBySize.lower_bound(count);
+	if (count == 0 || sizeIt == freeListBySize.end())
+	{
+		return false;
+	}
+
+	uint32 blockSize = sizeIt->first;
+	auto offsetIt = sizeIt->second;
+	uint32 offset = offsetIt->first;
+
+	freeListBySize.erase(sizeIt);
+	freeListByOffset.erase(offsetIt);
+
+	if (blockSize > count)
+	{
+		addFreeBlock(offset + count, blockSize - count);
+	}
+
+	numFree -= count;
+	outOffset = offset;
+
+	return true;
+}
+
+void free_list_allocator::free(uint32 offset, uint32 count)
+{
+	assert(offset + count <= capacity);
+
+	numFree += count;
+
+	// First block after the range.
+	auto nextIt = freeListByOffset.upper_bound(offset);
+
+	if (nextIt != freeListByOffset.begin())
+	{
+		auto prevIt = std::prev(nextIt);
+		assert(prevIt->first + prevIt->second.size <= offset && "Range is already free.");
+
+		// Merge with previous block.
+		if (prevIt->first + prevIt->second.size == offset)
+		{
+			offset = prevIt->first;
+			count += prevIt->second.size;
+
+			freeListBySize.erase(prevIt->second.sizeIterator);
+			freeListByOffset.erase(prevIt);
+		}
+	}
+
+	if (nextIt != freeListByOffset.end())
+	{
+		assert(offset + count <= nextIt->first && "Range is already free.");
+
+		// Merge with next block.
+		if (offset + count == nextIt->first)
+		{
+			count += nextIt->second.size;
+
+			freeListBySize.erase(nextIt->second.sizeIterator);
+			freeListByOffset.erase(nextIt);
+		}
+	}
+
+	addFreeBlock(offset, count);
+}
+
+void free_list_allocator::freeDeferred(uint32 offset, uint32 count, uint64 frameNumber)
+{
+	// Frame numbers are mostly increasing, but batched frees from other threads can arrive late. Keep the queue sorted,
+	// searching from the back, since that is where new ranges almost always go.
+	auto it = staleRanges.end();
+	while (it != staleRanges.begin() && std::prev(it)->frameNumber > frameNumber)
+	{
+		--it;
+	}
+
+	staleRanges.insert(it, { offset, count, frameNumber });
+	numStale += count;
+}
+
+void free_list_allocator::releaseStale(uint64 completedFrameNumber)
+{
+	while (!staleRanges.empty() && staleRanges.front().frameNumber <= completedFrameNumber)
+	{
+		const stale_range& range = staleRanges.front();
+		free(range.offset, range.count);
+		numStale -= range.count;
+
+		staleRanges.pop_front();
+	}
+}
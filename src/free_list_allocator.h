@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common.h"
+
+#include <map>
+#include <deque>
+
+// Best-fit range allocator over [0, capacity). This only manages offsets; it does not own any memory.
+// Free blocks are kept in two maps: one sorted by offset (for coalescing with the neighbours on free) and one sorted by
+// size (for finding the best fitting block on allocation).
+// Ranges can be freed immediately or deferred by frame number, for ranges which might still be in use by the GPU.
+class free_list_allocator
+{
+public:
+	void initialize(uint32 capacity);
+
+	// Returns false if there is no free block large enough.
+	bool allocate(uint32 count, uint32& outOffset);
+
+	void free(uint32 offset, uint32 count);
+
+	// The range is returned to the free list in the first call to releaseStale with a frame number >= frameNumber.
+	void freeDeferred(uint32 offset, uint32 count, uint64 frameNumber);
+	void releaseStale(uint64 completedFrameNumber);
+
+	uint32 getCapacity() const { return capacity; }
+	uint32 getNumFree() const { return numFree; }
+	uint32 getNumFreeBlocks() const { return (uint32)freeListByOffset.size(); }
+	uint32 getLargestFreeBlock() const { return freeListBySize.empty() ? 0 : freeListBySize.rbegin()->first; }
+	uint32 getNumStale() const { return numStale; }
+
+private:
+	struct free_block;
+
+	typedef std::map<uint32, free_block> free_list_by_offset;
+	typedef std::multimap<uint32, free_list_by_offset::iterator> free_list_by_size;
+
+	struct free_block
+	{
+		uint32 size;
+		free_list_by_size::iterator sizeIterator;
+	};
+
+	struct stale_range
+	{
+		uint32 offset;
+		uint32 count;
+		uint64 frameNumber;
+	};
+
+	void addFreeBlock(uint32 offset, uint32 size);
+
+	free_list_by_offset freeListByOffset;
+	free_list_by_size freeListBySize;
+
+	std::deque<stale_range> staleRanges;
+
+	uint32 capacity = 0;
+	uint32 numFree = 0;
+	uint32 numStale = 0;
+};
@@ -0,0 +1,203 @@
+#include "pch.h"
+#include "tests.h"
+#include "free_list_allocator.h"
+
+#include <random>
+
+
+static void testBestFit()
+{
+	free_list_allocator allocator;
+	allocator.initialize(100);
+
+	uint32 a, b, c, d;
+	CHECK(allocator.allocate(10, a) && a == 0);
+	CHECK(allocator.allocate(30, b) && b == 10);
+	CHECK(allocator.allocate(5, c) && c == 40);
+	CHECK(allocator.allocate(20, d) && d == 45);
+
+	// Leaves holes of 10, 5 and the tail of 35.
+	allocator.free(a, 10);
+	allocator.free(c, 5);
+	CHECK(allocator.getNumFreeBlocks() == 3);
+	CHECK(allocator.getNumFree() == 50);
+	CHECK(allocator.getLargestFreeBlock() == 35);
+
+	// The smallest block which fits is used, not the first one.
+	uint32 offset;
+	CHECK(allocator.allocate(4, offset) && offset == 40);
+	CHECK(allocator.allocate(8, offset) && offset == 0);
+	CHECK(allocator.allocate(12, offset) && offset == 65);
+	CHECK(allocator.getNumFree() == 26);
+}
+
+static void testCoalescing()
+{
+	free_list_allocator allocator;
+	allocator.initialize(64);
+
+	uint32 offsets[4];
+	for (uint32 i = 0; i < 4; ++i)
+	{
+		CHECK(allocator.allocate(16, offsets[i]) && offsets[i] == i * 16);
+	}
+	CHECK(allocator.getNumFree() == 0);
+	CHECK(allocator.getNumFreeBlocks() == 0);
+
+	uint32 offset;
+	CHECK(!allocator.allocate(1, offset));
+
+	// Neither neighbour is free.
+	allocator.free(offsets[1], 16);
+	allocator.free(offsets[3], 16);
+	CHECK(allocator.getNumFreeBlocks() == 2);
+	CHECK(allocator.getLargestFreeBlock() == 16);
+
+	// Merges with both neighbours.
+	allocator.free(offsets[2], 16);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+	CHECK(allocator.getLargestFreeBlock() == 48);
+
+	allocator.free(offsets[0], 16);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+	CHECK(allocator.getLargestFreeBlock() == 64);
+	CHECK(allocator.getNumFree() == 64);
+
+	CHECK(allocator.allocate(64, offset) && offset == 0);
+}
+
+static void testRejectsInvalidSizes()
+{
+	free_list_allocator allocator;
+	allocator.initialize(32);
+
+	uint32 offset;
+	CHECK(!allocator.allocate(0, offset));
+	CHECK(!allocator.allocate(33, offset));
+	CHECK(allocator.getNumFree() == 32);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+}
+
+static void testDeferredFree()
+{
+	free_list_allocator allocator;
+	allocator.initialize(48);
+
+	uint32 a, b, c;
+	CHECK(allocator.allocate(16, a));
+	CHECK(allocator.allocate(16, b));
+	CHECK(allocator.allocate(16, c));
+
+	// Arrive out of frame order, e.g. from a batch of another thread.
+	allocator.freeDeferred(a, 16, 5);
+	allocator.freeDeferred(b, 16, 3);
+	allocator.freeDeferred(c, 16, 4);
+	CHECK(allocator.getNumStale() == 48);
+	CHECK(allocator.getNumFree() == 0);
+
+	uint32 offset;
+	CHECK(!allocator.allocate(16, offset));
+
+	allocator.releaseStale(2);
+	CHECK(allocator.getNumStale() == 48);
+	CHECK(allocator.getNumFree() == 0);
+
+	allocator.releaseStale(4);
+	CHECK(allocator.getNumStale() == 16);
+	CHECK(allocator.getNumFree() == 32);
+	CHECK(allocator.getLargestFreeBlock() == 32);
+
+	allocator.releaseStale(5);
+	CHECK(allocator.getNumStale() == 0);
+	CHECK(allocator.getNumFree() == 48);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+
+	// Initializing again drops everything, including ranges which are still stale.
+	allocator.freeDeferred(0, 16, 6);
+	allocator.initialize(48);
+	CHECK(allocator.getNumStale() == 0);
+	CHECK(allocator.getNumFree() == 48);
+}
+
+static void testRandomAllocations()
+{
+	const uint32 capacity = 4096;
+
+	free_list_allocator allocator;
+	allocator.initialize(capacity);
+
+	struct range
+	{
+		uint32 offset;
+		uint32 count;
+	};
+	std::vector<range> live;
+	std::vector<bool> used(capacity, false);
+
+	std::mt19937 rng(5678);
+	std::uniform_int_distribution<uint32> sizeDistribution(1, 64);
+
+	uint32 numUsed = 0;
+	uint32 numFailedAllocations = 0;
+	for (uint32 i = 0; i < 10000; ++i)
+	{
+		if (!live.empty() && (rng() % 2 == 0 || numUsed > capacity / 2))
+		{
+			uint32 index = rng() % (uint32)live.size();
+			range r = live[index];
+			live[index] = live.back();
+			live.pop_back();
+
+			allocator.free(r.offset, r.count);
+			for (uint32 j = r.offset; j < r.offset + r.count; ++j)
+			{
+				used[j] = false;
+			}
+			numUsed -= r.count;
+		}
+		else
+		{
+			uint32 count = sizeDistribution(rng);
+			uint32 offset;
+			if (!allocator.allocate(count, offset))
+			{
+				++numFailedAllocations;
+				continue;
+			}
+
+			CHECK(offset + count <= capacity);
+			for (uint32 j = offset; j < offset + count; ++j)
+			{
+				CHECK(!used[j]);
+				used[j] = true;
+			}
+			numUsed += count;
+			live.push_back({ offset, count });
+		}
+
+		CHECK(allocator.getNumFree() == capacity - numUsed);
+	}
+
+	// At most half of the capacity is used, so there is always room for a small range, unless blocks are not coalesced.
+	CHECK(numFailedAllocations == 0);
+
+	for (const range& r : live)
+	{
+		allocator.free(r.offset, r.count);
+	}
+	CHECK(allocator.getNumFree() == capacity);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+	CHECK(allocator.getLargestFreeBlock() == capacity);
+}
+
+std::vector<unit_test> getFreeListAllocatorTests()
+{
+	return
+	{
+		{ "free_list_allocator/best_fit", testBestFit },
+		{ "free_list_allocator/coalescing", testCoalescing },
+		{ "free_list_allocator/rejects_invalid_sizes", testRejectsInvalidSizes },
+		{ "free_list_allocator/deferred_free", testDeferredFree },
+		{ "free_list_allocator/random_allocations", testRandomAllocations },
+	};
+}
@@ -4,6 +4,15 @@
 #include "model.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "profile_export.h"
+#include "bindless_descriptor_table.h"
+#include "heap_allocator.h"
+#include "upload_queue.h"
+#include "pipeline_factory.h"
+#include "shader_store.h"
+#include "memory_tracking.h"
+#include "scratch_arena.h"
+#include "cpu_benchmarks.h"
 
 #include <pix3.h>
 
@@ -29,9 +38,13 @@
 #define ENABLE_PROCEDURAL 1
 #define ENABLE_PROCEDURAL_SHADOWS 0
 
+static const DXGI_FORMAT hdrFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+static const DXGI_FORMAT depthFormat = DXGI_FORMAT_D32_FLOAT;
+
 void dx_game::initialize(ComPtr<ID3D12Device2> device, uint32 width, uint32 height, color_depth colorDepth)
 {
 	this->device = device;
+	frameGraph.initialize(device);
 	scissorRect = CD3DX12_RECT(0, 0, LONG_MAX, LONG_MAX);
 	viewport = CD3DX12_VIEWPORT(0.f, 0.f, (float)width, (float)height);
 
@@ -46,42 +59,17 @@ void dx_game::initialize(ComPtr<ID3D12Device2> device, uint32 width, uint32 heig
 		assert(colorDepth == color_depth_10);
 		screenRTFormats.RTFormats[0] = DXGI_FORMAT_R10G10B10A2_UNORM;
 	}
+	screenFormat = screenRTFormats.RTFormats[0];
 
 	{
 		PROFILE_BLOCK("Render targets");
 
-		// Color.
-		{
-			DXGI_FORMAT hdrFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
-			CD3DX12_RESOURCE_DESC hdrTextureDesc = CD3DX12_RESOURCE_DESC::Tex2D(hdrFormat, width, height);
-			hdrTextureDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
-
-			D3D12_CLEAR_VALUE hdrClearValue;
-			hdrClearValue.Format = hdrTextureDesc.Format;
-			hdrClearValue.Color[0] = 0.f;
-			hdrClearValue.Color[1] = 0.f;
-			hdrClearValue.Color[2] = 0.f;
-			hdrClearValue.Color[3] = 0.f;
-
-			hdrTexture.initialize(device, hdrTextureDesc, &hdrClearValue);
-			lightingRT.attachColorTexture(0, hdrTexture);
-		}
-
-		// Depth.
-		{
-			DXGI_FORMAT depthBufferFormat = DXGI_FORMAT_D32_FLOAT;
-			CD3DX12_RESOURCE_DESC depthDesc = CD3DX12_RESOURCE_DESC::Tex2D(depthBufferFormat, width, height);
-			depthDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
-			depthDesc.MipLevels = 1;
-
-			D3D12_CLEAR_VALUE depthClearValue;
-			depthClearValue.Format = depthDesc.Format;
-			depthClearValue.DepthStencil = { 1.f, 0 };
-
-			depthTexture.initialize(device, depthDesc, &depthClearValue);
-			lightingRT.attachDepthStencilTexture(depthTexture);
-
-		}
+		// Color and depth. These are transient textures of the frame graph, so the pipelines only get the formats here.
+		lightingRT.renderTargetFormat.NumRenderTargets = 1;
+		lightingRT.renderTargetFormat.RTFormats[0] = hdrFormat;
+		lightingRT.depthStencilFormat = depthFormat;
+		lightingRT.viewport = { 0.f, 0.f, (float)width, (float)height, 0.f, 1.f };
+		lightingRT.resize(width, height);
 
 		// Shadow maps.
 		{
@@ -417,8 +405,11 @@ void dx_game::initialize(ComPtr<ID3D12Device2> device, uint32 width, uint32 heig
 	{
 		PROFILE_BLOCK("Execute copy command list");
 
+		// The uploads recorded into this list have been streaming in through dx_upload_queue during loading. Nothing waits
+		// on the CPU here: the render queue waits for the copies and for mip generation on the compute queue.
 		uint64 fenceValue = copyCommandQueue.executeCommandList(commandList);
-		copyCommandQueue.waitForFenceValue(fenceValue);
+		dx_command_queue::renderCommandQueue.waitForOtherQueue(copyCommandQueue, fenceValue);
+		dx_command_queue::renderCommandQueue.waitForOtherQueue(dx_command_queue::computeCommandQueue);
 	}
 
 	{
@@ -436,22 +427,20 @@ void dx_game::initialize(ComPtr<ID3D12Device2> device, uint32 width, uint32 heig
 			commandList->transitionBarrier(indirectBuffer.indirectMaterials[i].roughness, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 			commandList->transitionBarrier(indirectBuffer.indirectMaterials[i].metallic, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 		}
+		commandList->transitionBarrier(indirectBuffer.materialTextureSlots, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
-		{
-			PROFILE_BLOCK("Execute transition command list");
-
-			uint64 fenceValue = renderCommandQueue.executeCommandList(commandList);
-			renderCommandQueue.waitForFenceValue(fenceValue);
-		}
+		renderCommandQueue.executeCommandList(commandList);
 	}
 
+	// The subsystems above only described their pipelines. Nothing renders with them before this point.
+	dx_pipeline_factory::waitForAll();
+
 	// Loading scene done.
 	contentLoaded = true;
 
 	this->width = width;
 	this->height = height;
 	viewport = CD3DX12_VIEWPORT(0.f, 0.f, (float)width, (float)height);
-	flushApplication();
 
 	camera.fovY = DirectX::XMConvertToRadians(70.f);
 	camera.nearPlane = 0.1f;
@@ -460,8 +449,9 @@ void dx_game::initialize(ComPtr<ID3D12Device2> device, uint32 width, uint32 heig
 	camera.rotation = quat::identity;
 	camera.updateMatrices(width, height);
 
-	inputMovement = vec3(0.f, 0.f, 0.f);
-	inputSpeedModifier = 1.f;
+	cameraController = camera_controller();
+	simulatedCamera = camera;
+	simulation.initialize(1.f / SIMULATION_TICK_RATE, [this](uint64 tickIndex, float dt) { simulationTick(tickIndex, dt); });
 
 	registerKeyDownCallback(BIND(keyDownCallback));
 	registerKeyUpCallback(BIND(keyUpCallback));
@@ -481,17 +471,29 @@ void dx_game::resize(uint32 width, uint32 height)
 
 		flushApplication();
 
+		// The frame graph recreates the textures with the new size.
+		lightingRT.detachAll();
 		lightingRT.resize(width, height);
 	}
 }
 
-void dx_game::update(float dt)
+void dx_game::startSimulationThread()
 {
-	camera.rotation = (createQuaternionFromAxisAngle(comp_vec(0.f, 1.f, 0.f), camera.yaw)
-		* createQuaternionFromAxisAngle(comp_vec(1.f, 0.f, 0.f), camera.pitch)).normalize();
+	simulation.startThread();
+}
 
-	camera.position = camera.position + camera.rotation * inputMovement * dt * CAMERA_MOVEMENT_SPEED * inputSpeedModifier;
-	camera.updateMatrices(width, height);
+void dx_game::stopSimulationThread()
+{
+	simulation.stopThread();
+}
+
+void dx_game::simulationTick(uint64 tickIndex, float dt)
+{
+	game_snapshot& snapshot = snapshots.getWriteSlot();
+	snapshot.previousCameraPosition = simulatedCamera.position;
+	snapshot.previousCameraRotation = simulatedCamera.rotation;
+
+	cameraController.simulate(simulatedCamera, dt);
 
 #if ENABLE_PARTICLES
 	particleSystemTime += dt;
@@ -505,15 +507,58 @@ void dx_game::update(float dt)
 	particleSystem2.update(dt);
 
 	particleSystem3.update(dt);
+
+	// The slots are reused, so after the first ticks this does not allocate.
+	snapshot.particles[0] = particleSystem1.particles;
+	snapshot.particles[1] = particleSystem2.particles;
+	snapshot.particles[2] = particleSystem3.particles;
 #endif
 
+	snapshot.numTicks = tickIndex + 1;
+	snapshot.cameraPosition = simulatedCamera.position;
+	snapshot.cameraRotation = simulatedCamera.rotation;
+	snapshot.cameraPitch = simulatedCamera.pitch;
+	snapshot.cameraYaw = simulatedCamera.yaw;
+
+	snapshots.publish();
+}
+
+void dx_game::update(float dt)
+{
+	simulation.advance(dt);
+
+	// The newest tick lies in the future. Interpolating to now keeps the motion smooth, independent of the frame rate.
+	snapshots.acquire();
+	const game_snapshot& snapshot = snapshots.getReadSlot();
+	if (snapshot.numTicks > 0)
+	{
+		float t = simulation.getInterpolationFactor(snapshot.numTicks);
+		camera.position = lerp<comp_vec>(snapshot.previousCameraPosition, snapshot.cameraPosition, t);
+		camera.rotation = slerp(snapshot.previousCameraRotation, snapshot.cameraRotation, t);
+		camera.pitch = snapshot.cameraPitch;
+		camera.yaw = snapshot.cameraYaw;
+	}
+	camera.updateMatrices(width, height);
+
+	// Once per frame, however many ticks ran.
+	PROFILE_COUNTER_SET("Live particles", snapshot.particles[0].size() + snapshot.particles[1].size() + snapshot.particles[2].size());
+
 	this->dt = dt;
 
+	// Statistics of the command lists executed last frame.
+	command_stream_statistics commandStreamStats = command_stream_filter::endFrame();
+	upload_ring_statistics uploadStats = dx_command_queue::renderCommandQueue.getUploadRing().endFrame();
+	descriptor_table_statistics descriptorTableStats = dx_dynamic_descriptor_heap::endFrame();
+	bindless_table_statistics bindlessStats = dx_bindless_descriptor_table::getStatistics();
+	barrier_statistics barrierStats = dx_resource_state_tracker::endFrame();
+	memory_statistics memoryStats = endMemoryFrame();
 
 	DEBUG_TAB(gui, "General")
 	{
 		gui.slider("GUI scale", gui.guiScale, 0.1f, 1.5f);
 		gui.textF("Performance: %.2f fps (%.3f ms)", 1.f / dt, dt * 1000.f);
+		gui.textF("Simulation: %llu ticks at %u Hz, %s", simulation.getNumTicks(), SIMULATION_TICK_RATE,
+			simulation.isThreaded() ? "on its own thread" : "inline");
 		DEBUG_GROUP(gui, "Camera")
 		{
 			gui.textF("Camera position: %.2f, %.2f, %.2f", camera.position.x, camera.position.y, camera.position.z);
@@ -586,6 +631,186 @@ void dx_game::update(float dt)
 			}
 		}
 		gui.textF("%u draw calls", indirectBuffer.numDrawCalls);
+		gui.textF("%u of %u recorded commands replayed, %u redundant state changes dropped, %u barrier batches merged",
+			commandStreamStats.numReplayedCommands, commandStreamStats.numRecordedCommands,
+			commandStreamStats.numRedundantCommands, commandStreamStats.numMergedBarrierBatches);
+		gui.textF("Upload ring: %.1f KB last frame, %.2f MB used, %.2f MB peak of %.2f MB, %u stalls, %u overflow allocations (%.2f MB)",
+			uploadStats.bytesAllocatedThisFrame / 1024.f, uploadStats.usedSize / (1024.f * 1024.f), uploadStats.peakUsedSize / (1024.f * 1024.f),
+			uploadStats.capacity / (1024.f * 1024.f), uploadStats.numWaitStallsThisFrame, uploadStats.numOverflowAllocationsThisFrame,
+			uploadStats.overflowMemory / (1024.f * 1024.f));
+		gui.textF("Descriptor tables: %u committed, %u copied (%u descriptors), %u reused (%u descriptor copies avoided)",
+			descriptorTableStats.numCommittedTables, descriptorTableStats.numCopiedTables, descriptorTableStats.numCopiedDescriptors,
+			descriptorTableStats.numReusedTables, descriptorTableStats.numAvoidedDescriptorCopies);
+		gui.textF("Bindless textures: %u of %u slots in use, %u waiting for release",
+			bindlessStats.numAllocatedSlots, bindlessStats.capacity, bindlessStats.numStaleSlots);
+		gui.textF("Barriers: %u transitions requested, %u barriers emitted (%u elided, %u read states combined, %u merged, %u split)",
+			barrierStats.numRequestedTransitions, barrierStats.numEmittedBarriers, barrierStats.numElidedTransitions,
+			barrierStats.numCombinedReadStates, barrierStats.numMergedBarriers, barrierStats.numSplitBarriers);
+		gui.toggle("Optimize barriers", dx_resource_state_tracker::enableBarrierOptimization);
+
+		const frame_graph_report& frameGraphReport = frameGraph.getReport();
+		gui.textF("Frame graph: %u passes (%u culled), %u transient textures, %u transitions (%u split), %u aliasing barriers",
+			frameGraphReport.numPasses, frameGraphReport.numCulledPasses, frameGraphReport.numTransientTextures,
+			frameGraphReport.numTransitions, frameGraphReport.numSplitBarriers, frameGraphReport.numAliasingBarriers);
+		gui.textF("Transient memory: %.2f MB aliased, %.2f MB without aliasing (%.2f MB saved)",
+			frameGraphReport.aliasedSizeInBytes / (1024.0 * 1024.0), frameGraphReport.unaliasedSizeInBytes / (1024.0 * 1024.0),
+			(frameGraphReport.unaliasedSizeInBytes - frameGraphReport.aliasedSizeInBytes) / (1024.0 * 1024.0));
+		gui.textF("Async compute: %u passes, %u command lists, %u cross-queue waits, %u queue transfers",
+			frameGraphReport.numAsyncComputePasses, frameGraphReport.numCommandLists, frameGraphReport.numCrossQueueWaits,
+			frameGraphReport.numQueueTransfers);
+
+		upload_queue_statistics uploadQueueStats = dx_upload_queue::getStatistics();
+		gui.textF("Upload queue: %llu uploads (%.2f MB) in %llu batches (%u by size, %u by time), %u in flight",
+			uploadQueueStats.numUploads, uploadQueueStats.bytesUploaded / (1024.0 * 1024.0), uploadQueueStats.numBatches,
+			uploadQueueStats.numSizeTriggeredBatches, uploadQueueStats.numTimeTriggeredBatches, uploadQueueStats.numBatchesInFlight);
+
+		pipeline_factory_statistics pipelineStats = dx_pipeline_factory::getStatistics();
+		shader_store_statistics shaderStats = dx_shader_store::getStatistics();
+		gui.textF("Pipelines: %u on %u threads in %.1f ms (%.1f ms total, longest %.1f ms), %u shaders (%.2f MB) for %u requests",
+			pipelineStats.numPipelines, pipelineStats.numThreads, pipelineStats.wallTimeInMilliseconds, pipelineStats.totalCreationTimeInMilliseconds,
+			pipelineStats.longestCreationTimeInMilliseconds, shaderStats.numShaders, shaderStats.bytesMapped / (1024.0 * 1024.0), shaderStats.numRequests);
+
+		DEBUG_GROUP(gui, "Memory")
+		{
+			const memory_domain_statistics& cpu = memoryStats.total.cpu;
+			const memory_domain_statistics& gpu = memoryStats.total.gpu;
+			gui.textF("CPU: %.2f MB in %llu allocations (peak %.2f MB), %u allocations (%.1f KB) and %u frees last frame",
+				cpu.liveBytes / (1024.0 * 1024.0), cpu.numLiveAllocations, cpu.peakLiveBytes / (1024.0 * 1024.0),
+				cpu.numFrameAllocations, cpu.frameAllocatedBytes / 1024.0, cpu.numFrameFrees);
+			gui.textF("GPU: %.2f MB in %llu objects (peak %.2f MB), %u created last frame",
+				gpu.liveBytes / (1024.0 * 1024.0), gpu.numLiveAllocations, gpu.peakLiveBytes / (1024.0 * 1024.0), gpu.numFrameAllocations);
+
+			const scratch_arena_statistics& scratch = getThreadScratchArena().getLastFrameStatistics();
+			gui.textF("Main thread scratch: %u allocations (%.1f KB) last frame, %.2f MB in %u blocks",
+				scratch.numAllocations, scratch.allocatedBytes / 1024.0, scratch.capacity / (1024.0 * 1024.0), scratch.numBlocks);
+
+			for (uint32 tag = 0; tag < memory_tag_count; ++tag)
+			{
+				const memory_tag_statistics& stats = memoryStats.tags[tag];
+				if (stats.cpu.numLiveAllocations == 0 && stats.gpu.numLiveAllocations == 0)
+				{
+					continue;
+				}
+
+				// The change over the last frames is what points at leaks.
+				gui.textF("%s: CPU %.2f MB (%llu allocations, %u last frame, %+.1f KB over %u frames), GPU %.2f MB (%llu objects, %+.1f KB)",
+					memoryTagNames[tag], stats.cpu.liveBytes / (1024.0 * 1024.0), stats.cpu.numLiveAllocations, stats.cpu.numFrameAllocations,
+					stats.cpu.liveBytesChange / 1024.0, MEMORY_HISTORY_LENGTH, stats.gpu.liveBytes / (1024.0 * 1024.0), stats.gpu.numLiveAllocations,
+					stats.gpu.liveBytesChange / 1024.0);
+			}
+		}
+
+		std::vector<gpu_heap_statistics> heapStats;
+		dx_heap_allocator::getStatistics(heapStats);
+		DEBUG_GROUP(gui, "GPU heaps")
+		{
+			for (const gpu_heap_statistics& heap : heapStats)
+			{
+				gui.textF("%s (%llu KB alignment): %.2f of %.2f MB used, %u allocations, %u free blocks, largest free block %.2f MB, %.0f%% fragmented",
+					heap.category, heap.alignment / 1024, heap.usedSize / (1024.0 * 1024.0), heap.size / (1024.0 * 1024.0),
+					heap.numAllocations, heap.numFreeBlocks, heap.largestFreeBlock / (1024.0 * 1024.0), heap.fragmentation * 100.f);
+			}
+			gui.toggle("Sub-allocate new resources", dx_heap_allocator::enableSubAllocation);
+			if (gui.button("Defragment"))
+			{
+				defragmentGPUHeaps = true;
+			}
+		}
+
+		DEBUG_GROUP(gui, "Command queues")
+		{
+			dx_command_queue* queues[] = { &dx_command_queue::renderCommandQueue, &dx_command_queue::computeCommandQueue, &dx_command_queue::copyCommandQueue };
+
+			std::vector<command_queue_wait> waits;
+			for (dx_command_queue* queue : queues)
+			{
+				command_queue_statistics stats = queue->getStatistics();
+				gui.textF("%s: %u submissions, %u CPU waits (%.2f ms, %u flushes), %u GPU waits, %u lists in flight (max %u), allocator reuse after %.2f ms (max %.2f ms)",
+					stats.queue, stats.numSubmissions, stats.numCpuWaits, stats.cpuWaitTimeInMilliseconds, stats.numFlushes, stats.numGpuWaits,
+					stats.numInFlightCommandLists, stats.maxInFlightCommandLists,
+					stats.averageAllocatorReuseLatencyInMilliseconds, stats.maxAllocatorReuseLatencyInMilliseconds);
+
+				command_allocator_pool_statistics allocatorStats = queue->getAllocatorStatistics();
+				gui.textF("    Allocators: %u small (%u free), %u medium (%u free), %u large (%u free), ~%.2f MB, %u created, %u trimmed",
+					allocatorStats.numAllocators[command_allocator_size_small], allocatorStats.numFree[command_allocator_size_small],
+					allocatorStats.numAllocators[command_allocator_size_medium], allocatorStats.numFree[command_allocator_size_medium],
+					allocatorStats.numAllocators[command_allocator_size_large], allocatorStats.numFree[command_allocator_size_large],
+					allocatorStats.estimatedMemory / (1024.0 * 1024.0), allocatorStats.numCreated, allocatorStats.numTrimmed);
+
+				queue->getWaits(waits);
+			}
+
+			for (const command_queue_wait& wait : waits)
+			{
+				gui.textF("Stall on %s queue in '%s': fence %llu, %.3f ms", wait.queue, wait.callSite, wait.fenceValue, wait.timeInMilliseconds);
+			}
+		}
+
+		DEBUG_GROUP(gui, "Benchmarks")
+		{
+			if (gui.button("Run descriptor allocation benchmark"))
+			{
+				benchmarkResults.clear();
+				for (uint32 numThreads = 1; numThreads <= 8; numThreads *= 2)
+				{
+					benchmarkResults.push_back(benchmarkDescriptorAllocation(numThreads, 4096, false));
+					benchmarkResults.push_back(benchmarkDescriptorAllocation(numThreads, 4096, true));
+				}
+			}
+			if (gui.button("Run resource state tracking benchmark"))
+			{
+				benchmarkResults.clear();
+				for (uint32 numThreads = 1; numThreads <= 8; numThreads *= 2)
+				{
+					benchmarkResults.push_back(benchmarkResourceStateTracking(numThreads, 64, 4096, false));
+					benchmarkResults.push_back(benchmarkResourceStateTracking(numThreads, 64, 4096, true));
+				}
+			}
+			if (gui.button("Run GPU heap allocation benchmark"))
+			{
+				benchmarkResults.clear();
+				benchmarkResults.push_back(benchmarkHeapAllocation(1 << 20, false));
+				benchmarkResults.push_back(benchmarkHeapAllocation(1 << 20, true));
+			}
+			if (gui.button("Run frame graph compilation benchmark"))
+			{
+				benchmarkResults.clear();
+				benchmarkResults.push_back(benchmarkFrameGraphCompilation(1000, benchmarkFrameGraphReport));
+			}
+			if (gui.button("Run indirect command building benchmark"))
+			{
+				benchmarkResults.clear();
+				benchmarkResults.push_back(benchmarkIndirectCommandBuilding(100, 256, 64));
+			}
+			if (gui.button("Run mesh import benchmark"))
+			{
+				benchmarkResults.clear();
+				benchmarkResults.push_back(benchmarkMeshImport("res/sponza/sponza.obj", 3));
+			}
+			if (gui.button("Run headless CPU benchmarks"))
+			{
+				// Same set as the benchmark executable, without repetitions.
+				benchmarkResults.clear();
+				for (const cpu_benchmark& benchmark : getCPUBenchmarks())
+				{
+					benchmarkResults.push_back(benchmark.run());
+				}
+			}
+			if (benchmarkFrameGraphReport.numPasses)
+			{
+				gui.textF("Benchmark graph: %u passes (%u culled), %.2f MB aliased, %.2f MB without aliasing",
+					benchmarkFrameGraphReport.numPasses, benchmarkFrameGraphReport.numCulledPasses,
+					benchmarkFrameGraphReport.aliasedSizeInBytes / (1024.0 * 1024.0), benchmarkFrameGraphReport.unaliasedSizeInBytes / (1024.0 * 1024.0));
+				gui.textF("Benchmark graph: %u command lists, %u cross-queue waits, %u queue transfers",
+					benchmarkFrameGraphReport.numCommandLists, benchmarkFrameGraphReport.numCrossQueueWaits, benchmarkFrameGraphReport.numQueueTransfers);
+			}
+
+			for (const benchmark_result& result : benchmarkResults)
+			{
+				gui.textF("%s, %u threads: %.3f ms (%.1f ns per operation)", result.name, result.numThreads,
+					result.milliseconds, result.milliseconds * 1e6 / result.numOperations);
+			}
+		}
 	}
 
 	sun.updateMatrices(camera);
@@ -594,13 +819,12 @@ void dx_game::update(float dt)
 
 void dx_game::renderScene(dx_command_list* commandList, render_camera& camera)
 {
-	camera_cb cameraCB;
-	camera.fillConstantBuffer(cameraCB);
-
-	D3D12_GPU_VIRTUAL_ADDRESS cameraCBAddress = commandList->uploadDynamicConstantBuffer(cameraCB);
-	D3D12_GPU_VIRTUAL_ADDRESS sunCBAddress = commandList->uploadDynamicConstantBuffer(sun);
-	D3D12_GPU_VIRTUAL_ADDRESS spotLightCBAddress = commandList->uploadDynamicConstantBuffer(spotLight);
+	renderDepthPrepass(commandList, camera);
+	renderLighting(commandList, camera);
+}
 
+void dx_game::renderDepthPrepass(dx_command_list* commandList, render_camera& camera)
+{
 #if DEPTH_PREPASS
 	indirect.renderDepthOnly(commandList, camera, indirectBuffer);
 #if ENABLE_PROCEDURAL
@@ -609,10 +833,20 @@ void dx_game::renderScene(dx_command_list* commandList, render_camera& camera)
 #endif
 	tree.renderDepthOnly(commandList, camera);
 #endif
+}
+
+void dx_game::renderLighting(dx_command_list* commandList, render_camera& camera)
+{
+	camera_cb cameraCB;
+	camera.fillConstantBuffer(cameraCB);
 
-	commandList->transitionBarrier(lightProbeSystem.packedSphericalHarmonicsBuffer.resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	commandList->transitionBarrier(lightProbeSystem.lightProbePositionBuffer.resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	commandList->transitionBarrier(lightProbeSystem.lightProbeTetrahedraBuffer.resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	D3D12_GPU_VIRTUAL_ADDRESS cameraCBAddress = commandList->uploadDynamicConstantBuffer(cameraCB);
+	D3D12_GPU_VIRTUAL_ADDRESS sunCBAddress = commandList->uploadDynamicConstantBuffer(sun);
+	D3D12_GPU_VIRTUAL_ADDRESS spotLightCBAddress = commandList->uploadDynamicConstantBuffer(spotLight);
+
+	commandList->transitionBarrier(lightProbeSystem.packedSphericalHarmonicsBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	commandList->transitionBarrier(lightProbeSystem.lightProbePositionBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	commandList->transitionBarrier(lightProbeSystem.lightProbeTetrahedraBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
 	indirect.render(commandList, indirectBuffer, cameraCBAddress, sunCBAddress, spotLightCBAddress);
 #if ENABLE_PROCEDURAL
@@ -652,13 +886,19 @@ void dx_game::renderShadowmap(dx_command_list* commandList, dx_render_target& sh
 #endif
 }
 
-uint64 dx_game::render(ComPtr<ID3D12Resource> backBuffer, CD3DX12_CPU_DESCRIPTOR_HANDLE screenRTV)
+uint64 dx_game::render(ComPtr<ID3D12Resource> backBuffer)
 {
 #if ENABLE_PROCEDURAL
-	proceduralPlacement.generate(isDebugCamera ? mainCameraCopy : camera);
+	proceduralPlacement.beginFrame();
 #endif
 
-	dx_command_list* commandList = dx_command_queue::renderCommandQueue.getAvailableCommandList();
+	dx_command_list* commandList = dx_command_queue::renderCommandQueue.getAvailableCommandList(command_allocator_size_large);
+
+	if (defragmentGPUHeaps)
+	{
+		dx_heap_allocator::defragment(commandList);
+		defragmentGPUHeaps = false;
+	}
 
 	PIXSetMarker(commandList->getD3D12CommandList().Get(), PIX_COLOR(255, 0, 0), "Frame start.");
 
@@ -668,69 +908,6 @@ uint64 dx_game::render(ComPtr<ID3D12Resource> backBuffer, CD3DX12_CPU_DESCRIPTOR
 	commandList->transitionBarrier(prefilteredEnvironment, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 	commandList->transitionBarrier(brdf, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
-	// Render to sun shadow map.
-	{
-		PROFILE_BLOCK("Record shadow map commands");
-
-		PIXScopedEvent(commandList->getD3D12CommandList().Get(), PIX_COLOR(255, 255, 0), "Sun shadow map.");
-
-		// If more than the static scene is rendered here, this stuff must go in the loop.
-		commandList->setPipelineState(indirect.depthOnlyPipelineState);
-		commandList->setGraphicsRootSignature(indirect.depthOnlyRootSignature);
-
-		commandList->setPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-		commandList->setVertexBuffer(0, indirectBuffer.indirectMesh.vertexBuffer);
-		commandList->setVertexBuffer(1, indirectBuffer.instanceBuffer);
-		commandList->setIndexBuffer(indirectBuffer.indirectMesh.indexBuffer);
-
-		for (uint32 i = 0; i < sun.numShadowCascades; ++i)
-		{
-			renderShadowmap(commandList, sunShadowMapRT[i], sun.vp[i]);
-		}
-		renderShadowmap(commandList, spotLightShadowMapRT, spotLight.vp);
-
-		for (uint32 i = 0; i < sun.numShadowCascades; ++i)
-		{
-			commandList->transitionBarrier(sunShadowMapTexture[i],
-				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-		}
-		commandList->transitionBarrier(spotLightShadowMapTexture,
-			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-	}
-
-
-	if (lightProbeRecording)
-	{
-		if (lightProbeGlobalIndex < lightProbeSystem.lightProbePositions.size())
-		{
-			vec3 lightProbePosition = lightProbeSystem.lightProbePositions[lightProbeGlobalIndex].xyz;
-
-			commandList->setRenderTarget(lightProbeSystem.lightProbeRT, 6 * lightProbeGlobalIndex + lightProbeFaceIndex);
-			commandList->setViewport(lightProbeSystem.lightProbeRT.viewport);
-			commandList->clearDepth(lightProbeSystem.lightProbeRT.depthStencilAttachment->getDepthStencilView());
-
-			cubemap_camera lightProbeCamera;
-			lightProbeCamera.initialize(lightProbePosition, lightProbeFaceIndex);
-			renderScene(commandList, lightProbeCamera);
-		}
-
-		++lightProbeFaceIndex;
-		if (lightProbeFaceIndex >= 6)
-		{
-			lightProbeFaceIndex = 0;
-			++lightProbeGlobalIndex;
-		}
-
-		if (lightProbeGlobalIndex >= lightProbeSystem.lightProbePositions.size())
-		{
-			lightProbeRecording = false;
-			lightProbeGlobalIndex = 0;
-			lightProbeFaceIndex = 0;
-		}
-	}
-
-
 	DEBUG_TAB(gui, "General")
 	{
 		gui.textF("%u/%u light probe faces recorded", 6 * lightProbeGlobalIndex + lightProbeFaceIndex, 6 * (uint32)lightProbeSystem.lightProbePositions.size());
@@ -753,7 +930,7 @@ uint64 dx_game::render(ComPtr<ID3D12Resource> backBuffer, CD3DX12_CPU_DESCRIPTOR
 				++index;
 
 				uint64 fenceValue = dx_command_queue::computeCommandQueue.executeCommandList(commandList);
-				dx_command_queue::computeCommandQueue.waitForFenceValue(fenceValue);
+				dx_command_queue::computeCommandQueue.waitForFenceValue(fenceValue, "Light probe update");
 			}
 		}
 
@@ -777,95 +954,256 @@ uint64 dx_game::render(ComPtr<ID3D12Resource> backBuffer, CD3DX12_CPU_DESCRIPTOR
 			}
 
 			lightProbeSystem.setSphericalHarmonics(device, commandList, shs);
-			commandList->transitionBarrier(lightProbeSystem.packedSphericalHarmonicsBuffer.resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true);
+			commandList->transitionBarrier(lightProbeSystem.packedSphericalHarmonicsBuffer, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true);
 		}
 	}
 
-	commandList->setRenderTarget(lightingRT);
-	commandList->setViewport(viewport);
-	commandList->clearDepth(lightingRT.depthStencilAttachment->getDepthStencilView());
 
-	renderScene(commandList, camera);
+	frameGraph.reset();
+
+	CD3DX12_RESOURCE_DESC hdrDesc = CD3DX12_RESOURCE_DESC::Tex2D(hdrFormat, width, height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+	D3D12_CLEAR_VALUE hdrClearValue = {};
+	hdrClearValue.Format = hdrFormat;
+
+	CD3DX12_RESOURCE_DESC depthDesc = CD3DX12_RESOURCE_DESC::Tex2D(depthFormat, width, height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+	D3D12_CLEAR_VALUE depthClearValue = {};
+	depthClearValue.Format = depthFormat;
+	depthClearValue.DepthStencil = { 1.f, 0 };
+
+	// Tone mapped, with the GUI on top. Only lives until it is copied to the back buffer, so it shares memory with the depth
+	// buffer, which is dead after the lighting.
+	CD3DX12_RESOURCE_DESC ldrDesc = CD3DX12_RESOURCE_DESC::Tex2D(screenFormat, width, height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+
+	frame_graph_resource hdr = frameGraph.createTexture("HDR", hdrDesc, &hdrClearValue);
+	frame_graph_resource depth = frameGraph.createTexture("Depth", depthDesc, &depthClearValue);
+	frame_graph_resource ldr = frameGraph.createTexture("LDR", ldrDesc);
+
+	frame_graph_resource sunShadowMaps[MAX_NUM_SUN_SHADOW_CASCADES];
+	for (uint32 i = 0; i < sun.numShadowCascades; ++i)
+	{
+		sunShadowMaps[i] = frameGraph.importTexture("Sun shadow map", sunShadowMapTexture[i]);
+	}
+	frame_graph_resource spotLightShadowMap = frameGraph.importTexture("Spot light shadow map", spotLightShadowMapTexture);
+	frame_graph_resource screen = frameGraph.importResource("Back buffer", backBuffer, D3D12_RESOURCE_STATE_PRESENT);
 
 #if ENABLE_PROCEDURAL
-	proceduralPlacementEditor.update(commandList, camera, proceduralPlacement, gui, dt);
+	// Runs on the compute queue, overlapping with the shadow maps.
+	frame_graph_resource placementCommands = frameGraph.importResource("Placement commands", proceduralPlacement.commandBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
+	frame_graph_resource placementDepthOnlyCommands = frameGraph.importResource("Placement depth only commands", proceduralPlacement.depthOnlyCommandBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
+	frame_graph_resource placementInstances = frameGraph.importResource("Placement instances", proceduralPlacement.instanceBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
+
+	frameGraph.addPass("Procedural placement", [this](dx_command_list* commandList, frame_graph& graph)
+	{
+		proceduralPlacement.generate(commandList, isDebugCamera ? mainCameraCopy : camera);
+	})
+		.write(placementCommands, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+		.write(placementDepthOnlyCommands, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+		.write(placementInstances, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+		.setAsyncCompute();
 #endif
 
-	if (isDebugCamera)
+	// Render to sun shadow map.
 	{
-		debugDisplay.renderFrustum(commandList, camera, mainCameraFrustum, vec4(1.f, 1.f, 1.f, 1.f));
+		frame_graph::pass_builder& pass = frameGraph.addPass("Shadow maps", [this](dx_command_list* commandList, frame_graph& graph)
+		{
+			PROFILE_BLOCK("Record shadow map commands");
+
+			// If more than the static scene is rendered here, this stuff must go in the loop.
+			commandList->setPipelineState(indirect.depthOnlyPipelineState);
+			commandList->setGraphicsRootSignature(indirect.depthOnlyRootSignature);
+
+			commandList->setPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+			commandList->setVertexBuffer(0, indirectBuffer.indirectMesh.vertexBuffer);
+			commandList->setVertexBuffer(1, indirectBuffer.instanceBuffer);
+			commandList->setIndexBuffer(indirectBuffer.indirectMesh.indexBuffer);
+
+			for (uint32 i = 0; i < sun.numShadowCascades; ++i)
+			{
+				renderShadowmap(commandList, sunShadowMapRT[i], sun.vp[i]);
+			}
+			renderShadowmap(commandList, spotLightShadowMapRT, spotLight.vp);
+		});
+
+		for (uint32 i = 0; i < sun.numShadowCascades; ++i)
+		{
+			pass.write(sunShadowMaps[i], D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		}
+		pass.write(spotLightShadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 	}
 
-#if ENABLE_PARTICLES
-	particles.renderParticleSystem(commandList, camera, particleSystem1);
-	particles.renderParticleSystem(commandList, camera, particleSystem2);
-	particles.renderParticleSystem(commandList, camera, particleSystem3);
-#endif
 
-	if (showLightProbes)
+	if (lightProbeRecording)
 	{
-		if (lightProbeSystem.tempSphericalHarmonicsBuffer.resource)
+		if (lightProbeGlobalIndex < lightProbeSystem.lightProbePositions.size())
 		{
-			lightProbeSystem.visualizeLightProbes(commandList, camera, showLightProbes, showLightProbeConnectivity, debugDisplay);
+			vec3 lightProbePosition = lightProbeSystem.lightProbePositions[lightProbeGlobalIndex].xyz;
+			uint32 faceIndex = lightProbeFaceIndex;
+			uint32 arraySlice = 6 * lightProbeGlobalIndex + lightProbeFaceIndex;
+
+			// Writes into the light probe textures, which are not known to the graph.
+			frame_graph::pass_builder& pass = frameGraph.addPass("Light probe", [this, lightProbePosition, faceIndex, arraySlice](dx_command_list* commandList, frame_graph& graph)
+			{
+				commandList->setRenderTarget(lightProbeSystem.lightProbeRT, arraySlice);
+				commandList->setViewport(lightProbeSystem.lightProbeRT.viewport);
+				commandList->clearDepth(lightProbeSystem.lightProbeRT.depthStencilAttachment->getDepthStencilView());
+
+				cubemap_camera lightProbeCamera;
+				lightProbeCamera.initialize(lightProbePosition, faceIndex);
+				renderScene(commandList, lightProbeCamera);
+			});
+
+			pass.setSideEffects();
+			for (uint32 i = 0; i < sun.numShadowCascades; ++i)
+			{
+				pass.read(sunShadowMaps[i]);
+			}
+			pass.read(spotLightShadowMap);
+#if ENABLE_PROCEDURAL
+			pass.read(placementCommands, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+			pass.read(placementDepthOnlyCommands, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+			pass.read(placementInstances, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+#endif
 		}
-		else
+
+		++lightProbeFaceIndex;
+		if (lightProbeFaceIndex >= 6)
+		{
+			lightProbeFaceIndex = 0;
+			++lightProbeGlobalIndex;
+		}
+
+		if (lightProbeGlobalIndex >= lightProbeSystem.lightProbePositions.size())
 		{
-			lightProbeSystem.visualizeLightProbeCubemaps(commandList, camera, -1.f);
+			lightProbeRecording = false;
+			lightProbeGlobalIndex = 0;
+			lightProbeFaceIndex = 0;
 		}
 	}
 
-	// Transition back to common, so that copy and compute list can handle the resource (for readback and convolution).
-	commandList->transitionBarrier(lightProbeSystem.packedSphericalHarmonicsBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
-	commandList->transitionBarrier(lightProbeSystem.lightProbeHDRTexture.resource, D3D12_RESOURCE_STATE_COMMON);
-	commandList->transitionBarrier(lightProbeSystem.tempSphericalHarmonicsBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
+	// The shadow maps are not needed before the lighting pass, so their transition can overlap with the depth prepass.
+	{
+		frame_graph::pass_builder& pass = frameGraph.addPass("Depth prepass", [this, hdr, depth](dx_command_list* commandList, frame_graph& graph)
+		{
+			lightingRT.attachColorTexture(0, graph.getTexture(hdr));
+			lightingRT.attachDepthStencilTexture(graph.getTexture(depth));
+
+			commandList->setRenderTarget(lightingRT);
+			commandList->setViewport(viewport);
+			commandList->clearDepth(lightingRT.depthStencilAttachment->getDepthStencilView());
+
+			renderDepthPrepass(commandList, camera);
+		});
+
+		pass.write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		pass.write(depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+#if ENABLE_PROCEDURAL && DEPTH_PREPASS
+		pass.read(placementDepthOnlyCommands, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+		pass.read(placementInstances, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+#endif
+	}
 
+	{
+		frame_graph::pass_builder& pass = frameGraph.addPass("Lighting", [this](dx_command_list* commandList, frame_graph& graph)
+		{
+			commandList->setRenderTarget(lightingRT);
+			commandList->setViewport(viewport);
 
+			renderLighting(commandList, camera);
 
+#if ENABLE_PROCEDURAL
+			proceduralPlacementEditor.update(commandList, camera, proceduralPlacement, gui, dt);
+#endif
 
+			if (isDebugCamera)
+			{
+				debugDisplay.renderFrustum(commandList, camera, mainCameraFrustum, vec4(1.f, 1.f, 1.f, 1.f));
+			}
 
+#if ENABLE_PARTICLES
+			const game_snapshot& snapshot = snapshots.getReadSlot();
+			particles.renderParticleSystem(commandList, camera, particleSystem1.textureAtlas, snapshot.particles[0]);
+			particles.renderParticleSystem(commandList, camera, particleSystem2.textureAtlas, snapshot.particles[1]);
+			particles.renderParticleSystem(commandList, camera, particleSystem3.textureAtlas, snapshot.particles[2]);
+#endif
 
-	// Transition backbuffer from "Present" to "Render Target", so we can render to it.
-	commandList->transitionBarrier(backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			if (showLightProbes)
+			{
+				if (lightProbeSystem.tempSphericalHarmonicsBuffer.resource)
+				{
+					lightProbeSystem.visualizeLightProbes(commandList, camera, showLightProbes, showLightProbeConnectivity, debugDisplay);
+				}
+				else
+				{
+					lightProbeSystem.visualizeLightProbeCubemaps(commandList, camera, -1.f);
+				}
+			}
 
+			// Transition back to common, so that copy and compute list can handle the resource (for readback and convolution).
+			commandList->transitionBarrier(lightProbeSystem.packedSphericalHarmonicsBuffer, D3D12_RESOURCE_STATE_COMMON);
+			commandList->transitionBarrier(lightProbeSystem.lightProbeHDRTexture, D3D12_RESOURCE_STATE_COMMON);
+			commandList->transitionBarrier(lightProbeSystem.tempSphericalHarmonicsBuffer, D3D12_RESOURCE_STATE_COMMON);
+		});
 
-	commandList->setScreenRenderTarget(&screenRTV, 1, nullptr);
+		pass.setSideEffects(); // The light probe buffers.
+		for (uint32 i = 0; i < sun.numShadowCascades; ++i)
+		{
+			pass.read(sunShadowMaps[i]);
+		}
+		pass.read(spotLightShadowMap);
+		pass.write(hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		pass.write(depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+#if ENABLE_PROCEDURAL
+		pass.read(placementCommands, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+		pass.read(placementInstances, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+#endif
+	}
 
-	present.render(commandList, hdrTexture);
-	processAndDisplayProfileEvents(gui);
-	gui.render(commandList, viewport); // Probably not completely correct here, since alpha blending assumes linear colors?
+	frameGraph.addPass("Tone mapping", [this, hdr, ldr](dx_command_list* commandList, frame_graph& graph)
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE ldrRTV = graph.getTexture(ldr).getRenderTargetView();
+		commandList->setScreenRenderTarget(&ldrRTV, 1, nullptr);
+		commandList->setViewport(viewport);
+
+		present.render(commandList, graph.getTexture(hdr));
+		processAndDisplayProfileEvents(gui);
+		gui.render(commandList, viewport); // Probably not completely correct here, since alpha blending assumes linear colors?
+	})
+		.read(hdr, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+		.write(ldr, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	frameGraph.addPass("Present", [backBuffer, ldr](dx_command_list* commandList, frame_graph& graph)
+	{
+		commandList->copyResource(backBuffer, graph.getTexture(ldr).resource, false);
+	})
+		.read(ldr, D3D12_RESOURCE_STATE_COPY_SOURCE)
+		.write(screen, D3D12_RESOURCE_STATE_COPY_DEST);
 
-	// Transition back to "Present".
-	commandList->transitionBarrier(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
+	{
+		PROFILE_BLOCK("Compile frame graph");
+		frameGraph.compile();
+	}
+	PROFILE_COUNTER_SET("Transient memory (MB)", frameGraph.getReport().aliasedSizeInBytes / (1024.0 * 1024.0));
+	PROFILE_COUNTER_SET("Transient memory saved by aliasing (MB)",
+		(frameGraph.getReport().unaliasedSizeInBytes - frameGraph.getReport().aliasedSizeInBytes) / (1024.0 * 1024.0));
+	commandList = frameGraph.execute(commandList);
 
 	return dx_command_queue::renderCommandQueue.executeCommandList(commandList);
 }
 
 bool dx_game::keyDownCallback(keyboard_event event)
 {
-	switch (event.key)
-	{
-	case key_w: inputMovement.z -= 1.f; break;
-	case key_s: inputMovement.z += 1.f; break;
-	case key_a: inputMovement.x -= 1.f; break;
-	case key_d: inputMovement.x += 1.f; break;
-	case key_q: inputMovement.y -= 1.f; break;
-	case key_e: inputMovement.y += 1.f; break;
-	case key_shift: inputSpeedModifier = 3.f; break;
-	}
+	simulation.submit([this, key = event.key]() { cameraController.keyDown(key); });
 	return true;
 }
 
 bool dx_game::keyUpCallback(keyboard_event event)
 {
+	simulation.submit([this, key = event.key]() { cameraController.keyUp(key); });
+
 	switch (event.key)
 	{
-	case key_w: inputMovement.z += 1.f; break;
-	case key_s: inputMovement.z -= 1.f; break;
-	case key_a: inputMovement.x += 1.f; break;
-	case key_d: inputMovement.x -= 1.f; break;
-	case key_q: inputMovement.y += 1.f; break;
-	case key_e: inputMovement.y -= 1.f; break;
-	case key_shift: inputSpeedModifier = 1.f; break;
+	case key_p: requestProfileCapture(); break;
 	case key_tab:
 	{
 		isDebugCamera = !isDebugCamera;
@@ -881,11 +1219,7 @@ bool dx_game::keyUpCallback(keyboard_event event)
 
 bool dx_game::mouseMoveCallback(mouse_move_event event)
 {
-	if (event.rightDown)
-	{
-		camera.pitch = camera.pitch - event.relDY * CAMERA_SENSITIVITY;
-		camera.yaw = camera.yaw - event.relDX * CAMERA_SENSITIVITY;
-	}
+	simulation.submit([this, event]() { cameraController.mouseMove(simulatedCamera, event); });
 	return true;
 }
 
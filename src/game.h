@@ -14,6 +14,7 @@
 #include "platform.h"
 #include "particles.h"
 #include "indirect_drawing.h"
+#include "frame_graph.h"
 
 #include "sky.h"
 #include "present.h"
@@ -21,10 +22,26 @@
 #include "procedural_placement_editor.h"
 
 #include "tree.h"
+#include "benchmark.h"
+#include "fixed_step_simulation.h"
 
 
-#define CAMERA_SENSITIVITY 4.f
-#define CAMERA_MOVEMENT_SPEED 10.f
+#define SIMULATION_TICK_RATE 60
+
+// Everything the renderer needs from one simulation tick. The camera is interpolated between the two stored poses.
+struct game_snapshot
+{
+	uint64 numTicks; // 0, if nothing has been simulated yet.
+
+	vec3 previousCameraPosition;
+	quat previousCameraRotation;
+	vec3 cameraPosition;
+	quat cameraRotation;
+	float cameraPitch;
+	float cameraYaw;
+
+	std::vector<particle_data> particles[3];
+};
 
 class dx_game
 {
@@ -33,7 +50,11 @@ public:
 	void resize(uint32 width, uint32 height);
 
 	void update(float dt);
-	uint64 render(ComPtr<ID3D12Resource> backBuffer, CD3DX12_CPU_DESCRIPTOR_HANDLE screenRTV);
+	uint64 render(ComPtr<ID3D12Resource> backBuffer);
+
+	// Without the thread, the simulation runs inline in update, which keeps it deterministic for recorded sessions.
+	void startSimulationThread();
+	void stopSimulationThread();
 
 	bool keyDownCallback(keyboard_event event);
 	bool keyUpCallback(keyboard_event event);
@@ -41,7 +62,11 @@ public:
 
 private:
 
+	void simulationTick(uint64 tickIndex, float dt);
+
 	void renderScene(dx_command_list* commandList, render_camera& camera);
+	void renderDepthPrepass(dx_command_list* commandList, render_camera& camera);
+	void renderLighting(dx_command_list* commandList, render_camera& camera);
 	void renderShadowmap(dx_command_list* commandList, dx_render_target& shadowMapRT, const mat4& vp);
 
 
@@ -60,6 +85,13 @@ private:
 	procedural_placement_editor proceduralPlacementEditor;
 
 
+	// The controller, the simulated camera and the particle systems are only touched by simulationTick and by the submitted
+	// input commands, which run on the simulation thread if there is one. Everything else reads the snapshots.
+	fixed_step_simulation simulation;
+	snapshot_exchange<game_snapshot> snapshots;
+	camera_controller cameraController;
+	render_camera simulatedCamera;
+
 	particle_system particleSystem1;
 	particle_system particleSystem2;
 	particle_system particleSystem3;
@@ -78,9 +110,6 @@ private:
 	dx_texture prefilteredEnvironment;
 	dx_texture brdf;
 
-	vec3 inputMovement;
-	float inputSpeedModifier;
-
 	uint32 width;
 	uint32 height;
 	float dt;
@@ -96,9 +125,10 @@ private:
 	debug_gui gui;
 	debug_display debugDisplay;
 
+	// The color and depth textures are transient, and attached to this target every frame.
 	dx_render_target lightingRT;
-	dx_texture hdrTexture;
-	dx_texture depthTexture;
+	frame_graph frameGraph;
+	DXGI_FORMAT screenFormat;
 
 	uint32 lightProbeFaceIndex = 0;
 	uint32 lightProbeGlobalIndex = 0;
@@ -113,5 +143,9 @@ private:
 
 	dx_render_target spotLightShadowMapRT;
 	dx_texture spotLightShadowMapTexture;
+
+	std::vector<benchmark_result> benchmarkResults;
+	frame_graph_report benchmarkFrameGraphReport = {};
+	bool defragmentGPUHeaps = false;
 };
 
@@ -2,9 +2,10 @@
 #include "generate_mips.h"
 #include "error.h"
 #include "descriptor_allocator.h"
+#include "shader_store.h"
 
 
-void dx_generate_mips_pso::initialize(ComPtr<ID3D12Device2> device)
+pipeline_handle dx_generate_mips_pso::initialize(ComPtr<ID3D12Device2> device)
 {
 	CD3DX12_DESCRIPTOR_RANGE1 srcMip(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 	CD3DX12_DESCRIPTOR_RANGE1 outMip(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 4, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -31,8 +32,7 @@ void dx_generate_mips_pso::initialize(ComPtr<ID3D12Device2> device)
 	rootSignature.initialize(device, rootSignatureDesc);
 
 
-	ComPtr<ID3DBlob> shaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/generate_mips.cso", &shaderBlob));
+	D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/generate_mips.cso");
 
 	struct pipeline_state_stream
 	{
@@ -41,12 +41,9 @@ void dx_generate_mips_pso::initialize(ComPtr<ID3D12Device2> device)
 	} pipelineStateStream;
 
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
-	pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+	pipelineStateStream.cs = shader;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	pipeline_handle handle = dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState);
 
 
 	dx_descriptor_allocation allocation = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 4);
@@ -65,4 +62,6 @@ void dx_generate_mips_pso::initialize(ComPtr<ID3D12Device2> device)
 			allocation.getDescriptorHandle(i)
 		);
 	}
+
+	return handle;
 }
@@ -3,6 +3,7 @@
 #include "common.h"
 #include "math.h"
 #include "root_signature.h"
+#include "pipeline_factory.h"
 
 struct alignas(16) generate_mips_cb
 {
@@ -24,7 +25,7 @@ enum generate_mips_root_parameter
 
 struct dx_generate_mips_pso
 {
-	void initialize(ComPtr<ID3D12Device2> device);
+	pipeline_handle initialize(ComPtr<ID3D12Device2> device); // The pipeline is built asynchronously.
 
 	dx_root_signature rootSignature;
 	ComPtr<ID3D12PipelineState> pipelineState;
@@ -0,0 +1,380 @@
+#include "pch.h"
+#include "heap_allocator.h"
+#include "command_list.h"
+#include "command_queue.h"
+#include "resource_state_tracker.h"
+#include "error.h"
+#include "memory_tracking.h"
+
+#include <algorithm>
+
+ComPtr<ID3D12Device2> dx_heap_allocator::device;
+uint64 dx_heap_allocator::heapSize;
+dx_heap_allocator::pool dx_heap_allocator::pools[resource_category_count * alignment_class_count];
+std::mutex dx_heap_allocator::mutex;
+std::atomic_uint64_t dx_heap_allocator::currentFrameNumber;
+bool dx_heap_allocator::enableSubAllocation = true;
+
+// {5C3E5A8B-1F47-4D6A-9B2E-7A0D3C64E1F9}
+static const GUID placedAllocationGUID = { 0x5c3e5a8b, 0x1f47, 0x4d6a, { 0x9b, 0x2e, 0x7a, 0x0d, 0x3c, 0x64, 0xe1, 0xf9 } };
+
+static const char* categoryNames[] = { "Buffers", "Textures", "RT/DS textures" };
+static const memory_tag categoryMemoryTags[] = { memory_tag_buffers, memory_tag_textures, memory_tag_render_targets };
+
+// Attached to each placed resource as private data. The resource releases it when it is destroyed, which frees the range.
+struct placed_allocation : IUnknown
+{
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
+	{
+		if (riid == __uuidof(IUnknown))
+		{
+			AddRef();
+			*object = this;
+			return S_OK;
+		}
+		*object = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override
+	{
+		return ++refCount;
+	}
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG result = --refCount;
+		if (result == 0)
+		{
+			dx_heap_allocator::free(this);
+			delete this;
+		}
+		return result;
+	}
+
+	std::atomic<ULONG> refCount = 1;
+
+	dx_heap_allocator::heap_page* page;
+	tlsf_allocator::allocation allocation;
+	memory_tag tag;
+
+	// Only for relocatable resources.
+	ID3D12Resource* resource; // Not owned.
+	D3D12_RESOURCE_DESC desc;
+	gpu_heap_relocation_func relocate;
+};
+
+void dx_heap_allocator::initialize(ComPtr<ID3D12Device2> device, uint64 heapSize)
+{
+	dx_heap_allocator::device = device;
+	dx_heap_allocator::heapSize = heapSize;
+
+	for (uint32 category = 0; category < resource_category_count; ++category)
+	{
+		for (uint32 alignment = 0; alignment < alignment_class_count; ++alignment)
+		{
+			pool& p = pools[category * alignment_class_count + alignment];
+			p.category = (resource_category)category;
+			p.alignment = (alignment_class)alignment;
+		}
+	}
+}
+
+uint64 dx_heap_allocator::getAlignment(alignment_class alignment)
+{
+	return (alignment == alignment_class_4MB) ? D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+}
+
+uint32 dx_heap_allocator::getPool(const D3D12_RESOURCE_DESC& desc)
+{
+	resource_category category = resource_category_texture;
+	if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+	{
+		category = resource_category_buffer;
+	}
+	else if (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+	{
+		category = resource_category_rt_ds_texture;
+	}
+
+	alignment_class alignment = (desc.SampleDesc.Count > 1) ? alignment_class_4MB : alignment_class_64KB;
+
+	return category * alignment_class_count + alignment;
+}
+
+dx_heap_allocator::heap_page* dx_heap_allocator::createPage(uint32 poolIndex)
+{
+	const pool& p = pools[poolIndex];
+
+	D3D12_HEAP_FLAGS flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+	if (p.category == resource_category_texture)
+	{
+		flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+	}
+	else if (p.category == resource_category_rt_ds_texture)
+	{
+		flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+	}
+
+	uint64 alignment = getAlignment(p.alignment);
+
+	D3D12_HEAP_DESC heapDesc = {};
+	heapDesc.SizeInBytes = heapSize;
+	heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+	heapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heapDesc.Alignment = alignment;
+	heapDesc.Flags = flags;
+
+	std::unique_ptr<heap_page> newPage = std::make_unique<heap_page>();
+	checkResult(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&newPage->heap)));
+	newPage->allocator.initialize(heapSize, alignment);
+	newPage->poolIndex = poolIndex;
+
+	pools[poolIndex].pages.push_back(std::move(newPage));
+	return pools[poolIndex].pages.back().get();
+}
+
+ComPtr<ID3D12Resource> dx_heap_allocator::createResource(const D3D12_RESOURCE_DESC& desc, D3D12_RESOURCE_STATES initialState,
+	const D3D12_CLEAR_VALUE* clearValue, const gpu_heap_relocation_func& relocate)
+{
+	ComPtr<ID3D12Resource> resource;
+
+	D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+	uint32 poolIndex = getPool(desc);
+
+	// Explicit tags win over the category.
+	memory_tag tag = getMemoryTag();
+	if (tag == memory_tag_untagged)
+	{
+		tag = categoryMemoryTags[pools[poolIndex].category];
+	}
+
+	if (!enableSubAllocation || info.SizeInBytes > heapSize / 4 || info.Alignment > getAlignment(pools[poolIndex].alignment))
+	{
+		checkResult(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&desc,
+			initialState,
+			clearValue,
+			IID_PPV_ARGS(&resource)));
+		trackGPUMemory(resource.Get(), info.SizeInBytes, tag);
+		return resource;
+	}
+
+	placed_allocation* allocation = new placed_allocation;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& h : pools[poolIndex].pages)
+		{
+			allocation->allocation = h->allocator.allocate(info.SizeInBytes);
+			if (allocation->allocation.isValid())
+			{
+				allocation->page = h.get();
+				break;
+			}
+		}
+
+		if (!allocation->allocation.isValid())
+		{
+			allocation->page = createPage(poolIndex);
+			allocation->allocation = allocation->page->allocator.allocate(info.SizeInBytes);
+			assert(allocation->allocation.isValid());
+		}
+	}
+
+	checkResult(device->CreatePlacedResource(allocation->page->heap.Get(), allocation->allocation.offset, &desc, initialState,
+		clearValue, IID_PPV_ARGS(&resource)));
+
+	allocation->resource = resource.Get();
+	allocation->desc = desc;
+	allocation->relocate = relocate;
+	allocation->tag = tag;
+
+	trackGPUMemory(resource.Get(), info.SizeInBytes, tag);
+
+	if (relocate)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		allocation->page->relocatableAllocations.push_back(allocation);
+	}
+
+	// The resource holds the only reference from now on.
+	checkResult(resource->SetPrivateDataInterface(placedAllocationGUID, allocation));
+	allocation->Release();
+
+	return resource;
+}
+
+void dx_heap_allocator::free(placed_allocation* allocation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	heap_page& h = *allocation->page;
+	h.allocator.freeDeferred(allocation->allocation, currentFrameNumber);
+
+	if (allocation->relocate)
+	{
+		auto it = std::find(h.relocatableAllocations.begin(), h.relocatableAllocations.end(), allocation);
+		if (it != h.relocatableAllocations.end())
+		{
+			h.relocatableAllocations.erase(it);
+		}
+	}
+}
+
+void dx_heap_allocator::beginFrame(uint64 frameNumber)
+{
+	currentFrameNumber = frameNumber;
+}
+
+void dx_heap_allocator::releaseStaleAllocations(uint64 completedFrameNumber)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (pool& p : pools)
+	{
+		for (auto& h : p.pages)
+		{
+			h->allocator.releaseStale(completedFrameNumber);
+		}
+	}
+}
+
+uint32 dx_heap_allocator::defragment(dx_command_list* commandList, uint32 maxMoves)
+{
+	struct relocation
+	{
+		ComPtr<ID3D12Resource> oldResource;
+		ComPtr<ID3D12Resource> newResource;
+		gpu_heap_relocation_func relocate;
+	};
+
+	std::vector<relocation> relocations;
+	std::vector<ComPtr<ID3D12Heap>> releasedHeaps;
+
+	// Owners rewrite their descriptors in place, which is only safe if no frame in flight reads them. Defragmentation only
+	// runs on demand, so simply waiting for the GPU is fine.
+	dx_command_queue::renderCommandQueue.flush();
+	dx_command_queue::computeCommandQueue.flush();
+	dx_command_queue::copyCommandQueue.flush();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (pool& p : pools)
+		{
+			for (auto& h : p.pages)
+			{
+				// Highest first, so that the heap is compacted from the end.
+				std::sort(h->relocatableAllocations.begin(), h->relocatableAllocations.end(),
+					[](const placed_allocation* a, const placed_allocation* b) { return a->allocation.offset > b->allocation.offset; });
+
+				std::vector<placed_allocation*> movedAllocations;
+				for (placed_allocation* allocation : h->relocatableAllocations)
+				{
+					if (relocations.size() >= maxMoves)
+					{
+						break;
+					}
+
+					// The old range stays allocated until the owner releases the old resource, so source and destination never overlap.
+					tlsf_allocator::allocation to = h->allocator.allocateBelow(allocation->allocation.size, allocation->allocation.offset);
+					if (!to.isValid())
+					{
+						continue;
+					}
+
+					placed_allocation* newAllocation = new placed_allocation;
+					newAllocation->page = h.get();
+					newAllocation->allocation = to;
+					newAllocation->desc = allocation->desc;
+					newAllocation->relocate = allocation->relocate;
+					newAllocation->tag = allocation->tag;
+
+					ComPtr<ID3D12Resource> newResource;
+					checkResult(device->CreatePlacedResource(h->heap.Get(), to.offset, &allocation->desc, D3D12_RESOURCE_STATE_COMMON,
+						nullptr, IID_PPV_ARGS(&newResource)));
+					newAllocation->resource = newResource.Get();
+					checkResult(newResource->SetPrivateDataInterface(placedAllocationGUID, newAllocation));
+					newAllocation->Release();
+					trackGPUMemory(newResource.Get(), allocation->allocation.size, allocation->tag);
+
+					relocations.push_back({ allocation->resource, newResource, allocation->relocate });
+					movedAllocations.push_back(newAllocation);
+
+					// The old range is freed once the owner releases the old resource.
+					allocation->relocate = nullptr;
+				}
+
+				h->relocatableAllocations.erase(std::remove_if(h->relocatableAllocations.begin(), h->relocatableAllocations.end(),
+					[](const placed_allocation* a) { return !a->relocate; }), h->relocatableAllocations.end());
+				append(h->relocatableAllocations, movedAllocations);
+			}
+		}
+
+		for (pool& p : pools)
+		{
+			for (auto it = p.pages.begin(); it != p.pages.end(); )
+			{
+				if ((*it)->allocator.getNumAllocations() == 0)
+				{
+					releasedHeaps.push_back((*it)->heap);
+					it = p.pages.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+	}
+
+	// Outside of the lock, since the owners release their old resources in the callbacks, which frees their ranges.
+	// All copies are recorded before any owner sees its new resource. copyResource tracks both resources in the command
+	// list, so the old ones stay alive until the copies have executed, no matter when the owners let go of them.
+	for (relocation& r : relocations)
+	{
+		D3D12_RESOURCE_DESC desc = r.newResource->GetDesc();
+		uint32 numSubresources = (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) ? 1 : desc.MipLevels * desc.DepthOrArraySize;
+		D3D12_RESOURCE_STATES state = dx_resource_state_tracker::getLastKnownGlobalState(r.oldResource.Get());
+
+		dx_resource_state_tracker::addGlobalResourceState(r.newResource.Get(), D3D12_RESOURCE_STATE_COMMON, numSubresources);
+		commandList->copyResource(r.newResource, r.oldResource, true);
+
+		// Leave the new resource in the state the owner expects, e.g. for reads through the bindless table.
+		commandList->transitionBarrier(r.newResource, state);
+	}
+
+	for (relocation& r : relocations)
+	{
+		r.relocate(r.newResource);
+	}
+
+	return (uint32)relocations.size();
+}
+
+void dx_heap_allocator::getStatistics(std::vector<gpu_heap_statistics>& outStatistics)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (const pool& p : pools)
+	{
+		for (const auto& h : p.pages)
+		{
+			gpu_heap_statistics stats;
+			stats.category = categoryNames[p.category];
+			stats.alignment = getAlignment(p.alignment);
+			stats.size = h->allocator.getCapacity();
+			stats.usedSize = h->allocator.getUsedSize();
+			stats.numAllocations = h->allocator.getNumAllocations();
+			stats.numFreeBlocks = h->allocator.getNumFreeBlocks();
+			stats.largestFreeBlock = h->allocator.getLargestFreeBlock();
+			stats.fragmentation = h->allocator.getFragmentation();
+			outStatistics.push_back(stats);
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+#include "tlsf_allocator.h"
+
+class dx_command_list;
+struct placed_allocation;
+
+struct gpu_heap_statistics
+{
+	const char* category;
+	uint64 alignment;
+	uint64 size;
+	uint64 usedSize;		// Including ranges which wait for the GPU before they can be reused.
+	uint32 numAllocations;
+	uint32 numFreeBlocks;
+	uint64 largestFreeBlock;
+	float fragmentation;
+};
+
+// Called with the new resource after a relocatable resource has been moved. The copy has been recorded, but not executed yet.
+// The GPU is idle at this point, so the owner may rewrite its descriptors in place.
+typedef std::function<void(ComPtr<ID3D12Resource> newResource)> gpu_heap_relocation_func;
+
+// Creates resources in the default heap as placed resources inside large shared heaps, instead of one committed resource
+// (and therefore one implicit heap) each. Every heap is sub-allocated with a tlsf_allocator.
+// Heaps are separated by resource category, since resource heap tier 1 hardware cannot mix buffers, render target and depth
+// textures, and other textures in one heap, and by alignment class: 64KB for everything except MSAA textures, which need 4MB.
+// Resources which are larger than a quarter of a heap get their own committed resource, as before.
+// Owners do not free anything explicitly. Each placed resource carries a small object as private data, which the resource
+// releases when it is destroyed; this returns the range to the heap. The range is reused a few frames later, since the GPU
+// might still access it.
+class dx_heap_allocator
+{
+public:
+	static void initialize(ComPtr<ID3D12Device2> device, uint64 heapSize = MB(64));
+
+	// Relocatable resources may be moved by defragment. Their owners must switch to the new resource in the callback. The
+	// GPU must only read them, since copies of the owner keep using the old resource.
+	static ComPtr<ID3D12Resource> createResource(const D3D12_RESOURCE_DESC& desc, D3D12_RESOURCE_STATES initialState,
+		const D3D12_CLEAR_VALUE* clearValue = nullptr, const gpu_heap_relocation_func& relocate = nullptr);
+
+	// Must be called at the start of each frame. Freed ranges are tagged with this number.
+	static void beginFrame(uint64 frameNumber);
+
+	// Returns all ranges which were freed in frames <= completedFrameNumber.
+	static void releaseStaleAllocations(uint64 completedFrameNumber);
+
+	// Moves up to maxMoves relocatable resources towards the start of their heaps and releases heaps which are completely
+	// empty. The copies are recorded into the command list, which must not have recorded anything else yet. This waits
+	// for the GPU first. The command list keeps the old resources alive until it has executed. Returns the number of
+	// moved resources.
+	// Relocatable resources must not be released by other threads at the same time.
+	static uint32 defragment(dx_command_list* commandList, uint32 maxMoves = 16);
+
+	static void getStatistics(std::vector<gpu_heap_statistics>& outStatistics);
+
+	// Only affects resources created afterwards.
+	static bool enableSubAllocation;
+
+private:
+	friend struct placed_allocation;
+
+	enum resource_category
+	{
+		resource_category_buffer,
+		resource_category_texture,
+		resource_category_rt_ds_texture,
+
+		resource_category_count,
+	};
+
+	enum alignment_class
+	{
+		alignment_class_64KB,
+		alignment_class_4MB,
+
+		alignment_class_count,
+	};
+
+	struct heap_page
+	{
+		ComPtr<ID3D12Heap> heap;
+		tlsf_allocator allocator;
+		uint32 poolIndex;
+		std::vector<placed_allocation*> relocatableAllocations;
+	};
+
+	struct pool
+	{
+		resource_category category;
+		alignment_class alignment;
+		std::vector<std::unique_ptr<heap_page>> pages; // Pointers, because allocations store a pointer to their page.
+	};
+
+	static uint32 getPool(const D3D12_RESOURCE_DESC& desc);
+	static uint64 getAlignment(alignment_class alignment);
+	static heap_page* createPage(uint32 poolIndex);
+	static void free(placed_allocation* allocation);
+
+	static ComPtr<ID3D12Device2> device;
+	static uint64 heapSize;
+	static pool pools[resource_category_count * alignment_class_count];
+	static std::mutex mutex;
+	static std::atomic_uint64_t currentFrameNumber;
+};
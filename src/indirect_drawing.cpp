@@ -3,6 +3,9 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "bindless_descriptor_table.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <pix3.h>
 
@@ -57,14 +60,23 @@ void indirect_draw_buffer::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 	{
 		PROFILE_BLOCK("Set up indirect descriptor heap");
 
-		descriptors.descriptorHeap.initialize(device,
-			(uint32)indirectMaterials.size() * 4	// Materials.
-			+ 3										// PBR Textures.
+		// The material textures have been registered in the bindless table while loading. The shader finds them through the
+		// material texture slots, so streaming a texture in or out only requires updating these.
+		std::vector<material_texture_slots> slots(indirectMaterials.size());
+		for (uint32 i = 0; i < (uint32)indirectMaterials.size(); ++i)
+		{
+			slots[i] = getMaterialTextureSlots(indirectMaterials[i]);
+		}
+		materialTextureSlots.initialize(device, slots.data(), (uint32)slots.size(), commandList);
+		SET_NAME(materialTextureSlots.resource, "Material texture slots");
+
+		descriptors.descriptorHeap = dx_bindless_descriptor_table::allocateStaticRange(
+			3										// PBR Textures.
 			+ MAX_NUM_SUN_SHADOW_CASCADES			// Sun shadow map cascades.
 			+ 1										// Spot light shadow map.
 			+ 3										// Light probes.
+			+ 1										// Material texture slots.
 		);
-		SET_NAME(descriptors.descriptorHeap.descriptorHeap, "Indirect descriptor heap");
 
 		descriptors.brdfOffset = descriptors.descriptorHeap.gpuHandle;
 		descriptors.descriptorHeap.pushCubemap(irradiance);
@@ -87,59 +99,36 @@ void indirect_draw_buffer::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 		descriptors.descriptorHeap.pushStructuredBuffer(lightProbeSystem.packedSphericalHarmonicsBuffer);
 		descriptors.descriptorHeap.pushStructuredBuffer(lightProbeSystem.lightProbeTetrahedraBuffer);
 
-		// I am putting the material textures at the very end of the descriptor heap, since they are variably sized and the shader complains if there
-		// is a buffer coming after them.
-		descriptors.albedosOffset = descriptors.descriptorHeap.gpuHandle;
-		for (uint32 i = 0; i < indirectMaterials.size(); ++i)
-		{
-			if (indirectMaterials[i].albedo.resource)
-			{
-				descriptors.descriptorHeap.push2DTexture(indirectMaterials[i].albedo);
-			}
-			else
-			{
-				descriptors.descriptorHeap.pushNullTexture();
-			}
-		}
-		descriptors.normalsOffset = descriptors.descriptorHeap.gpuHandle;
-		for (uint32 i = 0; i < indirectMaterials.size(); ++i)
-		{
-			if (indirectMaterials[i].normal.resource)
-			{
-				descriptors.descriptorHeap.push2DTexture(indirectMaterials[i].normal);
-			}
-			else
-			{
-				descriptors.descriptorHeap.pushNullTexture();
-			}
-		}
-		descriptors.roughnessesOffset = descriptors.descriptorHeap.gpuHandle;
-		for (uint32 i = 0; i < indirectMaterials.size(); ++i)
-		{
-			if (indirectMaterials[i].roughness.resource)
-			{
-				descriptors.descriptorHeap.push2DTexture(indirectMaterials[i].roughness);
-			}
-			else
-			{
-				descriptors.descriptorHeap.pushNullTexture();
-			}
-		}
-		descriptors.metallicsOffset = descriptors.descriptorHeap.gpuHandle;
-		for (uint32 i = 0; i < indirectMaterials.size(); ++i)
-		{
-			if (indirectMaterials[i].metallic.resource)
-			{
-				descriptors.descriptorHeap.push2DTexture(indirectMaterials[i].metallic);
-			}
-			else
-			{
-				descriptors.descriptorHeap.pushNullTexture();
-			}
-		}
+		descriptors.materialTexturesOffset = descriptors.descriptorHeap.gpuHandle;
+		descriptors.descriptorHeap.pushStructuredBuffer(materialTextureSlots);
+
+		descriptors.bindlessTexturesOffset = dx_bindless_descriptor_table::getTexturesGPUHandle();
 	}
 }
 
+material_texture_slots indirect_draw_buffer::getMaterialTextureSlots(const dx_material& material)
+{
+	// Unused textures point to the fallback slot. The shader checks the usage flags before sampling.
+	auto getSlot = [](const dx_texture& texture)
+	{
+		return dx_bindless_descriptor_table::getSlot(texture.bindlessSRV);
+	};
+
+	material_texture_slots result;
+	result.albedo = getSlot(material.albedo);
+	result.normal = getSlot(material.normal);
+	result.roughness = getSlot(material.roughness);
+	result.metallic = getSlot(material.metallic);
+	return result;
+}
+
+void indirect_draw_buffer::updateMaterialTextureSlots(dx_command_list* commandList, uint32 materialIndex)
+{
+	material_texture_slots slots = getMaterialTextureSlots(indirectMaterials[materialIndex]);
+	commandList->updateBufferDataRange(materialTextureSlots.resource, &slots, materialIndex * (uint32)sizeof(material_texture_slots), (uint32)sizeof(material_texture_slots));
+	commandList->transitionBarrier(materialTextureSlots, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
+
 void indirect_draw_buffer::pushInstance(submesh_info submesh, mat4 transform)
 {
 	submesh_identifier id = submesh;
@@ -163,13 +152,39 @@ void indirect_draw_buffer::pushInstance(submesh_info submesh, mat4 transform, ve
 void indirect_draw_buffer::finish(dx_command_list* commandList)
 {
 	PROFILE_FUNCTION();
+	SCRATCH_SCOPE(); // The buffers copy the data.
+
+	scratch_vector<indirect_command> commands;
+	scratch_vector<indirect_depth_only_command> depthOnlyCommands;
+	scratch_vector<mat4> instanceData;
+
+	buildCommands(commands, depthOnlyCommands, instanceData);
+	numDrawCalls = (uint32)commands.size();
+
+	commandBuffer.initialize(device, commands.data(), numDrawCalls, commandList);
+	depthOnlyCommandBuffer.initialize(device, depthOnlyCommands.data(), numDrawCalls, commandList);
+	instanceBuffer.initialize(device, instanceData.data(), (uint32)instanceData.size(), commandList);
+
+	SET_NAME(commandBuffer.resource, "Indirect command buffer");
+	SET_NAME(depthOnlyCommandBuffer.resource, "Indirect depth only command buffer");
+	SET_NAME(instanceBuffer.resource, "Indirect instance buffer");
+}
 
-	numDrawCalls = (uint32)instances.size();
+void indirect_draw_buffer::buildCommands(scratch_vector<indirect_command>& outCommands, scratch_vector<indirect_depth_only_command>& outDepthOnlyCommands,
+	scratch_vector<mat4>& outInstanceData) const
+{
+	uint32 numCommands = (uint32)instances.size();
 
-	std::vector<indirect_command> commands(numDrawCalls);
-	std::vector<indirect_depth_only_command> depthOnlyCommands(numDrawCalls);
+	uint32 numInstances = 0;
+	for (auto& mesh : instances)
+	{
+		numInstances += (uint32)mesh.second.size();
+	}
 
-	std::vector<mat4> instanceData;
+	outCommands.resize(numCommands);
+	outDepthOnlyCommands.resize(numCommands);
+	outInstanceData.clear();
+	outInstanceData.reserve(numInstances);
 
 	uint32 i = 0;
 	for (auto& mesh : instances)
@@ -177,8 +192,8 @@ void indirect_draw_buffer::finish(dx_command_list* commandList)
 		const submesh_identifier& id = mesh.first;
 		const std::vector<mat4>& matrices = mesh.second;
 
-		indirect_command& command = commands[i];
-		indirect_depth_only_command& doCommand = depthOnlyCommands[i];
+		indirect_command& command = outCommands[i];
+		indirect_depth_only_command& doCommand = outDepthOnlyCommands[i];
 
 		command.material.albedoTint = id.albedoTint;
 		command.material.roughnessOverride = id.roughnessOverride;
@@ -189,39 +204,29 @@ void indirect_draw_buffer::finish(dx_command_list* commandList)
 		command.drawArguments.IndexCountPerInstance = id.numTriangles * 3;
 		command.drawArguments.BaseVertexLocation = id.baseVertex;
 		command.drawArguments.InstanceCount = (uint32)matrices.size();
-		command.drawArguments.StartInstanceLocation = (uint32)instanceData.size();
+		command.drawArguments.StartInstanceLocation = (uint32)outInstanceData.size();
 
 		doCommand.drawArguments = command.drawArguments;
 
-		append(instanceData, matrices);
+		outInstanceData.insert(outInstanceData.end(), matrices.begin(), matrices.end());
 
 		++i;
 	}
 
-	for (mat4& m : instanceData)
+	for (mat4& m : outInstanceData)
 	{
 		m = comp_mat(m).transpose();
 	}
-
-	commandBuffer.initialize(device, commands.data(), numDrawCalls, commandList);
-	depthOnlyCommandBuffer.initialize(device, depthOnlyCommands.data(), numDrawCalls, commandList);
-	instanceBuffer.initialize(device, instanceData.data(), (uint32)instanceData.size(), commandList);
-
-	SET_NAME(commandBuffer.resource, "Indirect command buffer");
-	SET_NAME(depthOnlyCommandBuffer.resource, "Indirect depth only command buffer");
-	SET_NAME(instanceBuffer.resource, "Indirect instance buffer");
 }
 
 void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render_target& renderTarget, DXGI_FORMAT shadowMapFormat)
 {
 	PROFILE_BLOCK("Indirect pipeline");
 
-	ComPtr<ID3DBlob> vertexShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/geometry_vs.cso", &vertexShaderBlob));
-	ComPtr<ID3DBlob> pixelShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/standard_ps.cso", &pixelShaderBlob));
+	D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/geometry_vs.cso");
+	D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/standard_ps.cso");
 
-	D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+	static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -245,10 +250,8 @@ void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 
 	CD3DX12_DESCRIPTOR_RANGE1 pbrTextures(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 0, 1);
 
-	CD3DX12_DESCRIPTOR_RANGE1 albedos(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 2);
-	CD3DX12_DESCRIPTOR_RANGE1 normals(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 3);
-	CD3DX12_DESCRIPTOR_RANGE1 roughnesses(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 4);
-	CD3DX12_DESCRIPTOR_RANGE1 metallics(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 5);
+	CD3DX12_DESCRIPTOR_RANGE1 bindlessTextures(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 2, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
+	CD3DX12_DESCRIPTOR_RANGE1 materialTextures(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 3);
 
 	CD3DX12_DESCRIPTOR_RANGE1 shadowMaps(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, MAX_NUM_SUN_SHADOW_CASCADES + 1, 0, 6); // Sun cascades + spot light.
 
@@ -261,7 +264,7 @@ void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 		CD3DX12_DESCRIPTOR_RANGE1(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2, 7), // Tetrahedra.
 	};
 
-	CD3DX12_ROOT_PARAMETER1 rootParameters[11];
+	CD3DX12_ROOT_PARAMETER1 rootParameters[9];
 	rootParameters[INDIRECT_ROOTPARAM_CAMERA].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_ALL); // Camera.
 
 	rootParameters[INDIRECT_ROOTPARAM_MATERIAL].InitAsConstants(sizeof(material_cb) / sizeof(float), 2, 0, D3D12_SHADER_VISIBILITY_PIXEL); // Material.
@@ -270,10 +273,8 @@ void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 	rootParameters[INDIRECT_ROOTPARAM_BRDF_TEXTURES].InitAsDescriptorTable(1, &pbrTextures, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	// Materials.
-	rootParameters[INDIRECT_ROOTPARAM_ALBEDOS].InitAsDescriptorTable(1, &albedos, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootParameters[INDIRECT_ROOTPARAM_NORMALS].InitAsDescriptorTable(1, &normals, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootParameters[INDIRECT_ROOTPARAM_ROUGHNESSES].InitAsDescriptorTable(1, &roughnesses, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootParameters[INDIRECT_ROOTPARAM_METALLICS].InitAsDescriptorTable(1, &metallics, D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameters[INDIRECT_ROOTPARAM_BINDLESS_TEXTURES].InitAsDescriptorTable(1, &bindlessTextures, D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameters[INDIRECT_ROOTPARAM_MATERIAL_TEXTURES].InitAsDescriptorTable(1, &materialTextures, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	// Sun.
 	rootParameters[INDIRECT_ROOTPARAM_DIRECTIONAL].InitAsConstantBufferView(3, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -323,8 +324,8 @@ void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 		pipelineStateStream.rootSignature = geometryRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
@@ -332,10 +333,7 @@ void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 		pipelineStateStream.depthStencil = equalDepthDesc;
 #endif
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&geometryPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, geometryPipelineState, L"Indirect Pipeline");
 	}
 
 	// Depth only pass (for depth pre pass and shadow maps).
@@ -359,21 +357,16 @@ void indirect_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 		pipelineStateStream.rootSignature = depthOnlyRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
 		pipelineStateStream.dsvFormat = shadowMapFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&depthOnlyPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, depthOnlyPipelineState, L"Indirect Shadow Pipeline");
 	}
 
 
 	SET_NAME(geometryRootSignature.rootSignature, "Indirect Root Signature");
-	SET_NAME(geometryPipelineState, "Indirect Pipeline");
 	SET_NAME(depthOnlyRootSignature.rootSignature, "Indirect Shadow Root Signature");
-	SET_NAME(depthOnlyPipelineState, "Indirect Shadow Pipeline");
 
 
 	// Command Signature.
@@ -497,10 +490,8 @@ void indirect_pipeline::setupPipeline(dx_command_list* commandList, dx_mesh& mes
 	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_BRDF_TEXTURES, descriptors.brdfOffset);
 
 	// Materials.
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_ALBEDOS, descriptors.albedosOffset);
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_NORMALS, descriptors.normalsOffset);
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_ROUGHNESSES, descriptors.roughnessesOffset);
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_METALLICS, descriptors.metallicsOffset);
+	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_BINDLESS_TEXTURES, descriptors.bindlessTexturesOffset);
+	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(INDIRECT_ROOTPARAM_MATERIAL_TEXTURES, descriptors.materialTexturesOffset);
 
 	// Sun.
 	commandList->setGraphicsDynamicConstantBuffer(INDIRECT_ROOTPARAM_DIRECTIONAL, sunCBAddress);
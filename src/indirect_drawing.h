@@ -5,18 +5,17 @@
 #include "lighting.h"
 #include "camera.h"
 #include "descriptor_heap.h"
+#include "scratch_arena.h"
 
 #define INDIRECT_ROOTPARAM_CAMERA			0
 #define INDIRECT_ROOTPARAM_MATERIAL			1
 #define INDIRECT_ROOTPARAM_BRDF_TEXTURES	2
-#define INDIRECT_ROOTPARAM_ALBEDOS			3
-#define INDIRECT_ROOTPARAM_NORMALS			4
-#define INDIRECT_ROOTPARAM_ROUGHNESSES		5
-#define INDIRECT_ROOTPARAM_METALLICS		6
-#define INDIRECT_ROOTPARAM_DIRECTIONAL		7
-#define INDIRECT_ROOTPARAM_SPOT				8
-#define INDIRECT_ROOTPARAM_SHADOWMAPS		9
-#define INDIRECT_ROOTPARAM_LIGHTPROBES		10
+#define INDIRECT_ROOTPARAM_BINDLESS_TEXTURES	3
+#define INDIRECT_ROOTPARAM_MATERIAL_TEXTURES	4
+#define INDIRECT_ROOTPARAM_DIRECTIONAL		5
+#define INDIRECT_ROOTPARAM_SPOT				6
+#define INDIRECT_ROOTPARAM_SHADOWMAPS		7
+#define INDIRECT_ROOTPARAM_LIGHTPROBES		8
 
 
 #define DEPTH_PREPASS 1
@@ -36,13 +35,21 @@ struct indirect_depth_only_command
 };
 #pragma pack(pop)
 
+// Bindless slots of a material's textures, indexed by the texture ID in material_cb::textureID_usageFlags.
+struct material_texture_slots
+{
+	uint32 albedo;
+	uint32 normal;
+	uint32 roughness;
+	uint32 metallic;
+};
+
+// View into the static part of the bindless descriptor heap.
 struct indirect_descriptor_heap
 {
 	dx_descriptor_heap descriptorHeap;
-	CD3DX12_GPU_DESCRIPTOR_HANDLE albedosOffset;
-	CD3DX12_GPU_DESCRIPTOR_HANDLE normalsOffset;
-	CD3DX12_GPU_DESCRIPTOR_HANDLE roughnessesOffset;
-	CD3DX12_GPU_DESCRIPTOR_HANDLE metallicsOffset;
+	D3D12_GPU_DESCRIPTOR_HANDLE bindlessTexturesOffset;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE materialTexturesOffset;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE brdfOffset;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE shadowMapsOffset;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE lightProbeOffset;
@@ -128,8 +135,16 @@ struct indirect_draw_buffer
 
 	void finish(dx_command_list* commandList);
 
+	// CPU side of finish: one command per distinct submesh, and the transposed instance transforms in command order.
+	void buildCommands(scratch_vector<indirect_command>& outCommands, scratch_vector<indirect_depth_only_command>& outDepthOnlyCommands,
+		scratch_vector<mat4>& outInstanceData) const;
+
+	// Call after replacing textures of a material, e.g. when streaming.
+	void updateMaterialTextureSlots(dx_command_list* commandList, uint32 materialIndex);
+
 	dx_mesh indirectMesh;
 	std::vector<dx_material> indirectMaterials;
+	dx_structured_buffer materialTextureSlots;
 
 	dx_buffer commandBuffer;
 	dx_buffer depthOnlyCommandBuffer;
@@ -141,6 +156,7 @@ struct indirect_draw_buffer
 	ComPtr<ID3D12Device2> device;
 
 private:
+	static material_texture_slots getMaterialTextureSlots(const dx_material& material);
 
 	std::unordered_map<submesh_identifier, std::vector<mat4>> instances;
 };
@@ -1,6 +1,11 @@
 #pragma once
 
 
+// POSIX declares a type key_t, which collides with the enumerator when building the headless benchmarks on Linux.
+#ifndef _WIN32
+#define key_t keyboard_key_t
+#endif
+
 enum keyboard_key
 {
 	key_0, key_1, key_2, key_3, key_4, key_5, key_6, key_7, key_8, key_9,
@@ -16,6 +21,10 @@ enum keyboard_key
 	key_count, key_unknown
 };
 
+#ifndef _WIN32
+#undef key_t
+#endif
+
 enum mouse_button
 {
 	mouse_left,
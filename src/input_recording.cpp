@@ -0,0 +1,421 @@
+#include "pch.h"
+#include "input_recording.h"
+
+#include <cstring>
+
+#define INPUT_RECORDING_VERSION 1
+
+enum input_modifier_bits : uint8
+{
+	input_modifier_shift = (1 << 0),
+	input_modifier_ctrl = (1 << 1),
+	input_modifier_alt = (1 << 2),
+	input_modifier_left = (1 << 3),
+	input_modifier_right = (1 << 4),
+	input_modifier_middle = (1 << 5),
+};
+
+static uint8 packModifiers(bool shift, bool ctrl, bool alt, bool left = false, bool right = false, bool middle = false)
+{
+	return (shift ? input_modifier_shift : 0) | (ctrl ? input_modifier_ctrl : 0) | (alt ? input_modifier_alt : 0)
+		| (left ? input_modifier_left : 0) | (right ? input_modifier_right : 0) | (middle ? input_modifier_middle : 0);
+}
+
+struct input_writer
+{
+	std::vector<uint8> data;
+
+	void write(const void* bytes, uint32 size)
+	{
+		data.insert(data.end(), (const uint8*)bytes, (const uint8*)bytes + size);
+	}
+
+	void writeUint8(uint8 v) { data.push_back(v); }
+	void writeUint32(uint32 v) { write(&v, sizeof(v)); }
+	void writeFloat(float v) { write(&v, sizeof(v)); }
+
+	void writeVarint(uint32 v)
+	{
+		while (v >= 0x80)
+		{
+			data.push_back((uint8)(v | 0x80));
+			v >>= 7;
+		}
+		data.push_back((uint8)v);
+	}
+};
+
+// Every read checks the bounds, so that a truncated file fails to load instead of producing garbage.
+struct input_reader
+{
+	const uint8* current;
+	const uint8* end;
+
+	bool read(void* bytes, uint32 size)
+	{
+		if ((uint64)(end - current) < size)
+		{
+			return false;
+		}
+		memcpy(bytes, current, size);
+		current += size;
+		return true;
+	}
+
+	bool readUint8(uint8& v) { return read(&v, sizeof(v)); }
+	bool readUint32(uint32& v) { return read(&v, sizeof(v)); }
+	bool readFloat(float& v) { return read(&v, sizeof(v)); }
+
+	bool readVarint(uint32& v)
+	{
+		v = 0;
+		for (uint32 shift = 0; shift < 35; shift += 7)
+		{
+			uint8 byte;
+			if (!readUint8(byte))
+			{
+				return false;
+			}
+			v |= (uint32)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+static void writeEvent(input_writer& writer, const recorded_input_event& e)
+{
+	writer.writeUint8(e.type);
+	switch (e.type)
+	{
+		case input_event_key_down:
+		case input_event_key_up:
+		{
+			writer.writeUint8((uint8)e.keyboard.key);
+			writer.writeUint8(packModifiers(e.keyboard.shiftDown, e.keyboard.ctrlDown, e.keyboard.altDown));
+		} break;
+		case input_event_character:
+		{
+			writer.writeVarint(e.character.codePoint);
+		} break;
+		case input_event_mouse_button_down:
+		case input_event_mouse_button_up:
+		{
+			writer.writeUint8((uint8)e.mouseButton.button);
+			writer.writeUint8(packModifiers(e.mouseButton.shiftDown, e.mouseButton.ctrlDown, e.mouseButton.altDown));
+			writer.writeVarint(e.mouseButton.x);
+			writer.writeVarint(e.mouseButton.y);
+			writer.writeFloat(e.mouseButton.relX);
+			writer.writeFloat(e.mouseButton.relY);
+		} break;
+		case input_event_mouse_move:
+		{
+			const mouse_move_event& m = e.mouseMove;
+			writer.writeUint8(packModifiers(m.shiftDown, m.ctrlDown, m.altDown, m.leftDown, m.rightDown, m.middleDown));
+			writer.writeVarint(m.x);
+			writer.writeVarint(m.y);
+			writer.writeFloat(m.relX);
+			writer.writeFloat(m.relY);
+			writer.writeFloat(m.relDX);
+			writer.writeFloat(m.relDY);
+		} break;
+		case input_event_mouse_scroll:
+		{
+			const mouse_scroll_event& s = e.mouseScroll;
+			writer.writeUint8(packModifiers(s.shiftDown, s.ctrlDown, s.altDown, s.leftDown, s.rightDown, s.middleDown));
+			writer.writeFloat(s.scroll);
+			writer.writeVarint(s.x);
+			writer.writeVarint(s.y);
+			writer.writeFloat(s.relX);
+			writer.writeFloat(s.relY);
+		} break;
+		default:
+		{
+			assert(!"Unknown input event type.");
+		} break;
+	}
+}
+
+static bool readEvent(input_reader& reader, recorded_input_event& e)
+{
+	uint8 type, modifiers;
+	if (!reader.readUint8(type) || type >= input_event_type_count)
+	{
+		return false;
+	}
+
+	e = {};
+	e.type = (input_event_type)type;
+
+	switch (e.type)
+	{
+		case input_event_key_down:
+		case input_event_key_up:
+		{
+			uint8 key;
+			if (!reader.readUint8(key) || key >= key_count || !reader.readUint8(modifiers))
+			{
+				return false;
+			}
+			e.keyboard.key = (keyboard_key)key;
+			e.keyboard.shiftDown = (modifiers & input_modifier_shift) != 0;
+			e.keyboard.ctrlDown = (modifiers & input_modifier_ctrl) != 0;
+			e.keyboard.altDown = (modifiers & input_modifier_alt) != 0;
+			return true;
+		}
+		case input_event_character:
+		{
+			return reader.readVarint(e.character.codePoint);
+		}
+		case input_event_mouse_button_down:
+		case input_event_mouse_button_up:
+		{
+			uint8 button;
+			mouse_button_event& b = e.mouseButton;
+			if (!reader.readUint8(button) || !reader.readUint8(modifiers)
+				|| !reader.readVarint(b.x) || !reader.readVarint(b.y) || !reader.readFloat(b.relX) || !reader.readFloat(b.relY))
+			{
+				return false;
+			}
+			b.button = (mouse_button)button;
+			b.shiftDown = (modifiers & input_modifier_shift) != 0;
+			b.ctrlDown = (modifiers & input_modifier_ctrl) != 0;
+			b.altDown = (modifiers & input_modifier_alt) != 0;
+			return true;
+		}
+		case input_event_mouse_move:
+		{
+			mouse_move_event& m = e.mouseMove;
+			if (!reader.readUint8(modifiers) || !reader.readVarint(m.x) || !reader.readVarint(m.y)
+				|| !reader.readFloat(m.relX) || !reader.readFloat(m.relY) || !reader.readFloat(m.relDX) || !reader.readFloat(m.relDY))
+			{
+				return false;
+			}
+			m.shiftDown = (modifiers & input_modifier_shift) != 0;
+			m.ctrlDown = (modifiers & input_modifier_ctrl) != 0;
+			m.altDown = (modifiers & input_modifier_alt) != 0;
+			m.leftDown = (modifiers & input_modifier_left) != 0;
+			m.rightDown = (modifiers & input_modifier_right) != 0;
+			m.middleDown = (modifiers & input_modifier_middle) != 0;
+			return true;
+		}
+		case input_event_mouse_scroll:
+		{
+			mouse_scroll_event& s = e.mouseScroll;
+			if (!reader.readUint8(modifiers) || !reader.readFloat(s.scroll) || !reader.readVarint(s.x) || !reader.readVarint(s.y)
+				|| !reader.readFloat(s.relX) || !reader.readFloat(s.relY))
+			{
+				return false;
+			}
+			s.shiftDown = (modifiers & input_modifier_shift) != 0;
+			s.ctrlDown = (modifiers & input_modifier_ctrl) != 0;
+			s.altDown = (modifiers & input_modifier_alt) != 0;
+			s.leftDown = (modifiers & input_modifier_left) != 0;
+			s.rightDown = (modifiers & input_modifier_right) != 0;
+			s.middleDown = (modifiers & input_modifier_middle) != 0;
+			return true;
+		}
+		default:
+		{
+			return false; // Unknown type, the file is damaged or newer than this build.
+		}
+	}
+}
+
+bool input_recording::save(const char* path) const
+{
+	input_writer writer;
+	writer.write("INPR", 4);
+	writer.writeUint32(INPUT_RECORDING_VERSION);
+	writer.writeUint32(width);
+	writer.writeUint32(height);
+	writer.writeUint32((uint32)frames.size());
+
+	for (const recorded_frame& frame : frames)
+	{
+		writer.writeFloat(frame.dt);
+		writer.writeUint32(frame.randomSeed);
+		writer.writeVarint(frame.numEvents);
+		for (uint32 i = 0; i < frame.numEvents; ++i)
+		{
+			writeEvent(writer, events[frame.firstEvent + i]);
+		}
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		std::cerr << "Could not open " << path << " for writing." << std::endl;
+		return false;
+	}
+	bool success = fwrite(writer.data.data(), 1, writer.data.size(), file) == writer.data.size();
+	fclose(file);
+	return success;
+}
+
+bool input_recording::load(const char* path)
+{
+	frames.clear();
+	events.clear();
+
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		std::cerr << "Could not open " << path << "." << std::endl;
+		return false;
+	}
+
+	std::vector<uint8> data;
+	uint8 buffer[4096];
+	size_t numRead;
+	while ((numRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		data.insert(data.end(), buffer, buffer + numRead);
+	}
+	fclose(file);
+
+	input_reader reader = { data.data(), data.data() + data.size() };
+
+	char magic[4];
+	uint32 version, numFrames;
+	if (!reader.read(magic, 4) || memcmp(magic, "INPR", 4) != 0 || !reader.readUint32(version) || version != INPUT_RECORDING_VERSION
+		|| !reader.readUint32(width) || !reader.readUint32(height) || !reader.readUint32(numFrames))
+	{
+		std::cerr << path << " is not an input recording of version " << INPUT_RECORDING_VERSION << "." << std::endl;
+		return false;
+	}
+
+	frames.reserve(numFrames);
+	for (uint32 f = 0; f < numFrames; ++f)
+	{
+		recorded_frame frame;
+		if (!reader.readFloat(frame.dt) || !reader.readUint32(frame.randomSeed) || !reader.readVarint(frame.numEvents))
+		{
+			break;
+		}
+		frame.firstEvent = (uint32)events.size();
+
+		bool valid = true;
+		for (uint32 i = 0; i < frame.numEvents && valid; ++i)
+		{
+			recorded_input_event e;
+			valid = readEvent(reader, e);
+			if (valid)
+			{
+				events.push_back(e);
+			}
+		}
+		if (!valid)
+		{
+			break;
+		}
+
+		frames.push_back(frame);
+	}
+
+	if (frames.size() != numFrames)
+	{
+		std::cerr << path << " is damaged after frame " << frames.size() << " of " << numFrames << "." << std::endl;
+		frames.clear();
+		events.clear();
+		return false;
+	}
+	return true;
+}
+
+double input_recording::getDuration() const
+{
+	double duration = 0.0;
+	for (const recorded_frame& frame : frames)
+	{
+		duration += frame.dt;
+	}
+	return duration;
+}
+
+
+void input_recorder::begin(uint32 width, uint32 height, uint32 baseSeed)
+{
+	result = input_recording();
+	result.width = width;
+	result.height = height;
+	this->baseSeed = baseSeed;
+	firstEventOfFrame = 0;
+	recording = true;
+}
+
+void input_recorder::push(const recorded_input_event& event)
+{
+	if (recording)
+	{
+		result.events.push_back(event);
+	}
+}
+
+void input_recorder::record(input_event_type type, const keyboard_event& event)
+{
+	recorded_input_event e;
+	e.type = type;
+	e.keyboard = event;
+	push(e);
+}
+
+void input_recorder::record(input_event_type type, const character_event& event)
+{
+	recorded_input_event e;
+	e.type = type;
+	e.character = event;
+	push(e);
+}
+
+void input_recorder::record(input_event_type type, const mouse_button_event& event)
+{
+	recorded_input_event e;
+	e.type = type;
+	e.mouseButton = event;
+	push(e);
+}
+
+void input_recorder::record(input_event_type type, const mouse_move_event& event)
+{
+	recorded_input_event e;
+	e.type = type;
+	e.mouseMove = event;
+	push(e);
+}
+
+void input_recorder::record(input_event_type type, const mouse_scroll_event& event)
+{
+	recorded_input_event e;
+	e.type = type;
+	e.mouseScroll = event;
+	push(e);
+}
+
+uint32 input_recorder::endFrame(float dt)
+{
+	if (!recording)
+	{
+		return 0;
+	}
+
+	// Different for every frame, but reproducible from the base seed.
+	uint32 seed = baseSeed + (uint32)result.frames.size() * 0x9E3779B9;
+	seed ^= seed >> 16;
+	seed *= 0x85EBCA6B;
+	seed ^= seed >> 13;
+
+	recorded_frame frame;
+	frame.dt = dt;
+	frame.randomSeed = seed;
+	frame.firstEvent = firstEventOfFrame;
+	frame.numEvents = (uint32)result.events.size() - firstEventOfFrame;
+	result.frames.push_back(frame);
+
+	firstEventOfFrame = (uint32)result.events.size();
+
+	return seed;
+}
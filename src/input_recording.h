@@ -0,0 +1,94 @@
+#pragma once
+
+#include "common.h"
+#include "input.h"
+
+// Recorded sessions make performance runs repeatable: every frame stores the input events dispatched before the update, the
+// frame time and the seed passed to srand before the update. Replaying them feeds the same events back, with either the
+// recorded or a fixed time step, so the camera follows the same path on every run.
+//
+// File format (little endian):
+//   header: char magic[4] = "INPR", uint32 version, uint32 width, uint32 height, uint32 numFrames
+//   frames: float dt, uint32 random seed, varint numEvents, followed by the events:
+//     uint8 input_event_type, followed by
+//     key down/up:         uint8 key, uint8 modifiers
+//     character:           varint code point
+//     mouse button down/up: uint8 button, uint8 modifiers, varint x, varint y, float relX, float relY
+//     mouse move:          uint8 buttons and modifiers, varint x, varint y, float relX, float relY, float relDX, float relDY
+//     mouse scroll:        uint8 buttons and modifiers, float scroll, varint x, varint y, float relX, float relY
+// Modifiers are shift, ctrl and alt in bits 0 to 2. Mouse buttons are left, right and middle in bits 3 to 5.
+enum input_event_type : uint8
+{
+	input_event_key_down,
+	input_event_key_up,
+	input_event_character,
+	input_event_mouse_button_down,
+	input_event_mouse_button_up,
+	input_event_mouse_move,
+	input_event_mouse_scroll,
+
+	input_event_type_count,
+};
+
+struct recorded_input_event
+{
+	input_event_type type;
+	union
+	{
+		keyboard_event keyboard;
+		character_event character;
+		mouse_button_event mouseButton;
+		mouse_move_event mouseMove;
+		mouse_scroll_event mouseScroll;
+	};
+};
+
+struct recorded_frame
+{
+	float dt;
+	uint32 randomSeed;
+	uint32 firstEvent;
+	uint32 numEvents;
+};
+
+struct input_recording
+{
+	// Client size of the window when the recording started. Relative mouse positions and the camera's aspect ratio depend on it.
+	uint32 width = 0;
+	uint32 height = 0;
+
+	std::vector<recorded_frame> frames;
+	std::vector<recorded_input_event> events;
+
+	bool save(const char* path) const;
+	bool load(const char* path); // Returns false if the file is missing or damaged.
+
+	double getDuration() const;
+};
+
+class input_recorder
+{
+public:
+	void begin(uint32 width, uint32 height, uint32 baseSeed);
+	bool isRecording() const { return recording; }
+
+	// The type is stored as given, so key and mouse button events can be recorded as down or up.
+	void record(input_event_type type, const keyboard_event& event);
+	void record(input_event_type type, const character_event& event);
+	void record(input_event_type type, const mouse_button_event& event);
+	void record(input_event_type type, const mouse_move_event& event);
+	void record(input_event_type type, const mouse_scroll_event& event);
+
+	// Closes the frame with all events recorded since the last call. Returns the seed to pass to srand before the update.
+	uint32 endFrame(float dt);
+
+	const input_recording& getRecording() const { return result; }
+
+private:
+	void push(const recorded_input_event& event);
+
+	input_recording result;
+	uint32 baseSeed = 0;
+	uint32 firstEventOfFrame = 0;
+	bool recording = false;
+};
@@ -0,0 +1,64 @@
+#include "pch.h"
+#include "light_probe_tetrahedra.h"
+
+void computeLightProbeTetrahedronMatrix(const vec4* positions, light_probe_tetrahedron& tet)
+{
+	vec3 c0 = positions[tet.a] - positions[tet.d];
+	vec3 c1 = positions[tet.b] - positions[tet.d];
+	vec3 c2 = positions[tet.c] - positions[tet.d];
+
+	mat4 mat(c0.x, c1.x, c2.x, 0.f,
+		c0.y, c1.y, c2.y, 0.f,
+		c0.z, c1.z, c2.z, 0.f,
+		0.f, 0.f, 0.f, 1.f);
+
+	tet.matrix = mat.invert();
+}
+
+vec4 calculateLightProbeBarycentricCoordinates(const vec4* positions, const light_probe_tetrahedron& tet, vec3 position)
+{
+	vec4 barycentric = tet.matrix * (position - positions[tet.d]);
+	barycentric.w = 1.f - barycentric.x - barycentric.y - barycentric.z;
+	return barycentric;
+}
+
+uint32 findEnclosingLightProbeTetrahedron(const vec4* positions, const light_probe_tetrahedron* tetrahedra, vec3 position,
+	uint32 lastTetrahedron, vec4& barycentric)
+{
+	barycentric = calculateLightProbeBarycentricCoordinates(positions, tetrahedra[lastTetrahedron], position);
+
+	const uint32 maxNumIterations = 512;
+
+	uint32 iterations = 0;
+
+	while (!(barycentric.x >= 0.f && barycentric.y >= 0.f && barycentric.z >= 0.f && barycentric.w >= 0.f) && iterations < maxNumIterations)
+	{
+		uint32 smallestIndex = 0;
+		float smallest = barycentric.x;
+		for (uint32 i = 1; i < 4; ++i)
+		{
+			if (barycentric.data[i] < smallest)
+			{
+				smallest = barycentric.data[i];
+				smallestIndex = i;
+			}
+		}
+		assert(smallest < 0.f);
+
+		int neighbor = tetrahedra[lastTetrahedron].neighbors[smallestIndex];
+
+		if (neighbor != -1)
+		{
+			lastTetrahedron = (uint32)neighbor;
+			barycentric = calculateLightProbeBarycentricCoordinates(positions, tetrahedra[lastTetrahedron], position);
+		}
+		else
+		{
+			break;
+		}
+
+		++iterations;
+	}
+
+	return lastTetrahedron;
+}
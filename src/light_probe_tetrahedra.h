@@ -0,0 +1,34 @@
+#pragma once
+
+#include "math.h"
+
+struct light_probe_tetrahedron
+{
+	union
+	{
+		struct
+		{
+			int a, b, c, d;
+		};
+		int indices[4];
+	};
+	union
+	{
+		struct
+		{
+			int na, nb, nc, nd;
+		};
+		int neighbors[4]; // Neighbor i shares the face opposite of vertex i. -1 on the hull.
+	};
+
+	mat4 matrix; // Inverse of the matrix spanned by the edges to vertex d.
+};
+
+// These only touch CPU data, so they are also used by the headless benchmarks.
+void computeLightProbeTetrahedronMatrix(const vec4* positions, light_probe_tetrahedron& tet);
+vec4 calculateLightProbeBarycentricCoordinates(const vec4* positions, const light_probe_tetrahedron& tet, vec3 position);
+
+// Walks from lastTetrahedron through the face with the most negative barycentric coordinate until all are positive. Starting
+// at last frame's result usually takes only a few steps. Outside of the hull, the walk stops at a tetrahedron on the hull.
+uint32 findEnclosingLightProbeTetrahedron(const vec4* positions, const light_probe_tetrahedron* tetrahedra, vec3 position,
+	uint32 lastTetrahedron, vec4& barycentric);
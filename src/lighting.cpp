@@ -3,6 +3,8 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <tetgen/tetgen.h>
 
@@ -60,8 +62,9 @@ static packed_spherical_harmonics packSphericalHarmonics(const spherical_harmoni
 void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_list* commandList, const dx_render_target& renderTarget,
 	const std::vector<vec4>& lightProbePositions, const std::vector<spherical_harmonics>& sphericalHarmonics)
 {
-	DXGI_FORMAT hdrFormat = renderTarget.colorAttachments[0]->format;
-	DXGI_FORMAT depthFormat = renderTarget.depthStencilAttachment->format;
+	// Only the formats, since the attachments of the target might be transient.
+	DXGI_FORMAT hdrFormat = renderTarget.renderTargetFormat.RTFormats[0];
+	DXGI_FORMAT depthFormat = renderTarget.depthStencilFormat;
 
 	// Light probe cubemaps.
 	CD3DX12_RESOURCE_DESC hdrTextureDesc = CD3DX12_RESOURCE_DESC::Tex2D(hdrFormat, LIGHT_PROBE_RESOLUTION, LIGHT_PROBE_RESOLUTION);
@@ -101,14 +104,12 @@ void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_lis
 
 	// Visualization pipelines.
 
-	ComPtr<ID3DBlob> vertexShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/visualize_light_probe_vs.cso", &vertexShaderBlob));
+	D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/visualize_light_probe_vs.cso");
 
 	{
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/visualize_light_probe_cubemap_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/visualize_light_probe_cubemap_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
 
@@ -152,26 +153,21 @@ void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_lis
 		pipelineStateStream.rootSignature = visualizeCubemapRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&visualizeCubemapPipeline)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, visualizeCubemapPipeline, L"Visualize Cubemap Light Probe Pipeline");
 
 		SET_NAME(visualizeCubemapRootSignature.rootSignature, "Visualize Cubemap Light Probe Root Signature");
-		SET_NAME(visualizeCubemapPipeline, "Visualize Cubemap Light Probe Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/visualize_light_probe_sh_buffer_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/visualize_light_probe_sh_buffer_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
 
@@ -214,26 +210,21 @@ void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_lis
 		pipelineStateStream.rootSignature = visualizeSHBufferRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&visualizeSHBufferPipeline)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, visualizeSHBufferPipeline, L"Visualize SH Light Probe Buffer Pipeline");
 
 		SET_NAME(visualizeSHBufferRootSignature.rootSignature, "Visualize SH Light Probe Buffer Root Signature");
-		SET_NAME(visualizeSHBufferPipeline, "Visualize SH Light Probe Buffer Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/visualize_light_probe_sh_direct_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/visualize_light_probe_sh_direct_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
 
@@ -273,19 +264,15 @@ void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_lis
 		pipelineStateStream.rootSignature = visualizeSHDirectRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&visualizeSHDirectPipeline)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, visualizeSHDirectPipeline, L"Visualize SH Light Probe Direct Pipeline");
 
 		SET_NAME(visualizeSHDirectRootSignature.rootSignature, "Visualize SH Light Probe Direct Root Signature");
-		SET_NAME(visualizeSHDirectPipeline, "Visualize SH Light Probe Direct Pipeline");
 	}
 
 	cpu_triangle_mesh<vertex_3P> sphere;
@@ -362,16 +349,7 @@ void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_lis
 			tet.nc = tetgenOut.neighborlist[i * 4 + 2];
 			tet.nd = tetgenOut.neighborlist[i * 4 + 3];
 
-			vec3 c0 = lightProbePositions[tet.a] - lightProbePositions[tet.d];
-			vec3 c1 = lightProbePositions[tet.b] - lightProbePositions[tet.d];
-			vec3 c2 = lightProbePositions[tet.c] - lightProbePositions[tet.d];
-
-			mat4 mat(c0.x, c1.x, c2.x, 0.f,
-				c0.y, c1.y, c2.y, 0.f,
-				c0.z, c1.z, c2.z, 0.f,
-				0.f, 0.f, 0.f, 1.f);
-
-			tet.matrix = mat.invert();
+			computeLightProbeTetrahedronMatrix(lightProbePositions.data(), tet);
 		}
 
 		std::vector<indexed_line16> edgeList(tetgenOut.numberofedges);
@@ -445,11 +423,7 @@ void light_probe_system::initialize(ComPtr<ID3D12Device2> device, dx_command_lis
 
 vec4 light_probe_system::calculateBarycentricCoordinates(const light_probe_tetrahedron& tet, vec3 position)
 {
-	//PROFILE_FUNCTION();
-
-	vec4 barycentric = tet.matrix * (position - lightProbePositions[tet.d]);
-	barycentric.w = 1.f - barycentric.x - barycentric.y - barycentric.z;
-	return barycentric;
+	return calculateLightProbeBarycentricCoordinates(lightProbePositions.data(), tet, position);
 }
 
 spherical_harmonics light_probe_system::getInterpolatedSphericalHarmonics(const light_probe_tetrahedron& tet, vec4 barycentric)
@@ -479,44 +453,7 @@ spherical_harmonics light_probe_system::getInterpolatedSphericalHarmonics(uint32
 
 uint32 light_probe_system::getEnclosingTetrahedron(vec3 position, uint32 lastTetrahedron, vec4& barycentric)
 {
-	//PROFILE_FUNCTION();
-
-	barycentric = calculateBarycentricCoordinates(lightProbeTetrahedra[lastTetrahedron], position);
-
-	const uint32 maxNumIterations = 512;
-
-	uint32 iterations = 0;
-
-	while (!(barycentric.x >= 0.f && barycentric.y >= 0.f && barycentric.z >= 0.f && barycentric.w >= 0.f) && iterations < maxNumIterations)
-	{
-		uint32 smallestIndex = 0;
-		float smallest = barycentric.x;
-		for (uint32 i = 1; i < 4; ++i)
-		{
-			if (barycentric.data[i] < smallest)
-			{
-				smallest = barycentric.data[i];
-				smallestIndex = i;
-			}
-		}
-		assert(smallest < 0.f);
-
-		int neighbor = lightProbeTetrahedra[lastTetrahedron].neighbors[smallestIndex];
-
-		if (neighbor != -1)
-		{
-			lastTetrahedron = (uint32)neighbor;
-			barycentric = calculateBarycentricCoordinates(lightProbeTetrahedra[lastTetrahedron], position);
-		}
-		else
-		{
-			break;
-		}
-
-		++iterations;
-	}
-
-	return lastTetrahedron;
+	return findEnclosingLightProbeTetrahedron(lightProbePositions.data(), lightProbeTetrahedra.data(), position, lastTetrahedron, barycentric);
 }
 
 void light_probe_system::visualizeCubemap(dx_command_list* commandList, const render_camera& camera, vec3 position, dx_texture& cubemap,
@@ -646,7 +583,7 @@ void light_probe_system::visualizeLightProbes(dx_command_list* commandList, cons
 		commandList->setVertexBuffer(0, lightProbeMesh.vertexBuffer);
 		commandList->setIndexBuffer(lightProbeMesh.indexBuffer);
 
-		commandList->transitionBarrier(tempSphericalHarmonicsBuffer.resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		commandList->transitionBarrier(tempSphericalHarmonicsBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 		commandList->stageDescriptors(VISUALIZE_LIGHTPROBE_ROOTPARAM_SH, 0, 1, tempSphericalHarmonicsBuffer.srv);
 
 		// TODO: This could be rendered instanced.
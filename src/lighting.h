@@ -11,6 +11,7 @@
 #include "render_target.h"
 #include "command_list.h"
 #include "debug_display.h"
+#include "light_probe_tetrahedra.h"
 
 
 #define MAX_NUM_SUN_SHADOW_CASCADES 4
@@ -91,28 +92,6 @@ struct packed_spherical_harmonics
 	uint32 coefficients[9]; // Each int is 11 bits red, 11 bits green, 10 bits blue.
 };
 
-struct light_probe_tetrahedron
-{
-	union
-	{
-		struct
-		{
-			int a, b, c, d;
-		};
-		int indices[4];
-	};
-	union
-	{
-		struct
-		{
-			int na, nb, nc, nd;
-		};
-		int neighbors[4];
-	};
-
-	mat4 matrix;
-};
-
 
 #define VISUALIZE_LIGHTPROBE_ROOTPARAM_CB		0
 #define VISUALIZE_LIGHTPROBE_ROOTPARAM_TEXTURE	1
@@ -8,11 +8,22 @@
 #include "command_queue.h"
 #include "game.h"
 #include "descriptor_allocator.h"
+#include "bindless_descriptor_table.h"
+#include "resource_state_tracker.h"
+#include "heap_allocator.h"
+#include "upload_queue.h"
+#include "pipeline_factory.h"
+#include "shader_store.h"
 #include "graphics.h"
 #include "platform.h"
 #include "profiling.h"
+#include "profile_export.h"
+#include "input_recording.h"
+#include "scratch_arena.h"
+#include "tests.h"
 
 #include <windowsx.h>
+#include <ctime>
 
 
 static bool exclusiveFullscreen = false;
@@ -33,6 +44,10 @@ static std::vector<std::function<bool(mouse_button_event event)>> mouseButtonUpC
 static std::vector<std::function<bool(mouse_move_event event)>> mouseMoveCallbacks;
 static std::vector<std::function<bool(mouse_scroll_event event)>> mouseScrollCallbacks;
 
+static input_recorder inputRecorder;
+static input_recording inputReplay;
+static bool replayingInput = false;
+
 
 static bool initialized = false;
 
@@ -188,6 +203,33 @@ static void callCallback(std::vector<std::function<bool(T)>>& callbacks, const T
 	}
 }
 
+// Live input goes through here. During a replay it is ignored, so that only the recorded events steer the game.
+template <typename T>
+static void dispatchInputEvent(input_event_type type, std::vector<std::function<bool(T)>>& callbacks, const T& event)
+{
+	if (replayingInput)
+	{
+		return;
+	}
+
+	inputRecorder.record(type, event);
+	callCallback(callbacks, event);
+}
+
+static void dispatchRecordedInputEvent(const recorded_input_event& e)
+{
+	switch (e.type)
+	{
+	case input_event_key_down: callCallback(keyDownCallbacks, e.keyboard); break;
+	case input_event_key_up: callCallback(keyUpCallbacks, e.keyboard); break;
+	case input_event_character: callCallback(characterCallbacks, e.character); break;
+	case input_event_mouse_button_down: callCallback(mouseButtonDownCallbacks, e.mouseButton); break;
+	case input_event_mouse_button_up: callCallback(mouseButtonUpCallbacks, e.mouseButton); break;
+	case input_event_mouse_move: callCallback(mouseMoveCallbacks, e.mouseMove); break;
+	case input_event_mouse_scroll: callCallback(mouseScrollCallbacks, e.mouseScroll); break;
+	}
+}
+
 static keyboard_key mapVKCodeToKey(uint32 vkCode)
 {
 	if (vkCode >= '0' && vkCode <= '9')
@@ -271,7 +313,7 @@ LRESULT CALLBACK windowCallback(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wPara
 					keyboard_event event = { mapVKCodeToKey((uint32)wParam), shift, ctrl, alt };
 					if (event.key != key_unknown)
 					{
-						callCallback(keyDownCallbacks, event);
+						dispatchInputEvent(input_event_key_down, keyDownCallbacks, event);
 					}
 					if (event.key == key_shift)
 					{
@@ -296,7 +338,7 @@ LRESULT CALLBACK windowCallback(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wPara
 			keyboard_event event = { mapVKCodeToKey((uint32)wParam), shift, ctrl, alt };
 			if (event.key != key_unknown)
 			{
-				callCallback(keyUpCallbacks, event);
+				dispatchInputEvent(input_event_key_up, keyUpCallbacks, event);
 			}
 			if (event.key == key_shift)
 			{
@@ -315,55 +357,55 @@ LRESULT CALLBACK windowCallback(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wPara
 		case WM_UNICHAR:
 		{
 			character_event event = { (uint32)wParam };
-			callCallback(characterCallbacks, event);
+			dispatchInputEvent(input_event_character, characterCallbacks, event);
 		} break;
 
 		case WM_LBUTTONDOWN:
 		{
 			mouse_button_event event = { mouse_left, mouseX, mouseY, relMouseX, relMouseY, shift, ctrl, alt };
-			callCallback(mouseButtonDownCallbacks, event);
+			dispatchInputEvent(input_event_mouse_button_down, mouseButtonDownCallbacks, event);
 			left = true;
 		} break;
 
 		case WM_LBUTTONUP:
 		{
 			mouse_button_event event = { mouse_left, mouseX, mouseY, relMouseX, relMouseY, shift, ctrl, alt };
-			callCallback(mouseButtonUpCallbacks, event);
+			dispatchInputEvent(input_event_mouse_button_up, mouseButtonUpCallbacks, event);
 			left = false;
 		} break;
 
 		case WM_RBUTTONDOWN:
 		{
 			mouse_button_event event = { mouse_right, mouseX, mouseY, relMouseX, relMouseY, shift, ctrl, alt };
-			callCallback(mouseButtonDownCallbacks, event);
+			dispatchInputEvent(input_event_mouse_button_down, mouseButtonDownCallbacks, event);
 			right = true;
 		} break;
 
 		case WM_RBUTTONUP:
 		{
 			mouse_button_event event = { mouse_right, mouseX, mouseY, relMouseX, relMouseY, shift, ctrl, alt };
-			callCallback(mouseButtonUpCallbacks, event);
+			dispatchInputEvent(input_event_mouse_button_up, mouseButtonUpCallbacks, event);
 			right = false;
 		} break;
 
 		case WM_MBUTTONDOWN:
 		{
 			mouse_button_event event = { mouse_middle, mouseX, mouseY, relMouseX, relMouseY, shift, ctrl, alt };
-			callCallback(mouseButtonDownCallbacks, event);
+			dispatchInputEvent(input_event_mouse_button_down, mouseButtonDownCallbacks, event);
 			middle = true;
 		} break;
 
 		case WM_MBUTTONUP:
 		{
 			mouse_button_event event = { mouse_middle, mouseX, mouseY, relMouseX, relMouseY, shift, ctrl, alt };
-			callCallback(mouseButtonUpCallbacks, event);
+			dispatchInputEvent(input_event_mouse_button_up, mouseButtonUpCallbacks, event);
 			middle = false;
 		} break;
 
 		case WM_MOUSEWHEEL:
 		{
 			mouse_scroll_event event = { GET_WHEEL_DELTA_WPARAM(wParam) / 120.f, mouseX, mouseY, relMouseX, relMouseY, left, right, middle, shift, ctrl, alt };
-			callCallback(mouseScrollCallbacks, event);
+			dispatchInputEvent(input_event_mouse_scroll, mouseScrollCallbacks, event);
 		} break;
 
 		case WM_MOUSEMOVE:
@@ -383,7 +425,7 @@ LRESULT CALLBACK windowCallback(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wPara
 				currentHoverHWND = hwnd;
 			}
 
-			callCallback(mouseMoveCallbacks, event);
+			dispatchInputEvent(input_event_mouse_move, mouseMoveCallbacks, event);
 
 			lastRelMouseX = relMouseX;
 			lastRelMouseY = relMouseY;
@@ -452,13 +494,67 @@ LRESULT CALLBACK windowCallback(_In_ HWND hwnd, _In_ UINT msg, _In_ WPARAM wPara
 	}
 }
 
-int main()
+// Usage: renderer [--record <file>] [--replay <file>] [--fixed-dt <seconds>] [--run-tests]
+//
+// --record writes the input, frame times and random seeds of the session to the file when the application exits. --replay
+// plays such a file back, ignores live input and quits after the last recorded frame. --fixed-dt replaces the measured (or
+// recorded) frame time with a constant, which makes replays independent of the machine's frame rate. In all three cases the
+// simulation runs inline instead of on its own thread.
+// --run-tests runs the unit tests which need the D3D12 headers but no device (see tests.h) and exits with the number of
+// failed tests, without opening a window.
+int main(int argc, char** argv)
 {
 	PROFILE_INITIALIZATION();
 
 	uint32 initialWidth = 1280;
 	uint32 initialHeight = 720;
 
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	float fixedDt = 0.f;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--record") == 0 && hasValue)
+		{
+			recordPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+		{
+			replayPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--fixed-dt") == 0 && hasValue)
+		{
+			fixedDt = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--run-tests") == 0)
+		{
+			std::vector<unit_test> tests = getFrameGraphTests();
+			append(tests, getPipelineFactoryTests());
+			append(tests, getShaderStoreTests());
+			return runUnitTests(tests, nullptr, false);
+		}
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--record <file>] [--replay <file>] [--fixed-dt <seconds>] [--run-tests]" << std::endl;
+			return 1;
+		}
+	}
+
+	if (replayPath)
+	{
+		if (!inputReplay.load(replayPath) || inputReplay.frames.empty())
+		{
+			return 1;
+		}
+
+		// Relative mouse positions and the aspect ratio have to match the recording.
+		initialWidth = inputReplay.width;
+		initialHeight = inputReplay.height;
+		replayingInput = true;
+	}
+
 
 	{
 		PROFILE_BLOCK("Set up window and device");
@@ -496,6 +592,8 @@ int main()
 		device = createDevice(dxgiAdapter4);
 
 		dx_descriptor_allocator::initialize(device);
+		dx_heap_allocator::initialize(device);
+		dx_bindless_descriptor_table::initialize(device);
 		dx_command_queue::renderCommandQueue.initialize(device, D3D12_COMMAND_LIST_TYPE_DIRECT);
 		dx_command_queue::computeCommandQueue.initialize(device, D3D12_COMMAND_LIST_TYPE_COMPUTE);
 		dx_command_queue::copyCommandQueue.initialize(device, D3D12_COMMAND_LIST_TYPE_COPY);
@@ -504,6 +602,9 @@ int main()
 		SET_NAME(dx_command_queue::computeCommandQueue.getD3D12CommandQueue(), "Compute command queue");
 		SET_NAME(dx_command_queue::copyCommandQueue.getD3D12CommandQueue(), "Copy command queue");
 
+		dx_upload_queue::initialize(device);
+		dx_pipeline_factory::initialize(device);
+
 		initializeCommonGraphicsItems();
 
 		window.initialize(windowClass.lpszClassName, device, initialWidth, initialHeight, colorDepth, exclusiveFullscreen);
@@ -511,6 +612,18 @@ int main()
 
 	game.initialize(device, initialWidth, initialHeight, colorDepth);
 
+	if (recordPath && !replayingInput)
+	{
+		inputRecorder.begin(initialWidth, initialHeight, (uint32)time(nullptr));
+	}
+
+	// Recorded sessions need the simulation to depend on the frame times only, not on the wall clock.
+	if (!replayingInput && !inputRecorder.isRecording() && fixedDt <= 0.f)
+	{
+		game.startSimulationThread();
+	}
+	uint32 replayFrameIndex = 0;
+
 	uint64 fenceValues[NUM_BUFFERED_FRAMES] = {};
 	uint64 frameValues[NUM_BUFFERED_FRAMES] = {};
 
@@ -527,6 +640,7 @@ int main()
 	std::chrono::high_resolution_clock clock;
 	std::chrono::time_point now = clock.now();
 	std::chrono::time_point lastBeforeUpdate = now;
+	std::chrono::time_point replayStart = now;
 
 	uint32 currentBackBufferIndex = window.getCurrentBackBufferIndex();
 
@@ -534,6 +648,13 @@ int main()
 	while (running)
 	{
 		PROFILE_FRAME_MARKER(frameID);
+		getThreadScratchArena().reset();
+		dx_descriptor_allocator::beginFrame(frameID);
+		dx_bindless_descriptor_table::beginFrame(frameID);
+		dx_resource_state_tracker::beginFrame(frameID);
+		dx_heap_allocator::beginFrame(frameID);
+		dx_command_queue::beginFrame(frameID);
+		dx_upload_queue::update();
 
 		// Input and message processing.
 		{
@@ -561,6 +682,34 @@ int main()
 			float dt = (now - lastBeforeUpdate).count() * 1e-9f;
 			lastBeforeUpdate = now;
 
+			if (fixedDt > 0.f)
+			{
+				dt = fixedDt;
+			}
+
+			if (replayingInput)
+			{
+				const recorded_frame& frame = inputReplay.frames[replayFrameIndex++];
+				for (uint32 i = 0; i < frame.numEvents; ++i)
+				{
+					dispatchRecordedInputEvent(inputReplay.events[frame.firstEvent + i]);
+				}
+				srand(frame.randomSeed);
+				if (fixedDt <= 0.f)
+				{
+					dt = frame.dt;
+				}
+
+				if (replayFrameIndex == (uint32)inputReplay.frames.size())
+				{
+					running = false;
+				}
+			}
+			else if (inputRecorder.isRecording())
+			{
+				srand(inputRecorder.endFrame(dt));
+			}
+
 			game.update(dt);
 		}
 
@@ -571,21 +720,29 @@ int main()
 			PROFILE_BLOCK("Wait for backbuffer");
 
 			// Make sure, that the backbuffer to use in this frame is actually ready for use again.
-			renderCommandQueue.waitForFenceValue(fenceValues[currentBackBufferIndex]);
+			renderCommandQueue.waitForFenceValue(fenceValues[currentBackBufferIndex], "Wait for backbuffer");
 		}
 
 		{
 			PROFILE_BLOCK("Release stale descriptors");
-			dx_descriptor_allocator::releaseStaleDescriptors(frameValues[currentBackBufferIndex]);
+
+			// The frame which last used this backbuffer has completed (and with it all frames before). Before the backbuffer
+			// has been used for the first time, its frame value means nothing.
+			if (fenceValues[currentBackBufferIndex] != 0)
+			{
+				dx_descriptor_allocator::releaseStaleDescriptors(frameValues[currentBackBufferIndex]);
+				dx_bindless_descriptor_table::releaseStaleSlots(frameValues[currentBackBufferIndex]);
+				dx_resource_state_tracker::releaseStaleGlobalResourceStates(frameValues[currentBackBufferIndex]);
+				dx_heap_allocator::releaseStaleAllocations(frameValues[currentBackBufferIndex]);
+			}
 		}
 
 		{
 			PROFILE_BLOCK("Record render commands");
 
 			ComPtr<ID3D12Resource> backBuffer = window.getCurrentBackBuffer();
-			CD3DX12_CPU_DESCRIPTOR_HANDLE rtv = window.getCurrentRenderTargetView();
 
-			fenceValues[currentBackBufferIndex] = game.render(backBuffer, rtv);
+			fenceValues[currentBackBufferIndex] = game.render(backBuffer);
 		}
 
 		{
@@ -597,7 +754,27 @@ int main()
 		++frameID;
 	}
 
+	game.stopSimulationThread();
 	flushApplication();
+	shutdownProfileExport();
+
+	if (replayingInput)
+	{
+		double seconds = std::chrono::duration<double>(clock.now() - replayStart).count();
+		std::cout << "Replayed " << replayFrameIndex << " frames (" << inputReplay.getDuration() << " s recorded) in " << seconds
+			<< " s, " << (seconds * 1000.0 / max(replayFrameIndex, 1u)) << " ms per frame." << std::endl;
+	}
+	if (inputRecorder.isRecording())
+	{
+		const input_recording& recording = inputRecorder.getRecording();
+		if (recording.save(recordPath))
+		{
+			std::cout << "Recorded " << recording.frames.size() << " frames to " << recordPath << "." << std::endl;
+		}
+	}
+
+	dx_pipeline_factory::shutdown();
+	dx_shader_store::shutdown();
 
 	return 0;
 }
@@ -0,0 +1,272 @@
+#include "pch.h"
+#include "memory_tracking.h"
+#include "error.h"
+#include "profiling.h"
+
+#include <new>
+
+enum memory_domain
+{
+	memory_domain_cpu,
+	memory_domain_gpu,
+
+	memory_domain_count,
+};
+
+// Totals since startup. One cache line per tag, so that threads working under different tags do not share lines.
+struct alignas(64) memory_domain_counters
+{
+	std::atomic<uint64> numAllocations;
+	std::atomic<uint64> numFrees;
+	std::atomic<uint64> allocatedBytes;
+	std::atomic<uint64> freedBytes;
+};
+
+struct memory_domain_totals
+{
+	uint64 numAllocations;
+	uint64 numFrees;
+	uint64 allocatedBytes;
+	uint64 freedBytes;
+};
+
+// Zero initialized before any constructor runs, so allocations made during static initialization are counted as well.
+static memory_domain_counters memoryCounters[memory_domain_count][memory_tag_count];
+
+static thread_local memory_tag currentMemoryTag = memory_tag_untagged;
+
+// Only touched by endMemoryFrame.
+static memory_domain_totals previousTotals[memory_domain_count][memory_tag_count];
+static uint64 peakLiveBytes[memory_domain_count][memory_tag_count];
+static uint64 peakTotalLiveBytes[memory_domain_count];
+static uint64 liveBytesHistory[memory_domain_count][memory_tag_count][MEMORY_HISTORY_LENGTH];
+static uint32 numHistoryFrames;
+static uint32 nextHistoryFrame;
+
+static void recordAllocation(memory_domain domain, memory_tag tag, uint64 size)
+{
+	memory_domain_counters& counters = memoryCounters[domain][tag];
+	counters.numAllocations.fetch_add(1, std::memory_order_relaxed);
+	counters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void recordFree(memory_domain domain, memory_tag tag, uint64 size)
+{
+	memory_domain_counters& counters = memoryCounters[domain][tag];
+	counters.numFrees.fetch_add(1, std::memory_order_relaxed);
+	counters.freedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+memory_tag getMemoryTag()
+{
+	return currentMemoryTag;
+}
+
+memory_tag_scope::memory_tag_scope(memory_tag tag)
+{
+	previousTag = currentMemoryTag;
+	currentMemoryTag = tag;
+}
+
+memory_tag_scope::~memory_tag_scope()
+{
+	currentMemoryTag = previousTag;
+}
+
+
+// In front of every allocation made through operator new, so that the free knows the size and the tag.
+struct memory_allocation_header
+{
+	uint64 size;
+	uint32 offset;		// From the start of the malloc'ed block to the allocation.
+	memory_tag tag;
+};
+
+static_assert(sizeof(memory_allocation_header) == 16, "The header must keep the default 16 byte alignment of malloc.");
+
+static void* trackedAllocate(size_t size, size_t alignment)
+{
+	// Malloc returns 16 byte aligned blocks, so the header and the alignment padding fit into the additional bytes.
+	alignment = max(alignment, sizeof(memory_allocation_header));
+	uint8* block = (uint8*)malloc(size + alignment);
+	if (!block)
+	{
+		return nullptr;
+	}
+
+	uint8* result = (uint8*)alignTo(block + sizeof(memory_allocation_header), alignment);
+
+	memory_allocation_header* header = (memory_allocation_header*)result - 1;
+	header->size = size;
+	header->offset = (uint32)(result - block);
+	header->tag = currentMemoryTag;
+
+	recordAllocation(memory_domain_cpu, header->tag, size);
+
+	return result;
+}
+
+static void* trackedAllocateOrThrow(size_t size, size_t alignment)
+{
+	void* result = trackedAllocate(size, alignment);
+	if (!result)
+	{
+		throw std::bad_alloc();
+	}
+	return result;
+}
+
+static void trackedFree(void* ptr)
+{
+	if (!ptr)
+	{
+		return;
+	}
+
+	memory_allocation_header* header = (memory_allocation_header*)ptr - 1;
+	recordFree(memory_domain_cpu, header->tag, header->size);
+
+	free((uint8*)ptr - header->offset);
+}
+
+void* operator new(size_t size) { return trackedAllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return trackedAllocateOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return trackedAllocateOrThrow(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return trackedAllocateOrThrow(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return trackedAllocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return trackedAllocate(size, (size_t)alignment); }
+
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+
+
+// {9E4B21D7-6C0A-4F3E-B5A8-2D71C8F04E36}
+static const GUID memoryTrackerGUID = { 0x9e4b21d7, 0x6c0a, 0x4f3e, { 0xb5, 0xa8, 0x2d, 0x71, 0xc8, 0xf0, 0x4e, 0x36 } };
+
+// Attached to each tracked GPU object as private data. The object releases it when it is destroyed.
+struct gpu_memory_tracker : IUnknown
+{
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
+	{
+		if (riid == __uuidof(IUnknown))
+		{
+			AddRef();
+			*object = this;
+			return S_OK;
+		}
+		*object = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override
+	{
+		return ++refCount;
+	}
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG result = --refCount;
+		if (result == 0)
+		{
+			recordFree(memory_domain_gpu, tag, size);
+			delete this;
+		}
+		return result;
+	}
+
+	std::atomic<ULONG> refCount = 1;
+
+	uint64 size;
+	memory_tag tag;
+};
+
+void trackGPUMemory(ID3D12Object* object, uint64 size, memory_tag tag)
+{
+	gpu_memory_tracker* tracker = new gpu_memory_tracker;
+	tracker->size = size;
+	tracker->tag = tag;
+
+	recordAllocation(memory_domain_gpu, tag, size);
+
+	// The object holds the only reference from now on.
+	checkResult(object->SetPrivateDataInterface(memoryTrackerGUID, tracker));
+	tracker->Release();
+}
+
+
+static void accumulate(memory_domain_statistics& total, const memory_domain_statistics& stats)
+{
+	total.liveBytes += stats.liveBytes;
+	total.numLiveAllocations += stats.numLiveAllocations;
+	total.liveBytesChange += stats.liveBytesChange;
+	total.numFrameAllocations += stats.numFrameAllocations;
+	total.numFrameFrees += stats.numFrameFrees;
+	total.frameAllocatedBytes += stats.frameAllocatedBytes;
+}
+
+memory_statistics endMemoryFrame()
+{
+	memory_statistics result = {};
+
+	uint32 oldestHistoryFrame = (numHistoryFrames == MEMORY_HISTORY_LENGTH) ? nextHistoryFrame : 0;
+
+	for (uint32 domain = 0; domain < memory_domain_count; ++domain)
+	{
+		for (uint32 tag = 0; tag < memory_tag_count; ++tag)
+		{
+			const memory_domain_counters& counters = memoryCounters[domain][tag];
+
+			// Frees first. The counters are not read atomically as a whole, and this way an allocation which is freed
+			// in between is seen at most as live, never as freed twice.
+			memory_domain_totals totals;
+			totals.numFrees = counters.numFrees.load(std::memory_order_relaxed);
+			totals.freedBytes = counters.freedBytes.load(std::memory_order_relaxed);
+			totals.numAllocations = counters.numAllocations.load(std::memory_order_relaxed);
+			totals.allocatedBytes = counters.allocatedBytes.load(std::memory_order_relaxed);
+
+			memory_domain_totals& previous = previousTotals[domain][tag];
+
+			memory_domain_statistics& stats = (domain == memory_domain_cpu) ? result.tags[tag].cpu : result.tags[tag].gpu;
+			stats.liveBytes = (totals.allocatedBytes > totals.freedBytes) ? (totals.allocatedBytes - totals.freedBytes) : 0;
+			stats.numLiveAllocations = (totals.numAllocations > totals.numFrees) ? (totals.numAllocations - totals.numFrees) : 0;
+			stats.numFrameAllocations = (uint32)(totals.numAllocations - previous.numAllocations);
+			stats.numFrameFrees = (uint32)(totals.numFrees - previous.numFrees);
+			stats.frameAllocatedBytes = totals.allocatedBytes - previous.allocatedBytes;
+
+			peakLiveBytes[domain][tag] = max(peakLiveBytes[domain][tag], stats.liveBytes);
+			stats.peakLiveBytes = peakLiveBytes[domain][tag];
+
+			uint64* history = liveBytesHistory[domain][tag];
+			stats.liveBytesChange = (numHistoryFrames > 0) ? (int64)(stats.liveBytes - history[oldestHistoryFrame]) : 0;
+			history[nextHistoryFrame] = stats.liveBytes;
+
+			previous = totals;
+
+			memory_domain_statistics& total = (domain == memory_domain_cpu) ? result.total.cpu : result.total.gpu;
+			accumulate(total, stats);
+		}
+
+		memory_domain_statistics& total = (domain == memory_domain_cpu) ? result.total.cpu : result.total.gpu;
+		peakTotalLiveBytes[domain] = max(peakTotalLiveBytes[domain], total.liveBytes);
+		total.peakLiveBytes = peakTotalLiveBytes[domain];
+	}
+
+	nextHistoryFrame = (nextHistoryFrame + 1) % MEMORY_HISTORY_LENGTH;
+	numHistoryFrames = min(numHistoryFrames + 1, (uint32)MEMORY_HISTORY_LENGTH);
+
+	PROFILE_COUNTER_SET("Heap allocations", result.total.cpu.numFrameAllocations);
+
+	return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.h"
+
+// Every CPU allocation made through operator new and every tracked GPU object is counted under a tag. CPU allocations take
+// the tag of the innermost MEMORY_TAG scope on the allocating thread, and are counted as freed under the same tag, no matter
+// where they are freed. The bookkeeping is a few relaxed atomic adds per allocation, so this stays on in release builds.
+STRINGIFY_ENUM(memoryTagNames,
+	enum memory_tag : uint8
+{
+	memory_tag_untagged, "Untagged",
+	memory_tag_textures, "Textures",
+	memory_tag_render_targets, "Render targets",
+	memory_tag_buffers, "Buffers",
+	memory_tag_upload, "Upload",
+	memory_tag_descriptors, "Descriptors",
+	memory_tag_meshes, "Meshes",
+	memory_tag_profiler, "Profiler",
+
+	memory_tag_count, "Count",
+};
+)
+
+memory_tag getMemoryTag();
+
+struct memory_tag_scope
+{
+	memory_tag_scope(memory_tag tag);
+	~memory_tag_scope();
+
+	memory_tag previousTag;
+};
+
+#define MEMORY_TAG(tag) memory_tag_scope COMPOSITE_VARNAME(MEMORY_TAG, __LINE__)(tag)
+
+// Adds the size to the tag. The object carries a small tracker as private data, which the object releases when it is
+// destroyed. This subtracts the size again, so owners do not report frees.
+void trackGPUMemory(ID3D12Object* object, uint64 size, memory_tag tag);
+
+
+#define MEMORY_HISTORY_LENGTH 256
+
+struct memory_domain_statistics
+{
+	uint64 liveBytes;
+	uint64 numLiveAllocations;
+	uint64 peakLiveBytes;				// Sampled once per frame.
+	int64 liveBytesChange;				// Over the last MEMORY_HISTORY_LENGTH frames. Keeps growing if something leaks.
+
+	uint32 numFrameAllocations;			// Since the previous frame.
+	uint32 numFrameFrees;
+	uint64 frameAllocatedBytes;
+};
+
+struct memory_tag_statistics
+{
+	memory_domain_statistics cpu;
+	memory_domain_statistics gpu;
+};
+
+struct memory_statistics
+{
+	memory_tag_statistics tags[memory_tag_count];
+	memory_tag_statistics total;
+};
+
+// Must be called once per frame. The per-frame numbers cover everything since the previous call.
+memory_statistics endMemoryFrame();
@@ -4,6 +4,7 @@
 #include "math.h"
 #include "material.h"
 #include "skeleton.h"
+#include "memory_tracking.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/Exporter.hpp>
@@ -224,6 +225,8 @@ void cpu_triangle_mesh<vertex_t>::readSkeleton(const aiNode* node, animation_ske
 template<typename vertex_t>
 inline std::vector<submesh_info> cpu_triangle_mesh<vertex_t>::pushFromFile(const std::string& filename, animation_skeleton* skeleton)
 {
+	MEMORY_TAG(memory_tag_meshes);
+
 	fs::path path(filename);
 	assert(fs::exists(path));
 
@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "particle_simulation.h"
+#include "profiling.h"
+
+// Same layout as dx_texture_atlas::getUVs.
+static void getAtlasUVs(uint32 index, uint32 slicesX, uint32 slicesY, vec2& uv0, vec2& uv1)
+{
+	uint32 x = index % slicesX;
+	uint32 y = index / slicesX;
+
+	float width = 1.f / slicesX;
+	float height = 1.f / slicesY;
+	uv0 = vec2(x * width, y * height);
+	uv1 = vec2((x + 1) * width, (y + 1) * height);
+}
+
+void particle_simulation::initialize(uint32 numParticles)
+{
+	particles.reserve(numParticles);
+	particleSpawnAccumulator = 0.f;
+}
+
+void particle_simulation::update(float dt, uint32 numTextureSlicesX, uint32 numTextureSlicesY)
+{
+	PROFILE_FUNCTION();
+
+	uint32 numParticles = (uint32)particles.size();
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		particle_data& p = particles[i];
+		p.timeAlive += dt;
+		if (p.timeAlive >= p.maxLifetime)
+		{
+			std::swap(p, particles[numParticles - 1]);
+			--numParticles;
+			--i;
+		}
+	}
+	particles.resize(numParticles);
+
+	comp_vec gravity(0.f, -9.81f * gravityFactor * dt, 0.f, 0.f);
+	uint32 textureSlices = numTextureSlicesX * numTextureSlicesY;
+	for (uint32 i = 0; i < numParticles; ++i)
+	{
+		particle_data& p = particles[i];
+		p.position = p.position + 0.5f * gravity * dt + p.velocity * dt;
+		p.velocity = p.velocity + gravity;
+		float relLifetime = p.timeAlive / p.maxLifetime;
+		p.color = color.interpolate(relLifetime, p.color);
+		if (textureSlices)
+		{
+			uint32 index = min((uint32)(relLifetime * textureSlices), textureSlices - 1);
+			getAtlasUVs(index, numTextureSlicesX, numTextureSlicesY, p.uv0, p.uv1);
+		}
+	}
+
+	particleSpawnAccumulator += spawnRate * dt;
+	uint32 spaceLeft = (uint32)particles.capacity() - numParticles;
+	uint32 numNewParticles = min((uint32)particleSpawnAccumulator, spaceLeft);
+
+	particleSpawnAccumulator -= numNewParticles;
+
+	for (uint32 i = 0; i < numNewParticles; ++i)
+	{
+		particle_data p;
+		p.position = spawnPosition;
+		p.timeAlive = 0.f;
+		p.velocity = startVelocity.start();
+		p.color = color.start();
+		p.maxLifetime = maxLifetime.start();
+		if (textureSlices)
+		{
+			getAtlasUVs(0, numTextureSlicesX, numTextureSlicesY, p.uv0, p.uv1);
+		}
+		
+		particles.push_back(p);
+	}
+}
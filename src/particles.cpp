@@ -3,82 +3,31 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
+#include "scratch_arena.h"
 
 #include <pix3.h>
 
-void particle_system::initialize(uint32 numParticles)
-{
-	particles.reserve(numParticles);
-	particleSpawnAccumulator = 0.f;
-}
-
 void particle_system::update(float dt)
 {
-	PROFILE_FUNCTION();
-
-	uint32 numParticles = (uint32)particles.size();
-	for (uint32 i = 0; i < numParticles; ++i)
+	if (textureAtlas.resource)
 	{
-		particle_data& p = particles[i];
-		p.timeAlive += dt;
-		if (p.timeAlive >= p.maxLifetime)
-		{
-			std::swap(p, particles[numParticles - 1]);
-			--numParticles;
-			--i;
-		}
+		particle_simulation::update(dt, textureAtlas.slicesX, textureAtlas.slicesY);
 	}
-	particles.resize(numParticles);
-
-	comp_vec gravity(0.f, -9.81f * gravityFactor * dt, 0.f, 0.f);
-	uint32 textureSlices = textureAtlas.slicesX * textureAtlas.slicesY;
-	for (uint32 i = 0; i < numParticles; ++i)
-	{
-		particle_data& p = particles[i];
-		p.position = p.position + 0.5f * gravity * dt + p.velocity * dt;
-		p.velocity = p.velocity + gravity;
-		float relLifetime = p.timeAlive / p.maxLifetime;
-		p.color = color.interpolate(relLifetime, p.color);
-		if (textureAtlas.resource)
-		{
-			uint32 index = min((uint32)(relLifetime * textureSlices), textureSlices - 1);
-			textureAtlas.getUVs(index, p.uv0, p.uv1);
-		}
-	}
-
-	particleSpawnAccumulator += spawnRate * dt;
-	uint32 spaceLeft = (uint32)particles.capacity() - numParticles;
-	uint32 numNewParticles = min((uint32)particleSpawnAccumulator, spaceLeft);
-
-	particleSpawnAccumulator -= numNewParticles;
-
-	for (uint32 i = 0; i < numNewParticles; ++i)
+	else
 	{
-		particle_data p;
-		p.position = spawnPosition;
-		p.timeAlive = 0.f;
-		p.velocity = startVelocity.start();
-		p.color = color.start();
-		p.maxLifetime = maxLifetime.start();
-		if (textureAtlas.resource)
-		{
-			textureAtlas.getUVs(0, p.uv0, p.uv1);
-		}
-		
-		particles.push_back(p);
+		particle_simulation::update(dt);
 	}
 }
 
 void particle_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render_target& renderTarget)
 {
-	ComPtr<ID3DBlob> vertexShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/particles_vs.cso", &vertexShaderBlob));
-	ComPtr<ID3DBlob> texturedPixelShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/unlit_textured_ps.cso", &texturedPixelShaderBlob));
-	ComPtr<ID3DBlob> flatPixelShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/unlit_flat_ps.cso", &flatPixelShaderBlob));
-
-	D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+	D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/particles_vs.cso");
+	D3D12_SHADER_BYTECODE texturedPixelShader = dx_shader_store::load(L"shaders/bin/unlit_textured_ps.cso");
+	D3D12_SHADER_BYTECODE flatPixelShader = dx_shader_store::load(L"shaders/bin/unlit_flat_ps.cso");
+
+	static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 
@@ -131,8 +80,8 @@ void particle_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 	pipelineStateStream.rootSignature = texturedRootSignature.rootSignature.Get();
 	pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 	pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-	pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(texturedPixelShaderBlob.Get());
+	pipelineStateStream.vs = vertexShader;
+	pipelineStateStream.ps = texturedPixelShader;
 	pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 	pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 	pipelineStateStream.rasterizer = defaultRasterizerDesc;
@@ -143,13 +92,9 @@ void particle_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 	pipelineStateStream.depthStencilDesc = depthDesc;
 
 	{
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&texturedPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, texturedPipelineState, L"Textured Particle Pipeline");
 	}
 	SET_NAME(texturedRootSignature.rootSignature, "Textured Particle Root Signature");
-	SET_NAME(texturedPipelineState, "Textured Particle Pipeline");
 
 
 
@@ -161,16 +106,12 @@ void particle_pipeline::initialize(ComPtr<ID3D12Device2> device, const dx_render
 	flatRootSignature.initialize(device, rootSignatureDesc);
 
 	pipelineStateStream.rootSignature = flatRootSignature.rootSignature.Get();
-	pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(flatPixelShaderBlob.Get());
+	pipelineStateStream.ps = flatPixelShader;
 
 	{
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&flatPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, flatPipelineState, L"Flat Particle Pipeline");
 	}
 	SET_NAME(flatRootSignature.rootSignature, "Flat Particle Root Signature");
-	SET_NAME(flatPipelineState, "Flat Particle Pipeline");
 }
 
 struct particle_instance_data
@@ -181,18 +122,19 @@ struct particle_instance_data
 	vec2 uv1;
 };
 
-void particle_pipeline::renderParticleSystem(dx_command_list* commandList, const render_camera& camera, particle_system& particleSystem)
+void particle_pipeline::renderParticleSystem(dx_command_list* commandList, const render_camera& camera, const dx_texture_atlas& textureAtlas,
+	const std::vector<particle_data>& particles)
 {
 	PROFILE_FUNCTION();
 
 	PIXScopedEvent(commandList->getD3D12CommandList().Get(), PIX_COLOR(255, 255, 0), "Particles.");
 
-	if (particleSystem.textureAtlas.resource)
+	if (textureAtlas.resource)
 	{
 		commandList->setPipelineState(texturedPipelineState);
 		commandList->setGraphicsRootSignature(texturedRootSignature);
 
-		commandList->setShaderResourceView(PARTICLES_ROOTPARAM_TEXTURE, 0, particleSystem.textureAtlas);
+		commandList->setShaderResourceView(PARTICLES_ROOTPARAM_TEXTURE, 0, textureAtlas);
 	}
 	else
 	{
@@ -202,13 +144,14 @@ void particle_pipeline::renderParticleSystem(dx_command_list* commandList, const
 
 	commandList->setPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 
-	std::vector<particle_instance_data> instanceData(particleSystem.particles.size());
-	for (uint32 i = 0; i < (uint32)particleSystem.particles.size(); ++i)
+	// Copied into the upload ring below.
+	scratch_vector<particle_instance_data> instanceData(particles.size());
+	for (uint32 i = 0; i < (uint32)particles.size(); ++i)
 	{
-		instanceData[i].position = particleSystem.particles[i].position;
-		instanceData[i].color = particleSystem.particles[i].color;
-		instanceData[i].uv0 = particleSystem.particles[i].uv0;
-		instanceData[i].uv1 = particleSystem.particles[i].uv1;
+		instanceData[i].position = particles[i].position;
+		instanceData[i].color = particles[i].color;
+		instanceData[i].uv0 = particles[i].uv0;
+		instanceData[i].uv1 = particles[i].uv1;
 	}
 
 	float size = 0.3f;
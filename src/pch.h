@@ -20,6 +20,8 @@
 
 namespace fs = std::filesystem;
 
+#ifdef _WIN32
+
 // Windows.
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
@@ -34,3 +36,11 @@ using namespace Microsoft::WRL;
 
 #undef near
 #undef far
+
+#else
+
+// Headless builds (the benchmarks) only compile the parts which do not touch the GPU. DirectXMath is header only and
+// works with GCC and Clang, given its sal.h.
+#include <DirectXMath.h>
+
+#endif
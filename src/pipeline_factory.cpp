@@ -0,0 +1,243 @@
+#include "pch.h"
+#include "pipeline_factory.h"
+#include "error.h"
+#include "profiling.h"
+
+
+pipeline_create_func dx_pipeline_factory::create;
+
+std::vector<std::thread> dx_pipeline_factory::threads;
+std::deque<dx_pipeline_factory::job> dx_pipeline_factory::jobs;
+std::deque<uint32> dx_pipeline_factory::pendingJobs;
+uint32 dx_pipeline_factory::numUnfinishedJobs = 0;
+HRESULT dx_pipeline_factory::firstError = S_OK;
+bool dx_pipeline_factory::running = false;
+
+std::mutex dx_pipeline_factory::mutex;
+std::condition_variable dx_pipeline_factory::jobAvailable;
+std::condition_variable dx_pipeline_factory::jobFinished;
+
+pipeline_factory_statistics dx_pipeline_factory::statistics = {};
+std::chrono::high_resolution_clock::time_point dx_pipeline_factory::firstRequestTime;
+
+void dx_pipeline_factory::initialize(ComPtr<ID3D12Device2> device, uint32 numThreads)
+{
+	initialize([device](const D3D12_PIPELINE_STATE_STREAM_DESC& desc, ComPtr<ID3D12PipelineState>& outPipelineState)
+	{
+		return device->CreatePipelineState(&desc, IID_PPV_ARGS(&outPipelineState));
+	}, numThreads);
+}
+
+void dx_pipeline_factory::initialize(const pipeline_create_func& create, uint32 numThreads)
+{
+	// Handles and errors of an earlier initialization (e.g. of a test with a fake device) do not carry over.
+	assert(threads.empty() && numUnfinishedJobs == 0);
+	jobs.clear();
+	pendingJobs.clear();
+	firstError = S_OK;
+
+	dx_pipeline_factory::create = create;
+
+	if (numThreads == 0)
+	{
+		uint32 numCores = std::thread::hardware_concurrency();
+		numThreads = numCores > 1 ? numCores - 1 : 0;
+	}
+
+	statistics = {};
+	statistics.numThreads = numThreads;
+
+	running = true;
+	for (uint32 i = 0; i < numThreads; ++i)
+	{
+		threads.emplace_back(workerThread);
+	}
+}
+
+void dx_pipeline_factory::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	jobAvailable.notify_all();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	threads.clear();
+}
+
+pipeline_handle dx_pipeline_factory::createPipelineState(const void* stream, uint32 streamSize, ComPtr<ID3D12PipelineState>& target, const wchar_t* name)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (statistics.numPipelines == 0)
+	{
+		firstRequestTime = std::chrono::high_resolution_clock::now();
+	}
+
+	uint32 index = (uint32)jobs.size();
+	job& newJob = jobs.emplace_back();
+	newJob.stream.resize(alignTo(streamSize, sizeof(uint64)) / sizeof(uint64));
+	memcpy(newJob.stream.data(), stream, streamSize);
+	newJob.streamSize = streamSize;
+	newJob.target = &target;
+	newJob.name = name;
+	newJob.result = S_OK;
+	newJob.done = false;
+
+	++statistics.numPipelines;
+	++numUnfinishedJobs;
+
+	if (threads.empty())
+	{
+		lock.unlock();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		runJob(newJob);
+		float time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		lock.lock();
+		finishJob(newJob, time);
+	}
+	else
+	{
+		pendingJobs.push_back(index);
+		lock.unlock();
+		jobAvailable.notify_one();
+	}
+
+	return index + 1;
+}
+
+void dx_pipeline_factory::runJob(job& job)
+{
+	PROFILE_FUNCTION();
+
+	D3D12_PIPELINE_STATE_STREAM_DESC desc = { job.streamSize, job.stream.data() };
+	job.result = create(desc, *job.target);
+
+#if defined(PROFILE) || defined(_DEBUG)
+	if (SUCCEEDED(job.result) && job.name && *job.target)
+	{
+		(*job.target)->SetName(job.name);
+	}
+#endif
+
+	job.stream.clear();
+	job.stream.shrink_to_fit();
+}
+
+// Called with the lock held.
+void dx_pipeline_factory::finishJob(job& job, float timeInMilliseconds)
+{
+	job.done = true;
+	--numUnfinishedJobs;
+
+	if (FAILED(job.result) && SUCCEEDED(firstError))
+	{
+		firstError = job.result;
+	}
+
+	statistics.totalCreationTimeInMilliseconds += timeInMilliseconds;
+	statistics.longestCreationTimeInMilliseconds = max(statistics.longestCreationTimeInMilliseconds, timeInMilliseconds);
+	if (numUnfinishedJobs == 0)
+	{
+		statistics.wallTimeInMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - firstRequestTime).count();
+	}
+
+	jobFinished.notify_all();
+}
+
+// Called with the lock held and at least one pending job. Releases the lock while the job runs.
+void dx_pipeline_factory::runPendingJob(std::unique_lock<std::mutex>& lock)
+{
+	job& job = jobs[pendingJobs.front()];
+	pendingJobs.pop_front();
+
+	lock.unlock();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	runJob(job);
+	float time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	lock.lock();
+	finishJob(job, time);
+}
+
+void dx_pipeline_factory::workerThread()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		jobAvailable.wait(lock, [] { return !pendingJobs.empty() || !running; });
+
+		if (pendingJobs.empty())
+		{
+			break; // Shutting down.
+		}
+
+		runPendingJob(lock);
+	}
+}
+
+void dx_pipeline_factory::wait(pipeline_handle handle)
+{
+	assert(handle > 0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	job& job = jobs[handle - 1];
+	while (!job.done)
+	{
+		if (!pendingJobs.empty())
+		{
+			runPendingJob(lock);
+		}
+		else
+		{
+			jobFinished.wait(lock);
+		}
+	}
+
+	HRESULT result = job.result;
+	lock.unlock();
+
+	checkResult(result);
+}
+
+void dx_pipeline_factory::waitForAll()
+{
+	PROFILE_FUNCTION();
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (numUnfinishedJobs > 0)
+	{
+		if (!pendingJobs.empty())
+		{
+			runPendingJob(lock);
+		}
+		else
+		{
+			jobFinished.wait(lock);
+		}
+	}
+
+	HRESULT result = firstError;
+	lock.unlock();
+
+	checkResult(result);
+}
+
+pipeline_factory_statistics dx_pipeline_factory::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	pipeline_factory_statistics result = statistics;
+	result.numPending = numUnfinishedJobs;
+	return result;
+}
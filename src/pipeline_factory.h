@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common.h"
+
+#include <deque>
+#include <thread>
+#include <condition_variable>
+
+// Identifies a pipeline which was handed to the factory. 0 is never a valid handle.
+typedef uint32 pipeline_handle;
+
+// Returns the HRESULT instead of throwing, so that failures surface on the thread which waits for the pipeline.
+typedef std::function<HRESULT(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, ComPtr<ID3D12PipelineState>& outPipelineState)> pipeline_create_func;
+
+struct pipeline_factory_statistics
+{
+	uint32 numThreads;
+	uint32 numPipelines;
+	uint32 numPending;
+	float totalCreationTimeInMilliseconds;		// Summed over all threads.
+	float longestCreationTimeInMilliseconds;
+	float wallTimeInMilliseconds;				// From the first request until the queue last ran empty.
+};
+
+// Builds pipeline states on worker threads. Subsystems describe their pipelines during initialization as before, but hand
+// the stream to the factory instead of calling CreatePipelineState. Everything that records with a pipeline must wait
+// for its handle first (or for all of them).
+class dx_pipeline_factory
+{
+public:
+	// numThreads = 0 starts one worker per core, except for the calling thread. With a single core, pipelines are
+	// created right away.
+	static void initialize(ComPtr<ID3D12Device2> device, uint32 numThreads = 0);
+
+	// Any creation function, e.g. a fake device.
+	static void initialize(const pipeline_create_func& create, uint32 numThreads = 0);
+	static void shutdown();
+
+	// The stream is copied. Everything it points to (root signature, shader bytecode from dx_shader_store, input layout)
+	// must stay alive until the pipeline has been created, so input layouts should be static. The target is written by a
+	// worker thread, and must not be used or moved before the handle has been waited for.
+	template <typename stream_t>
+	static pipeline_handle createPipelineState(const stream_t& stream, ComPtr<ID3D12PipelineState>& target, const wchar_t* name = nullptr)
+	{
+		return createPipelineState(&stream, sizeof(stream_t), target, name);
+	}
+	static pipeline_handle createPipelineState(const void* stream, uint32 streamSize, ComPtr<ID3D12PipelineState>& target, const wchar_t* name = nullptr);
+
+	// The waiting thread works on pending pipelines meanwhile. Throws if the creation failed.
+	static void wait(pipeline_handle handle);
+	static void waitForAll();
+
+	static pipeline_factory_statistics getStatistics();
+
+private:
+	struct job
+	{
+		std::vector<uint64> stream; // uint64 keeps the subobjects aligned. Freed after creation.
+		uint32 streamSize;
+		ComPtr<ID3D12PipelineState>* target;
+		const wchar_t* name;
+		HRESULT result;
+		bool done;
+	};
+
+	static void workerThread();
+	static void runJob(job& job);
+	static void runPendingJob(std::unique_lock<std::mutex>& lock);
+	static void finishJob(job& job, float timeInMilliseconds);
+
+	static pipeline_create_func create;
+
+	static std::vector<std::thread> threads;
+	static std::deque<job> jobs;				// Indexed by handle - 1. Only grows, so references stay valid.
+	static std::deque<uint32> pendingJobs;
+	static uint32 numUnfinishedJobs;
+	static HRESULT firstError;
+	static bool running;
+
+	static std::mutex mutex;
+	static std::condition_variable jobAvailable;
+	static std::condition_variable jobFinished;
+
+	static pipeline_factory_statistics statistics;
+	static std::chrono::high_resolution_clock::time_point firstRequestTime;
+};
@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "tests.h"
+#include "pipeline_factory.h"
+
+#include <atomic>
+
+
+// The factory is driven by a fake creation function instead of a device. It only sees the stream, so the tests use their
+// own stream layout. Pipelines stay null, which the factory allows (it only names pipelines which were created).
+
+struct fake_pipeline_stream
+{
+	uint64 id;
+	uint64 payload;
+};
+
+static std::atomic<uint32> numCreateCalls;
+static std::atomic<uint64> sumOfIds;
+static std::atomic<uint32> numCorruptStreams;
+
+static HRESULT fakeCreate(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, ComPtr<ID3D12PipelineState>& /*outPipelineState*/)
+{
+	++numCreateCalls;
+
+	if (desc.SizeInBytes != sizeof(fake_pipeline_stream))
+	{
+		++numCorruptStreams;
+		return E_INVALIDARG;
+	}
+
+	const fake_pipeline_stream* stream = (const fake_pipeline_stream*)desc.pPipelineStateSubobjectStream;
+	if (stream->payload != stream->id * 3)
+	{
+		++numCorruptStreams;
+	}
+	sumOfIds += stream->id;
+
+	return (stream->id == 0) ? E_FAIL : S_OK; // Id 0 stands for a pipeline the driver rejects.
+}
+
+static void resetCounters()
+{
+	numCreateCalls = 0;
+	sumOfIds = 0;
+	numCorruptStreams = 0;
+}
+
+static void createAndWait(uint32 numThreads)
+{
+	resetCounters();
+	dx_pipeline_factory::initialize(fakeCreate, numThreads);
+
+	const uint32 numPipelines = 64;
+	std::vector<ComPtr<ID3D12PipelineState>> targets(numPipelines);
+	std::vector<pipeline_handle> handles;
+	uint64 expectedSum = 0;
+	for (uint32 i = 0; i < numPipelines; ++i)
+	{
+		// The stream is copied, so it may go out of scope (or be overwritten) right after the call.
+		fake_pipeline_stream stream = { i + 1, (i + 1) * 3 };
+		handles.push_back(dx_pipeline_factory::createPipelineState(stream, targets[i]));
+		stream.payload = 0;
+		expectedSum += i + 1;
+	}
+
+	// Handles are unique and never 0.
+	for (uint32 i = 0; i < numPipelines; ++i)
+	{
+		CHECK(handles[i] == i + 1);
+	}
+
+	dx_pipeline_factory::wait(handles[numPipelines / 2]);
+	dx_pipeline_factory::waitForAll();
+
+	CHECK(numCreateCalls == numPipelines);
+	CHECK(sumOfIds == expectedSum);
+	CHECK(numCorruptStreams == 0);
+
+	pipeline_factory_statistics stats = dx_pipeline_factory::getStatistics();
+	CHECK(stats.numThreads == numThreads);
+	CHECK(stats.numPipelines == numPipelines);
+	CHECK(stats.numPending == 0);
+	CHECK(stats.longestCreationTimeInMilliseconds <= stats.totalCreationTimeInMilliseconds);
+
+	dx_pipeline_factory::shutdown();
+}
+
+static void testCreateOnCallingThread()
+{
+	createAndWait(0);
+}
+
+static void testCreateOnWorkers()
+{
+	createAndWait(4);
+}
+
+static bool throws(const std::function<void()>& f)
+{
+	try
+	{
+		f();
+	}
+	catch (const std::exception&)
+	{
+		return true;
+	}
+	return false;
+}
+
+static void testFailureAndReinitialization()
+{
+	resetCounters();
+	dx_pipeline_factory::initialize(fakeCreate, 2);
+
+	ComPtr<ID3D12PipelineState> good, bad;
+	pipeline_handle goodHandle = dx_pipeline_factory::createPipelineState(fake_pipeline_stream{ 7, 21 }, good);
+	pipeline_handle badHandle = dx_pipeline_factory::createPipelineState(fake_pipeline_stream{ 0, 0 }, bad);
+
+	// The failure is reported by whoever waits for it, and by waitForAll, but not for other pipelines.
+	CHECK(!throws([=] { dx_pipeline_factory::wait(goodHandle); }));
+	CHECK(throws([=] { dx_pipeline_factory::wait(badHandle); }));
+	CHECK(throws([] { dx_pipeline_factory::waitForAll(); }));
+	CHECK(numCreateCalls == 2);
+
+	dx_pipeline_factory::shutdown();
+
+	// After a new initialization, handles start over and the old error is gone.
+	dx_pipeline_factory::initialize(fakeCreate, 0);
+	ComPtr<ID3D12PipelineState> again;
+	CHECK(dx_pipeline_factory::createPipelineState(fake_pipeline_stream{ 1, 3 }, again) == 1);
+	CHECK(!throws([] { dx_pipeline_factory::waitForAll(); }));
+	CHECK(dx_pipeline_factory::getStatistics().numPipelines == 1);
+	dx_pipeline_factory::shutdown();
+}
+
+std::vector<unit_test> getPipelineFactoryTests()
+{
+	return
+	{
+		{ "pipeline_factory/create_on_calling_thread", testCreateOnCallingThread },
+		{ "pipeline_factory/create_on_workers", testCreateOnWorkers },
+		{ "pipeline_factory/failure_and_reinitialization", testFailureAndReinitialization },
+	};
+}
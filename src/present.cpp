@@ -3,15 +3,15 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <pix3.h>
 
 void present_pipeline::initialize(ComPtr<ID3D12Device2> device, const D3D12_RT_FORMAT_ARRAY& renderTargetFormat)
 {
-	ComPtr<ID3DBlob> vertexShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/fullscreen_triangle_vs.cso", &vertexShaderBlob));
-	ComPtr<ID3DBlob> pixelShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/present_ps.cso", &pixelShaderBlob));
+	D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/fullscreen_triangle_vs.cso");
+	D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/present_ps.cso");
 
 	// Root signature.
 	D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
@@ -58,8 +58,8 @@ void present_pipeline::initialize(ComPtr<ID3D12Device2> device, const D3D12_RT_F
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
 	pipelineStateStream.inputLayout = { nullptr, 0 };
 	pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-	pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+	pipelineStateStream.vs = vertexShader;
+	pipelineStateStream.ps = pixelShader;
 	pipelineStateStream.rtvFormats = renderTargetFormat;
 
 	CD3DX12_DEPTH_STENCIL_DESC1 depthDesc(D3D12_DEFAULT);
@@ -67,13 +67,9 @@ void present_pipeline::initialize(ComPtr<ID3D12Device2> device, const D3D12_RT_F
 	depthDesc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO; // Don't write to depth (or stencil) buffer.
 	pipelineStateStream.depthStencilDesc = depthDesc;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState, L"Present Pipeline");
 
 	SET_NAME(rootSignature.rootSignature, "Present Root Signature");
-	SET_NAME(pipelineState, "Present Pipeline");
 
 
 	tonemapParams.exposure = 0.2f;
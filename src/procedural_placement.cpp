@@ -6,6 +6,8 @@
 #include "command_queue.h"
 #include "profiling.h"
 #include "poisson_distribution.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <pix3.h>
 
@@ -47,8 +49,7 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 	const placement_mesh& treeMesh)
 {
 	{
-		ComPtr<ID3DBlob> shaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/procedural_placement_clear_buffer.cso", &shaderBlob));
+		D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/procedural_placement_clear_buffer.cso");
 
 		CD3DX12_DESCRIPTOR_RANGE1 buffer(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
 
@@ -72,20 +73,15 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 		} pipelineStateStream;
 
 		pipelineStateStream.rootSignature = clearBufferRootSignature.rootSignature.Get();
-		pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+		pipelineStateStream.cs = shader;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&clearBufferPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, clearBufferPipelineState, L"Procedural Placement Clear Buffer Pipeline");
 
 		SET_NAME(clearBufferRootSignature.rootSignature, "Procedural Placement Clear Buffer Root Signature");
-		SET_NAME(clearBufferPipelineState, "Procedural Placement Clear Buffer Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> shaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/procedural_placement_prefix_sum.cso", &shaderBlob));
+		D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/procedural_placement_prefix_sum.cso");
 
 		CD3DX12_DESCRIPTOR_RANGE1 srvs(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 		CD3DX12_DESCRIPTOR_RANGE1 uavs(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -111,20 +107,15 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 		} pipelineStateStream;
 
 		pipelineStateStream.rootSignature = prefixSumRootSignature.rootSignature.Get();
-		pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+		pipelineStateStream.cs = shader;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&prefixSumPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, prefixSumPipelineState, L"Procedural Placement Prefix Sum Pipeline");
 
 		SET_NAME(prefixSumRootSignature.rootSignature, "Procedural Placement Prefix Sum Root Signature");
-		SET_NAME(prefixSumPipelineState, "Procedural Placement Prefix Sum Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> shaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/procedural_placement_gen_points.cso", &shaderBlob));
+		D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/procedural_placement_gen_points.cso");
 
 		CD3DX12_DESCRIPTOR_RANGE1 srvs(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 0); // Sample positions, density map and meshes.
 		CD3DX12_DESCRIPTOR_RANGE1 uavs(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE); // Generated points, point count and submesh count.
@@ -151,20 +142,15 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 		} pipelineStateStream;
 
 		pipelineStateStream.rootSignature = generatePointsRootSignature.rootSignature.Get();
-		pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+		pipelineStateStream.cs = shader;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&generatePointsPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, generatePointsPipelineState, L"Procedural Placement Generate Points Pipeline");
 
 		SET_NAME(generatePointsRootSignature.rootSignature, "Procedural Placement Generate Points Root Signature");
-		SET_NAME(generatePointsPipelineState, "Procedural Placement Generate Points Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> shaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/procedural_placement_place_geometry.cso", &shaderBlob));
+		D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/procedural_placement_place_geometry.cso");
 
 		CD3DX12_DESCRIPTOR_RANGE1 srvs(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0);
 		CD3DX12_DESCRIPTOR_RANGE1 uavs(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -189,20 +175,15 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 		} pipelineStateStream;
 
 		pipelineStateStream.rootSignature = placeGeometryRootSignature.rootSignature.Get();
-		pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+		pipelineStateStream.cs = shader;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&placeGeometryPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, placeGeometryPipelineState, L"Procedural Placement Place Geometry Pipeline");
 
 		SET_NAME(placeGeometryRootSignature.rootSignature, "Procedural Placement Place Geometry Root Signature");
-		SET_NAME(placeGeometryPipelineState, "Procedural Placement Place Geometry Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> shaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/procedural_placement_create_commands.cso", &shaderBlob));
+		D3D12_SHADER_BYTECODE shader = dx_shader_store::load(L"shaders/bin/procedural_placement_create_commands.cso");
 
 		CD3DX12_DESCRIPTOR_RANGE1 srvs(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0);
 		CD3DX12_DESCRIPTOR_RANGE1 uavs(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
@@ -227,15 +208,11 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 		} pipelineStateStream;
 
 		pipelineStateStream.rootSignature = createCommandsRootSignature.rootSignature.Get();
-		pipelineStateStream.cs = CD3DX12_SHADER_BYTECODE(shaderBlob.Get());
+		pipelineStateStream.cs = shader;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&createCommandsPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, createCommandsPipelineState, L"Procedural Placement Create Commands Pipeline");
 
 		SET_NAME(createCommandsRootSignature.rootSignature, "Procedural Placement Create Commands Root Signature");
-		SET_NAME(createCommandsPipelineState, "Procedural Placement Create Commands Pipeline");
 	}
 
 	numTilesX = 10;
@@ -381,10 +358,8 @@ void procedural_placement::initialize(ComPtr<ID3D12Device2> device, dx_command_l
 
 }
 
-void procedural_placement::generate(const render_camera& camera)
+void procedural_placement::beginFrame()
 {
-	PROFILE_FUNCTION();
-
 	++currentRenderResources;
 	if (currentRenderResources >= NUM_BUFFERED_FRAMES)
 	{
@@ -395,16 +370,15 @@ void procedural_placement::generate(const render_camera& camera)
 	depthOnlyCommandBuffer = renderResources[currentRenderResources].depthOnlyCommandBuffer;
 	instanceBufferInternal = renderResources[currentRenderResources].instanceBuffer;
 	instanceBuffer.resource = renderResources[currentRenderResources].instanceBuffer.resource;
+	instanceBuffer.stateHandle = renderResources[currentRenderResources].instanceBuffer.stateHandle;
 	instanceBuffer.view.BufferLocation = instanceBuffer.resource->GetGPUVirtualAddress();
 	instanceBuffer.view.SizeInBytes = maxNumInstances * sizeof(mat4);
 	instanceBuffer.view.StrideInBytes = sizeof(mat4);
+}
 
-#if PROCEDURAL_PLACEMENT_ALLOW_SIMULTANEOUS_EDITING
-	// This is only necessary, if we use the density textures on the render queue as well (I think).
-	dx_command_queue::computeCommandQueue.waitForOtherQueue(dx_command_queue::renderCommandQueue);
-#endif
-
-	dx_command_list* commandList = dx_command_queue::computeCommandQueue.getAvailableCommandList();
+void procedural_placement::generate(dx_command_list* commandList, const render_camera& camera)
+{
+	PROFILE_FUNCTION();
 
 	camera_frustum_planes frustum = camera.getWorldSpaceFrustumPlanes();
 
@@ -415,6 +389,7 @@ void procedural_placement::generate(const render_camera& camera)
 		clearBuffer(commandList, submeshCountBuffer);
 
 		uint32 maxNumGeneratedPlacementPoints = generatePoints(commandList, camera.position, frustum);
+		PROFILE_COUNTER_SET("Procedural placement points (max)", maxNumGeneratedPlacementPoints);
 		computeSubmeshOffsets(commandList);
 
 		if (maxNumGeneratedPlacementPoints > 0)
@@ -425,9 +400,9 @@ void procedural_placement::generate(const render_camera& camera)
 		createCommands(commandList);
 
 		// These are the buffers used for rendering.
-		commandList->transitionBarrier(commandBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
-		commandList->transitionBarrier(depthOnlyCommandBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
-		commandList->transitionBarrier(instanceBufferInternal.resource, D3D12_RESOURCE_STATE_COMMON);
+		commandList->transitionBarrier(commandBuffer, D3D12_RESOURCE_STATE_COMMON);
+		commandList->transitionBarrier(depthOnlyCommandBuffer, D3D12_RESOURCE_STATE_COMMON);
+		commandList->transitionBarrier(instanceBufferInternal, D3D12_RESOURCE_STATE_COMMON);
 
 
 #if PROCEDURAL_PLACEMENT_ALLOW_SIMULTANEOUS_EDITING
@@ -435,30 +410,21 @@ void procedural_placement::generate(const render_camera& camera)
 #endif
 
 
-		/*commandList->transitionBarrier(submeshCountBuffer.resource, D3D12_RESOURCE_STATE_COMMON);
-		commandList->transitionBarrier(submeshOffsetBuffer.resource, D3D12_RESOURCE_STATE_COMMON);*/
-	}
-	{
-		PROFILE_BLOCK("Execute command list");
-		dx_command_queue::computeCommandQueue.executeCommandList(commandList);
-	}
-	{
-		PROFILE_BLOCK("Wait for compute queue");
-		dx_command_queue::renderCommandQueue.waitForOtherQueue(dx_command_queue::computeCommandQueue);
-
-
-		/*flushApplication();
-		uint32 counts[512];
-		uint32 offsets[512];
-		indirect_command commands[32];
-		uint32 numDraws[2];
-		submeshCountBuffer.copyBackToCPU(counts, submeshCountBuffer.count * sizeof(uint32));
-		submeshOffsetBuffer.copyBackToCPU(offsets, submeshOffsetBuffer.count * sizeof(uint32));
-		commandBuffer.copyBackToCPU(commands, commandBuffer.count * sizeof(indirect_command));
-		numDrawCallsBuffer.copyBackToCPU(numDraws, 2 * sizeof(uint32));
-		flushApplication();
-		int a = 0;*/
+		/*commandList->transitionBarrier(submeshCountBuffer, D3D12_RESOURCE_STATE_COMMON);
+		commandList->transitionBarrier(submeshOffsetBuffer, D3D12_RESOURCE_STATE_COMMON);*/
 	}
+
+	/*flushApplication();
+	uint32 counts[512];
+	uint32 offsets[512];
+	indirect_command commands[32];
+	uint32 numDraws[2];
+	submeshCountBuffer.copyBackToCPU(counts, submeshCountBuffer.count * sizeof(uint32));
+	submeshOffsetBuffer.copyBackToCPU(offsets, submeshOffsetBuffer.count * sizeof(uint32));
+	commandBuffer.copyBackToCPU(commands, commandBuffer.count * sizeof(indirect_command));
+	numDrawCallsBuffer.copyBackToCPU(numDraws, 2 * sizeof(uint32));
+	flushApplication();
+	int a = 0;*/
 }
 
 void procedural_placement::transitionAllTexturesToCommon(dx_command_list* commandList)
@@ -574,8 +540,8 @@ void procedural_placement::computeSubmeshOffsets(dx_command_list* commandList)
 	commandList->setPipelineState(prefixSumPipelineState);
 	commandList->setComputeRootSignature(prefixSumRootSignature);
 
-	commandList->transitionBarrier(submeshCountBuffer.resource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-	commandList->transitionBarrier(submeshOffsetBuffer.resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	commandList->transitionBarrier(submeshCountBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->transitionBarrier(submeshOffsetBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
 	commandList->setCompute32BitConstants(PROCEDURAL_PLACEMENT_ROOTPARAM_CB, submeshCountBuffer.count);
 	commandList->stageDescriptors(PROCEDURAL_PLACEMENT_ROOTPARAM_SRVS, 0, 1, submeshCountBuffer.srv);
@@ -595,9 +561,9 @@ void procedural_placement::placeGeometry(dx_command_list* commandList, const cam
 	commandList->setPipelineState(placeGeometryPipelineState);
 	commandList->setComputeRootSignature(placeGeometryRootSignature);
 
-	commandList->transitionBarrier(submeshOffsetBuffer.resource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->transitionBarrier(submeshOffsetBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
-	commandList->transitionBarrier(instanceBufferInternal.resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	commandList->transitionBarrier(instanceBufferInternal, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
 	commandList->setCompute32BitConstants(PROCEDURAL_PLACEMENT_ROOTPARAM_CAMERA, frustum);
 	commandList->stageDescriptors(PROCEDURAL_PLACEMENT_ROOTPARAM_SRVS, 0, 1, placementPointsBuffer.srv);
@@ -625,9 +591,9 @@ void procedural_placement::createCommands(dx_command_list* commandList)
 	commandList->setPipelineState(createCommandsPipelineState);
 	commandList->setComputeRootSignature(createCommandsRootSignature);
 
-	commandList->transitionBarrier(commandBuffer.resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	commandList->transitionBarrier(depthOnlyCommandBuffer.resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	commandList->transitionBarrier(submeshOffsetBuffer.resource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->transitionBarrier(commandBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	commandList->transitionBarrier(depthOnlyCommandBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	commandList->transitionBarrier(submeshOffsetBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
 	commandList->setCompute32BitConstants(PROCEDURAL_PLACEMENT_ROOTPARAM_CB, submeshBuffer.count);
 	commandList->stageDescriptors(PROCEDURAL_PLACEMENT_ROOTPARAM_SRVS, 0, 1, submeshCountBuffer.srv);
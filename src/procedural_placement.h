@@ -92,7 +92,12 @@ struct procedural_placement
 		const placement_mesh& treeMesh
 	);
 
-	void generate(const render_camera& camera);
+	// Switches the buffers below to the ones for this frame. Must be called before the frame graph is built.
+	void beginFrame();
+
+	// Only records. Meant to run as an async compute pass of the frame graph, which waits for the graphics work before
+	// it (the density textures may be edited there) and makes the passes using the buffers below wait for it.
+	void generate(dx_command_list* commandList, const render_camera& camera);
 
 	void transitionAllTexturesToCommon(dx_command_list* commandList);
 	
@@ -4,6 +4,8 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 struct brush_cb
 {
@@ -17,12 +19,10 @@ struct brush_cb
 void procedural_placement_editor::initialize(ComPtr<ID3D12Device2> device, const dx_render_target& renderTarget)
 {
 	{
-		ComPtr<ID3DBlob> vertexShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/placement_editor_vs.cso", &vertexShaderBlob));
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/placement_editor_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/placement_editor_vs.cso");
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/placement_editor_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 			{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
@@ -68,28 +68,22 @@ void procedural_placement_editor::initialize(ComPtr<ID3D12Device2> device, const
 		pipelineStateStream.rootSignature = visualizeDensityRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&visualizeDensityPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, visualizeDensityPipelineState, L"Placement Editor Visualize Density Pipeline");
 
 		SET_NAME(visualizeDensityRootSignature.rootSignature, "Placement Editor Visualize Density Root Signature");
-		SET_NAME(visualizeDensityPipelineState, "Placement Editor Visualize Density Pipeline");
 	}
 
 	{
-		ComPtr<ID3DBlob> vertexShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/placement_editor_apply_brush_vs.cso", &vertexShaderBlob));
-		ComPtr<ID3DBlob> pixelShaderBlob;
-		checkResult(D3DReadFileToBlob(L"shaders/bin/placement_editor_apply_brush_ps.cso", &pixelShaderBlob));
+		D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/placement_editor_apply_brush_vs.cso");
+		D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/placement_editor_apply_brush_ps.cso");
 
-		D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 			{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		};
@@ -134,8 +128,8 @@ void procedural_placement_editor::initialize(ComPtr<ID3D12Device2> device, const
 		pipelineStateStream.rootSignature = applyBrushRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.rtvFormats = applyBrushRTFormat;
 		pipelineStateStream.rasterizer = noBackfaceCullRasterizerDesc;
 
@@ -158,12 +152,8 @@ void procedural_placement_editor::initialize(ComPtr<ID3D12Device2> device, const
 		{
 			pipelineStateStream.blend = blendDescs[i];
 
-			D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-				sizeof(pipeline_state_stream), &pipelineStateStream
-			};
-			checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&applyBrushPipelineState[i])));
+			dx_pipeline_factory::createPipelineState(pipelineStateStream, applyBrushPipelineState[i], L"Placement Editor Apply Brush Pipeline");
 
-			SET_NAME(applyBrushPipelineState[i], "Placement Editor Apply Brush Pipeline");
 		}
 
 		SET_NAME(applyBrushRootSignature.rootSignature, "Placement Editor Apply Brush Root Signature");
@@ -0,0 +1,706 @@
+#include "pch.h"
+#include "profile_export.h"
+#include "profile_statistics.h"
+#include "debug_gui.h"
+#include "memory_tracking.h"
+
+#include <deque>
+#include <thread>
+#include <condition_variable>
+
+#ifdef PROFILE
+
+#define PROFILE_CAPTURE_VERSION			2
+#define MAX_NUM_QUEUED_EXPORT_EVENTS	(1 << 20)	// Frames which do not fit are dropped, if the disk cannot keep up.
+#define MAX_NUM_PRE_ROLL_EVENTS			(1 << 19)
+
+profile_capture_settings profileCaptureSettings;
+
+enum profile_export_command_type
+{
+	profile_export_command_begin_capture,
+	profile_export_command_frame,
+	profile_export_command_end_capture,
+};
+
+struct profile_export_command
+{
+	profile_export_command_type type;
+
+	// Begin capture.
+	std::string path;
+	profile_capture_format format = profile_capture_chrome_trace;
+	uint64 clockFrequency = 0;
+	uint64 startClock = 0;
+
+	// Frame. Starts with the frame marker.
+	std::vector<profile_event> events;
+};
+
+
+// Only touched by the thread which drains the profiler.
+static std::vector<profile_event> currentFrameEvents;
+static std::deque<std::vector<profile_event>> preRollFrames;
+static uint32 numPreRollEvents;
+
+static bool captureRunning;
+static uint32 numCaptureFramesLeft;
+static uint32 requestedCaptureFrames;
+
+static uint32 numSlowFrameCaptures;
+static uint32 framesSinceSlowFrameCapture = -1;
+
+
+// Shared with the writer thread.
+static std::thread exportThread;
+static std::deque<profile_export_command> exportCommands;
+static uint32 numQueuedExportEvents;
+static bool exportThreadRunning;
+
+static std::mutex exportMutex;
+static std::condition_variable exportCommandAvailable;
+
+static uint32 numCapturesWritten;
+static uint32 numDroppedExportFrames;
+static std::string lastCaptureStatus;
+
+
+// Only touched by the writer thread.
+struct profile_capture_file
+{
+	FILE* file;
+	profile_capture_format format;
+	uint64 clockFrequency;
+	uint64 startClock;
+	uint64 lastClock;
+	bool firstEvent;
+
+	std::unordered_map<const char*, uint32> stringIDs;
+	std::unordered_map<uint32, uint32> openBlocksPerThread;
+	std::unordered_map<uint32, uint32> threadIndices;
+
+	std::vector<profile_counter> counters;
+	std::vector<double> counterTotals;		// Running totals of summed counters within the current frame.
+};
+
+static profile_capture_file capture;
+
+
+static void writeJSONString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str; ++str)
+	{
+		char c = *str;
+		if (c == '"' || c == '\\')
+		{
+			fputc('\\', file);
+			fputc(c, file);
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			fprintf(file, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static void writeVarint(FILE* file, uint64 value)
+{
+	while (value >= 0x80)
+	{
+		fputc((int)(value & 0x7F) | 0x80, file);
+		value >>= 7;
+	}
+	fputc((int)value, file);
+}
+
+static void beginJSONEvent(const char* phase, uint32 threadID, uint64 clock)
+{
+	double timeInMicroseconds = ((double)clock - (double)capture.startClock) * 1000000.0 / (double)capture.clockFrequency;
+
+	fprintf(capture.file, "%s\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", capture.firstEvent ? "" : ",", phase, threadID, timeInMicroseconds);
+	capture.firstEvent = false;
+}
+
+static void writeThreadMetadata(uint32 threadID)
+{
+	if (capture.threadIndices.find(threadID) == capture.threadIndices.end())
+	{
+		uint32 threadIndex = (uint32)capture.threadIndices.size();
+		capture.threadIndices[threadID] = threadIndex;
+
+		fprintf(capture.file, "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"Thread %u\"}}",
+			capture.firstEvent ? "" : ",", threadID, threadIndex);
+		fprintf(capture.file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%u}}",
+			threadID, threadIndex);
+		capture.firstEvent = false;
+	}
+}
+
+static uint32 getCaptureStringID(const char* str)
+{
+	auto it = capture.stringIDs.find(str);
+	if (it != capture.stringIDs.end())
+	{
+		return it->second;
+	}
+
+	uint32 stringID = (uint32)capture.stringIDs.size();
+	capture.stringIDs[str] = stringID;
+
+	uint16 length = (uint16)min(strlen(str), (size_t)UINT16_MAX);
+	fputc(profile_capture_tag_string, capture.file);
+	fwrite(&stringID, sizeof(stringID), 1, capture.file);
+	fwrite(&length, sizeof(length), 1, capture.file);
+	fwrite(str, 1, length, capture.file);
+	return stringID;
+}
+
+// Counters are registered lazily, so ones which were created after the capture started are fetched on first use.
+static const profile_counter& getCaptureCounter(uint16 counterIndex)
+{
+	if (counterIndex >= capture.counters.size())
+	{
+		uint32 numCounters = getNumProfileCounters();
+		for (uint32 i = (uint32)capture.counters.size(); i < numCounters; ++i)
+		{
+			capture.counters.push_back(getProfileCounter(i));
+		}
+		capture.counterTotals.resize(numCounters, 0.0);
+	}
+
+	return capture.counters[counterIndex];
+}
+
+static void writeCaptureEvent(const profile_event& event)
+{
+	if (event.type == profile_event_frame_marker)
+	{
+		capture.counterTotals.assign(capture.counterTotals.size(), 0.0);
+	}
+
+	if (capture.format == profile_capture_chrome_trace)
+	{
+		writeThreadMetadata(event.threadID);
+
+		switch (event.type)
+		{
+			case profile_event_frame_marker:
+			{
+				beginJSONEvent("i", event.threadID, event.clock);
+				if (event.frameID == -1)
+				{
+					fprintf(capture.file, ",\"s\":\"g\",\"name\":\"Initialization\"}");
+				}
+				else
+				{
+					fprintf(capture.file, ",\"s\":\"g\",\"name\":\"Frame %llu\"}", event.frameID);
+				}
+			} break;
+			case profile_event_begin_block:
+			{
+				beginJSONEvent("B", event.threadID, event.clock);
+				fprintf(capture.file, ",\"name\":");
+				writeJSONString(capture.file, event.info);
+				fputc('}', capture.file);
+			} break;
+			case profile_event_end_block:
+			{
+				beginJSONEvent("E", event.threadID, event.clock);
+				fputc('}', capture.file);
+			} break;
+			case profile_event_counter:
+			{
+				// Chrome plots counters as they are, so sums are accumulated here.
+				const profile_counter& counter = getCaptureCounter(event.counterIndex);
+				double value = event.value;
+				if (counter.kind == profile_counter_sum)
+				{
+					value = (capture.counterTotals[event.counterIndex] += event.value);
+				}
+
+				beginJSONEvent("C", event.threadID, event.clock);
+				fprintf(capture.file, ",\"name\":");
+				writeJSONString(capture.file, counter.name);
+				fprintf(capture.file, ",\"args\":{\"value\":%.17g}}", value);
+			} break;
+		}
+	}
+	else
+	{
+		switch (event.type)
+		{
+			case profile_event_frame_marker:
+			{
+				fputc(profile_capture_tag_frame_marker, capture.file);
+				writeVarint(capture.file, event.threadID);
+				writeVarint(capture.file, event.clock - capture.lastClock);
+				writeVarint(capture.file, event.frameID);
+			} break;
+			case profile_event_begin_block:
+			{
+				uint32 stringID = getCaptureStringID(event.info);
+
+				fputc(profile_capture_tag_begin_block, capture.file);
+				writeVarint(capture.file, event.threadID);
+				writeVarint(capture.file, event.clock - capture.lastClock);
+				writeVarint(capture.file, stringID);
+			} break;
+			case profile_event_end_block:
+			{
+				fputc(profile_capture_tag_end_block, capture.file);
+				writeVarint(capture.file, event.threadID);
+				writeVarint(capture.file, event.clock - capture.lastClock);
+			} break;
+			case profile_event_counter:
+			{
+				const profile_counter& counter = getCaptureCounter(event.counterIndex);
+				uint32 stringID = getCaptureStringID(counter.name);
+				uint8 kind = (uint8)counter.kind;
+
+				fputc(profile_capture_tag_counter, capture.file);
+				writeVarint(capture.file, event.threadID);
+				writeVarint(capture.file, event.clock - capture.lastClock);
+				writeVarint(capture.file, stringID);
+				fputc(kind, capture.file);
+				fwrite(&event.value, sizeof(event.value), 1, capture.file);
+			} break;
+		}
+	}
+
+	capture.lastClock = event.clock;
+}
+
+static void beginCaptureFile(const profile_export_command& command)
+{
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(command.path).parent_path(), error);
+
+	capture.file = fopen(command.path.c_str(), (command.format == profile_capture_chrome_trace) ? "w" : "wb");
+	capture.format = command.format;
+	capture.clockFrequency = command.clockFrequency;
+	capture.startClock = command.startClock;
+	capture.lastClock = command.startClock;
+	capture.firstEvent = true;
+	capture.stringIDs.clear();
+	capture.openBlocksPerThread.clear();
+	capture.threadIndices.clear();
+	capture.counterTotals.assign(capture.counterTotals.size(), 0.0);
+
+	if (!capture.file)
+	{
+		std::lock_guard<std::mutex> lock(exportMutex);
+		lastCaptureStatus = "Could not open " + command.path;
+		return;
+	}
+
+	if (capture.format == profile_capture_chrome_trace)
+	{
+		fprintf(capture.file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	}
+	else
+	{
+		uint32 version = PROFILE_CAPTURE_VERSION;
+		fwrite("PRFC", 1, 4, capture.file);
+		fwrite(&version, sizeof(version), 1, capture.file);
+		fwrite(&capture.clockFrequency, sizeof(capture.clockFrequency), 1, capture.file);
+		fwrite(&capture.startClock, sizeof(capture.startClock), 1, capture.file);
+	}
+
+	std::lock_guard<std::mutex> lock(exportMutex);
+	lastCaptureStatus = "Writing " + command.path;
+}
+
+static void writeCaptureFrame(const std::vector<profile_event>& events)
+{
+	if (!capture.file)
+	{
+		return;
+	}
+
+	for (const profile_event& event : events)
+	{
+		if (event.type == profile_event_begin_block)
+		{
+			++capture.openBlocksPerThread[event.threadID];
+		}
+		else if (event.type == profile_event_end_block)
+		{
+			// Blocks which started before the capture are left out.
+			uint32& numOpenBlocks = capture.openBlocksPerThread[event.threadID];
+			if (numOpenBlocks == 0)
+			{
+				continue;
+			}
+			--numOpenBlocks;
+		}
+
+		writeCaptureEvent(event);
+	}
+}
+
+static void endCaptureFile(const std::string& path)
+{
+	if (!capture.file)
+	{
+		return;
+	}
+
+	// Blocks which are still running end with the capture.
+	for (auto& [threadID, numOpenBlocks] : capture.openBlocksPerThread)
+	{
+		for (; numOpenBlocks > 0; --numOpenBlocks)
+		{
+			profile_event endBlock = {};
+			endBlock.type = profile_event_end_block;
+			endBlock.threadID = threadID;
+			endBlock.clock = capture.lastClock;
+			writeCaptureEvent(endBlock);
+		}
+	}
+
+	if (capture.format == profile_capture_chrome_trace)
+	{
+		fprintf(capture.file, "\n]}\n");
+	}
+
+	fclose(capture.file);
+	capture.file = nullptr;
+
+	std::lock_guard<std::mutex> lock(exportMutex);
+	++numCapturesWritten;
+	lastCaptureStatus = "Wrote " + path;
+}
+
+static void profileExportThread()
+{
+	MEMORY_TAG(memory_tag_profiler);
+
+	std::string path;
+
+	std::unique_lock<std::mutex> lock(exportMutex);
+	while (true)
+	{
+		exportCommandAvailable.wait(lock, [] { return !exportCommands.empty() || !exportThreadRunning; });
+
+		if (exportCommands.empty())
+		{
+			break; // Shutting down.
+		}
+
+		profile_export_command command = std::move(exportCommands.front());
+		exportCommands.pop_front();
+		lock.unlock();
+
+		switch (command.type)
+		{
+			case profile_export_command_begin_capture: path = command.path; beginCaptureFile(command); break;
+			case profile_export_command_frame: writeCaptureFrame(command.events); break;
+			case profile_export_command_end_capture: endCaptureFile(path); break;
+		}
+
+		lock.lock();
+		numQueuedExportEvents -= (uint32)command.events.size();
+	}
+}
+
+static void pushExportCommand(profile_export_command&& command)
+{
+	{
+		std::lock_guard<std::mutex> lock(exportMutex);
+
+		if (command.type == profile_export_command_frame && numQueuedExportEvents + command.events.size() > MAX_NUM_QUEUED_EXPORT_EVENTS)
+		{
+			++numDroppedExportFrames;
+			return;
+		}
+
+		if (!exportThreadRunning)
+		{
+			exportThreadRunning = true;
+			exportThread = std::thread(profileExportThread);
+		}
+
+		numQueuedExportEvents += (uint32)command.events.size();
+		exportCommands.push_back(std::move(command));
+	}
+	exportCommandAvailable.notify_one();
+}
+
+static void beginCapture(const char* reason, uint64 frameID, uint64 startClock, uint64 clockFrequency, uint32 numFrames)
+{
+	char name[128];
+	snprintf(name, sizeof(name), "profile_%lld_%s.%s", (int64)frameID, reason,
+		(profileCaptureSettings.format == profile_capture_chrome_trace) ? "json" : "pbin");
+
+	profile_export_command command;
+	command.type = profile_export_command_begin_capture;
+	command.path = (std::filesystem::path(profileCaptureSettings.directory) / name).string();
+	command.format = profileCaptureSettings.format;
+	command.clockFrequency = clockFrequency;
+	command.startClock = startClock;
+	pushExportCommand(std::move(command));
+
+	captureRunning = true;
+	numCaptureFramesLeft = numFrames;
+}
+
+static void endCapture()
+{
+	profile_export_command command;
+	command.type = profile_export_command_end_capture;
+	pushExportCommand(std::move(command));
+
+	captureRunning = false;
+}
+
+static void pushCaptureFrame(std::vector<profile_event>&& events)
+{
+	profile_export_command command;
+	command.type = profile_export_command_frame;
+	command.events = std::move(events);
+	pushExportCommand(std::move(command));
+}
+
+// Called with the marker which ends the current frame.
+static void finishFrame(uint64 endClock, uint64 clockFrequency)
+{
+	if (currentFrameEvents.empty() || currentFrameEvents[0].type != profile_event_frame_marker)
+	{
+		currentFrameEvents.clear(); // Before the first frame.
+		return;
+	}
+
+	uint64 frameID = currentFrameEvents[0].frameID;
+	float frameTimeInMilliseconds = (float)((double)(endClock - currentFrameEvents[0].clock) * 1000.0 / (double)clockFrequency);
+
+	if (captureRunning)
+	{
+		pushCaptureFrame(std::move(currentFrameEvents));
+		if (--numCaptureFramesLeft == 0)
+		{
+			endCapture();
+		}
+		return;
+	}
+
+	if (framesSinceSlowFrameCapture != -1)
+	{
+		++framesSinceSlowFrameCapture;
+	}
+
+	const profile_capture_settings& settings = profileCaptureSettings;
+	if (!settings.captureSlowFrames)
+	{
+		preRollFrames.clear();
+		numPreRollEvents = 0;
+		return;
+	}
+
+	numPreRollEvents += (uint32)currentFrameEvents.size();
+	preRollFrames.push_back(std::move(currentFrameEvents));
+
+	// The slow frame itself is always kept.
+	while (preRollFrames.size() > settings.numFramesBeforeSlowFrame + 1 ||
+		(preRollFrames.size() > 1 && numPreRollEvents > MAX_NUM_PRE_ROLL_EVENTS))
+	{
+		numPreRollEvents -= (uint32)preRollFrames.front().size();
+		preRollFrames.pop_front();
+	}
+
+	if (frameTimeInMilliseconds > settings.slowFrameThresholdInMilliseconds && frameID != -1
+		&& framesSinceSlowFrameCapture >= settings.minFramesBetweenSlowFrameCaptures
+		&& numSlowFrameCaptures < settings.maxNumSlowFrameCaptures)
+	{
+		beginCapture("slow", frameID, preRollFrames.front()[0].clock, clockFrequency, settings.numFramesAfterSlowFrame);
+
+		for (std::vector<profile_event>& frame : preRollFrames)
+		{
+			pushCaptureFrame(std::move(frame));
+		}
+		preRollFrames.clear();
+		numPreRollEvents = 0;
+
+		if (numCaptureFramesLeft == 0)
+		{
+			endCapture();
+		}
+
+		++numSlowFrameCaptures;
+		framesSinceSlowFrameCapture = 0;
+	}
+}
+
+static void startFrame(const profile_event& marker, uint64 clockFrequency)
+{
+	if (captureRunning)
+	{
+		return;
+	}
+
+	if (requestedCaptureFrames)
+	{
+		beginCapture("manual", marker.frameID, marker.clock, clockFrequency, requestedCaptureFrames);
+		requestedCaptureFrames = 0;
+	}
+	else if (profileCaptureSettings.captureAtFrameID != -1 && marker.frameID == profileCaptureSettings.captureAtFrameID
+		&& profileCaptureSettings.numFramesPerCapture)
+	{
+		beginCapture("frame", marker.frameID, marker.clock, clockFrequency, profileCaptureSettings.numFramesPerCapture);
+	}
+}
+
+void requestProfileCapture(uint32 numFrames)
+{
+	requestedCaptureFrames = numFrames ? numFrames : profileCaptureSettings.numFramesPerCapture;
+}
+
+void exportProfileEvents(const profile_event* events, uint32 numEvents, uint64 clockFrequency)
+{
+	PROFILE_FUNCTION();
+
+	for (uint32 i = 0; i < numEvents; ++i)
+	{
+		const profile_event& event = events[i];
+
+		if (event.type == profile_event_frame_marker)
+		{
+			finishFrame(event.clock, clockFrequency);
+			currentFrameEvents.clear();
+			startFrame(event, clockFrequency);
+		}
+
+		if (currentFrameEvents.size() < MAX_NUM_QUEUED_EXPORT_EVENTS)
+		{
+			currentFrameEvents.push_back(event);
+		}
+	}
+}
+
+void displayProfileCaptureInfo(debug_gui& gui)
+{
+	if (gui.button(captureRunning ? "Capturing..." : "Capture frames"))
+	{
+		requestProfileCapture();
+	}
+	gui.radio("Capture format", profileCaptureFormatNames, profile_capture_format_count, (uint32&)profileCaptureSettings.format);
+	gui.toggle("Capture slow frames", profileCaptureSettings.captureSlowFrames);
+	if (profileCaptureSettings.captureSlowFrames)
+	{
+		gui.slider("Slow frame threshold (ms)", profileCaptureSettings.slowFrameThresholdInMilliseconds, 5.f, 100.f);
+	}
+
+	std::lock_guard<std::mutex> lock(exportMutex);
+	gui.textF("Captures written: %u, dropped frames: %u", numCapturesWritten, numDroppedExportFrames);
+	if (!lastCaptureStatus.empty())
+	{
+		gui.text(lastCaptureStatus.c_str());
+	}
+}
+
+static void writeStatisticsHistogram(FILE* file, const profile_histogram& histogram)
+{
+	// Only non-empty buckets, as [upper bound in ms, count].
+	fprintf(file, "\"histogram\":[");
+	bool first = true;
+	for (uint32 bucket = 0; bucket < PROFILE_HISTOGRAM_NUM_BUCKETS; ++bucket)
+	{
+		if (histogram.counts[bucket])
+		{
+			fprintf(file, "%s[%g,%u]", first ? "" : ",", profile_histogram::bucketUpperBound(bucket), histogram.counts[bucket]);
+			first = false;
+		}
+	}
+	fprintf(file, "]");
+}
+
+void exportProfileStatistics()
+{
+	static uint32 numExports;
+
+	char name[128];
+	snprintf(name, sizeof(name), "profile_statistics_%u.json", numExports++);
+	std::filesystem::path path = std::filesystem::path(profileCaptureSettings.directory) / name;
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	FILE* file = fopen(path.string().c_str(), "w");
+	if (!file)
+	{
+		std::lock_guard<std::mutex> lock(exportMutex);
+		lastCaptureStatus = "Could not open " + path.string();
+		return;
+	}
+
+	std::vector<profile_block_summary> summaries;
+	getProfileBlockSummaries(summaries);
+
+	fprintf(file, "{\"windowSize\":%u,\n\"blocks\":[", PROFILE_STATISTICS_WINDOW_SIZE);
+	for (uint32 i = 0; i < (uint32)summaries.size(); ++i)
+	{
+		const profile_block_summary& s = summaries[i];
+
+		fprintf(file, "%s\n{\"name\":", i ? "," : "");
+		writeJSONString(file, s.info);
+		fprintf(file, ",\"window\":{\"frames\":%u,\"min\":%g,\"mean\":%g,\"max\":%g,\"p50\":%g,\"p95\":%g,\"p99\":%g}",
+			s.numWindowFrames, s.windowMin, s.windowMean, s.windowMax, s.windowP50, s.windowP95, s.windowP99);
+		fprintf(file, ",\"session\":{\"frames\":%llu,\"calls\":%llu,\"min\":%g,\"mean\":%g,\"max\":%g,\"p50\":%g,\"p95\":%g,\"p99\":%g},",
+			s.numSessionFrames, s.numSessionCalls, s.sessionMin, s.sessionMean, s.sessionMax, s.sessionP50, s.sessionP95, s.sessionP99);
+
+		const profile_histogram* histogram = (i == 0) ? &getProfileFrameHistogram() : getProfileBlockHistogram(s.info);
+		writeStatisticsHistogram(file, *histogram);
+		fprintf(file, "}");
+	}
+
+	std::vector<profile_hitch> hitches;
+	getProfileHitches(hitches);
+
+	fprintf(file, "\n],\n\"hitches\":[");
+	for (uint32 i = 0; i < (uint32)hitches.size(); ++i)
+	{
+		const profile_hitch& hitch = hitches[i];
+
+		fprintf(file, "%s\n{\"frame\":%llu,\"time\":%g,\"median\":%g,\"contributors\":[", i ? "," : "",
+			hitch.frameID, hitch.frameTimeInMilliseconds, hitch.medianFrameTimeInMilliseconds);
+		for (uint32 c = 0; c < hitch.numContributors; ++c)
+		{
+			fprintf(file, "%s{\"name\":", c ? "," : "");
+			writeJSONString(file, hitch.contributors[c].info);
+			fprintf(file, ",\"time\":%g,\"excess\":%g}", hitch.contributors[c].timeInMilliseconds, hitch.contributors[c].excessInMilliseconds);
+		}
+		fprintf(file, "]}");
+	}
+	fprintf(file, "\n]}\n");
+
+	fclose(file);
+
+	std::lock_guard<std::mutex> lock(exportMutex);
+	lastCaptureStatus = "Wrote " + path.string();
+}
+
+void shutdownProfileExport()
+{
+	if (captureRunning)
+	{
+		endCapture();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(exportMutex);
+		if (!exportThreadRunning)
+		{
+			return;
+		}
+		exportThreadRunning = false;
+	}
+	exportCommandAvailable.notify_all();
+	exportThread.join();
+}
+
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "profiling.h"
+
+#ifdef PROFILE
+
+STRINGIFY_ENUM(profileCaptureFormatNames,
+	enum profile_capture_format
+{
+	profile_capture_chrome_trace, "Chrome trace (json)",
+	profile_capture_binary, "Binary",
+
+	profile_capture_format_count, "Count",
+};
+)
+
+// Captures are written to disk by a background thread while the game keeps running. They are either started by hand (key
+// or button), at a given frame, or when a frame takes longer than the threshold. In the last case, the frames leading up
+// to the slow one are included.
+//
+// Chrome traces open in chrome://tracing or ui.perfetto.dev. The binary format is a lot smaller:
+//   header:  char magic[4] = "PRFC", uint32 version, uint64 clock ticks per second, uint64 start clock
+//   records: uint8 tag, followed by
+//     profile_capture_tag_string:        uint32 id, uint16 length, char[length]
+//     profile_capture_tag_frame_marker:  varint threadID, varint clock delta, varint frameID
+//     profile_capture_tag_begin_block:   varint threadID, varint clock delta, varint string id
+//     profile_capture_tag_end_block:     varint threadID, varint clock delta
+//     profile_capture_tag_counter:       varint threadID, varint clock delta, varint string id, uint8 profile_counter_kind, double value
+// Clock deltas are relative to the previous event in the file. An end block closes the innermost open block of its thread.
+// Counter values are stored as recorded. In Chrome traces, summed counters show the running total within the frame.
+enum profile_capture_tag
+{
+	profile_capture_tag_string,
+	profile_capture_tag_frame_marker,
+	profile_capture_tag_begin_block,
+	profile_capture_tag_end_block,
+	profile_capture_tag_counter,
+};
+
+struct profile_capture_settings
+{
+	profile_capture_format format = profile_capture_chrome_trace;
+	const char* directory = "captures";
+
+	uint32 numFramesPerCapture = 60;				// For captures started by hand or at a frame.
+	uint64 captureAtFrameID = -1;					// Starts a capture when this frame begins. -1 = never.
+
+	bool captureSlowFrames = false;
+	float slowFrameThresholdInMilliseconds = 33.3f;
+	uint32 numFramesBeforeSlowFrame = 30;
+	uint32 numFramesAfterSlowFrame = 10;
+	uint32 minFramesBetweenSlowFrameCaptures = 300;
+	uint32 maxNumSlowFrameCaptures = 16;			// Per session, so a slow machine does not fill the disk.
+};
+
+extern profile_capture_settings profileCaptureSettings;
+
+// Starts with the next frame. numFrames = 0 uses the setting.
+void requestProfileCapture(uint32 numFrames = 0);
+
+// Called by the profiler with every batch of drained events.
+void exportProfileEvents(const profile_event* events, uint32 numEvents, uint64 clockFrequency);
+void displayProfileCaptureInfo(class debug_gui& gui);
+
+// Writes the block statistics, their histograms and the recent hitches as json into the capture directory.
+void exportProfileStatistics();
+
+// Finishes the running capture and waits until everything is on disk.
+void shutdownProfileExport();
+
+#else
+#define requestProfileCapture(...)
+#define exportProfileStatistics()
+#define shutdownProfileExport()
+#endif
@@ -0,0 +1,275 @@
+#include "pch.h"
+#include "profile_statistics.h"
+
+#include <algorithm>
+
+#ifdef PROFILE
+
+#define MIN_NUM_FRAMES_FOR_RELATIVE_HITCHES		16
+
+profile_statistics_settings profileStatisticsSettings;
+
+struct profile_block_history
+{
+	const char* info;
+
+	float windowSamples[PROFILE_STATISTICS_WINDOW_SIZE];
+	uint32 numWindowSamples;
+	uint32 nextWindowSample;
+
+	uint64 numSessionCalls;
+	float sessionMin;
+	float sessionMax;
+	double sessionSum;
+	profile_histogram histogram;
+};
+
+static profile_block_history frameHistory = { "Frame" };
+static std::unordered_map<const char*, profile_block_history> blockHistories;
+
+static profile_hitch recordedHitches[MAX_NUM_RECORDED_HITCHES];
+static uint32 numRecordedHitches;
+static uint32 nextRecordedHitch;
+
+void profile_histogram::add(float timeInMilliseconds)
+{
+	uint32 bucket = 0;
+	if (timeInMilliseconds > PROFILE_HISTOGRAM_MIN_TIME)
+	{
+		bucket = 1 + (uint32)(log2f(timeInMilliseconds / PROFILE_HISTOGRAM_MIN_TIME) * PROFILE_HISTOGRAM_BUCKETS_PER_OCTAVE);
+		bucket = min(bucket, (uint32)PROFILE_HISTOGRAM_NUM_BUCKETS - 1);
+	}
+
+	++counts[bucket];
+	++numSamples;
+}
+
+float profile_histogram::quantile(float q) const
+{
+	if (numSamples == 0)
+	{
+		return 0.f;
+	}
+
+	uint64 target = max((uint64)ceil(q * numSamples), (uint64)1);
+	uint64 count = 0;
+	for (uint32 bucket = 0; bucket < PROFILE_HISTOGRAM_NUM_BUCKETS; ++bucket)
+	{
+		count += counts[bucket];
+		if (count >= target)
+		{
+			// Geometric center of the bucket.
+			return (bucket == 0) ? PROFILE_HISTOGRAM_MIN_TIME
+				: PROFILE_HISTOGRAM_MIN_TIME * exp2f((bucket - 0.5f) / PROFILE_HISTOGRAM_BUCKETS_PER_OCTAVE);
+		}
+	}
+	return bucketUpperBound(PROFILE_HISTOGRAM_NUM_BUCKETS - 1);
+}
+
+float profile_histogram::bucketUpperBound(uint32 bucket)
+{
+	return PROFILE_HISTOGRAM_MIN_TIME * exp2f((float)bucket / PROFILE_HISTOGRAM_BUCKETS_PER_OCTAVE);
+}
+
+static void addSample(profile_block_history& history, float timeInMilliseconds, uint32 numCalls)
+{
+	history.windowSamples[history.nextWindowSample] = timeInMilliseconds;
+	history.nextWindowSample = (history.nextWindowSample + 1) % PROFILE_STATISTICS_WINDOW_SIZE;
+	history.numWindowSamples = min(history.numWindowSamples + 1, (uint32)PROFILE_STATISTICS_WINDOW_SIZE);
+
+	if (history.histogram.numSamples == 0)
+	{
+		history.sessionMin = timeInMilliseconds;
+		history.sessionMax = timeInMilliseconds;
+	}
+	else
+	{
+		history.sessionMin = min(history.sessionMin, timeInMilliseconds);
+		history.sessionMax = max(history.sessionMax, timeInMilliseconds);
+	}
+	history.sessionSum += timeInMilliseconds;
+	history.numSessionCalls += numCalls;
+	history.histogram.add(timeInMilliseconds);
+}
+
+static float windowMedian(const profile_block_history& history)
+{
+	if (history.numWindowSamples == 0)
+	{
+		return 0.f;
+	}
+
+	float samples[PROFILE_STATISTICS_WINDOW_SIZE];
+	memcpy(samples, history.windowSamples, history.numWindowSamples * sizeof(float));
+
+	float* median = samples + history.numWindowSamples / 2;
+	std::nth_element(samples, median, samples + history.numWindowSamples);
+	return *median;
+}
+
+// Nearest rank.
+static float sortedQuantile(const float* sorted, uint32 count, float q)
+{
+	uint32 rank = (uint32)ceil(q * count);
+	return sorted[clamp(rank, 1u, count) - 1];
+}
+
+static void summarize(const profile_block_history& history, profile_block_summary& outSummary)
+{
+	outSummary = {};
+	outSummary.info = history.info;
+
+	uint32 count = history.numWindowSamples;
+	if (count)
+	{
+		float samples[PROFILE_STATISTICS_WINDOW_SIZE];
+		memcpy(samples, history.windowSamples, count * sizeof(float));
+		std::sort(samples, samples + count);
+
+		float sum = 0.f;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			sum += samples[i];
+		}
+
+		outSummary.numWindowFrames = count;
+		outSummary.windowMin = samples[0];
+		outSummary.windowMax = samples[count - 1];
+		outSummary.windowMean = sum / count;
+		outSummary.windowP50 = sortedQuantile(samples, count, 0.5f);
+		outSummary.windowP95 = sortedQuantile(samples, count, 0.95f);
+		outSummary.windowP99 = sortedQuantile(samples, count, 0.99f);
+	}
+
+	const profile_histogram& histogram = history.histogram;
+	if (histogram.numSamples)
+	{
+		outSummary.numSessionFrames = histogram.numSamples;
+		outSummary.numSessionCalls = history.numSessionCalls;
+		outSummary.sessionMin = history.sessionMin;
+		outSummary.sessionMax = history.sessionMax;
+		outSummary.sessionMean = (float)(history.sessionSum / histogram.numSamples);
+		outSummary.sessionP50 = histogram.quantile(0.5f);
+		outSummary.sessionP95 = histogram.quantile(0.95f);
+		outSummary.sessionP99 = histogram.quantile(0.99f);
+	}
+}
+
+static void recordHitch(uint64 frameID, float frameTimeInMilliseconds, float medianFrameTimeInMilliseconds,
+	const profile_frame_timings& timings)
+{
+	profile_hitch& hitch = recordedHitches[nextRecordedHitch];
+	nextRecordedHitch = (nextRecordedHitch + 1) % MAX_NUM_RECORDED_HITCHES;
+	numRecordedHitches = min(numRecordedHitches + 1, (uint32)MAX_NUM_RECORDED_HITCHES);
+
+	hitch.frameID = frameID;
+	hitch.frameTimeInMilliseconds = frameTimeInMilliseconds;
+	hitch.medianFrameTimeInMilliseconds = medianFrameTimeInMilliseconds;
+	hitch.numContributors = 0;
+
+	// Keep the blocks which took longest compared to how long they usually take, sorted descending.
+	for (auto& [info, stat] : timings)
+	{
+		float timeInMilliseconds = stat.totalDuration * 1000.f;
+
+		auto it = blockHistories.find(info);
+		float median = (it != blockHistories.end()) ? windowMedian(it->second) : 0.f;
+		float excess = timeInMilliseconds - median;
+		if (excess <= 0.f)
+		{
+			continue;
+		}
+
+		uint32 index = hitch.numContributors;
+		while (index > 0 && hitch.contributors[index - 1].excessInMilliseconds < excess)
+		{
+			if (index < MAX_NUM_HITCH_CONTRIBUTORS)
+			{
+				hitch.contributors[index] = hitch.contributors[index - 1];
+			}
+			--index;
+		}
+
+		if (index < MAX_NUM_HITCH_CONTRIBUTORS)
+		{
+			hitch.contributors[index] = { info, timeInMilliseconds, excess };
+			hitch.numContributors = min(hitch.numContributors + 1, (uint32)MAX_NUM_HITCH_CONTRIBUTORS);
+		}
+	}
+}
+
+bool addProfileFrameStatistics(uint64 frameID, float frameTimeInMilliseconds, const profile_frame_timings& timings)
+{
+	const profile_statistics_settings& settings = profileStatisticsSettings;
+
+	// The hitch is judged against the frames before it.
+	float medianFrameTime = windowMedian(frameHistory);
+	bool isHitch = frameTimeInMilliseconds > settings.hitchThresholdInMilliseconds;
+	if (frameHistory.numWindowSamples >= MIN_NUM_FRAMES_FOR_RELATIVE_HITCHES)
+	{
+		isHitch |= frameTimeInMilliseconds > medianFrameTime * settings.hitchMedianFactor;
+	}
+
+	if (isHitch)
+	{
+		recordHitch(frameID, frameTimeInMilliseconds, medianFrameTime, timings);
+	}
+
+	addSample(frameHistory, frameTimeInMilliseconds, 1);
+	for (auto& [info, stat] : timings)
+	{
+		profile_block_history& history = blockHistories[info];
+		history.info = info;
+		addSample(history, stat.totalDuration * 1000.f, stat.numCalls);
+	}
+
+	return isHitch;
+}
+
+void getProfileBlockSummaries(std::vector<profile_block_summary>& outSummaries)
+{
+	outSummaries.resize(1 + blockHistories.size());
+
+	summarize(frameHistory, outSummaries[0]);
+
+	uint32 index = 1;
+	for (auto& [info, history] : blockHistories)
+	{
+		summarize(history, outSummaries[index++]);
+	}
+}
+
+const profile_histogram& getProfileFrameHistogram()
+{
+	return frameHistory.histogram;
+}
+
+const profile_histogram* getProfileBlockHistogram(const char* info)
+{
+	auto it = blockHistories.find(info);
+	return (it != blockHistories.end()) ? &it->second.histogram : nullptr;
+}
+
+void getProfileHitches(std::vector<profile_hitch>& outHitches)
+{
+	outHitches.clear();
+	for (uint32 i = 0; i < numRecordedHitches; ++i)
+	{
+		uint32 index = (nextRecordedHitch + MAX_NUM_RECORDED_HITCHES - 1 - i) % MAX_NUM_RECORDED_HITCHES;
+		outHitches.push_back(recordedHitches[index]);
+	}
+}
+
+void resetProfileStatistics()
+{
+	const char* frameInfo = frameHistory.info;
+	frameHistory = {};
+	frameHistory.info = frameInfo;
+
+	blockHistories.clear();
+
+	numRecordedHitches = 0;
+	nextRecordedHitch = 0;
+}
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+#include "scratch_arena.h"
+
+#ifdef PROFILE
+
+// Fixed size log histogram with 8 buckets per power of two between 1 microsecond and ~16 seconds. Quantiles read from it
+// are off by at most ~4.5%, independent of the number of samples, so it can run for the whole session.
+#define PROFILE_HISTOGRAM_BUCKETS_PER_OCTAVE	8
+#define PROFILE_HISTOGRAM_NUM_BUCKETS			(1 + 24 * PROFILE_HISTOGRAM_BUCKETS_PER_OCTAVE)
+#define PROFILE_HISTOGRAM_MIN_TIME				0.001f // Milliseconds.
+
+struct profile_histogram
+{
+	uint32 counts[PROFILE_HISTOGRAM_NUM_BUCKETS];
+	uint64 numSamples;
+
+	void add(float timeInMilliseconds);
+	float quantile(float q) const;
+
+	static float bucketUpperBound(uint32 bucket);
+};
+
+// Summed over all calls within one frame.
+struct profile_block_statistics
+{
+	uint32 numCalls;
+	float totalDuration;
+	float averageDuration;
+};
+
+// The timings of one frame, by block info. Every finished frame builds one, so they live in the scratch arena.
+typedef std::unordered_map<const char*, profile_block_statistics, std::hash<const char*>, std::equal_to<const char*>,
+	scratch_allocator<std::pair<const char* const, profile_block_statistics>>> profile_frame_timings;
+
+// All times in milliseconds. The window covers the last PROFILE_STATISTICS_WINDOW_SIZE frames in which the block ran,
+// and its percentiles are exact. The session values cover everything since the statistics were last reset. Every sample
+// is the time a block took in one frame, summed over its calls.
+#define PROFILE_STATISTICS_WINDOW_SIZE			256
+
+struct profile_block_summary
+{
+	const char* info;
+
+	uint32 numWindowFrames;
+	float windowMin;
+	float windowMax;
+	float windowMean;
+	float windowP50;
+	float windowP95;
+	float windowP99;
+
+	uint64 numSessionFrames;
+	uint64 numSessionCalls;
+	float sessionMin;
+	float sessionMax;
+	float sessionMean;
+	float sessionP50;
+	float sessionP95;
+	float sessionP99;
+};
+
+#define MAX_NUM_HITCH_CONTRIBUTORS				4
+
+struct profile_hitch_contributor
+{
+	const char* info;
+	float timeInMilliseconds;
+	float excessInMilliseconds;	// Over the block's window median.
+};
+
+struct profile_hitch
+{
+	uint64 frameID;
+	float frameTimeInMilliseconds;
+	float medianFrameTimeInMilliseconds;
+
+	profile_hitch_contributor contributors[MAX_NUM_HITCH_CONTRIBUTORS];
+	uint32 numContributors;
+};
+
+struct profile_statistics_settings
+{
+	// A frame is a hitch if it is slower than the absolute threshold or than the factor times the median frame.
+	float hitchThresholdInMilliseconds = 33.3f;
+	float hitchMedianFactor = 2.f;
+};
+
+extern profile_statistics_settings profileStatisticsSettings;
+
+// Called once for every finished frame. Returns true if the frame is a hitch.
+bool addProfileFrameStatistics(uint64 frameID, float frameTimeInMilliseconds, const profile_frame_timings& timings);
+
+// The first summary is the frame itself.
+void getProfileBlockSummaries(std::vector<profile_block_summary>& outSummaries);
+const profile_histogram& getProfileFrameHistogram();
+const profile_histogram* getProfileBlockHistogram(const char* info);
+
+// The last MAX_NUM_RECORDED_HITCHES, most recent first.
+#define MAX_NUM_RECORDED_HITCHES				32
+void getProfileHitches(std::vector<profile_hitch>& outHitches);
+
+void resetProfileStatistics();
+
+#endif
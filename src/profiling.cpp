@@ -1,32 +1,95 @@
 #include "pch.h"
 #include "profiling.h"
+#include "profile_export.h"
+#include "profile_statistics.h"
 #include "debug_gui.h"
+#include "memory_tracking.h"
+
+#include <algorithm>
 
 #ifdef PROFILE
 
-profile_event profileEvents[2][MAX_NUM_PROFILE_EVENTS];
-std::atomic_uint64_t profileArrayAndEventIndex;
-static uint32 lastFrameEventCount;
+thread_local profile_thread_buffer* profileThreadBuffer;
+
+static std::atomic<profile_thread_buffer*> firstProfileThreadBuffer;
+static std::mutex profileThreadRegistrationMutex;
+
+// Exiting threads record into this one. It is always full, so everything they record is dropped and counted.
+static profile_thread_buffer exitedProfileThreadBuffer;
+
+struct profile_thread_exit_handler
+{
+	profile_thread_buffer* buffer;
 
+	~profile_thread_exit_handler()
+	{
+		if (buffer)
+		{
+			exitedProfileThreadBuffer.writeIndex.store(PROFILE_THREAD_BUFFER_SIZE, std::memory_order_relaxed);
+			profileThreadBuffer = &exitedProfileThreadBuffer;
+			buffer->ownerExited.store(true, std::memory_order_release);
+		}
+	}
+};
 
+static thread_local profile_thread_exit_handler profileThreadExitHandler;
 
+// Ticks of profileClock per second.
 static uint64 performanceFrequency;
 
+// The reference which profileClock is calibrated against.
+static uint64 readReferenceCounter()
+{
+#ifdef _WIN32
+	uint64 counter;
+	QueryPerformanceCounter((LARGE_INTEGER*)&counter);
+	return counter;
+#else
+	return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static uint64 readReferenceFrequency()
+{
+#ifdef _WIN32
+	uint64 frequency;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	return frequency;
+#else
+	return 1000000000;
+#endif
+}
+
+static uint64 calibrationStartClock = profileClock();
+static uint64 calibrationStartCounter = readReferenceCounter();
+
+
+// Blocks live in chunks, which belong to a frame and are recycled when the frame is overwritten. Memory is therefore
+// proportional to the number of blocks in the recorded frames, and there is no limit on threads or callstack depth.
+#define MAX_NUM_RECORDED_FRAMES				256
+#define PROFILE_BLOCK_CHUNK_SIZE			256
+#define MAX_NUM_FREE_PROFILE_BLOCK_CHUNKS	64
 
-#define MAX_NUM_RECORDED_FRAMES			256
-#define MAX_NUM_RECORDED_THREADS		16
-#define MAX_RECORDED_CALLSTACK_DEPTH	128
-#define MAX_NUM_PROFILE_BLOCKS			(MAX_NUM_RECORDED_FRAMES * MAX_NUM_RECORDED_THREADS * MAX_RECORDED_CALLSTACK_DEPTH)
+// Block times are stored relative to the frame start, in units of 2^shift clock ticks. At 3 GHz this is a resolution of
+// 85 ns and a range of more than 6 minutes, which is enough even for the initialization frame.
+#define PROFILE_BLOCK_CLOCK_SHIFT			8
+#define PROFILE_BLOCK_RUNNING				0xFFFFFFFF
 
 struct profile_block
 {
-	profile_block* firstChild;
-	profile_block* nextSibling;
-	profile_block* parent;
+	uint32 firstChild;		// Index into the frame's blocks. -1 if none.
+	uint32 nextSibling;		// Index into the frame's blocks. -1 if none.
 
-	uint64 startClock;
-	uint64 endClock;
-	const char* info;
+	uint32 start;
+	uint32 end;				// PROFILE_BLOCK_RUNNING until the block ends.
+	uint32 infoIndex;		// Into profileBlockInfos.
+};
+
+static_assert(sizeof(profile_block) == 20, "Profile block should be compact.");
+
+struct profile_block_chunk
+{
+	profile_block blocks[PROFILE_BLOCK_CHUNK_SIZE];
 };
 
 struct profile_frame
@@ -36,7 +99,16 @@ struct profile_frame
 	uint64 globalFrameID;
 	float timeInSeconds;
 
-	profile_block* firstTopLevelBlockPerThread[MAX_NUM_RECORDED_THREADS];
+	std::vector<profile_block_chunk*> chunks;
+	uint32 numBlocks;
+
+	std::vector<uint32> firstTopLevelBlockPerThread; // Indexed by the thread index. -1 if none.
+	std::vector<double> counterValues; // Indexed by the counter index.
+
+	profile_block& getBlock(uint32 index)
+	{
+		return chunks[index / PROFILE_BLOCK_CHUNK_SIZE]->blocks[index % PROFILE_BLOCK_CHUNK_SIZE];
+	}
 };
 
 struct profile_thread
@@ -44,7 +116,9 @@ struct profile_thread
 	uint32 threadID;
 	uint32 threadIndex;
 
-	profile_block* callstack[MAX_RECORDED_CALLSTACK_DEPTH];
+	// Block indices in the current frame. The entry right above the top is the last block which ended at that depth, so
+	// that the next block there can be linked as its sibling.
+	std::vector<uint32> callstack;
 	uint32 callstackDepth;
 };
 
@@ -53,35 +127,279 @@ static uint32 currentProfileFrame = -1;
 static uint32 highlightFrameIndex = -1;
 
 
-static profile_thread recordedProfileThreads[MAX_NUM_RECORDED_THREADS];
-static uint32 numProfileThreads;
+static std::vector<profile_thread> recordedProfileThreads;
 
-static profile_block* allProfileBlocks = new profile_block[MAX_NUM_PROFILE_BLOCKS];
-static uint32 nextFreeProfileBlock;
+static std::vector<profile_block_chunk*> freeProfileBlockChunks;
+static uint32 numAllocatedProfileBlockChunks;
 
-static profile_block* currentFrameLastTopLevelBlocks[MAX_NUM_RECORDED_THREADS];
+static std::vector<const char*> profileBlockInfos;
+static std::unordered_map<const char*, uint32> profileBlockInfoIndices;
+
+static std::vector<profile_counter> profileCounters;
+static std::mutex profileCounterMutex;
+
+static std::vector<profile_counter_kind> collatedCounterKinds;
 
 static bool profilingPaused;
 
+profile_thread_buffer* registerProfileThread()
+{
+	std::lock_guard<std::mutex> lock(profileThreadRegistrationMutex);
+
+	// Take over the buffer of a thread which has exited, once the collator has emptied it.
+	profile_thread_buffer* buffer = nullptr;
+	for (profile_thread_buffer* b = firstProfileThreadBuffer.load(std::memory_order_acquire); b; b = b->next)
+	{
+		if (b->ownerExited.load(std::memory_order_acquire) &&
+			b->readIndex.load(std::memory_order_acquire) == b->writeIndex.load(std::memory_order_relaxed))
+		{
+			b->ownerExited.store(false, std::memory_order_relaxed);
+			buffer = b;
+			break;
+		}
+	}
+
+	if (!buffer)
+	{
+		MEMORY_TAG(memory_tag_profiler);
+		buffer = new profile_thread_buffer();
+		buffer->next = firstProfileThreadBuffer.load(std::memory_order_relaxed);
+		firstProfileThreadBuffer.store(buffer, std::memory_order_release);
+	}
+
+	buffer->threadID = GetCurrentThreadId();
+	buffer->numOpenBlocks = 0;
+
+	profileThreadExitHandler.buffer = buffer;
+	profileThreadBuffer = buffer;
+	return buffer;
+}
+
+profile_counter::profile_counter(const char* name, profile_counter_kind kind)
+	: name(name), kind(kind)
+{
+	std::lock_guard<std::mutex> lock(profileCounterMutex);
+
+	// Call sites with the same name feed the same counter.
+	for (const profile_counter& counter : profileCounters)
+	{
+		if (strcmp(counter.name, name) == 0)
+		{
+			assert(counter.kind == kind);
+			index = counter.index;
+			return;
+		}
+	}
+
+	index = (uint16)profileCounters.size();
+	profileCounters.push_back(*this);
+}
+
+uint32 getNumProfileCounters()
+{
+	std::lock_guard<std::mutex> lock(profileCounterMutex);
+	return (uint32)profileCounters.size();
+}
+
+profile_counter getProfileCounter(uint32 index)
+{
+	std::lock_guard<std::mutex> lock(profileCounterMutex);
+	return profileCounters[index];
+}
+
+static profile_counter_kind getCollatedCounterKind(uint32 index)
+{
+	if (index >= collatedCounterKinds.size())
+	{
+		std::lock_guard<std::mutex> lock(profileCounterMutex);
+		collatedCounterKinds.clear();
+		for (const profile_counter& counter : profileCounters)
+		{
+			collatedCounterKinds.push_back(counter.kind);
+		}
+	}
+	return collatedCounterKinds[index];
+}
+
+static uint32 getNumDroppedProfileEvents()
+{
+	uint32 result = exitedProfileThreadBuffer.numDroppedEvents.load(std::memory_order_relaxed);
+
+	for (profile_thread_buffer* buffer = firstProfileThreadBuffer.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+	{
+		result += buffer->numDroppedEvents.load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
 static profile_thread& getProfileThread(uint32 threadID)
 {
-	for (uint32 i = 0; i < numProfileThreads; ++i)
+	for (profile_thread& thread : recordedProfileThreads)
 	{
-		if (recordedProfileThreads[i].threadID == threadID)
+		if (thread.threadID == threadID)
 		{
-			return recordedProfileThreads[i];
+			return thread;
 		}
 	}
-	assert(numProfileThreads < arraysize(recordedProfileThreads));
-	uint32 index = numProfileThreads++;
-	profile_thread& result = recordedProfileThreads[index];
+
+	profile_thread& result = recordedProfileThreads.emplace_back();
 	result.threadID = threadID;
 	result.callstackDepth = 0;
-	result.threadIndex = index;
+	result.threadIndex = (uint32)recordedProfileThreads.size() - 1;
 	return result;
 }
 
-static void collateProfileEvents(profile_event* profileEvents, uint32 numProfileEvents)
+static uint32 internProfileBlockInfo(const char* info)
+{
+	auto it = profileBlockInfoIndices.find(info);
+	if (it != profileBlockInfoIndices.end())
+	{
+		return it->second;
+	}
+
+	uint32 index = (uint32)profileBlockInfos.size();
+	profileBlockInfos.push_back(info);
+	profileBlockInfoIndices[info] = index;
+	return index;
+}
+
+static uint32 toProfileBlockTime(const profile_frame& frame, uint64 clock)
+{
+	uint64 time = (clock > frame.startClock) ? ((clock - frame.startClock) >> PROFILE_BLOCK_CLOCK_SHIFT) : 0;
+	return (uint32)min(time, (uint64)PROFILE_BLOCK_RUNNING - 1);
+}
+
+static float profileBlockTimeToSeconds(uint32 time)
+{
+	return (float)((double)((uint64)time << PROFILE_BLOCK_CLOCK_SHIFT) / (double)performanceFrequency);
+}
+
+static uint32 allocateProfileBlock(profile_frame& frame)
+{
+	if (frame.numBlocks == frame.chunks.size() * PROFILE_BLOCK_CHUNK_SIZE)
+	{
+		profile_block_chunk* chunk;
+		if (!freeProfileBlockChunks.empty())
+		{
+			chunk = freeProfileBlockChunks.back();
+			freeProfileBlockChunks.pop_back();
+		}
+		else
+		{
+			chunk = new profile_block_chunk;
+			++numAllocatedProfileBlockChunks;
+		}
+		frame.chunks.push_back(chunk);
+	}
+	return frame.numBlocks++;
+}
+
+// A few chunks are kept around for the next frames, the rest is freed, e.g. after the initialization frame.
+static void releaseProfileBlocks(profile_frame& frame)
+{
+	for (profile_block_chunk* chunk : frame.chunks)
+	{
+		if (freeProfileBlockChunks.size() < MAX_NUM_FREE_PROFILE_BLOCK_CHUNKS)
+		{
+			freeProfileBlockChunks.push_back(chunk);
+		}
+		else
+		{
+			delete chunk;
+			--numAllocatedProfileBlockChunks;
+		}
+	}
+	frame.chunks.clear();
+	frame.numBlocks = 0;
+}
+
+static void beginProfileBlock(profile_frame& frame, profile_thread& thread, uint32 start, uint32 infoIndex)
+{
+	uint32 index = allocateProfileBlock(frame);
+
+	profile_block& block = frame.getBlock(index);
+	block.firstChild = -1;
+	block.nextSibling = -1;
+	block.start = start;
+	block.end = PROFILE_BLOCK_RUNNING;
+	block.infoIndex = infoIndex;
+
+	if (thread.callstackDepth > 0)
+	{
+		profile_block& parent = frame.getBlock(thread.callstack[thread.callstackDepth - 1]);
+		if (parent.firstChild == -1)
+		{
+			parent.firstChild = index;
+		}
+		else
+		{
+			frame.getBlock(thread.callstack[thread.callstackDepth]).nextSibling = index;
+		}
+	}
+	else
+	{
+		if (thread.threadIndex >= frame.firstTopLevelBlockPerThread.size())
+		{
+			frame.firstTopLevelBlockPerThread.resize(thread.threadIndex + 1, -1);
+		}
+
+		uint32& firstTopLevelBlock = frame.firstTopLevelBlockPerThread[thread.threadIndex];
+		if (firstTopLevelBlock == -1)
+		{
+			firstTopLevelBlock = index;
+		}
+		else
+		{
+			frame.getBlock(thread.callstack[0]).nextSibling = index;
+		}
+	}
+
+	if (thread.callstackDepth == thread.callstack.size())
+	{
+		thread.callstack.push_back(index);
+	}
+	else
+	{
+		thread.callstack[thread.callstackDepth] = index;
+	}
+	++thread.callstackDepth;
+}
+
+template <typename timings_map>
+static void accumulateTimings(profile_frame* frame, uint32 firstBlock, timings_map& outTimings)
+{
+	for (uint32 index = firstBlock; index != -1; index = frame->getBlock(index).nextSibling)
+	{
+		profile_block& block = frame->getBlock(index);
+		if (block.end != PROFILE_BLOCK_RUNNING)
+		{
+			profile_block_statistics& stat = outTimings[profileBlockInfos[block.infoIndex]];
+			++stat.numCalls;
+			stat.totalDuration += profileBlockTimeToSeconds(block.end - block.start);
+		}
+
+		accumulateTimings(frame, block.firstChild, outTimings);
+	}
+}
+
+// Works with the scratch allocated timings of the statistics and the persistent ones of the selected frame.
+template <typename timings_map>
+static void accumulateTimings(profile_frame* frame, timings_map& outTimings)
+{
+	outTimings.clear();
+
+	for (uint32 topLevelBlock : frame->firstTopLevelBlockPerThread)
+	{
+		accumulateTimings(frame, topLevelBlock, outTimings);
+	}
+
+	for (auto& it : outTimings)
+	{
+		it.second.averageDuration = it.second.totalDuration / it.second.numCalls;
+	}
+}
+
+static void collateProfileEvents(const profile_event* profileEvents, uint32 numProfileEvents)
 {
 	PROFILE_FUNCTION();
 
@@ -89,7 +407,7 @@ static void collateProfileEvents(profile_event* profileEvents, uint32 numProfile
 
 	for (uint32 eventIndex = 0; eventIndex < numProfileEvents; ++eventIndex)
 	{
-		profile_event& event = profileEvents[eventIndex];
+		const profile_event& event = profileEvents[eventIndex];
 		profile_thread& thread = getProfileThread(event.threadID);
 
 		if (event.type == profile_event_frame_marker)
@@ -99,11 +417,25 @@ static void collateProfileEvents(profile_event* profileEvents, uint32 numProfile
 			if (frame)
 			{
 				// End frame.
-				assert(thread.callstackDepth == 0);
-				assert(&thread == &recordedProfileThreads[0]);
+				// Blocks which still run on other threads are cut here and continue in the next frame.
+				uint32 end = toProfileBlockTime(*frame, event.clock);
+				for (profile_thread& t : recordedProfileThreads)
+				{
+					for (uint32 i = 0; i < t.callstackDepth; ++i)
+					{
+						frame->getBlock(t.callstack[i]).end = end;
+					}
+				}
 
 				frame->endClock = event.clock;
 				frame->timeInSeconds = ((float)(frame->endClock - frame->startClock) / (float)performanceFrequency);
+
+				if (frame->globalFrameID != -1)
+				{
+					profile_frame_timings timings;
+					accumulateTimings(frame, timings);
+					addProfileFrameStatistics(frame->globalFrameID, frame->timeInSeconds * 1000.f, timings);
+				}
 			}
 
 			// New frame.
@@ -114,21 +446,33 @@ static void collateProfileEvents(profile_event* profileEvents, uint32 numProfile
 			}
 			profile_frame* newFrame = recordedProfileFrames + currentProfileFrame;
 			
+			releaseProfileBlocks(*newFrame);
 			newFrame->startClock = event.clock;
 			newFrame->endClock = 0;
 			newFrame->globalFrameID = event.frameID;
+			newFrame->firstTopLevelBlockPerThread.assign(recordedProfileThreads.size(), -1);
+			newFrame->counterValues.clear();
 
-			for (uint32 threadIndex = 0; threadIndex < MAX_NUM_RECORDED_THREADS; ++threadIndex)
+			if (frame)
 			{
-				profile_block* prevFrameLastTopLevelBlock = currentFrameLastTopLevelBlocks[threadIndex];
-				if (prevFrameLastTopLevelBlock && prevFrameLastTopLevelBlock->endClock == 0)
+				// Sampled counters keep their value until the next sample.
+				newFrame->counterValues.resize(frame->counterValues.size(), 0.0);
+				for (uint32 i = 0; i < (uint32)frame->counterValues.size(); ++i)
 				{
-					// This block still runs, so it becomes the first block of the next frame.
-					newFrame->firstTopLevelBlockPerThread[threadIndex] = prevFrameLastTopLevelBlock;
+					if (getCollatedCounterKind(i) == profile_counter_sample)
+					{
+						newFrame->counterValues[i] = frame->counterValues[i];
+					}
 				}
-				else
+
+				for (profile_thread& t : recordedProfileThreads)
 				{
-					newFrame->firstTopLevelBlockPerThread[threadIndex] = nullptr;
+					uint32 depth = t.callstackDepth;
+					t.callstackDepth = 0;
+					for (uint32 i = 0; i < depth; ++i)
+					{
+						beginProfileBlock(*newFrame, t, 0, frame->getBlock(t.callstack[i]).infoIndex);
+					}
 				}
 			}
 
@@ -136,69 +480,38 @@ static void collateProfileEvents(profile_event* profileEvents, uint32 numProfile
 		}
 		else if (event.type == profile_event_begin_block)
 		{
-			assert(thread.callstackDepth < arraysize(thread.callstack));
-
-			uint32 profileBlockIndex = nextFreeProfileBlock++;
-			if (nextFreeProfileBlock >= MAX_NUM_PROFILE_BLOCKS)
+			if (!frame)
 			{
-				nextFreeProfileBlock = 0;
+				continue; // Before the first frame.
 			}
 
-			profile_block* newProfileBlock = allProfileBlocks + profileBlockIndex;
-			newProfileBlock->startClock = event.clock;
-			newProfileBlock->endClock = 0;
-			newProfileBlock->info = event.info;
-			newProfileBlock->firstChild = nullptr;
-			newProfileBlock->nextSibling = nullptr;
-			
-			if (thread.callstackDepth > 0)
+			beginProfileBlock(*frame, thread, toProfileBlockTime(*frame, event.clock), internProfileBlockInfo(event.info));
+		}
+		else if (event.type == profile_event_end_block)
+		{
+			if (thread.callstackDepth == 0)
 			{
-				uint32 parent = thread.callstackDepth - 1;
-				newProfileBlock->parent = thread.callstack[parent];
-				if (!thread.callstack[parent]->firstChild)
-				{
-					thread.callstack[parent]->firstChild = newProfileBlock;
-				}
-				else
-				{
-					thread.callstack[thread.callstackDepth]->nextSibling = newProfileBlock;
-				}
+				continue; // Began before the first frame or while collation was paused.
 			}
-			else
+
+			uint32 index = thread.callstack[--thread.callstackDepth];
+			frame->getBlock(index).end = toProfileBlockTime(*frame, event.clock);
+		}
+		else if (event.type == profile_event_counter)
+		{
+			if (!frame)
 			{
-				newProfileBlock->parent = nullptr;
-				currentFrameLastTopLevelBlocks[thread.threadIndex] = newProfileBlock;
+				continue; // Before the first frame.
+			}
 
-				if (!frame->firstTopLevelBlockPerThread[thread.threadIndex])
-				{
-					frame->firstTopLevelBlockPerThread[thread.threadIndex] = newProfileBlock;
-				}
-				else
-				{
-					thread.callstack[0]->nextSibling = newProfileBlock;
-				}
+			if (event.counterIndex >= frame->counterValues.size())
+			{
+				frame->counterValues.resize(event.counterIndex + 1, 0.0);
 			}
 
-			thread.callstack[thread.callstackDepth++] = newProfileBlock;
+			double& value = frame->counterValues[event.counterIndex];
+			value = (getCollatedCounterKind(event.counterIndex) == profile_counter_sum) ? (value + event.value) : event.value;
 		}
-		else if (event.type == profile_event_end_block)
-		{
-			assert(thread.callstackDepth > 0);
-			profile_block* block = thread.callstack[--thread.callstackDepth];
-			block->endClock = event.clock;
-		}
-	}
-}
-
-static float measureSignedTime(uint64 frameStart, uint64 clock)
-{
-	if (clock >= frameStart)
-	{
-		return ((float)(clock - frameStart) / (float)performanceFrequency);
-	}
-	else
-	{
-		return -((float)(frameStart - clock) / (float)performanceFrequency);
 	}
 }
 
@@ -231,28 +544,32 @@ struct profile_display_state
 };
 
 static uint32 displayProfileBlock(profile_display_state& state, debug_gui& gui, profile_frame* frame, 
-	profile_block* topLevelBlock, float top)
+	uint32 topLevelBlock, float top)
 {
 	uint32 result = 0;
 
 	float bottom = top + state.barHeight;
 
-	if (topLevelBlock)
+	if (topLevelBlock != -1)
 	{
 		result += 1;
 	}
 
-	for (profile_block* block = topLevelBlock; block; block = block->nextSibling)
+	for (uint32 index = topLevelBlock; index != -1; index = frame->getBlock(index).nextSibling)
 	{
-		float relStartTime = measureSignedTime(frame->startClock, block->startClock);
-		float relEndTime = measureSignedTime(frame->startClock, block->endClock);
+		profile_block& block = frame->getBlock(index);
+
+		uint32 end = (block.end == PROFILE_BLOCK_RUNNING) ? toProfileBlockTime(*frame, frame->endClock) : block.end;
+
+		float relStartTime = profileBlockTimeToSeconds(block.start);
+		float relEndTime = profileBlockTimeToSeconds(end);
 
 		float left = state.leftOffset + relStartTime / 0.0167f * state.frameWidth60FPS;
 		float right = state.leftOffset + relEndTime / 0.0167f * state.frameWidth60FPS;
 
 		if (gui.quadHover(left, right, top, bottom, colorTable[state.colorIndex]))
 		{
-			gui.textAtMouseF("%s: %f ms", block->info, (relEndTime - relStartTime) * 1000.f);
+			gui.textAtMouseF("%s: %f ms", profileBlockInfos[block.infoIndex], (relEndTime - relStartTime) * 1000.f);
 			state.mouseHoverX = gui.mousePosition.x;
 		}
 
@@ -263,68 +580,138 @@ static uint32 displayProfileBlock(profile_display_state& state, debug_gui& gui,
 		}
 
 		// Display children.
-		result += displayProfileBlock(state, gui, frame, block->firstChild, bottom);
+		result += displayProfileBlock(state, gui, frame, block.firstChild, bottom);
 	}
 
 	return result;
 }
 
-struct profile_block_statistics
-{
-	uint32 numCalls;
-	float totalDuration;
-	float averageDuration;
-};
+static std::unordered_map<const char*, profile_block_statistics> selectedFrameAccumulatedTimings;
 
-static void accumulateTimings(profile_block* topLevelBlock, std::unordered_map<const char*, profile_block_statistics>& outTimings)
-{
-	for (profile_block* block = topLevelBlock; block; block = block->nextSibling)
-	{
-		float duration = ((float)(block->endClock - block->startClock) / (float)performanceFrequency);
+static float normalFrameWidth60FPS = 500.f;
+static float initializationFrameWidth60FPS = 2.f;
 
-		profile_block_statistics& stat = outTimings[block->info];
-		++stat.numCalls;
-		stat.totalDuration += duration;
+static float normalCallstackLeftOffset = 150.f;
+static float initializationCallstackLeftOffset = 150.f;
 
-		accumulateTimings(block->firstChild, outTimings);
-	}
-}
+static float frameWidth60FPS;
+static float callstackLeftOffset;
+
+static uint32 interactionGUID = 0;
+static float scrollAnchor;
+static bool scrolling;
 
-static std::unordered_map<const char*, profile_block_statistics> accumulateTimings(profile_frame* frame)
+static profile_display_mode displayMode;
+
+static void displayProfileCounters(debug_gui& gui)
 {
-	std::unordered_map<const char*, profile_block_statistics> timings;
+	static std::vector<const char*> counterNames;
+	static uint32 selectedCounter;
 
-	for (uint32 threadIndex = 0; threadIndex < MAX_NUM_RECORDED_THREADS; ++threadIndex)
+	uint32 numCounters = getNumProfileCounters();
+	if (counterNames.size() != numCounters)
 	{
-		profile_block* topLevelBlock = frame->firstTopLevelBlockPerThread[threadIndex];
-
-		accumulateTimings(topLevelBlock, timings);
+		counterNames.resize(numCounters);
+		for (uint32 i = 0; i < numCounters; ++i)
+		{
+			counterNames[i] = getProfileCounter(i).name;
+		}
 	}
 
-	for (auto& it : timings)
+	gui.radio("Counter", counterNames.data(), numCounters, selectedCounter);
+
+	// Oldest to newest.
+	float values[MAX_NUM_RECORDED_FRAMES];
+	uint32 numValues = 0;
+	float maxValue = 0.f;
+	double sum = 0.0;
+	for (uint32 i = 1; i <= MAX_NUM_RECORDED_FRAMES; ++i)
 	{
-		it.second.averageDuration = it.second.totalDuration / it.second.numCalls;
+		const profile_frame& frame = recordedProfileFrames[(currentProfileFrame + i) % MAX_NUM_RECORDED_FRAMES];
+		if (frame.endClock == 0 || frame.globalFrameID == -1)
+		{
+			continue;
+		}
+
+		float value = (selectedCounter < frame.counterValues.size()) ? (float)frame.counterValues[selectedCounter] : 0.f;
+		values[numValues++] = value;
+		maxValue = max(maxValue, value);
+		sum += value;
 	}
 
-	return timings;
+	if (numValues > 1)
+	{
+		gui.textF("Last: %g, mean: %g, max: %g", values[numValues - 1], sum / numValues, maxValue);
+		gui.graph(values, numValues, 0.f, max(maxValue * 1.1f, 1.f));
+	}
 }
 
-static std::unordered_map<const char*, profile_block_statistics> selectedFrameAccumulatedTimings;
+// Lists the recent hitches, followed by the window and session statistics of every block, sorted by the time it took in
+// the selected frame.
+static void displayProfileStatistics(debug_gui& gui, float top)
+{
+	const uint32 textColor = 0xFFFFFFFF;
+	const uint32 hitchColor = color_32(255, 128, 0, 255);
+	const float left = 150.f;
 
-static float normalFrameWidth60FPS = 500.f;
-static float initializationFrameWidth60FPS = 2.f;
+	static std::vector<profile_hitch> hitches;
+	getProfileHitches(hitches);
 
-static float normalCallstackLeftOffset = 150.f;
-static float initializationCallstackLeftOffset = 150.f;
+	float y = top;
+	for (uint32 i = 0; i < min((uint32)hitches.size(), 5u); ++i)
+	{
+		const profile_hitch& hitch = hitches[i];
+		gui.textAtF(left, y, hitchColor, "Hitch in frame %llu: %.2f ms (median %.2f ms)", hitch.frameID, hitch.frameTimeInMilliseconds, hitch.medianFrameTimeInMilliseconds);
+		y += gui.textHeight;
 
-static float frameWidth60FPS;
-static float callstackLeftOffset;
+		for (uint32 c = 0; c < hitch.numContributors; ++c)
+		{
+			const profile_hitch_contributor& contributor = hitch.contributors[c];
+			gui.textAtF(left + 30.f, y, hitchColor, "%s: %.2f ms (+%.2f ms)", contributor.info, contributor.timeInMilliseconds, contributor.excessInMilliseconds);
+			y += gui.textHeight;
+		}
+	}
+	y += gui.textHeight;
 
-static uint32 interactionGUID = 0;
-static float scrollAnchor;
-static bool scrolling;
+	static std::vector<profile_block_summary> summaries;
+	getProfileBlockSummaries(summaries);
 
-static profile_display_mode displayMode;
+	auto selectedTime = [](const profile_block_summary& summary)
+	{
+		auto it = selectedFrameAccumulatedTimings.find(summary.info);
+		return (it != selectedFrameAccumulatedTimings.end()) ? it->second.totalDuration * 1000.f : 0.f;
+	};
+
+	// The frame itself stays on top.
+	std::sort(summaries.begin() + 1, summaries.end(), [&](const profile_block_summary& a, const profile_block_summary& b)
+	{
+		return selectedTime(a) > selectedTime(b);
+	});
+
+	const float columnsLeft = left + 500.f;
+	const float columnWidth = 75.f;
+	const char* columnNames[] = { "Selected", "Mean", "P50", "P95", "P99", "Max", "All P99", "All max" };
+	for (uint32 i = 0; i < arraysize(columnNames); ++i)
+	{
+		gui.textAt(columnsLeft + i * columnWidth, y, textColor, columnNames[i]);
+	}
+	gui.textAt(left, y, textColor, "Milliseconds per frame");
+	y += gui.textHeight;
+
+	float selectedFrameTime = recordedProfileFrames[highlightFrameIndex].timeInSeconds * 1000.f;
+	for (const profile_block_summary& summary : summaries)
+	{
+		float values[] = { (&summary == &summaries[0]) ? selectedFrameTime : selectedTime(summary),
+			summary.windowMean, summary.windowP50, summary.windowP95, summary.windowP99, summary.windowMax, summary.sessionP99, summary.sessionMax };
+
+		gui.textAt(left, y, textColor, summary.info);
+		for (uint32 i = 0; i < arraysize(values); ++i)
+		{
+			gui.textAtF(columnsLeft + i * columnWidth, y, textColor, "%.3f", values[i]);
+		}
+		y += gui.textHeight;
+	}
+}
 
 static void displayProfileInfo(debug_gui& gui)
 {
@@ -342,15 +729,47 @@ static void displayProfileInfo(debug_gui& gui)
 	{
 		if (gui.toggle("Paused", profilingPaused))
 		{
-			if (profilingPaused)
+			if (!profilingPaused)
 			{
-				for (uint32 i = 0; i < MAX_NUM_RECORDED_THREADS; ++i)
+				// Everything which was open when pausing has been thrown away.
+				for (profile_thread& thread : recordedProfileThreads)
 				{
-					currentFrameLastTopLevelBlocks[i] = nullptr;
+					thread.callstackDepth = 0;
 				}
 			}
 		}
 		gui.radio("Display mode", displayModeNames, profile_display_mode_count, (uint32&)displayMode);
+		gui.textF("Dropped events: %u", getNumDroppedProfileEvents());
+
+		uint32 numRecordedBlocks = 0;
+		for (const profile_frame& frame : recordedProfileFrames)
+		{
+			numRecordedBlocks += frame.numBlocks;
+		}
+		gui.textF("History: %u blocks, %u threads, %.2f MB", numRecordedBlocks, (uint32)recordedProfileThreads.size(),
+			numAllocatedProfileBlockChunks * sizeof(profile_block_chunk) / (1024.f * 1024.f));
+		displayProfileCaptureInfo(gui);
+
+		DEBUG_GROUP(gui, "Statistics")
+		{
+			gui.slider("Hitch threshold (ms)", profileStatisticsSettings.hitchThresholdInMilliseconds, 5.f, 100.f);
+			if (gui.button("Export statistics"))
+			{
+				exportProfileStatistics();
+			}
+			if (gui.button("Reset statistics"))
+			{
+				resetProfileStatistics();
+			}
+		}
+
+		if (getNumProfileCounters())
+		{
+			DEBUG_GROUP(gui, "Counters")
+			{
+				displayProfileCounters(gui);
+			}
+		}
 
 		uint32 initColor = color_32(0, 255, 0, 255);
 		uint32 frameColor = color_32(255, 0, 0, 255);
@@ -380,7 +799,7 @@ static void displayProfileInfo(debug_gui& gui)
 					frameWidth60FPS = initializationFrameWidth60FPS;
 					callstackLeftOffset = initializationCallstackLeftOffset;
 
-					selectedFrameAccumulatedTimings = accumulateTimings(frame);
+					accumulateTimings(frame, selectedFrameAccumulatedTimings);
 				}
 			}
 			else
@@ -391,7 +810,7 @@ static void displayProfileInfo(debug_gui& gui)
 					frameWidth60FPS = normalFrameWidth60FPS;
 					callstackLeftOffset = normalCallstackLeftOffset;
 
-					selectedFrameAccumulatedTimings = accumulateTimings(frame);
+					accumulateTimings(frame, selectedFrameAccumulatedTimings);
 				}
 			}
 		}
@@ -433,7 +852,7 @@ static void displayProfileInfo(debug_gui& gui)
 
 					// Display call stacks.
 					uint32 currentLane = 0;
-					for (uint32 threadIndex = 0; threadIndex < MAX_NUM_RECORDED_THREADS; ++threadIndex)
+					for (uint32 threadIndex = 0; threadIndex < (uint32)frame->firstTopLevelBlockPerThread.size(); ++threadIndex)
 					{
 						float top = currentLane * barSpacing + topOffset;
 						uint32 numLanesInThread = displayProfileBlock(state, gui, frame, frame->firstTopLevelBlockPerThread[threadIndex], top);
@@ -538,41 +957,115 @@ static void displayProfileInfo(debug_gui& gui)
 				}
 				else
 				{
-					uint32 row = 0;
-					for (auto& it : selectedFrameAccumulatedTimings)
-					{
-						gui.textAtF(150, topOffset + row * gui.textHeight, 0xFFFFFFFF, "%s: %f ms", it.first, it.second.totalDuration * 1000.f);
-						++row;
-					}
+					displayProfileStatistics(gui, topOffset);
 				}
 			}
 		}
 	}
 }
 
+static void calibrateProfileClock()
+{
+	static uint64 counterFrequency = readReferenceFrequency();
+
+	// The longer the interval, the more exact this gets.
+	uint64 clock = profileClock();
+	uint64 counter = readReferenceCounter();
+
+	if (counter > calibrationStartCounter)
+	{
+		performanceFrequency = (uint64)((double)(clock - calibrationStartClock) * (double)counterFrequency / (double)(counter - calibrationStartCounter));
+	}
+}
+
+// Takes all events up to the cutoff out of the thread buffers and merges them into one list, ordered by time. Within a
+// thread, the order is kept.
+static void drainProfileThreadBuffers(uint64 cutoffClock, std::vector<profile_event>& outEvents)
+{
+	PROFILE_FUNCTION();
+
+	static std::vector<std::vector<profile_event>> threadEvents;
+	static std::vector<uint32> next;
+
+	// Buffers registered from now on are picked up next time.
+	profile_thread_buffer* firstBuffer = firstProfileThreadBuffer.load(std::memory_order_acquire);
+
+	uint32 numBuffers = 0;
+	for (profile_thread_buffer* buffer = firstBuffer; buffer; buffer = buffer->next)
+	{
+		++numBuffers;
+	}
+	threadEvents.resize(max(numBuffers, (uint32)threadEvents.size()));
+	next.resize(numBuffers);
+
+	uint32 totalNumEvents = 0;
+
+	profile_thread_buffer* buffer = firstBuffer;
+	for (uint32 i = 0; i < numBuffers; ++i, buffer = buffer->next)
+	{
+		std::vector<profile_event>& events = threadEvents[i];
+		events.clear();
+
+		uint32 read = buffer->readIndex.load(std::memory_order_relaxed);
+		uint32 write = buffer->writeIndex.load(std::memory_order_acquire);
+
+		for (; read != write; ++read)
+		{
+			const profile_event& event = buffer->events[read & (PROFILE_THREAD_BUFFER_SIZE - 1)];
+			if (event.clock > cutoffClock)
+			{
+				break;
+			}
+			events.push_back(event);
+		}
+
+		buffer->readIndex.store(read, std::memory_order_release);
+
+		next[i] = 0;
+		totalNumEvents += (uint32)events.size();
+	}
+
+	outEvents.clear();
+	outEvents.reserve(totalNumEvents);
+
+	for (uint32 e = 0; e < totalNumEvents; ++e)
+	{
+		uint32 earliest = -1;
+		for (uint32 i = 0; i < numBuffers; ++i)
+		{
+			if (next[i] < threadEvents[i].size() &&
+				(earliest == -1 || threadEvents[i][next[i]].clock < threadEvents[earliest][next[earliest]].clock))
+			{
+				earliest = i;
+			}
+		}
+		outEvents.push_back(threadEvents[earliest][next[earliest]++]);
+	}
+}
+
 void processAndDisplayProfileEvents(debug_gui& gui)
 {
 	PROFILE_FUNCTION();
+	MEMORY_TAG(memory_tag_profiler);
 
-	// Do not remove this line!
-	static bool performanceFrequencyQueried = QueryPerformanceFrequency((LARGE_INTEGER*)&performanceFrequency);
+	calibrateProfileClock();
 
-	uint64 currentArrayAndEventIndex = profileArrayAndEventIndex; // We are only interested in upper 32 bits, so don't worry about thread safety.
-	uint32 arrayIndex = (uint32)(!(currentArrayAndEventIndex >> 32));
-	uint32 eventCount = lastFrameEventCount;
+	// Events from the current call onwards are left for the next frame.
+	static std::vector<profile_event> events;
+	drainProfileThreadBuffers(profileClock(), events);
+
+	// Captures keep running while the display is paused.
+	exportProfileEvents(events.data(), (uint32)events.size(), performanceFrequency);
 
 	if (!profilingPaused)
 	{
-		collateProfileEvents(profileEvents[arrayIndex], eventCount);
+		collateProfileEvents(events.data(), (uint32)events.size());
 	}
 
 	if (currentProfileFrame >= 0)
 	{
 		displayProfileInfo(gui);
 	}
-
-	currentArrayAndEventIndex = profileArrayAndEventIndex.exchange((uint64)arrayIndex << 32);
-	lastFrameEventCount = (uint32)(currentArrayAndEventIndex & 0xFFFFFFFF);
 }
 
 #endif
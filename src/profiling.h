@@ -2,15 +2,20 @@
 
 #include "common.h"
 
-#include <intrin.h>
-
 #ifdef PROFILE
 
-enum profile_event_type
+#if defined(_WIN32)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum profile_event_type : uint16
 {
 	profile_event_frame_marker,
 	profile_event_begin_block,
 	profile_event_end_block,
+	profile_event_counter,
 };
 
 struct profile_event
@@ -18,10 +23,12 @@ struct profile_event
 	uint64 clock;
 	uint32 threadID;
 	profile_event_type type;
+	uint16 counterIndex;
 	union
 	{
 		const char* info;
 		uint64 frameID;
+		double value;
 	};
 };
 
@@ -37,37 +44,124 @@ STRINGIFY_ENUM(displayModeNames,
 
 static_assert(sizeof(profile_event) == 24, "Profile event struct is misaligned or something.");
 
-#define MAX_NUM_PROFILE_EVENTS 16384
-extern profile_event profileEvents[2][MAX_NUM_PROFILE_EVENTS];
-extern std::atomic_uint64_t profileArrayAndEventIndex;
-
-#define recordProfileEvent(type_, info_frameID) \
-	uint64 arrayAndEventIndex = profileArrayAndEventIndex++; \
-	uint32 eventIndex = (arrayAndEventIndex & 0xFFFFFFFF); \
-	assert(eventIndex < MAX_NUM_PROFILE_EVENTS); \
-	profile_event* event = profileEvents[arrayAndEventIndex >> 32] + eventIndex; \
-	uint8* threadLocalStorage = (uint8*)__readgsqword(0x30); \
-	event->threadID = *(uint32*)(threadLocalStorage + 0x48); \
-	event->frameID = info_frameID; \
-	event->type = type_; \
-	QueryPerformanceCounter((LARGE_INTEGER*)&event->clock);
+// Every thread records into its own ring buffer, which is registered on first use and drained by the collator once per
+// frame. No state is shared between recording threads. If a ring is full, events are dropped and counted. A block begin
+// is only recorded if there is also room for the end events of all blocks which are open on that thread, so dropping
+// never unbalances the callstack. Buffers of threads which have exited are handed to new threads.
+#define PROFILE_THREAD_BUFFER_SIZE		16384 // Events per thread between two drains. Must be a power of two.
+
+struct profile_thread_buffer
+{
+	profile_event events[PROFILE_THREAD_BUFFER_SIZE];
+	alignas(64) std::atomic_uint32_t writeIndex;	// Only written by the owning thread.
+	alignas(64) std::atomic_uint32_t readIndex;		// Only written by the collator.
+	std::atomic_uint32_t numDroppedEvents;
+	std::atomic_bool ownerExited;
+	uint32 threadID;
+	uint32 numOpenBlocks;						// Only touched by the owning thread.
+
+	profile_thread_buffer* next;				// Registered buffers form a list, which only grows.
+};
+
+extern thread_local profile_thread_buffer* profileThreadBuffer;
+profile_thread_buffer* registerProfileThread();
+
+// Invariant TSC. Calibrated against the performance counter by the collator. Platforms without a TSC fall back to the
+// steady clock, which goes through the same calibration.
+inline uint64 profileClock()
+{
+#if defined(_WIN32) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return (uint64)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+inline bool recordProfileEvent(profile_event_type type, uint64 info_frameID, uint16 counterIndex = 0)
+{
+	profile_thread_buffer* buffer = profileThreadBuffer;
+	if (!buffer)
+	{
+		buffer = registerProfileThread();
+	}
+
+	uint32 write = buffer->writeIndex.load(std::memory_order_relaxed);
+	uint32 read = buffer->readIndex.load(std::memory_order_acquire);
+
+	uint32 required = (type == profile_event_end_block) ? 1 : (buffer->numOpenBlocks + 1 + (type == profile_event_begin_block));
+	if (PROFILE_THREAD_BUFFER_SIZE - (write - read) < required)
+	{
+		buffer->numDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	profile_event* event = buffer->events + (write & (PROFILE_THREAD_BUFFER_SIZE - 1));
+	event->clock = profileClock();
+	event->threadID = buffer->threadID;
+	event->type = type;
+	event->counterIndex = counterIndex;
+	event->frameID = info_frameID;
+
+	buffer->writeIndex.store(write + 1, std::memory_order_release);
+
+	if (type == profile_event_begin_block)
+	{
+		++buffer->numOpenBlocks;
+	}
+	else if (type == profile_event_end_block)
+	{
+		--buffer->numOpenBlocks;
+	}
+	return true;
+}
 
 struct profile_block_recorder
 {
 	uint64 info_frameID;
+	bool recorded;
 
 	profile_block_recorder(const char* info)
 	{
 		info_frameID = (uint64)info;
-		recordProfileEvent(profile_event_begin_block, info_frameID);
+		recorded = recordProfileEvent(profile_event_begin_block, info_frameID);
 	}
 
 	~profile_block_recorder()
 	{
-		recordProfileEvent(profile_event_end_block, info_frameID);
+		if (recorded)
+		{
+			recordProfileEvent(profile_event_end_block, info_frameID);
+		}
 	}
 };
 
+// Counters are numeric values, which are summed (e.g. draw calls, bytes uploaded) or sampled (e.g. slots in use) per frame.
+enum profile_counter_kind : uint16
+{
+	profile_counter_sum,
+	profile_counter_sample,
+};
+
+struct profile_counter
+{
+	const char* name;
+	profile_counter_kind kind;
+	uint16 index;
+
+	profile_counter(const char* name, profile_counter_kind kind);
+
+	void record(double value)
+	{
+		uint64 bits;
+		memcpy(&bits, &value, sizeof(value));
+		recordProfileEvent(profile_event_counter, bits, index);
+	}
+};
+
+// Thread safe.
+uint32 getNumProfileCounters();
+profile_counter getProfileCounter(uint32 index);
+
 #define PROFILE_INFO__(a, b, c, d) a b " | " c "[" #d "]"
 #define PROFILE_INFO_(a, b, c, d) PROFILE_INFO__(a, b, c, d)
 #define PROFILE_INFO(prefix) PROFILE_INFO_(prefix, __FUNCTION__, "", __LINE__)
@@ -79,6 +173,10 @@ struct profile_block_recorder
 #define PROFILE_FRAME_MARKER(frameNum) { recordProfileEvent(profile_event_frame_marker, frameNum); }
 #define PROFILE_INITIALIZATION() PROFILE_FRAME_MARKER(-1)
 
+#define PROFILE_COUNTER_(counter, name, kind, value) { static profile_counter COMPOSITE_VARNAME(PROFILE_COUNTER, counter)(name, kind); COMPOSITE_VARNAME(PROFILE_COUNTER, counter).record((double)(value)); }
+#define PROFILE_COUNTER_ADD(name, value) PROFILE_COUNTER_(__COUNTER__, name, profile_counter_sum, value)
+#define PROFILE_COUNTER_SET(name, value) PROFILE_COUNTER_(__COUNTER__, name, profile_counter_sample, value)
+
 void processAndDisplayProfileEvents(class debug_gui& gui);
 
 #else
@@ -86,6 +184,8 @@ void processAndDisplayProfileEvents(class debug_gui& gui);
 #define PROFILE_BLOCK(name)
 #define PROFILE_FRAME_MARKER(frameNum)
 #define PROFILE_INITIALIZATION()
+#define PROFILE_COUNTER_ADD(name, value)
+#define PROFILE_COUNTER_SET(name, value)
 
 #define processAndDisplayProfileEvents(...)
 
@@ -79,3 +79,12 @@ void dx_render_target::resize(uint32 width, uint32 height)
 	viewport.Width = (float)width;
 	viewport.Height = (float)height;
 }
+
+void dx_render_target::detachAll()
+{
+	for (uint32 i = 0; i < arraysize(colorAttachments); ++i)
+	{
+		colorAttachments[i] = nullptr;
+	}
+	depthStencilAttachment = nullptr;
+}
@@ -8,6 +8,10 @@ struct dx_render_target
 	void attachDepthStencilTexture(dx_texture& texture);
 	void resize(uint32 width, uint32 height);
 
+	// Keeps the formats, so that pipelines can still be created for this target. Used for targets whose textures are
+	// attached anew every frame.
+	void detachAll();
+
 	dx_texture* colorAttachments[8] = {};
 	dx_texture* depthStencilAttachment = nullptr;
 	D3D12_VIEWPORT viewport;
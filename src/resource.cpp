@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "resource.h"
 #include "error.h"
+#include "resource_state_tracker.h"
+#include "heap_allocator.h"
 
 namespace std
 {
@@ -132,6 +134,16 @@ namespace std
 	};
 }
 
+static uint32 getNumSubresources(const D3D12_RESOURCE_DESC& desc)
+{
+	if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+	{
+		return 1;
+	}
+	uint32 numArraySlices = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? 1 : desc.DepthOrArraySize;
+	return desc.MipLevels * numArraySlices;
+}
+
 dx_resource::dx_resource(const dx_resource& other)
 {
 	this->device = other.device;
@@ -142,11 +154,13 @@ dx_resource::dx_resource(const dx_resource& other)
 	}
 	this->formatSupport = other.formatSupport;
 	this->resource = other.resource;
+	this->stateHandle = other.stateHandle;
 	this->shaderResourceViews = other.shaderResourceViews;
 	this->unorderedAccessViews = other.unorderedAccessViews;
 }
 
-void dx_resource::initialize(ComPtr<ID3D12Device2> device, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_CLEAR_VALUE* clearValue)
+void dx_resource::initialize(ComPtr<ID3D12Device2> device, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_CLEAR_VALUE* clearValue,
+	const gpu_heap_relocation_func& relocate)
 {
 	this->device = device;
 	clearValueValid = false;
@@ -156,12 +170,9 @@ void dx_resource::initialize(ComPtr<ID3D12Device2> device, const D3D12_RESOURCE_
 		clearValueValid = true;
 	}
 
-	checkResult(device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&resourceDesc,
-		D3D12_RESOURCE_STATE_COMMON,
-		clearValue,
-		IID_PPV_ARGS(&resource)));
+	resource = dx_heap_allocator::createResource(resourceDesc, D3D12_RESOURCE_STATE_COMMON, clearValue, relocate);
+
+	stateHandle = dx_resource_state_tracker::addGlobalResourceState(resource.Get(), D3D12_RESOURCE_STATE_COMMON, getNumSubresources(resource->GetDesc()));
 
 	formatSupport.Format = resourceDesc.Format;
 	checkResult(device->CheckFeatureSupport(
@@ -181,6 +192,9 @@ void dx_resource::initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Resource
 
 	D3D12_RESOURCE_DESC resourceDesc(resource->GetDesc());
 
+	// Resources which are shared between wrappers (e.g. through the texture cache) keep their tracked state.
+	stateHandle = dx_resource_state_tracker::getGlobalResourceHandle(resource.Get(), D3D12_RESOURCE_STATE_COMMON, getNumSubresources(resourceDesc));
+
 	formatSupport.Format = resourceDesc.Format;
 	checkResult(device->CheckFeatureSupport(
 		D3D12_FEATURE_FORMAT_SUPPORT,
@@ -204,12 +218,18 @@ D3D12_CPU_DESCRIPTOR_HANDLE dx_resource::getShaderResourceView(const D3D12_SHADE
 	auto iter = shaderResourceViews.find(hash);
 	if (iter == shaderResourceViews.end())
 	{
-		D3D12_CPU_DESCRIPTOR_HANDLE srv = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV).getDescriptorHandle(0);
-		device->CreateShaderResourceView(resource.Get(), srvDesc, srv);
+		shader_resource_view srv = {};
+		srv.handle = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV).getDescriptorHandle(0);
+		srv.hasDesc = (srvDesc != nullptr);
+		if (srvDesc)
+		{
+			srv.desc = *srvDesc;
+		}
+		device->CreateShaderResourceView(resource.Get(), srvDesc, srv.handle);
 		iter = shaderResourceViews.insert({ hash, srv }).first;
 	}
 
-	return iter->second;
+	return iter->second.handle;
 }
 
 D3D12_CPU_DESCRIPTOR_HANDLE dx_resource::getUnorderedAccessView(const D3D12_UNORDERED_ACCESS_VIEW_DESC* uavDesc)
@@ -2,12 +2,14 @@
 
 #include "common.h"
 #include "descriptor_allocator.h"
+#include "heap_allocator.h"
 
 
 
 struct dx_resource
 {
-	void initialize(ComPtr<ID3D12Device2> device, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_CLEAR_VALUE* clearValue);
+	void initialize(ComPtr<ID3D12Device2> device, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_CLEAR_VALUE* clearValue,
+		const gpu_heap_relocation_func& relocate = nullptr);
 	void initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Resource> resource);
 
 	dx_resource() {}
@@ -15,6 +17,10 @@ struct dx_resource
 
 	ComPtr<ID3D12Resource> resource;
 
+	// Handle into the global resource state table, see dx_resource_state_tracker. Transitions of resources with a valid handle
+	// skip the pointer lookup.
+	uint32 stateHandle = (uint32)-1;
+
 	D3D12_CPU_DESCRIPTOR_HANDLE getShaderResourceView(const D3D12_SHADER_RESOURCE_VIEW_DESC* srvDesc);
 	D3D12_CPU_DESCRIPTOR_HANDLE getUnorderedAccessView(const D3D12_UNORDERED_ACCESS_VIEW_DESC* uavDesc);
 
@@ -37,7 +43,15 @@ protected:
 
 	D3D12_FEATURE_DATA_FORMAT_SUPPORT formatSupport;
 
-	std::unordered_map<size_t, D3D12_CPU_DESCRIPTOR_HANDLE> shaderResourceViews;
+	// The description is kept, so that the view can be created again for a relocated resource.
+	struct shader_resource_view
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE handle;
+		D3D12_SHADER_RESOURCE_VIEW_DESC desc;
+		bool hasDesc;
+	};
+
+	std::unordered_map<size_t, shader_resource_view> shaderResourceViews;
 	std::unordered_map<size_t, D3D12_CPU_DESCRIPTOR_HANDLE> unorderedAccessViews;
 
 	ComPtr<ID3D12Device2> device;
@@ -2,88 +2,376 @@
 #include "resource_state_tracker.h"
 #include "command_list.h"
 #include "resource.h"
+#include "buffer.h"
 
-std::mutex dx_resource_state_tracker::globalMutex;
-bool dx_resource_state_tracker::isLocked = false;
-std::unordered_map<ID3D12Resource*, dx_resource_state_tracker::resource_state> dx_resource_state_tracker::globalResourceState;
+dx_resource_state_tracker::global_resource_state* dx_resource_state_tracker::globalStateChunks[maxNumGlobalStateChunks];
+uint32 dx_resource_state_tracker::numGlobalStateHandles = 0;
+std::vector<uint32> dx_resource_state_tracker::freeGlobalStateHandles;
+std::deque<dx_resource_state_tracker::stale_handle> dx_resource_state_tracker::staleGlobalStateHandles;
+uint64 dx_resource_state_tracker::currentFrameNumber = 0;
+std::unordered_map<ID3D12Resource*, uint32> dx_resource_state_tracker::globalStateHandles;
+std::mutex dx_resource_state_tracker::registryMutex;
+std::mutex dx_resource_state_tracker::shardMutexes[numGlobalStateShards];
 
+bool dx_resource_state_tracker::enableBarrierOptimization = true;
 
-void dx_resource_state_tracker::initialize()
+std::atomic_uint32_t dx_resource_state_tracker::frameRequestedTransitions;
+std::atomic_uint32_t dx_resource_state_tracker::frameEmittedBarriers;
+std::atomic_uint32_t dx_resource_state_tracker::frameElidedTransitions;
+std::atomic_uint32_t dx_resource_state_tracker::frameCombinedReadStates;
+std::atomic_uint32_t dx_resource_state_tracker::frameMergedBarriers;
+std::atomic_uint32_t dx_resource_state_tracker::frameSplitBarriers;
+
+static const D3D12_RESOURCE_STATES readOnlyStates =
+	D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+	D3D12_RESOURCE_STATE_INDEX_BUFFER |
+	D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+	D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+	D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+	D3D12_RESOURCE_STATE_COPY_SOURCE |
+	D3D12_RESOURCE_STATE_DEPTH_READ;
+
+bool dx_resource_state_tracker::isReadOnlyState(D3D12_RESOURCE_STATES state)
+{
+	// Common is not a read state here, since leaving it is what makes the resource usable on this queue.
+	return state != D3D12_RESOURCE_STATE_COMMON && (state & ~readOnlyStates) == 0;
+}
+
+
+void dx_resource_state_tracker::initialize(D3D12_COMMAND_LIST_TYPE commandListType)
+{
+	switch (commandListType)
+	{
+		case D3D12_COMMAND_LIST_TYPE_COMPUTE:
+		{
+			combinableReadStates = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_COPY_SOURCE;
+		} break;
+		case D3D12_COMMAND_LIST_TYPE_COPY:
+		{
+			combinableReadStates = D3D12_RESOURCE_STATE_COPY_SOURCE;
+		} break;
+		default:
+		{
+			combinableReadStates = readOnlyStates;
+		} break;
+	}
+}
+
+dx_resource_state_tracker::global_resource_state& dx_resource_state_tracker::getGlobalState(uint32 handle)
 {
+	assert(handle < numGlobalStateHandles);
+	return globalStateChunks[handle / globalStateChunkSize][handle % globalStateChunkSize];
+}
+
+dx_resource_state_tracker::local_resource_state& dx_resource_state_tracker::getLocalState(uint32 handle, bool& outFirstUse)
+{
+	if (handle >= (uint32)localStateIndices.size())
+	{
+		localStateIndices.resize(max(handle + 1, (uint32)localStateIndices.size() * 2), 0);
+	}
+
+	uint32& index = localStateIndices[handle];
+	outFirstUse = (index == 0);
+
+	if (outFirstUse)
+	{
+		// Registering the resource again can change the subresource count.
+		uint32 numSubResources;
+		{
+			std::lock_guard<std::mutex> lock(shardMutexes[getShard(handle)]);
+			numSubResources = getGlobalState(handle).numSubResources;
+		}
+
+		local_resource_state localState;
+		localState.handle = handle;
+		localState.state.initialize(numSubResources);
+		localStates.push_back(std::move(localState));
+
+		index = (uint32)localStates.size();
+		shardMask |= 1u << getShard(handle);
+	}
+
+	return localStates[index - 1];
+}
+
+dx_resource_state_tracker::local_resource_state* dx_resource_state_tracker::findLocalState(uint32 handle)
+{
+	if (handle < (uint32)localStateIndices.size() && localStateIndices[handle] != 0)
+	{
+		return &localStates[localStateIndices[handle] - 1];
+	}
+	return nullptr;
+}
+
+D3D12_RESOURCE_STATES dx_resource_state_tracker::getOptimizedState(D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES requestedState) const
+{
+	// Bouncing between read states costs a barrier each time. Instead the resource is put into all read states it
+	// has been requested in, which makes later reads free.
+	if (enableBarrierOptimization && isReadOnlyState(stateBefore) && isReadOnlyState(requestedState))
+	{
+		if ((stateBefore | requestedState) == stateBefore)
+		{
+			return stateBefore; // Already covered.
+		}
+
+		// States which this list type does not support are dropped from the combination.
+		return (D3D12_RESOURCE_STATES)((stateBefore & combinableReadStates) | requestedState);
+	}
+	return requestedState;
+}
+
+void dx_resource_state_tracker::pushBarrier(const D3D12_RESOURCE_BARRIER& barrier, uint32 handle)
+{
+	resourceBarriers.push_back(barrier);
+	resourceBarrierHandles.push_back(handle);
 }
 
 void dx_resource_state_tracker::resourceBarrier(const D3D12_RESOURCE_BARRIER& barrier)
 {
 	if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
 	{
-		const D3D12_RESOURCE_TRANSITION_BARRIER& transitionBarrier = barrier.Transition;
+		trackTransition(getGlobalResourceHandle(barrier.Transition.pResource), barrier);
+	}
+	else
+	{
+		if (!splitHandles.empty())
+		{
+			// A resource must not be in the middle of a split barrier when it is used.
+			if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV)
+			{
+				endSplitBarrier(barrier.UAV.pResource);
+			}
+			else
+			{
+				endSplitBarrier(barrier.Aliasing.pResourceBefore);
+				endSplitBarrier(barrier.Aliasing.pResourceAfter);
+			}
+		}
+
+		pushBarrier(barrier, invalidHandle);
+
+		// Transitions must not be moved across UAV or aliasing barriers.
+		++batchEpoch;
+	}
+}
+
+void dx_resource_state_tracker::trackTransition(uint32 handle, const D3D12_RESOURCE_BARRIER& barrier)
+{
+	const D3D12_RESOURCE_TRANSITION_BARRIER& transitionBarrier = barrier.Transition;
+	assert(getGlobalState(handle).resource == transitionBarrier.pResource && "Resource state handle does not belong to this resource.");
+
+	++stats.numRequestedTransitions;
+
+	bool firstUse;
+	local_resource_state& localState = getLocalState(handle, firstUse);
+	resource_state& resourceState = localState.state;
+
+	if (firstUse)
+	{
+		// The state before this list is only known at submit time.
+		pendingResourceBarriers.push_back({ barrier, handle });
+		resourceState.setSubresourceState(transitionBarrier.Subresource, transitionBarrier.StateAfter);
+		return;
+	}
 
-		const auto it = finalResourceState.find(transitionBarrier.pResource);
-		resource_state* resourceState;
-		if (it != finalResourceState.end())
+	endSplitBarrier(localState);
+
+	if (transitionBarrier.Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES &&
+		!resourceState.subresourceStates.empty())
+	{
+		// Transition all of the subresources if they are different than the StateAfter.
+		for (uint32 i = 0; i < resourceState.subresourceStates.size(); ++i)
 		{
-			resourceState = &it->second;
+			D3D12_RESOURCE_STATES subresourceState = resourceState.subresourceStates[i];
+			D3D12_RESOURCE_STATES stateAfter = getOptimizedState(subresourceState, transitionBarrier.StateAfter);
 
-			if (transitionBarrier.Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES &&
-				!resourceState->subresourceStates.empty())
+			if (stateAfter != subresourceState)
 			{
-				// Transition all of the subresources if they are different than the StateAfter.
-				for (uint32 i = 0; i < resourceState->subresourceStates.size(); ++i)
-				{
-					D3D12_RESOURCE_STATES subresourceState = resourceState->subresourceStates[i];
-
-					if (transitionBarrier.StateAfter != subresourceState)
-					{
-						D3D12_RESOURCE_BARRIER newBarrier = barrier;
-						newBarrier.Transition.Subresource = i;
-						newBarrier.Transition.StateBefore = subresourceState;
-						resourceBarriers.push_back(newBarrier);
-					}
-				}
+				emitTransition(localState, barrier, i, subresourceState, stateAfter);
+				resourceState.subresourceStates[i] = stateAfter;
 			}
 			else
 			{
-				D3D12_RESOURCE_STATES finalState = resourceState->getSubresourceState(transitionBarrier.Subresource);
-				if (transitionBarrier.StateAfter != finalState)
-				{
-					D3D12_RESOURCE_BARRIER newBarrier = barrier;
-					newBarrier.Transition.StateBefore = finalState;
-					resourceBarriers.push_back(newBarrier);
-				}
+				++stats.numElidedTransitions;
 			}
 		}
+
+		resourceState.collapseSubresourceStates();
+	}
+	else
+	{
+		D3D12_RESOURCE_STATES finalState = resourceState.getSubresourceState(transitionBarrier.Subresource);
+		D3D12_RESOURCE_STATES stateAfter = getOptimizedState(finalState, transitionBarrier.StateAfter);
+
+		if (stateAfter != finalState)
+		{
+			emitTransition(localState, barrier, transitionBarrier.Subresource, finalState, stateAfter);
+			resourceState.setSubresourceState(transitionBarrier.Subresource, stateAfter);
+		}
 		else
 		{
-			pendingResourceBarriers.push_back(barrier);
-			resourceState = &finalResourceState.insert({ transitionBarrier.pResource, resource_state() }).first->second;
+			++stats.numElidedTransitions;
+		}
+	}
+}
 
-			// Get subresource count from global list.
-			std::lock_guard<std::mutex> lock(globalMutex);
-			auto& global = globalResourceState[transitionBarrier.pResource];
-			resourceState->initialize((uint32)global.subresourceStates.capacity());
+void dx_resource_state_tracker::emitTransition(local_resource_state& localState, const D3D12_RESOURCE_BARRIER& barrier, uint32 subresource,
+	D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+{
+	if (stateAfter != barrier.Transition.StateAfter)
+	{
+		++stats.numCombinedReadStates;
+	}
 
-			
+	localState.transitionedAfterFirstUse = true;
+
+	// Fold back-to-back transitions of the same subresource, when no GPU work was recorded in between. If this turns the
+	// previous barrier into a no-op, it is dropped when the batch is flushed.
+	if (enableBarrierOptimization && localState.batchEpoch == batchEpoch && barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE)
+	{
+		D3D12_RESOURCE_BARRIER& previous = resourceBarriers[localState.batchBarrierIndex];
+		if (previous.Transition.Subresource == subresource && previous.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE)
+		{
+			assert(previous.Transition.StateAfter == stateBefore);
+			previous.Transition.StateAfter = stateAfter;
+			++stats.numMergedBarriers;
+			return;
 		}
+	}
+
+	D3D12_RESOURCE_BARRIER newBarrier = barrier;
+	newBarrier.Transition.Subresource = subresource;
+	newBarrier.Transition.StateBefore = stateBefore;
+	newBarrier.Transition.StateAfter = stateAfter;
 
-		resourceState->setSubresourceState(transitionBarrier.Subresource, transitionBarrier.StateAfter);
+	localState.batchBarrierIndex = (uint32)resourceBarriers.size();
+	localState.batchEpoch = batchEpoch;
+	pushBarrier(newBarrier, localState.handle);
+}
+
+void dx_resource_state_tracker::beginTransition(uint32 handle, ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter)
+{
+	local_resource_state* localState = findLocalState(handle);
+	if (!enableBarrierOptimization || !localState || !localState->state.subresourceStates.empty())
+	{
+		transitionResource(handle, resource, stateAfter);
+		return;
+	}
+
+	assert(getGlobalState(handle).resource == resource && "Resource state handle does not belong to this resource.");
+
+	++stats.numRequestedTransitions;
+
+	endSplitBarrier(*localState);
+
+	D3D12_RESOURCE_STATES stateBefore = localState->state.state;
+	stateAfter = getOptimizedState(stateBefore, stateAfter);
+	if (stateAfter == stateBefore)
+	{
+		++stats.numElidedTransitions;
+		return;
+	}
+
+	localState->transitionedAfterFirstUse = true;
+	// Later transitions in this batch must not be folded into an earlier barrier of the resource. The begin itself is
+	// never folded into, since it is not a plain barrier.
+	localState->batchBarrierIndex = (uint32)resourceBarriers.size();
+	localState->batchEpoch = batchEpoch;
+	localState->splitPending = true;
+	localState->splitBarrierIndex = (uint32)resourceBarriers.size();
+	localState->splitEpoch = flushEpoch;
+	localState->splitStateBefore = stateBefore;
+	localState->state.setSubresourceState(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, stateAfter);
+
+	pushBarrier(CD3DX12_RESOURCE_BARRIER::Transition(resource, stateBefore, stateAfter,
+		D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY), handle);
+	splitHandles.push_back(handle);
+}
+
+void dx_resource_state_tracker::endSplitBarrier(local_resource_state& localState)
+{
+	if (!localState.splitPending)
+	{
+		return;
+	}
+
+	localState.splitPending = false;
+
+	if (localState.splitEpoch == flushEpoch)
+	{
+		// The begin has not been flushed yet, so no GPU work was recorded since. A regular barrier does the same job.
+		resourceBarriers[localState.splitBarrierIndex].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
 	}
 	else
 	{
-		resourceBarriers.push_back(barrier);
+		localState.batchBarrierIndex = (uint32)resourceBarriers.size();
+		localState.batchEpoch = batchEpoch;
+		pushBarrier(CD3DX12_RESOURCE_BARRIER::Transition(getGlobalState(localState.handle).resource, localState.splitStateBefore, localState.state.state,
+			D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY), localState.handle);
+		++stats.numSplitBarriers;
+	}
+}
+
+void dx_resource_state_tracker::endSplitBarrier(ID3D12Resource* resource)
+{
+	// Only look the resource up if there is anything to finish.
+	if (resource && !splitHandles.empty())
+	{
+		if (local_resource_state* localState = findLocalState(getGlobalResourceHandle(resource)))
+		{
+			endSplitBarrier(*localState);
+		}
+	}
+}
+
+void dx_resource_state_tracker::endSplitBarriers()
+{
+	for (uint32 handle : splitHandles)
+	{
+		if (local_resource_state* localState = findLocalState(handle))
+		{
+			endSplitBarrier(*localState);
+		}
 	}
+	splitHandles.clear();
 }
 
 void dx_resource_state_tracker::transitionResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, uint32 subResource)
 {
 	if (resource)
 	{
-		resourceBarrier(CD3DX12_RESOURCE_BARRIER::Transition(resource, D3D12_RESOURCE_STATE_COMMON, stateAfter, subResource));
+		transitionResource(getGlobalResourceHandle(resource), resource, stateAfter, subResource);
 	}
 }
 
 void dx_resource_state_tracker::transitionResource(const dx_resource& resource, D3D12_RESOURCE_STATES stateAfter, uint32 subResource)
 {
-	transitionResource(resource.resource.Get(), stateAfter, subResource);
+	if (resource.stateHandle != invalidHandle)
+	{
+		transitionResource(resource.stateHandle, resource.resource.Get(), stateAfter, subResource);
+	}
+	else
+	{
+		transitionResource(resource.resource.Get(), stateAfter, subResource);
+	}
+}
+
+void dx_resource_state_tracker::transitionResource(const dx_buffer& buffer, D3D12_RESOURCE_STATES stateAfter, uint32 subResource)
+{
+	if (buffer.stateHandle != invalidHandle)
+	{
+		transitionResource(buffer.stateHandle, buffer.resource.Get(), stateAfter, subResource);
+	}
+	else
+	{
+		transitionResource(buffer.resource.Get(), stateAfter, subResource);
+	}
+}
+
+void dx_resource_state_tracker::transitionResource(uint32 handle, ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, uint32 subResource)
+{
+	trackTransition(handle, CD3DX12_RESOURCE_BARRIER::Transition(resource, D3D12_RESOURCE_STATE_COMMON, stateAfter, subResource));
 }
 
 void dx_resource_state_tracker::uavBarrier(const dx_resource* resource)
@@ -100,125 +388,368 @@ void dx_resource_state_tracker::aliasBarrier(const dx_resource* resourceBefore,
 	resourceBarrier(CD3DX12_RESOURCE_BARRIER::Aliasing(d3d12ResourceBefore, d3d12ResourceAfter));
 }
 
-uint32 dx_resource_state_tracker::flushPendingResourceBarriers(ComPtr<ID3D12GraphicsCommandList2> commandList)
+uint32 dx_resource_state_tracker::resolvePendingResourceBarriers(std::vector<D3D12_RESOURCE_BARRIER>& outBarriers)
 {
-	assert(isLocked);
-
-	// Resolve the pending resource barriers by checking the global state of the 
+	// Resolve the pending resource barriers by checking the global state of the
 	// (sub)resources. Add barriers if the pending state and the global state do
-	//  not match.
-	std::vector<D3D12_RESOURCE_BARRIER> resourceBarriers;
-	resourceBarriers.reserve(pendingResourceBarriers.size());
+	// not match.
+	uint32 numBarriersBefore = (uint32)outBarriers.size();
 
-	for (auto pendingBarrier : pendingResourceBarriers)
+	for (const pending_barrier& pending : pendingResourceBarriers)
 	{
-		if (pendingBarrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)  // Only transition barriers should be pending...
+		const D3D12_RESOURCE_TRANSITION_BARRIER& pendingTransition = pending.barrier.Transition;
+		const global_resource_state& globalState = getGlobalState(pending.handle);
+
+		// Read states are combined here as well, like during recording. This is only possible if the list did not
+		// transition the resource again, because those barriers were recorded with the first state as their before state.
+		local_resource_state* localState = findLocalState(pending.handle);
+		if (enableBarrierOptimization && localState && !localState->transitionedAfterFirstUse &&
+			pendingTransition.Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES && globalState.subresourceStates.empty())
 		{
-			auto pendingTransition = pendingBarrier.Transition;
-			const auto& iter = globalResourceState.find(pendingTransition.pResource);
-			if (iter != globalResourceState.end())
+			D3D12_RESOURCE_STATES combinedState = getOptimizedState(globalState.state, pendingTransition.StateAfter);
+			if (combinedState != pendingTransition.StateAfter)
 			{
-				auto& resourceState = iter->second;
-				if (pendingTransition.Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES &&
-					!resourceState.subresourceStates.empty())
+				// Committed as the final state of this list.
+				localState->state.setSubresourceState(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, combinedState);
+
+				if (combinedState != globalState.state)
 				{
-					for (uint32 i = 0; i < resourceState.subresourceStates.size(); ++i)
-					{
-						D3D12_RESOURCE_STATES subresourceState = resourceState.subresourceStates[i];
-
-						if (pendingTransition.StateAfter != subresourceState)
-						{
-							D3D12_RESOURCE_BARRIER newBarrier = pendingBarrier;
-							newBarrier.Transition.Subresource = i;
-							newBarrier.Transition.StateBefore = subresourceState;
-							resourceBarriers.push_back(newBarrier);
-						}
-					}
+					D3D12_RESOURCE_BARRIER newBarrier = pending.barrier;
+					newBarrier.Transition.StateBefore = globalState.state;
+					newBarrier.Transition.StateAfter = combinedState;
+					outBarriers.push_back(newBarrier);
+					++stats.numCombinedReadStates;
 				}
 				else
 				{
-					// No (sub)resources need to be transitioned. Just add a single transition barrier (if needed).
-					auto globalState = (iter->second).getSubresourceState(pendingTransition.Subresource);
-					if (pendingTransition.StateAfter != globalState)
-					{
-						// Fix-up the before state based on current global state of the resource.
-						pendingBarrier.Transition.StateBefore = globalState;
-						resourceBarriers.push_back(pendingBarrier);
-					}
+					++stats.numElidedTransitions;
 				}
+				continue;
+			}
+		}
+
+		if (pendingTransition.Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES &&
+			!globalState.subresourceStates.empty())
+		{
+			for (uint32 i = 0; i < globalState.subresourceStates.size(); ++i)
+			{
+				D3D12_RESOURCE_STATES subresourceState = globalState.subresourceStates[i];
+
+				if (pendingTransition.StateAfter != subresourceState)
+				{
+					D3D12_RESOURCE_BARRIER newBarrier = pending.barrier;
+					newBarrier.Transition.Subresource = i;
+					newBarrier.Transition.StateBefore = subresourceState;
+					outBarriers.push_back(newBarrier);
+				}
+			}
+		}
+		else
+		{
+			// No (sub)resources need to be transitioned. Just add a single transition barrier (if needed).
+			D3D12_RESOURCE_STATES globalSubresourceState = globalState.getSubresourceState(pendingTransition.Subresource);
+			if (pendingTransition.StateAfter != globalSubresourceState)
+			{
+				// Fix-up the before state based on current global state of the resource.
+				D3D12_RESOURCE_BARRIER newBarrier = pending.barrier;
+				newBarrier.Transition.StateBefore = globalSubresourceState;
+				outBarriers.push_back(newBarrier);
 			}
 		}
 	}
 
-	uint32 numBarriers = (uint32)resourceBarriers.size();
+	pendingResourceBarriers.clear();
+
+	return (uint32)outBarriers.size() - numBarriersBefore;
+}
+
+uint32 dx_resource_state_tracker::flushPendingResourceBarriers(ComPtr<ID3D12GraphicsCommandList2> commandList)
+{
+	resolvedPendingBarriers.clear();
+	uint32 numBarriers = resolvePendingResourceBarriers(resolvedPendingBarriers);
+
 	if (numBarriers > 0)
 	{
-		commandList->ResourceBarrier(numBarriers, resourceBarriers.data());
+		commandList->ResourceBarrier(numBarriers, resolvedPendingBarriers.data());
+		stats.numEmittedBarriers += numBarriers;
 	}
 
-	pendingResourceBarriers.clear();
-	
 	return numBarriers;
 }
 
-void dx_resource_state_tracker::flushResourceBarriers(ComPtr<ID3D12GraphicsCommandList2> commandList)
+uint32 dx_resource_state_tracker::optimizeBarrierBatch()
 {
 	uint32 numBarriers = (uint32)resourceBarriers.size();
-	if (numBarriers > 0)
+	uint32 numWritten = 0;
+
+	for (uint32 readIndex = 0; readIndex < numBarriers;)
+	{
+		D3D12_RESOURCE_BARRIER barrier = resourceBarriers[readIndex];
+
+		if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+		{
+			const D3D12_RESOURCE_TRANSITION_BARRIER& transition = barrier.Transition;
+
+			// Folded into a no-op.
+			if (transition.StateBefore == transition.StateAfter)
+			{
+				++stats.numMergedBarriers;
+				++readIndex;
+				continue;
+			}
+
+			// A run of barriers for subresources 0..n-1 with the same states is the same as one barrier for the whole resource.
+			if (transition.Subresource == 0 && barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE)
+			{
+				// Every transition has been tracked, so the resource has a local state.
+				const local_resource_state* localState = findLocalState(resourceBarrierHandles[readIndex]);
+				uint32 numSubResources = localState ? localState->state.numSubResources : 1;
+
+				uint32 runLength = 1;
+				while (runLength < numSubResources && readIndex + runLength < numBarriers)
+				{
+					const D3D12_RESOURCE_BARRIER& next = resourceBarriers[readIndex + runLength];
+					if (next.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION || next.Flags != D3D12_RESOURCE_BARRIER_FLAG_NONE ||
+						next.Transition.pResource != transition.pResource || next.Transition.Subresource != runLength ||
+						next.Transition.StateBefore != transition.StateBefore || next.Transition.StateAfter != transition.StateAfter)
+					{
+						break;
+					}
+					++runLength;
+				}
+
+				if (numSubResources > 1 && runLength == numSubResources)
+				{
+					barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+					resourceBarriers[numWritten++] = barrier;
+					stats.numMergedBarriers += runLength - 1;
+					readIndex += runLength;
+					continue;
+				}
+			}
+		}
+
+		resourceBarriers[numWritten++] = barrier;
+		++readIndex;
+	}
+
+	return numWritten;
+}
+
+void dx_resource_state_tracker::flushResourceBarriers(command_stream& stream)
+{
+	if (!resourceBarriers.empty())
 	{
-		commandList->ResourceBarrier(numBarriers, resourceBarriers.data());
+		uint32 numBarriers = enableBarrierOptimization ? optimizeBarrierBatch() : (uint32)resourceBarriers.size();
+		if (numBarriers > 0)
+		{
+			stream.barriers(numBarriers, resourceBarriers.data());
+			stats.numEmittedBarriers += numBarriers;
+		}
+
 		resourceBarriers.clear();
+		resourceBarrierHandles.clear();
 	}
+
+	// Everything recorded from here on is separated from the flushed barriers by GPU work.
+	++batchEpoch;
+	++flushEpoch;
 }
 
 void dx_resource_state_tracker::commitFinalResourceStates()
 {
-	assert(isLocked);
+	assert(splitHandles.empty() && "Split barriers must be finished before the list is submitted.");
 
-	for (const auto& resourceState : finalResourceState)
+	for (local_resource_state& localState : localStates)
 	{
-		globalResourceState[resourceState.first] = resourceState.second;
+		global_resource_state& globalState = getGlobalState(localState.handle);
+		globalState.state = localState.state.state;
+		globalState.subresourceStates = localState.state.subresourceStates;
+
+		localStateIndices[localState.handle] = 0;
 	}
 
-	finalResourceState.clear();
+	localStates.clear();
+	shardMask = 0;
 }
 
 void dx_resource_state_tracker::reset()
 {
 	pendingResourceBarriers.clear();
 	resourceBarriers.clear();
-	finalResourceState.clear();
+	resourceBarrierHandles.clear();
+	splitHandles.clear();
+
+	for (const local_resource_state& localState : localStates)
+	{
+		localStateIndices[localState.handle] = 0;
+	}
+
+	localStates.clear();
+	shardMask = 0;
 }
 
-void dx_resource_state_tracker::lock()
+void dx_resource_state_tracker::accumulateFrameStatistics(const barrier_statistics& stats)
 {
-	globalMutex.lock();
-	isLocked = true;
+	frameRequestedTransitions += stats.numRequestedTransitions;
+	frameEmittedBarriers += stats.numEmittedBarriers;
+	frameElidedTransitions += stats.numElidedTransitions;
+	frameCombinedReadStates += stats.numCombinedReadStates;
+	frameMergedBarriers += stats.numMergedBarriers;
+	frameSplitBarriers += stats.numSplitBarriers;
 }
 
-void dx_resource_state_tracker::unlock()
+barrier_statistics dx_resource_state_tracker::endFrame()
 {
-	isLocked = false;
-	globalMutex.unlock();
+	barrier_statistics result;
+	result.numRequestedTransitions = frameRequestedTransitions.exchange(0);
+	result.numEmittedBarriers = frameEmittedBarriers.exchange(0);
+	result.numElidedTransitions = frameElidedTransitions.exchange(0);
+	result.numCombinedReadStates = frameCombinedReadStates.exchange(0);
+	result.numMergedBarriers = frameMergedBarriers.exchange(0);
+	result.numSplitBarriers = frameSplitBarriers.exchange(0);
+	return result;
 }
 
-void dx_resource_state_tracker::addGlobalResourceState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state, uint32 numSubResources)
+void dx_resource_state_tracker::lockShards(uint32 shardMask)
 {
-	if (resource)
+	for (uint32 i = 0; i < numGlobalStateShards; ++i)
+	{
+		if (shardMask & (1u << i))
+		{
+			shardMutexes[i].lock();
+		}
+	}
+}
+
+void dx_resource_state_tracker::unlockShards(uint32 shardMask)
+{
+	for (uint32 i = 0; i < numGlobalStateShards; ++i)
+	{
+		if (shardMask & (1u << i))
+		{
+			shardMutexes[i].unlock();
+		}
+	}
+}
+
+uint32 dx_resource_state_tracker::addGlobalResourceState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state, uint32 numSubResources)
+{
+	if (!resource)
+	{
+		return invalidHandle;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	auto it = globalStateHandles.find(resource);
+	uint32 handle;
+	if (it != globalStateHandles.end())
 	{
-		std::lock_guard<std::mutex> lock(globalMutex);
+		handle = it->second;
+	}
+	else
+	{
+		if (!freeGlobalStateHandles.empty())
+		{
+			handle = freeGlobalStateHandles.back();
+			freeGlobalStateHandles.pop_back();
+		}
+		else
+		{
+			handle = numGlobalStateHandles;
+
+			uint32 chunkIndex = handle / globalStateChunkSize;
+			assert(chunkIndex < maxNumGlobalStateChunks && "Too many resources.");
+			if (!globalStateChunks[chunkIndex])
+			{
+				globalStateChunks[chunkIndex] = new global_resource_state[globalStateChunkSize];
+			}
 
-		auto& it = globalResourceState[resource];
-		it.initialize(numSubResources, state);
-		it.setSubresourceState(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, state);
+			++numGlobalStateHandles;
+		}
+
+		globalStateHandles.insert({ resource, handle });
 	}
+
+	// Submissions might be committing to the same entry, if the resource is registered again.
+	std::lock_guard<std::mutex> shardLock(shardMutexes[getShard(handle)]);
+
+	global_resource_state& globalState = getGlobalState(handle);
+	globalState.resource = resource;
+	globalState.initialize(numSubResources, state);
+
+	return handle;
 }
 
 void dx_resource_state_tracker::removeGlobalResourceState(ID3D12Resource* resource)
 {
 	if (resource)
 	{
-		std::lock_guard<std::mutex> lock(globalMutex);
-		globalResourceState.erase(resource);
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		auto it = globalStateHandles.find(resource);
+		if (it != globalStateHandles.end())
+		{
+			getGlobalState(it->second).resource = nullptr;
+			staleGlobalStateHandles.push_back({ it->second, currentFrameNumber });
+			globalStateHandles.erase(it);
+		}
+	}
+}
+
+void dx_resource_state_tracker::beginFrame(uint64 frameNumber)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	currentFrameNumber = frameNumber;
+}
+
+void dx_resource_state_tracker::releaseStaleGlobalResourceStates(uint64 completedFrameNumber)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	while (!staleGlobalStateHandles.empty() && staleGlobalStateHandles.front().frameNumber <= completedFrameNumber)
+	{
+		freeGlobalStateHandles.push_back(staleGlobalStateHandles.front().handle);
+		staleGlobalStateHandles.pop_front();
+	}
+}
+
+uint32 dx_resource_state_tracker::getGlobalResourceHandle(ID3D12Resource* resource, D3D12_RESOURCE_STATES initialState, uint32 numSubResources)
+{
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		auto it = globalStateHandles.find(resource);
+		if (it != globalStateHandles.end())
+		{
+			return it->second;
+		}
+	}
+
+	// Raw resources which were never registered are assumed to be in the common state, with all subresources tracked together.
+	return addGlobalResourceState(resource, initialState, numSubResources);
+}
+
+uint32 dx_resource_state_tracker::getNumGlobalResourceStates()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	return (uint32)globalStateHandles.size();
+}
+
+D3D12_RESOURCE_STATES dx_resource_state_tracker::getLastKnownGlobalState(ID3D12Resource* resource)
+{
+	uint32 handle = getGlobalResourceHandle(resource);
+
+	std::lock_guard<std::mutex> lock(shardMutexes[getShard(handle)]);
+	return getGlobalState(handle).state;
+}
+
+D3D12_RESOURCE_STATES dx_resource_state_tracker::getLastKnownLocalState(ID3D12Resource* resource)
+{
+	if (local_resource_state* localState = findLocalState(getGlobalResourceHandle(resource)))
+	{
+		return localState->state.state;
 	}
+	return getLastKnownGlobalState(resource);
 }
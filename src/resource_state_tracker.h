@@ -1,45 +1,104 @@
 #pragma once
 
 #include "common.h"
+#include "small_vector.h"
+
+#include <deque>
 
 
 class dx_command_list;
+class command_stream;
 struct dx_resource;
+struct dx_buffer;
+
+struct barrier_statistics
+{
+	uint32 numRequestedTransitions;
+	uint32 numEmittedBarriers;		// Including the barriers resolved at submit time.
+	uint32 numElidedTransitions;	// No-ops, including reads which were already covered by a combined read state.
+	uint32 numCombinedReadStates;
+	uint32 numMergedBarriers;		// Back-to-back transitions folded into one, and subresource barriers collapsed into one.
+	uint32 numSplitBarriers;
+};
 
+// Tracks the states of all resources used by one command list, and resolves them against the global states at submit time.
+// Each registered resource gets a compact handle into a dense global state table. The dx_resource and dx_buffer wrappers
+// carry this handle, so transitions on them never hash anything. Raw resource pointers are mapped to their handle through
+// a lookup table, which is only a fallback for resources without a wrapper.
+// The global states are split into shards by handle. A submission only locks the shards its command lists touched, so
+// submissions of unrelated resources (for example on the compute or copy queue) do not wait for each other.
+// Barriers are optimized before they are written to the command stream: read states are combined instead of bouncing
+// between them, no-op transitions are dropped, back-to-back transitions of a resource without work in between are folded
+// into one, and per-subresource barriers which cover the whole resource are collapsed into a single one.
 class dx_resource_state_tracker
 {
 public:
-	void initialize();
+	static const uint32 invalidHandle = (uint32)-1;
+	static const uint32 numGlobalStateShards = 32;
+
+	// Read states are only combined with the states the list type supports, e.g. compute lists never get pixel shader or
+	// depth reads.
+	void initialize(D3D12_COMMAND_LIST_TYPE commandListType = D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+	void resourceBarrier(const D3D12_RESOURCE_BARRIER& barrier);
 
-	void resourceBarrier(const D3D12_RESOURCE_BARRIER& barrier); 
-	
 	void transitionResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, uint32 subResource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
 	void transitionResource(const dx_resource& resource, D3D12_RESOURCE_STATES stateAfter, uint32 subResource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+	void transitionResource(const dx_buffer& buffer, D3D12_RESOURCE_STATES stateAfter, uint32 subResource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+	void transitionResource(uint32 handle, ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, uint32 subResource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+
+	// Starts a split barrier. The transition is finished by the next transitionResource call of this resource, which must
+	// happen before the resource is used. Open split barriers are finished when the list is closed.
+	// Resources which are used for the first time in this list, or whose subresources are in different states, are
+	// transitioned right away.
+	void beginTransition(uint32 handle, ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter);
+	void endSplitBarriers();
 
 	void uavBarrier(const dx_resource* resource = nullptr);
 	void aliasBarrier(const dx_resource* resourceBefore = nullptr, const dx_resource* resourceAfter = nullptr);
 
+	// Resolves the barriers of resources whose state at the start of this list was unknown against the global states.
+	// The shards of this list must be locked.
+	uint32 resolvePendingResourceBarriers(std::vector<D3D12_RESOURCE_BARRIER>& outBarriers);
 	uint32 flushPendingResourceBarriers(ComPtr<ID3D12GraphicsCommandList2> commandList);
-	void flushResourceBarriers(ComPtr<ID3D12GraphicsCommandList2> commandList);
+	void flushResourceBarriers(command_stream& stream);
 	void commitFinalResourceStates();
 	void reset();
 
-	static void lock();
-	static void unlock();
+	// Bit i is set if this list touched a resource in global state shard i.
+	uint32 getShardMask() const { return shardMask; }
 
-	static void addGlobalResourceState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state, uint32 numSubResources);
+	const barrier_statistics& getStatistics() const { return stats; }
+	void resetStatistics() { stats = {}; }
+
+	// Per frame statistics, accumulated over all command lists.
+	static void accumulateFrameStatistics(const barrier_statistics& stats);
+	static barrier_statistics endFrame();
+
+	static bool enableBarrierOptimization;
+
+	// True for states which only allow reads, and can therefore be combined with other read states.
+	static bool isReadOnlyState(D3D12_RESOURCE_STATES state);
+
+	// Shards are always locked in ascending order, so overlapping masks cannot deadlock.
+	static void lockShards(uint32 shardMask);
+	static void unlockShards(uint32 shardMask);
+
+	// Returns the handle of the resource. Registering a resource again re-initializes its state and keeps the handle.
+	static uint32 addGlobalResourceState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state, uint32 numSubResources);
+	// Command lists in flight might still commit to the handle, so it is only reused after
+	// releaseStaleGlobalResourceStates has been called with the current frame number (or a later one).
 	static void removeGlobalResourceState(ID3D12Resource* resource);
+	// Registers the resource with the given state, if it is not known yet.
+	static uint32 getGlobalResourceHandle(ID3D12Resource* resource, D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON, uint32 numSubResources = 1);
+	static uint32 getNumGlobalResourceStates();
 
-	static D3D12_RESOURCE_STATES getLastKnownGlobalState(ID3D12Resource* resource)
-	{
-		std::lock_guard<std::mutex> lock(globalMutex);
-		return globalResourceState[resource].state;
-	}
+	// Same frame numbers as in dx_descriptor_allocator.
+	static void beginFrame(uint64 frameNumber);
+	static void releaseStaleGlobalResourceStates(uint64 completedFrameNumber);
 
-	D3D12_RESOURCE_STATES getLastKnownLocalState(ID3D12Resource* resource)
-	{
-		return finalResourceState[resource].state;
-	}
+	static D3D12_RESOURCE_STATES getLastKnownGlobalState(ID3D12Resource* resource);
+	D3D12_RESOURCE_STATES getLastKnownLocalState(ID3D12Resource* resource);
 
 private:
 	struct resource_state
@@ -47,28 +106,45 @@ private:
 		void initialize(uint32 numSubResources, D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON)
 		{
 			this->state = state;
-			if (numSubResources > 1)
-			{
-				subresourceStates.reserve(numSubResources);
-			}
+			this->numSubResources = numSubResources;
+			subresourceStates.clear();
 		}
 
 		void setSubresourceState(uint32 subresource, D3D12_RESOURCE_STATES state)
 		{
-			if (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES || subresourceStates.capacity() == 0)
+			if (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES || numSubResources <= 1)
 			{
 				this->state = state;
 				subresourceStates.clear();
 			}
 			else
 			{
-				assert(subresource < subresourceStates.capacity());
+				assert(subresource < numSubResources);
 
 				if (subresourceStates.empty())
 				{
-					subresourceStates.resize(subresourceStates.capacity(), this->state);
+					subresourceStates.resize(numSubResources, this->state);
 				}
 				subresourceStates[subresource] = state;
+
+				collapseSubresourceStates();
+			}
+		}
+
+		// Once all subresources are in the same state again, they are tracked together.
+		void collapseSubresourceStates()
+		{
+			for (uint32 i = 1; i < subresourceStates.size(); ++i)
+			{
+				if (subresourceStates[i] != subresourceStates[0])
+				{
+					return;
+				}
+			}
+			if (!subresourceStates.empty())
+			{
+				state = subresourceStates[0];
+				subresourceStates.clear();
 			}
 		}
 
@@ -84,15 +160,105 @@ private:
 		}
 
 		D3D12_RESOURCE_STATES state;
-		std::vector<D3D12_RESOURCE_STATES> subresourceStates;
+		uint32 numSubResources;
+
+		// Only filled while the subresources are in different states. 16 covers a full mip chain of a 32K texture.
+		small_vector<D3D12_RESOURCE_STATES, 16> subresourceStates;
+	};
+
+	struct global_resource_state : resource_state
+	{
+		ID3D12Resource* resource;
+	};
+
+	struct local_resource_state
+	{
+		uint32 handle;
+		resource_state state;
+
+		// Last barrier of this resource in the current batch, if batchEpoch matches the tracker's.
+		uint32 batchBarrierIndex = 0;
+		uint32 batchEpoch = 0;
+
+		// Set once a barrier has changed the state after the first use. Until then, the state at the first use can still be
+		// combined with the global state at submit time.
+		bool transitionedAfterFirstUse = false;
+
+		// Open split barrier.
+		bool splitPending = false;
+		uint32 splitBarrierIndex = 0;
+		uint32 splitEpoch = 0; // Flush epoch of the begin.
+		D3D12_RESOURCE_STATES splitStateBefore = D3D12_RESOURCE_STATE_COMMON;
+	};
+
+	struct pending_barrier
+	{
+		D3D12_RESOURCE_BARRIER barrier;
+		uint32 handle;
 	};
 
+	void trackTransition(uint32 handle, const D3D12_RESOURCE_BARRIER& barrier);
+	void emitTransition(local_resource_state& localState, const D3D12_RESOURCE_BARRIER& barrier, uint32 subresource,
+		D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter);
+	void endSplitBarrier(local_resource_state& localState);
+	void endSplitBarrier(ID3D12Resource* resource);
+	void pushBarrier(const D3D12_RESOURCE_BARRIER& barrier, uint32 handle);
+	uint32 optimizeBarrierBatch();
+
+	local_resource_state& getLocalState(uint32 handle, bool& outFirstUse);
+	local_resource_state* findLocalState(uint32 handle);
+
+	D3D12_RESOURCE_STATES getOptimizedState(D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES requestedState) const;
+
+	static global_resource_state& getGlobalState(uint32 handle);
+	static uint32 getShard(uint32 handle) { return handle % numGlobalStateShards; }
+
 	std::vector<D3D12_RESOURCE_BARRIER> resourceBarriers;
-	std::vector<D3D12_RESOURCE_BARRIER> pendingResourceBarriers;
+	std::vector<uint32> resourceBarrierHandles; // Parallel to resourceBarriers. Invalid for non-transition barriers.
+	std::vector<pending_barrier> pendingResourceBarriers;
+	std::vector<D3D12_RESOURCE_BARRIER> resolvedPendingBarriers;
+
+	// Indexed by handle. 0 means the resource has not been used in this list yet, otherwise this is an index + 1 into localStates.
+	std::vector<uint32> localStateIndices;
+	std::vector<local_resource_state> localStates;
+	uint32 shardMask = 0;
+
+	// Read states which may be combined on this list type.
+	D3D12_RESOURCE_STATES combinableReadStates = D3D12_RESOURCE_STATE_COMMON;
 
-	std::unordered_map<ID3D12Resource*, resource_state> finalResourceState;
+	// Incremented whenever the recorded barriers are flushed (i.e. before GPU work) or a non-transition barrier is recorded.
+	// Transitions recorded within the same epoch can be folded together.
+	uint32 batchEpoch = 1;
+	// Only incremented by flushes. The begin and end of a split barrier must not land in the same flushed batch, even if a
+	// UAV or aliasing barrier was recorded in between.
+	uint32 flushEpoch = 1;
+	std::vector<uint32> splitHandles;
 
-	static std::unordered_map<ID3D12Resource*, resource_state> globalResourceState;
-	static std::mutex globalMutex;
-	static bool isLocked;
+	barrier_statistics stats = {};
+
+	static std::atomic_uint32_t frameRequestedTransitions;
+	static std::atomic_uint32_t frameEmittedBarriers;
+	static std::atomic_uint32_t frameElidedTransitions;
+	static std::atomic_uint32_t frameCombinedReadStates;
+	static std::atomic_uint32_t frameMergedBarriers;
+	static std::atomic_uint32_t frameSplitBarriers;
+
+	// The global table grows in fixed size chunks, so that entries never move and can be read without taking the registry lock.
+	static const uint32 globalStateChunkSize = 1024;
+	static const uint32 maxNumGlobalStateChunks = 256;
+
+	static global_resource_state* globalStateChunks[maxNumGlobalStateChunks];
+	static uint32 numGlobalStateHandles;
+	static std::vector<uint32> freeGlobalStateHandles;
+
+	struct stale_handle
+	{
+		uint32 handle;
+		uint64 frameNumber;
+	};
+	static std::deque<stale_handle> staleGlobalStateHandles;
+	static uint64 currentFrameNumber;
+	static std::unordered_map<ID3D12Resource*, uint32> globalStateHandles;
+	static std::mutex registryMutex;
+	static std::mutex shardMutexes[numGlobalStateShards];
 };
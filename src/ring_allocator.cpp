@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "ring_allocator.h"
+
+
+void ring_allocator::initialize(uint64 capacity)
+{
+	this->capacity = capacity;
+	head = 0;
+	tail = 0;
+	usedSize = 0;
+	firstBlockID = 0;
+	blocks.clear();
+}
+
+bool ring_allocator::allocateBlock(uint64 size, uint64& outBlockID, uint64& outOffset)
+{
+	if (size == 0 || size > capacity)
+	{
+		return false;
+	}
+
+	if (usedSize == 0)
+	{
+		head = 0;
+		tail = 0;
+	}
+
+	uint64 offset;
+	uint64 padding = 0;
+
+	if (head >= tail && usedSize < capacity)
+	{
+		// Free space is [head, capacity) and [0, tail).
+		if (capacity - head >= size)
+		{
+			offset = head;
+		}
+		else if (tail >= size)
+		{
+			// Skip the rest of the ring. The skipped range is freed together with this block.
+			padding = capacity - head;
+			offset = 0;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// Free space is [head, tail).
+		if (tail - head >= size)
+		{
+			offset = head;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	if (padding > 0)
+	{
+		// Attach the padding to the previous block, so that it is freed in order. If there is no previous block, the ring
+		// is empty and we just start over at 0.
+		if (!blocks.empty())
+		{
+			blocks.back().size += padding;
+			usedSize += padding;
+		}
+		else
+		{
+			tail = 0;
+		}
+	}
+
+	block b;
+	b.offset = offset;
+	b.size = size;
+	b.fenceValue = 0;
+	b.submitted = false;
+	blocks.push_back(b);
+
+	head = offset + size;
+	if (head == capacity)
+	{
+		head = 0;
+	}
+	usedSize += size;
+
+	outBlockID = firstBlockID + blocks.size() - 1;
+	outOffset = offset;
+
+	return true;
+}
+
+void ring_allocator::submitBlock(uint64 blockID, uint64 fenceValue)
+{
+	assert(blockID >= firstBlockID && blockID < firstBlockID + blocks.size());
+
+	block& b = blocks[blockID - firstBlockID];
+	assert(!b.submitted);
+	b.fenceValue = fenceValue;
+	b.submitted = true;
+}
+
+void ring_allocator::retire(uint64 completedFenceValue)
+{
+	while (!blocks.empty() && blocks.front().submitted && blocks.front().fenceValue <= completedFenceValue)
+	{
+		const block& b = blocks.front();
+		usedSize -= b.size;
+		tail = b.offset + b.size;
+		if (tail >= capacity)
+		{
+			tail -= capacity;
+		}
+
+		blocks.pop_front();
+		++firstBlockID;
+	}
+
+	if (blocks.empty())
+	{
+		assert(usedSize == 0);
+		head = 0;
+		tail = 0;
+	}
+}
+
+bool ring_allocator::getOldestSubmittedFenceValue(uint64& outFenceValue) const
+{
+	if (blocks.empty() || !blocks.front().submitted)
+	{
+		return false;
+	}
+
+	outFenceValue = blocks.front().fenceValue;
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+
+#include <deque>
+
+// Fence-tracked ring allocator. This only manages offsets; it does not own any memory.
+// Space is handed out in blocks. A block is owned by whoever allocated it until it is submitted with the fence value of the
+// submission which used it. The blocks are retired in allocation order, as soon as the submission's fence value has completed.
+// Since fence values are passed in from the outside, the allocator works with any monotonically increasing counter.
+class ring_allocator
+{
+public:
+	void initialize(uint64 capacity);
+
+	// Returns false if there is no contiguous range of the requested size available right now.
+	bool allocateBlock(uint64 size, uint64& outBlockID, uint64& outOffset);
+	void submitBlock(uint64 blockID, uint64 fenceValue);
+
+	// Frees all blocks at the front of the ring, which were submitted with a fence value <= completedFenceValue.
+	void retire(uint64 completedFenceValue);
+
+	// Returns true if the oldest block has been submitted, i.e. waiting for its fence value will eventually free up space.
+	// Returns false if the ring is empty or the oldest block is still being recorded into.
+	bool getOldestSubmittedFenceValue(uint64& outFenceValue) const;
+
+	uint64 getCapacity() const { return capacity; }
+	uint64 getUsedSize() const { return usedSize; }
+	uint32 getNumBlocks() const { return (uint32)blocks.size(); }
+
+private:
+	struct block
+	{
+		uint64 offset;
+		uint64 size; // Includes padding at the end of the ring, if the block wrapped around.
+		uint64 fenceValue;
+		bool submitted;
+	};
+
+	std::deque<block> blocks;
+	uint64 firstBlockID = 0; // ID of blocks.front().
+
+	uint64 capacity = 0;
+	uint64 head = 0; // Next free offset.
+	uint64 tail = 0; // Offset of the oldest live block.
+	uint64 usedSize = 0;
+};
@@ -0,0 +1,217 @@
+#include "pch.h"
+#include "tests.h"
+#include "ring_allocator.h"
+
+#include <random>
+
+
+// Stands in for an ID3D12Fence and its queue. Every submission signals the next value, and the "GPU" completes them
+// whenever the test says so.
+struct fake_fence
+{
+	uint64 signal() { return ++lastSignaledValue; }
+	void completeUpTo(uint64 fenceValue) { completedValue = max(completedValue, min(fenceValue, lastSignaledValue)); }
+	void completeAll() { completedValue = lastSignaledValue; }
+
+	uint64 lastSignaledValue = 0;
+	uint64 completedValue = 0;
+};
+
+static void testRetireInSubmissionOrder()
+{
+	ring_allocator ring;
+	ring.initialize(1024);
+	fake_fence fence;
+
+	uint64 ids[3], offsets[3];
+	for (uint32 i = 0; i < 3; ++i)
+	{
+		CHECK(ring.allocateBlock(256, ids[i], offsets[i]));
+		CHECK(offsets[i] == i * 256);
+		CHECK(i == 0 || ids[i] == ids[i - 1] + 1);
+	}
+
+	uint64 fenceValues[3];
+	for (uint32 i = 0; i < 3; ++i)
+	{
+		fenceValues[i] = fence.signal();
+		ring.submitBlock(ids[i], fenceValues[i]);
+	}
+
+	uint64 oldest;
+	CHECK(ring.getOldestSubmittedFenceValue(oldest) && oldest == fenceValues[0]);
+
+	// Nothing is freed before the GPU has caught up.
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 768);
+
+	fence.completeUpTo(fenceValues[1]);
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 256);
+	CHECK(ring.getNumBlocks() == 1);
+	CHECK(ring.getOldestSubmittedFenceValue(oldest) && oldest == fenceValues[2]);
+
+	fence.completeAll();
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 0);
+	CHECK(!ring.getOldestSubmittedFenceValue(oldest));
+}
+
+static void testBlocksInRecordingAreNotRetired()
+{
+	ring_allocator ring;
+	ring.initialize(1024);
+	fake_fence fence;
+
+	uint64 recordingID, submittedID, offset;
+	CHECK(ring.allocateBlock(512, recordingID, offset));
+	CHECK(ring.allocateBlock(512, submittedID, offset));
+	ring.submitBlock(submittedID, fence.signal());
+	fence.completeAll();
+
+	// The younger block's fence has passed, but blocks are only freed in order.
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 1024);
+
+	// Waiting would not help, since the oldest block has not been submitted yet.
+	uint64 oldest;
+	CHECK(!ring.getOldestSubmittedFenceValue(oldest));
+	CHECK(!ring.allocateBlock(256, recordingID, offset));
+
+	ring.submitBlock(recordingID, fence.signal());
+	fence.completeAll();
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 0);
+}
+
+static void testWrapAround()
+{
+	ring_allocator ring;
+	ring.initialize(1024);
+	fake_fence fence;
+
+	uint64 first, second, third, offset;
+	CHECK(ring.allocateBlock(400, first, offset) && offset == 0);
+	CHECK(ring.allocateBlock(400, second, offset) && offset == 400);
+	ring.submitBlock(first, fence.signal());
+	ring.submitBlock(second, fence.signal());
+
+	// 224 bytes are left at the end, 400 at the start once the first block is retired.
+	CHECK(!ring.allocateBlock(400, third, offset));
+	fence.completeUpTo(1);
+	ring.retire(fence.completedValue);
+
+	CHECK(ring.allocateBlock(400, third, offset) && offset == 0);
+
+	// The skipped end of the ring belongs to the second block and is freed with it.
+	CHECK(ring.getUsedSize() == 400 + 224 + 400);
+	ring.submitBlock(third, fence.signal());
+
+	fence.completeUpTo(2);
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 400);
+	CHECK(ring.getNumBlocks() == 1);
+
+	CHECK(ring.allocateBlock(624, first, offset) && offset == 400);
+	CHECK(ring.getUsedSize() == 1024);
+	CHECK(!ring.allocateBlock(256, second, offset));
+}
+
+static void testRejectsInvalidSizes()
+{
+	ring_allocator ring;
+	ring.initialize(1024);
+
+	uint64 id, offset;
+	CHECK(!ring.allocateBlock(0, id, offset));
+	CHECK(!ring.allocateBlock(1025, id, offset));
+	CHECK(ring.allocateBlock(1024, id, offset) && offset == 0);
+	CHECK(ring.getUsedSize() == 1024);
+}
+
+// Random block sizes over many frames, with the GPU two frames behind. Live blocks must never overlap, and everything must
+// be freed once the GPU has finished.
+static void testFramesInFlight()
+{
+	const uint64 capacity = MB(1);
+	const uint32 numFramesInFlight = 2;
+
+	ring_allocator ring;
+	ring.initialize(capacity);
+	fake_fence fence;
+
+	struct live_block
+	{
+		uint64 offset;
+		uint64 size;
+		uint64 fenceValue;
+	};
+	std::vector<live_block> live;
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<uint32> sizeDistribution(1, 64);
+
+	uint32 numAllocations = 0;
+	uint32 numFailedAllocations = 0;
+	for (uint32 frame = 0; frame < 1000; ++frame)
+	{
+		fence.completeUpTo(fence.lastSignaledValue > numFramesInFlight ? fence.lastSignaledValue - numFramesInFlight : 0);
+		ring.retire(fence.completedValue);
+		live.erase(std::remove_if(live.begin(), live.end(), [&](const live_block& b) { return b.fenceValue <= fence.completedValue; }), live.end());
+
+		std::vector<uint64> frameBlocks;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			uint64 size = sizeDistribution(rng) * 256ull;
+			uint64 id, offset;
+			if (!ring.allocateBlock(size, id, offset))
+			{
+				++numFailedAllocations;
+				continue;
+			}
+			++numAllocations;
+
+			CHECK(offset + size <= capacity);
+			for (const live_block& b : live)
+			{
+				CHECK(offset + size <= b.offset || b.offset + b.size <= offset);
+			}
+
+			frameBlocks.push_back(id);
+			live.push_back({ offset, size, UINT64_MAX });
+		}
+
+		uint64 fenceValue = fence.signal();
+		for (uint64 id : frameBlocks)
+		{
+			ring.submitBlock(id, fenceValue);
+		}
+		for (live_block& b : live)
+		{
+			b.fenceValue = min(b.fenceValue, fenceValue);
+		}
+
+		CHECK(ring.getUsedSize() <= capacity);
+	}
+
+	// Three frames of 16 blocks of at most 16KB always fit. Failures would mean that retired space is not reused.
+	CHECK(numFailedAllocations == 0);
+	CHECK(numAllocations == 16000);
+
+	fence.completeAll();
+	ring.retire(fence.completedValue);
+	CHECK(ring.getUsedSize() == 0);
+	CHECK(ring.getNumBlocks() == 0);
+}
+
+std::vector<unit_test> getRingAllocatorTests()
+{
+	return
+	{
+		{ "ring_allocator/retire_in_submission_order", testRetireInSubmissionOrder },
+		{ "ring_allocator/blocks_in_recording_are_not_retired", testBlocksInRecordingAreNotRetired },
+		{ "ring_allocator/wrap_around", testWrapAround },
+		{ "ring_allocator/rejects_invalid_sizes", testRejectsInvalidSizes },
+		{ "ring_allocator/frames_in_flight", testFramesInFlight },
+	};
+}
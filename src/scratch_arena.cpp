@@ -0,0 +1,105 @@
+#include "pch.h"
+#include "scratch_arena.h"
+
+#define SCRATCH_ARENA_MIN_BLOCK_SIZE KB(256)
+
+
+static thread_local scratch_arena threadScratchArena;
+
+scratch_arena& getThreadScratchArena()
+{
+	return threadScratchArena;
+}
+
+scratch_arena::~scratch_arena()
+{
+	for (block& b : blocks)
+	{
+		delete[] b.memory;
+	}
+}
+
+void* scratch_arena::allocate(uint64 size, uint64 alignment)
+{
+	++numAllocations;
+	allocatedBytes += size;
+
+	for (; currentBlock < (uint32)blocks.size(); ++currentBlock, currentOffset = 0)
+	{
+		block& b = blocks[currentBlock];
+		uint8* result = (uint8*)alignTo(b.memory + currentOffset, alignment);
+		if (result + size <= b.memory + b.size)
+		{
+			currentOffset = (result + size) - b.memory;
+			return result;
+		}
+	}
+
+	// None of the blocks has room. The new one is at least as large as all others together, so the arena doubles.
+	uint64 capacity = 0;
+	for (block& b : blocks)
+	{
+		capacity += b.size;
+	}
+
+	block newBlock;
+	newBlock.size = max(max(capacity, (uint64)SCRATCH_ARENA_MIN_BLOCK_SIZE), size + alignment);
+	newBlock.memory = new uint8[newBlock.size];
+	blocks.push_back(newBlock);
+
+	currentBlock = (uint32)blocks.size() - 1;
+	uint8* result = (uint8*)alignTo(newBlock.memory, alignment);
+	currentOffset = (result + size) - newBlock.memory;
+	return result;
+}
+
+void scratch_arena::free(void* memory, uint64 size)
+{
+	if (currentBlock < (uint32)blocks.size())
+	{
+		uint8* blockMemory = blocks[currentBlock].memory;
+		if ((uint8*)memory + size == blockMemory + currentOffset)
+		{
+			currentOffset = (uint8*)memory - blockMemory;
+		}
+	}
+}
+
+void scratch_arena::resetToMarker(scratch_arena_marker marker)
+{
+	assert(marker.block < currentBlock || (marker.block == currentBlock && marker.offset <= currentOffset));
+
+	currentBlock = marker.block;
+	currentOffset = marker.offset;
+}
+
+void scratch_arena::reset()
+{
+	lastFrameStatistics.numAllocations = numAllocations;
+	lastFrameStatistics.allocatedBytes = allocatedBytes;
+	lastFrameStatistics.numBlocks = (uint32)blocks.size();
+	lastFrameStatistics.capacity = 0;
+	for (block& b : blocks)
+	{
+		lastFrameStatistics.capacity += b.size;
+	}
+
+	if (blocks.size() > 1)
+	{
+		for (block& b : blocks)
+		{
+			delete[] b.memory;
+		}
+		blocks.clear();
+
+		block merged;
+		merged.size = lastFrameStatistics.capacity;
+		merged.memory = new uint8[merged.size];
+		blocks.push_back(merged);
+	}
+
+	currentBlock = 0;
+	currentOffset = 0;
+	numAllocations = 0;
+	allocatedBytes = 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.h"
+
+// Linear allocator for transient CPU memory. Every thread has its own arena, which hands out memory by bumping an offset and
+// gives it all back at once when the thread resets it at its frame boundary (the main loop does so at the start of every
+// frame). Nothing allocated here may be kept beyond that. Freeing single allocations is optional and only gives memory back
+// if it was the latest allocation.
+//
+// If a frame needs more than the arena holds, a new block is allocated from the heap. All blocks are merged into one at the
+// next reset, so after a few frames the arena does not touch the heap anymore.
+struct scratch_arena_statistics
+{
+	uint32 numAllocations;			// Since the previous reset.
+	uint64 allocatedBytes;
+	uint64 capacity;
+	uint32 numBlocks;				// More than one means that the arena grew during the frame.
+};
+
+struct scratch_arena_marker
+{
+	uint32 block;
+	uint64 offset;
+};
+
+class scratch_arena
+{
+public:
+	scratch_arena() {}
+	scratch_arena(const scratch_arena&) = delete;
+	~scratch_arena();
+
+	void* allocate(uint64 size, uint64 alignment = 16);
+	void free(void* memory, uint64 size);
+
+	// Invalidates everything allocated from this arena.
+	void reset();
+
+	// Allocations made after getMarker are given back by resetToMarker. Markers must be reset in reverse order.
+	scratch_arena_marker getMarker() const { return { currentBlock, currentOffset }; }
+	void resetToMarker(scratch_arena_marker marker);
+
+	const scratch_arena_statistics& getLastFrameStatistics() const { return lastFrameStatistics; }
+
+private:
+	struct block
+	{
+		uint8* memory;
+		uint64 size;
+	};
+
+	std::vector<block> blocks;
+	uint32 currentBlock = 0;
+	uint64 currentOffset = 0;
+
+	uint32 numAllocations = 0;
+	uint64 allocatedBytes = 0;
+	scratch_arena_statistics lastFrameStatistics = {};
+};
+
+scratch_arena& getThreadScratchArena();
+
+// Gives back everything allocated from the thread's arena within the scope.
+struct scratch_arena_scope
+{
+	scratch_arena_scope() : arena(getThreadScratchArena()), marker(arena.getMarker()) {}
+	~scratch_arena_scope() { arena.resetToMarker(marker); }
+
+	scratch_arena& arena;
+	scratch_arena_marker marker;
+};
+
+#define SCRATCH_SCOPE() scratch_arena_scope COMPOSITE_VARNAME(SCRATCH_SCOPE, __LINE__)
+
+
+// Standard allocator interface, so that containers can live in an arena. By default that is the arena of the constructing
+// thread. Containers must not outlive the reset of their arena.
+template <typename T>
+struct scratch_allocator
+{
+	typedef T value_type;
+
+	scratch_allocator() : arena(&getThreadScratchArena()) {}
+	scratch_allocator(scratch_arena& arena) : arena(&arena) {}
+
+	template <typename U>
+	scratch_allocator(const scratch_allocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) { return (T*)arena->allocate(n * sizeof(T), alignof(T)); }
+	void deallocate(T* p, size_t n) { arena->free(p, n * sizeof(T)); }
+
+	template <typename U>
+	bool operator==(const scratch_allocator<U>& other) const { return arena == other.arena; }
+	template <typename U>
+	bool operator!=(const scratch_allocator<U>& other) const { return arena != other.arena; }
+
+	scratch_arena* arena;
+};
+
+template <typename T>
+using scratch_vector = std::vector<T, scratch_allocator<T>>;
@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "shader_store.h"
+#include "error.h"
+#include "profiling.h"
+
+
+std::unordered_map<std::wstring, dx_shader_store::mapped_shader> dx_shader_store::shaders;
+uint32 dx_shader_store::numRequests = 0;
+std::mutex dx_shader_store::mutex;
+
+D3D12_SHADER_BYTECODE dx_shader_store::load(const wchar_t* path)
+{
+	PROFILE_FUNCTION();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	++numRequests;
+
+	auto it = shaders.find(path);
+	if (it == shaders.end())
+	{
+		mapped_shader shader;
+
+		shader.file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (shader.file == INVALID_HANDLE_VALUE)
+		{
+			checkResult(HRESULT_FROM_WIN32(GetLastError()));
+		}
+
+		LARGE_INTEGER size;
+		GetFileSizeEx(shader.file, &size);
+		shader.size = size.QuadPart;
+
+		shader.mapping = CreateFileMappingW(shader.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!shader.mapping)
+		{
+			HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+			CloseHandle(shader.file);
+			checkResult(hr);
+		}
+
+		shader.data = MapViewOfFile(shader.mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!shader.data)
+		{
+			HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+			CloseHandle(shader.mapping);
+			CloseHandle(shader.file);
+			checkResult(hr);
+		}
+
+		it = shaders.emplace(path, shader).first;
+	}
+
+	return { it->second.data, (SIZE_T)it->second.size };
+}
+
+void dx_shader_store::shutdown()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& [path, shader] : shaders)
+	{
+		UnmapViewOfFile(shader.data);
+		CloseHandle(shader.mapping);
+		CloseHandle(shader.file);
+	}
+	shaders.clear();
+}
+
+shader_store_statistics dx_shader_store::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	shader_store_statistics result = {};
+	result.numShaders = (uint32)shaders.size();
+	result.numRequests = numRequests;
+	for (auto& [path, shader] : shaders)
+	{
+		result.bytesMapped += shader.size;
+	}
+	return result;
+}
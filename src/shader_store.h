@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+
+struct shader_store_statistics
+{
+	uint32 numShaders;		// Distinct files.
+	uint32 numRequests;		// Including the ones which hit an already loaded file.
+	uint64 bytesMapped;
+};
+
+// Compiled shaders (.cso) are memory mapped once and shared by everyone who asks for the same path. The returned
+// bytecode stays valid until shutdown, so it can be referenced by pipeline descriptions which are built later on another
+// thread. Thread safe.
+class dx_shader_store
+{
+public:
+	static D3D12_SHADER_BYTECODE load(const wchar_t* path);
+
+	static void shutdown();
+
+	static shader_store_statistics getStatistics();
+
+private:
+	struct mapped_shader
+	{
+		HANDLE file;
+		HANDLE mapping;
+		const void* data;
+		uint64 size;
+	};
+
+	static std::unordered_map<std::wstring, mapped_shader> shaders;
+	static uint32 numRequests;
+	static std::mutex mutex;
+};
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "tests.h"
+#include "shader_store.h"
+
+#include <cstring>
+
+
+// Works on real files in the temp directory, since the store maps them. The store is global, so these tests shut it down,
+// and must not run while the renderer has shaders loaded.
+
+static fs::path writeTestShader(const char* name, const char* contents)
+{
+	fs::path path = fs::temp_directory_path() / name;
+	FILE* file = fopen(path.string().c_str(), "wb");
+	CHECK(file);
+	if (file)
+	{
+		fwrite(contents, 1, strlen(contents), file);
+		fclose(file);
+	}
+	return path;
+}
+
+static bool hasContents(D3D12_SHADER_BYTECODE bytecode, const char* contents)
+{
+	return bytecode.BytecodeLength == strlen(contents) && memcmp(bytecode.pShaderBytecode, contents, bytecode.BytecodeLength) == 0;
+}
+
+static void testHitsAndMisses()
+{
+	dx_shader_store::shutdown();
+
+	fs::path pathA = writeTestShader("shader_store_test_a.cso", "first shader");
+	fs::path pathB = writeTestShader("shader_store_test_b.cso", "second, longer shader");
+	shader_store_statistics before = dx_shader_store::getStatistics();
+
+	// A miss maps the file, a hit returns the same mapping.
+	D3D12_SHADER_BYTECODE a0 = dx_shader_store::load(pathA.wstring().c_str());
+	D3D12_SHADER_BYTECODE b = dx_shader_store::load(pathB.wstring().c_str());
+	D3D12_SHADER_BYTECODE a1 = dx_shader_store::load(pathA.wstring().c_str());
+
+	CHECK(hasContents(a0, "first shader"));
+	CHECK(hasContents(b, "second, longer shader"));
+	CHECK(a1.pShaderBytecode == a0.pShaderBytecode && a1.BytecodeLength == a0.BytecodeLength);
+
+	shader_store_statistics after = dx_shader_store::getStatistics();
+	CHECK(after.numShaders == before.numShaders + 2);
+	CHECK(after.numRequests == before.numRequests + 3);
+	CHECK(after.bytesMapped == before.bytesMapped + strlen("first shader") + strlen("second, longer shader"));
+
+	// Missing files throw and are not cached, so a later attempt tries again.
+	fs::path missing = fs::temp_directory_path() / "shader_store_test_missing.cso";
+	fs::remove(missing);
+	bool threw = false;
+	try
+	{
+		dx_shader_store::load(missing.wstring().c_str());
+	}
+	catch (const std::exception&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	CHECK(dx_shader_store::getStatistics().numShaders == after.numShaders);
+
+	dx_shader_store::shutdown();
+	CHECK(dx_shader_store::getStatistics().numShaders == 0);
+
+	fs::remove(pathA);
+	fs::remove(pathB);
+}
+
+static void testReloadAfterShutdown()
+{
+	dx_shader_store::shutdown();
+
+	fs::path path = writeTestShader("shader_store_test_reload.cso", "old bytecode");
+	CHECK(hasContents(dx_shader_store::load(path.wstring().c_str()), "old bytecode"));
+
+	// The file is mapped, so it can only be replaced after shutdown. The next load maps the new contents.
+	dx_shader_store::shutdown();
+	writeTestShader("shader_store_test_reload.cso", "new, recompiled bytecode");
+	CHECK(hasContents(dx_shader_store::load(path.wstring().c_str()), "new, recompiled bytecode"));
+	CHECK(dx_shader_store::getStatistics().numShaders == 1);
+
+	dx_shader_store::shutdown();
+	fs::remove(path);
+}
+
+std::vector<unit_test> getShaderStoreTests()
+{
+	return
+	{
+		{ "shader_store/hits_and_misses", testHitsAndMisses },
+		{ "shader_store/reload_after_shutdown", testReloadAfterShutdown },
+	};
+}
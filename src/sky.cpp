@@ -3,17 +3,17 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <pix3.h>
 
 void sky_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* commandList, const dx_render_target& renderTarget)
 {
-	ComPtr<ID3DBlob> vertexShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/sky_vs.cso", &vertexShaderBlob));
-	ComPtr<ID3DBlob> pixelShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/sky_ps.cso", &pixelShaderBlob));
+	D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/sky_vs.cso");
+	D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/sky_ps.cso");
 
-	D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+	static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 
@@ -57,19 +57,15 @@ void sky_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* com
 	pipelineStateStream.rootSignature = rootSignature.rootSignature.Get();
 	pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 	pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-	pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+	pipelineStateStream.vs = vertexShader;
+	pipelineStateStream.ps = pixelShader;
 	pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 	pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 	pipelineStateStream.rasterizer = defaultRasterizerDesc;
 
-	D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-		sizeof(pipeline_state_stream), &pipelineStateStream
-	};
-	checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&pipelineState)));
+	dx_pipeline_factory::createPipelineState(pipelineStateStream, pipelineState, L"Sky Pipeline");
 
 	SET_NAME(rootSignature.rootSignature, "Sky Root Signature");
-	SET_NAME(pipelineState, "Sky Pipeline");
 
 
 	cpu_triangle_mesh<vertex_3P> skybox;
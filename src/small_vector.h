@@ -0,0 +1,151 @@
+#pragma once
+
+#include "common.h"
+
+#include <type_traits>
+#include <cstring>
+
+// Vector which stores up to numInlineElements in place and only goes to the heap when it grows beyond that.
+// Restricted to trivially copyable types, so elements are moved around with memcpy.
+template <typename T, uint32 numInlineElements>
+class small_vector
+{
+	static_assert(std::is_trivially_copyable<T>::value, "small_vector only supports trivially copyable types.");
+
+public:
+	small_vector() {}
+	small_vector(const small_vector& other);
+	small_vector(small_vector&& other);
+	~small_vector();
+
+	small_vector& operator=(const small_vector& other);
+	small_vector& operator=(small_vector&& other);
+
+	void resize(uint32 newSize, const T& value = T());
+	void push_back(const T& value);
+
+	// Keeps the heap memory, if any.
+	void clear() { count = 0; }
+
+	uint32 size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T* data() { return elements; }
+	const T* data() const { return elements; }
+
+	T& operator[](uint32 index) { assert(index < count); return elements[index]; }
+	const T& operator[](uint32 index) const { assert(index < count); return elements[index]; }
+
+	T* begin() { return elements; }
+	T* end() { return elements + count; }
+	const T* begin() const { return elements; }
+	const T* end() const { return elements + count; }
+
+private:
+	void reserve(uint32 newCapacity);
+	bool isInline() const { return elements == inlineElements; }
+
+	T* elements = inlineElements;
+	uint32 count = 0;
+	uint32 capacity = numInlineElements;
+
+	T inlineElements[numInlineElements];
+};
+
+template <typename T, uint32 numInlineElements>
+small_vector<T, numInlineElements>::small_vector(const small_vector& other)
+{
+	*this = other;
+}
+
+template <typename T, uint32 numInlineElements>
+small_vector<T, numInlineElements>::small_vector(small_vector&& other)
+{
+	*this = std::move(other);
+}
+
+template <typename T, uint32 numInlineElements>
+small_vector<T, numInlineElements>::~small_vector()
+{
+	if (!isInline())
+	{
+		delete[] elements;
+	}
+}
+
+template <typename T, uint32 numInlineElements>
+small_vector<T, numInlineElements>& small_vector<T, numInlineElements>::operator=(const small_vector& other)
+{
+	if (this != &other)
+	{
+		reserve(other.count);
+		memcpy(elements, other.elements, sizeof(T) * other.count);
+		count = other.count;
+	}
+	return *this;
+}
+
+template <typename T, uint32 numInlineElements>
+small_vector<T, numInlineElements>& small_vector<T, numInlineElements>::operator=(small_vector&& other)
+{
+	if (this != &other)
+	{
+		if (other.isInline())
+		{
+			*this = (const small_vector&)other;
+		}
+		else
+		{
+			// Steal the heap memory.
+			if (!isInline())
+			{
+				delete[] elements;
+			}
+			elements = other.elements;
+			capacity = other.capacity;
+			count = other.count;
+
+			other.elements = other.inlineElements;
+			other.capacity = numInlineElements;
+		}
+		other.count = 0;
+	}
+	return *this;
+}
+
+template <typename T, uint32 numInlineElements>
+void small_vector<T, numInlineElements>::reserve(uint32 newCapacity)
+{
+	if (newCapacity > capacity)
+	{
+		newCapacity = max(newCapacity, capacity * 2);
+
+		T* newElements = new T[newCapacity];
+		memcpy(newElements, elements, sizeof(T) * count);
+
+		if (!isInline())
+		{
+			delete[] elements;
+		}
+		elements = newElements;
+		capacity = newCapacity;
+	}
+}
+
+template <typename T, uint32 numInlineElements>
+void small_vector<T, numInlineElements>::resize(uint32 newSize, const T& value)
+{
+	reserve(newSize);
+	for (uint32 i = count; i < newSize; ++i)
+	{
+		elements[i] = value;
+	}
+	count = newSize;
+}
+
+template <typename T, uint32 numInlineElements>
+void small_vector<T, numInlineElements>::push_back(const T& value)
+{
+	reserve(count + 1);
+	elements[count++] = value;
+}
@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "tests.h"
+
+// Entry point of the headless test executable. This does not create a window or a device.
+//
+// Usage: tests [--filter <substring>] [--list]
+//
+// Runs every selected test and prints the failed checks. The exit code is the number of failed tests, so 0 means success.
+//
+// On Windows, build the Tests project in the solution. Tests which need the D3D12 headers (e.g. of the frame graph) are part
+// of the renderer instead, see 'renderer --run-tests'. On Linux, DirectXMath (github.com/microsoft/DirectXMath) and the
+// sal.h stub from DirectX-Headers (include/wsl/stubs) have to be on the include path. From the repository root (one line):
+//   g++ -std=c++17 -O1 -I <DirectXMath>/Inc -I <DirectX-Headers>/include/wsl/stubs -o tests
+//     src/test_main.cpp src/tests.cpp src/bindless_slot_allocator_tests.cpp src/bindless_slot_allocator.cpp
+//     src/command_stream_tests.cpp src/command_stream.cpp
+//     src/free_list_allocator_tests.cpp src/free_list_allocator.cpp src/ring_allocator_tests.cpp src/ring_allocator.cpp
+//     src/tlsf_allocator_tests.cpp src/tlsf_allocator.cpp -pthread
+// Do not add src to the include path, or src/math.h shadows the system's math.h. Tests rely on assert, so do not define NDEBUG.
+
+#include <cstring>
+
+
+int main(int argc, char** argv)
+{
+	const char* filter = nullptr;
+	bool listOnly = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "--list") == 0)
+		{
+			listOnly = true;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--filter <substring>] [--list]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	std::vector<unit_test> tests;
+	append(tests, getBindlessSlotAllocatorTests());
+	append(tests, getCommandStreamTests());
+	append(tests, getFreeListAllocatorTests());
+	append(tests, getRingAllocatorTests());
+	append(tests, getTLSFAllocatorTests());
+
+	return runUnitTests(tests, filter, listOnly);
+}
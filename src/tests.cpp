@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "tests.h"
+
+#include <cstring>
+
+
+static uint32 numFailedChecks;
+
+void reportCheckFailure(const char* expression, const char* file, int line)
+{
+	fprintf(stderr, "\n  %s(%d): CHECK(%s) failed", file, line, expression);
+	++numFailedChecks;
+}
+
+int runUnitTests(const std::vector<unit_test>& tests, const char* filter, bool listOnly)
+{
+	uint32 numRun = 0;
+	uint32 numFailed = 0;
+	for (const unit_test& test : tests)
+	{
+		if (filter && !strstr(test.name, filter))
+		{
+			continue;
+		}
+
+		if (listOnly)
+		{
+			printf("%s\n", test.name);
+			continue;
+		}
+
+		fprintf(stderr, "%s", test.name);
+
+		uint32 failedChecksBefore = numFailedChecks;
+		test.run();
+		++numRun;
+
+		if (numFailedChecks != failedChecksBefore)
+		{
+			++numFailed;
+			fprintf(stderr, "\n%s: FAILED\n", test.name);
+		}
+		else
+		{
+			fprintf(stderr, ": ok\n");
+		}
+	}
+
+	if (!listOnly)
+	{
+		fprintf(stderr, "%u of %u tests passed.\n", numRun - numFailed, numRun);
+	}
+
+	return (int)numFailed;
+}
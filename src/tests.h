@@ -0,0 +1,34 @@
+#pragma once
+
+#include "common.h"
+
+#include <functional>
+
+// Unit tests of the renderer's CPU-side building blocks. They run in the headless test executable (test_main.cpp), which
+// does not create a device and also builds on Linux. Everything which would talk to D3D12 is replaced by a fake, e.g. fence
+// values are just counters.
+
+struct unit_test
+{
+	const char* name;				// Unique. The group comes first, e.g. "ring_allocator/wrap_around".
+	std::function<void()> run;
+};
+
+// A failed check is reported and the test keeps running, so that one run shows all failures.
+void reportCheckFailure(const char* expression, const char* file, int line);
+
+#define CHECK(expression) do { if (!(expression)) { reportCheckFailure(#expression, __FILE__, __LINE__); } } while (0)
+
+// Runs the tests whose names contain the filter (all, if null), or only prints the names. Returns the number of failed tests.
+int runUnitTests(const std::vector<unit_test>& tests, const char* filter, bool listOnly);
+
+std::vector<unit_test> getBindlessSlotAllocatorTests();
+std::vector<unit_test> getCommandStreamTests();
+std::vector<unit_test> getFreeListAllocatorTests();
+std::vector<unit_test> getRingAllocatorTests();
+std::vector<unit_test> getTLSFAllocatorTests();
+
+// Need the D3D12 headers, but no device. These run in the renderer ('renderer --run-tests'), not in the test executable.
+std::vector<unit_test> getFrameGraphTests();
+std::vector<unit_test> getPipelineFactoryTests();	// With a fake creation function.
+std::vector<unit_test> getShaderStoreTests();		// Maps files in the temp directory.
@@ -2,8 +2,10 @@
 #include "texture.h"
 #include "error.h"
 #include "descriptor_allocator.h"
+#include "bindless_descriptor_table.h"
 #include "common.h"
 #include "resource_state_tracker.h"
+#include "heap_allocator.h"
 
 
 dx_texture::dx_texture(const dx_texture& other)
@@ -13,11 +15,30 @@ dx_texture::dx_texture(const dx_texture& other)
 	this->renderTargetViews = other.renderTargetViews;
 	this->shaderResourceViews = other.shaderResourceViews;
 	this->unorderedAccessViews = other.unorderedAccessViews;
+	this->bindlessSRV = other.bindlessSRV;
+	this->ownsViews = false;
+	this->ownsBindlessSRV = false;
+}
+
+dx_texture::dx_texture(dx_texture&& other) noexcept
+	: dx_texture((const dx_texture&)other)
+{
+	ownsViews = other.ownsViews;
+	ownsBindlessSRV = other.ownsBindlessSRV;
+	other.ownsViews = false;
+	other.ownsBindlessSRV = false;
+
+	self = std::move(other.self);
+	if (self)
+	{
+		*self = this;
+	}
 }
 
 dx_texture& dx_texture::operator=(const dx_texture& other)
 {
 	this->resource = other.resource;
+	this->stateHandle = other.stateHandle;
 	this->device = other.device;
 	this->clearValueValid = other.clearValueValid;
 	if (clearValueValid)
@@ -28,7 +49,30 @@ dx_texture& dx_texture::operator=(const dx_texture& other)
 	this->renderTargetViews = other.renderTargetViews;
 	this->shaderResourceViews = other.shaderResourceViews;
 	this->unorderedAccessViews = other.unorderedAccessViews;
+	this->bindlessSRV = other.bindlessSRV;
+	this->ownsViews = false;
+	this->ownsBindlessSRV = false;
+	this->self = nullptr;
+
+	return *this;
+}
 
+dx_texture& dx_texture::operator=(dx_texture&& other) noexcept
+{
+	if (this != &other)
+	{
+		*this = (const dx_texture&)other;
+		ownsViews = other.ownsViews;
+		ownsBindlessSRV = other.ownsBindlessSRV;
+		other.ownsViews = false;
+		other.ownsBindlessSRV = false;
+
+		self = std::move(other.self);
+		if (self)
+		{
+			*self = this;
+		}
+	}
 	return *this;
 }
 
@@ -45,24 +89,18 @@ void dx_texture::resize(uint32 width, uint32 height)
 
 		D3D12_CLEAR_VALUE* cv = clearValueValid ? &clearValue : nullptr;
 
-		checkResult(device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&resourceDesc,
-			D3D12_RESOURCE_STATE_COMMON,
-			cv,
-			IID_PPV_ARGS(&resource)
-		));
+		resource = dx_heap_allocator::createResource(resourceDesc, D3D12_RESOURCE_STATE_COMMON, cv, takeOwnership(resourceDesc));
 
-		dx_resource_state_tracker::addGlobalResourceState(resource.Get(), D3D12_RESOURCE_STATE_COMMON, resourceDesc.MipLevels * resourceDesc.DepthOrArraySize);
+		stateHandle = dx_resource_state_tracker::addGlobalResourceState(resource.Get(), D3D12_RESOURCE_STATE_COMMON, resourceDesc.MipLevels * resourceDesc.DepthOrArraySize);
 
-		shaderResourceViews.clear();
-		unorderedAccessViews.clear();
+		bool registeredBindless = bindlessSRV.isValid();
+		freeViews();
 
-		// TODO: This leaks the old descriptors. Find a way to free them.
 		if ((resourceDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0 &&
 			checkRTVSupport())
 		{
+			renderTargetViews.resize(resourceDesc.DepthOrArraySize);
+
 			if (resourceDesc.DepthOrArraySize > 1)
 			{
 				D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
@@ -105,18 +143,103 @@ void dx_texture::resize(uint32 width, uint32 height)
 				device->CreateDepthStencilView(resource.Get(), nullptr, depthStencilView);
 			}
 		}
+
+		// The old slot might still be read by frames in flight, so the new resource gets a new one.
+		if (registeredBindless)
+		{
+			dx_bindless_descriptor_table::registerTexture(*this);
+		}
 	}
 }
 
+void dx_texture::freeViews()
+{
+	// The views might still be referenced by command lists in flight, so these are only returned to the allocator a few frames later.
+	if (ownsViews)
+	{
+		for (auto& srv : shaderResourceViews)
+		{
+			dx_descriptor_allocator::freeDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, srv.second.handle);
+		}
+		for (auto& uav : unorderedAccessViews)
+		{
+			dx_descriptor_allocator::freeDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, uav.second);
+		}
+
+		if (!renderTargetViews.empty() && renderTargetViews[0].ptr)
+		{
+			// Array slices are allocated as one contiguous range.
+			dx_descriptor_allocator::freeDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, renderTargetViews[0], (uint32)renderTargetViews.size());
+		}
+
+		if (depthStencilView.ptr)
+		{
+			dx_descriptor_allocator::freeDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, depthStencilView);
+		}
+	}
+
+	shaderResourceViews.clear();
+	unorderedAccessViews.clear();
+	renderTargetViews.clear();
+	depthStencilView.ptr = 0;
+
+	// Views created from now on belong to this texture.
+	ownsViews = true;
+
+	dx_bindless_descriptor_table::unregisterTexture(*this);
+}
+
+gpu_heap_relocation_func dx_texture::takeOwnership(const D3D12_RESOURCE_DESC& resourceDesc)
+{
+	self = std::make_shared<dx_texture*>(this);
+
+	// The GPU writes to these, so copies of the texture must not end up with a different resource.
+	if (resourceDesc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS))
+	{
+		return nullptr;
+	}
+
+	return [target = std::weak_ptr<dx_texture*>(self)](ComPtr<ID3D12Resource> newResource)
+	{
+		// The texture might have been destroyed or re-initialized in the meantime.
+		if (auto texture = target.lock())
+		{
+			(*texture)->relocate(newResource);
+		}
+	};
+}
+
+void dx_texture::relocate(ComPtr<ID3D12Resource> newResource)
+{
+	resource = newResource;
+	stateHandle = dx_resource_state_tracker::getGlobalResourceHandle(resource.Get());
+
+	// The GPU is idle (see dx_heap_allocator::defragment), so the views are rewritten in place. Copies which share them read
+	// the new resource from now on, which holds the same data. Relocatable textures have no render target, depth stencil or
+	// unordered access views.
+	{
+		std::lock_guard<std::mutex> lock(srvMutex);
+		for (auto& srv : shaderResourceViews)
+		{
+			device->CreateShaderResourceView(resource.Get(), srv.second.hasDesc ? &srv.second.desc : nullptr, srv.second.handle);
+		}
+	}
+
+	dx_bindless_descriptor_table::updateTexture(*this);
+}
+
 void dx_texture::initialize(ComPtr<ID3D12Device2> device, D3D12_RESOURCE_DESC resourceDesc, D3D12_CLEAR_VALUE* clearValue)
 {
+	// The texture object is being reused for a new resource.
+	freeViews();
+
 	format = resourceDesc.Format;
 	if (isDepthFormat(format))
 	{
 		resourceDesc.Format = getTypelessFormat(format);
 	}
 
-	dx_resource::initialize(device, resourceDesc, clearValue);
+	dx_resource::initialize(device, resourceDesc, clearValue, takeOwnership(resourceDesc));
 
 	if ((resourceDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0 &&
 		checkRTVSupport())
@@ -169,6 +292,9 @@ void dx_texture::initialize(ComPtr<ID3D12Device2> device, D3D12_RESOURCE_DESC re
 
 void dx_texture::initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Resource> resource)
 {
+	freeViews();
+	self = nullptr;
+
 	dx_resource::initialize(device, resource);
 
 	D3D12_RESOURCE_DESC resourceDesc(resource->GetDesc());
@@ -178,6 +304,8 @@ void dx_texture::initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Resource>
 	if ((resourceDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0 &&
 		checkRTVSupport())
 	{
+		renderTargetViews.resize(resourceDesc.DepthOrArraySize);
+
 		if (resourceDesc.DepthOrArraySize > 1)
 		{
 			D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
@@ -204,6 +332,8 @@ void dx_texture::initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Resource>
 	if ((resourceDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) != 0 &&
 		(checkDSVSupport() || isDepthFormat(format)))
 	{
+		depthStencilView = dx_descriptor_allocator::allocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_DSV).getDescriptorHandle(0);
+
 		if (isDepthFormat(format))
 		{
 			assert(resourceDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE2D);
@@ -224,10 +354,15 @@ void dx_texture::initialize(const dx_texture& other)
 {
 	this->device = other.device;
 	this->resource = other.resource;
+	this->stateHandle = other.stateHandle;
 	this->shaderResourceViews = other.shaderResourceViews;
 	this->unorderedAccessViews = other.unorderedAccessViews;
 	this->depthStencilView = other.depthStencilView;
 	this->renderTargetViews = other.renderTargetViews;
+	this->bindlessSRV = other.bindlessSRV;
+	this->ownsViews = false;
+	this->ownsBindlessSRV = false;
+	this->self = nullptr;
 }
 
 bool dx_texture::isUAVCompatibleFormat(DXGI_FORMAT format)
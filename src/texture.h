@@ -2,6 +2,9 @@
 
 #include "resource.h"
 #include "math.h"
+#include "bindless_slot_allocator.h"
+
+#include <memory>
 
 enum texture_type
 {
@@ -17,12 +20,22 @@ struct dx_texture : dx_resource
 
 	DXGI_FORMAT format;
 
+	// Copies share the views and the bindless slot, but do not own them. Re-initializing or resizing a copy therefore
+	// never frees anything the original still uses. Moves hand the ownership over.
+	// Textures which the GPU only reads may be moved by dx_heap_allocator::defragment. The texture which created the
+	// resource switches to the new one and rewrites its views. Copies keep the old resource.
 	dx_texture() {}
 	dx_texture(const dx_texture& other);
+	dx_texture(dx_texture&& other) noexcept;
 	dx_texture& operator=(const dx_texture& other);
+	dx_texture& operator=(dx_texture&& other) noexcept;
 
 	void resize(uint32 width, uint32 height);
 
+	// Frees all views and the bindless slot, if this texture owns them, otherwise it just lets go of them. The owner may
+	// only call this once no copy is used anymore. Initializing the texture again and resizing it do this automatically.
+	void freeViews();
+
 	static bool isUAVCompatibleFormat(DXGI_FORMAT format);
 	static bool isSRGBFormat(DXGI_FORMAT format);
 	static bool isBGRFormat(DXGI_FORMAT format);
@@ -48,9 +61,23 @@ struct dx_texture : dx_resource
 	D3D12_CPU_DESCRIPTOR_HANDLE getRenderTargetView(uint32 index = 0) { return renderTargetViews[index]; }
 	D3D12_CPU_DESCRIPTOR_HANDLE getDepthStencilView() { return depthStencilView; }
 
+	// Slot in the bindless descriptor table, if the texture has been registered there. Copies share the slot.
+	bindless_handle bindlessSRV;
+	bool ownsBindlessSRV = false; // Set by dx_bindless_descriptor_table::registerTexture.
+
+	// Refers to the texture which created the resource, for as long as it uses it. Follows it through moves.
+	std::weak_ptr<dx_texture*> getCreator() const { return self; }
+
 private:
+	// Makes this texture the creator of a new resource. Returns the relocation callback, if the resource may be moved.
+	gpu_heap_relocation_func takeOwnership(const D3D12_RESOURCE_DESC& resourceDesc);
+	void relocate(ComPtr<ID3D12Resource> newResource);
+
+	bool ownsViews = true;
+	std::shared_ptr<dx_texture*> self; // Points back to this texture, see getCreator. Copies do not get one.
+
 	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> renderTargetViews;
-	D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView;
+	D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = {};
 };
 
 struct dx_texture_atlas : dx_texture
@@ -0,0 +1,471 @@
+#include "pch.h"
+#include "tlsf_allocator.h"
+
+
+// Also compiled into the headless benchmarks, hence the GCC/Clang versions.
+static uint32 indexOfLowestSetBit(uint32 mask)
+{
+#ifdef _WIN32
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return (uint32)__builtin_ctz(mask);
+#endif
+}
+
+static uint32 indexOfHighestSetBit(uint32 mask)
+{
+#ifdef _WIN32
+	unsigned long index;
+	_BitScanReverse(&index, mask);
+	return index;
+#else
+	return 31 - (uint32)__builtin_clz(mask);
+#endif
+}
+
+void tlsf_allocator::initialize(uint64 capacity, uint64 granularity)
+{
+	assert(granularity > 0);
+	assert(capacity / granularity > 0 && capacity / granularity < (1ull << 31));
+
+	this->granularity = granularity;
+	this->capacity = (uint32)(capacity / granularity);
+
+	blocks.clear();
+	unusedBlocks.clear();
+	staleAllocations.clear();
+
+	firstLevelBitmap = 0;
+	for (uint32 i = 0; i < numFirstLevelBins; ++i)
+	{
+		secondLevelBitmaps[i] = 0;
+		for (uint32 j = 0; j < numSecondLevelBins; ++j)
+		{
+			freeLists[i][j] = invalidBlock;
+		}
+	}
+
+	numUsedGranules = 0;
+	numStaleGranules = 0;
+	numAllocations = 0;
+	numFreeBlocks = 0;
+
+	firstBlock = newBlock();
+	block& b = blocks[firstBlock];
+	b.offset = 0;
+	b.size = this->capacity;
+	b.prevPhysical = invalidBlock;
+	b.nextPhysical = invalidBlock;
+	insertFreeBlock(firstBlock);
+}
+
+void tlsf_allocator::getBin(uint32 size, uint32& firstLevel, uint32& secondLevel)
+{
+	if (size < numSecondLevelBins)
+	{
+		firstLevel = 0;
+		secondLevel = size;
+	}
+	else
+	{
+		uint32 highestBit = indexOfHighestSetBit(size);
+		firstLevel = highestBit - numSecondLevelBinsLog2 + 1;
+		secondLevel = (size >> (highestBit - numSecondLevelBinsLog2)) - numSecondLevelBins;
+	}
+}
+
+uint32 tlsf_allocator::findFreeBlock(uint32 size) const
+{
+	uint32 firstLevel, secondLevel;
+
+	// Round up to the start of the next bin, so that every block in the bin we find is large enough.
+	uint32 roundedSize = size;
+	if (size >= numSecondLevelBins)
+	{
+		roundedSize += (1u << (indexOfHighestSetBit(size) - numSecondLevelBinsLog2)) - 1;
+	}
+	getBin(roundedSize, firstLevel, secondLevel);
+
+	uint32 secondLevelMask = (firstLevel < numFirstLevelBins) ? (secondLevelBitmaps[firstLevel] & (~0u << secondLevel)) : 0;
+	if (!secondLevelMask)
+	{
+		uint32 firstLevelMask = (firstLevel + 1 < 32) ? (firstLevelBitmap & (~0u << (firstLevel + 1))) : 0;
+		if (!firstLevelMask)
+		{
+			// Only the bin of the exact size is left, which may still contain a block which is large enough.
+			getBin(size, firstLevel, secondLevel);
+			for (uint32 index = freeLists[firstLevel][secondLevel]; index != invalidBlock; index = blocks[index].nextFree)
+			{
+				if (blocks[index].size >= size)
+				{
+					return index;
+				}
+			}
+			return invalidBlock;
+		}
+		firstLevel = indexOfLowestSetBit(firstLevelMask);
+		secondLevelMask = secondLevelBitmaps[firstLevel];
+	}
+	secondLevel = indexOfLowestSetBit(secondLevelMask);
+
+	return freeLists[firstLevel][secondLevel];
+}
+
+void tlsf_allocator::insertFreeBlock(uint32 index)
+{
+	block& b = blocks[index];
+
+	uint32 firstLevel, secondLevel;
+	getBin(b.size, firstLevel, secondLevel);
+
+	uint32 head = freeLists[firstLevel][secondLevel];
+	b.free = true;
+	b.prevFree = invalidBlock;
+	b.nextFree = head;
+	if (head != invalidBlock)
+	{
+		blocks[head].prevFree = index;
+	}
+	freeLists[firstLevel][secondLevel] = index;
+
+	firstLevelBitmap |= 1u << firstLevel;
+	secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+
+	++numFreeBlocks;
+}
+
+void tlsf_allocator::removeFreeBlock(uint32 index)
+{
+	block& b = blocks[index];
+	assert(b.free);
+
+	if (b.prevFree != invalidBlock)
+	{
+		blocks[b.prevFree].nextFree = b.nextFree;
+	}
+	else
+	{
+		uint32 firstLevel, secondLevel;
+		getBin(b.size, firstLevel, secondLevel);
+
+		freeLists[firstLevel][secondLevel] = b.nextFree;
+		if (b.nextFree == invalidBlock)
+		{
+			secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+			if (!secondLevelBitmaps[firstLevel])
+			{
+				firstLevelBitmap &= ~(1u << firstLevel);
+			}
+		}
+	}
+	if (b.nextFree != invalidBlock)
+	{
+		blocks[b.nextFree].prevFree = b.prevFree;
+	}
+
+	b.free = false;
+	--numFreeBlocks;
+}
+
+uint32 tlsf_allocator::useFreeBlock(uint32 index, uint32 size)
+{
+	removeFreeBlock(index);
+
+	// Split off the remainder. Careful: newBlock may reallocate the block array.
+	if (blocks[index].size > size)
+	{
+		uint32 remainderIndex = newBlock();
+		block& b = blocks[index];
+		block& remainder = blocks[remainderIndex];
+
+		remainder.offset = b.offset + size;
+		remainder.size = b.size - size;
+		remainder.prevPhysical = index;
+		remainder.nextPhysical = b.nextPhysical;
+		if (b.nextPhysical != invalidBlock)
+		{
+			blocks[b.nextPhysical].prevPhysical = remainderIndex;
+		}
+		b.nextPhysical = remainderIndex;
+		b.size = size;
+
+		insertFreeBlock(remainderIndex);
+	}
+
+	numUsedGranules += size;
+	++numAllocations;
+
+	return index;
+}
+
+void tlsf_allocator::freeBlock(uint32 index)
+{
+	assert(!blocks[index].free);
+
+	numUsedGranules -= blocks[index].size;
+	--numAllocations;
+
+	uint32 prev = blocks[index].prevPhysical;
+	if (prev != invalidBlock && blocks[prev].free)
+	{
+		removeFreeBlock(prev);
+		blocks[prev].size += blocks[index].size;
+		blocks[prev].nextPhysical = blocks[index].nextPhysical;
+		if (blocks[index].nextPhysical != invalidBlock)
+		{
+			blocks[blocks[index].nextPhysical].prevPhysical = prev;
+		}
+		deleteBlock(index);
+		index = prev;
+	}
+
+	uint32 next = blocks[index].nextPhysical;
+	if (next != invalidBlock && blocks[next].free)
+	{
+		removeFreeBlock(next);
+		blocks[index].size += blocks[next].size;
+		blocks[index].nextPhysical = blocks[next].nextPhysical;
+		if (blocks[next].nextPhysical != invalidBlock)
+		{
+			blocks[blocks[next].nextPhysical].prevPhysical = index;
+		}
+		deleteBlock(next);
+	}
+
+	insertFreeBlock(index);
+}
+
+uint32 tlsf_allocator::newBlock()
+{
+	if (!unusedBlocks.empty())
+	{
+		uint32 index = unusedBlocks.back();
+		unusedBlocks.pop_back();
+		return index;
+	}
+	blocks.emplace_back();
+	return (uint32)blocks.size() - 1;
+}
+
+void tlsf_allocator::deleteBlock(uint32 index)
+{
+	unusedBlocks.push_back(index);
+}
+
+tlsf_allocator::allocation tlsf_allocator::makeAllocation(uint32 index) const
+{
+	allocation result;
+	result.offset = (uint64)blocks[index].offset * granularity;
+	result.size = (uint64)blocks[index].size * granularity;
+	result.block = index;
+	return result;
+}
+
+tlsf_allocator::allocation tlsf_allocator::allocate(uint64 size)
+{
+	uint32 numGranules = (uint32)max((size + granularity - 1) / granularity, (uint64)1);
+	if (numGranules > capacity)
+	{
+		return allocation();
+	}
+
+	uint32 index = findFreeBlock(numGranules);
+	if (index == invalidBlock)
+	{
+		return allocation();
+	}
+
+	return makeAllocation(useFreeBlock(index, numGranules));
+}
+
+tlsf_allocator::allocation tlsf_allocator::allocateBelow(uint64 size, uint64 maxEnd)
+{
+	uint32 numGranules = (uint32)max((size + granularity - 1) / granularity, (uint64)1);
+	uint64 maxEndGranules = maxEnd / granularity;
+
+	for (uint32 index = firstBlock; index != invalidBlock; index = blocks[index].nextPhysical)
+	{
+		const block& b = blocks[index];
+		if ((uint64)b.offset + numGranules > maxEndGranules)
+		{
+			break;
+		}
+		if (b.free && b.size >= numGranules)
+		{
+			return makeAllocation(useFreeBlock(index, numGranules));
+		}
+	}
+	return allocation();
+}
+
+void tlsf_allocator::free(const allocation& allocation)
+{
+	assert(allocation.isValid());
+	assert((uint64)blocks[allocation.block].offset * granularity == allocation.offset);
+
+	freeBlock(allocation.block);
+}
+
+void tlsf_allocator::freeDeferred(const allocation& allocation, uint64 frameNumber)
+{
+	assert(allocation.isValid());
+	assert(staleAllocations.empty() || staleAllocations.back().frameNumber <= frameNumber);
+
+	staleAllocations.push_back({ allocation.block, frameNumber });
+	numStaleGranules += blocks[allocation.block].size;
+}
+
+void tlsf_allocator::releaseStale(uint64 completedFrameNumber)
+{
+	while (!staleAllocations.empty() && staleAllocations.front().frameNumber <= completedFrameNumber)
+	{
+		uint32 index = staleAllocations.front().block;
+		staleAllocations.pop_front();
+
+		numStaleGranules -= blocks[index].size;
+		freeBlock(index);
+	}
+}
+
+uint32 tlsf_allocator::defragment(std::vector<move>& outMoves, uint32 maxMoves)
+{
+	// Stale blocks can neither move nor be moved over, since they might still be in use.
+	std::vector<bool> isStale(blocks.size(), false);
+	for (const stale_allocation& stale : staleAllocations)
+	{
+		isStale[stale.block] = true;
+	}
+
+	std::vector<allocation> candidates;
+	for (uint32 index = firstBlock; index != invalidBlock; index = blocks[index].nextPhysical)
+	{
+		if (!blocks[index].free && !isStale[index])
+		{
+			candidates.push_back(makeAllocation(index));
+		}
+	}
+
+	uint32 numMoves = 0;
+	for (auto it = candidates.rbegin(); it != candidates.rend() && numMoves < maxMoves; ++it)
+	{
+		allocation to = allocateBelow(it->size, it->offset);
+		if (to.isValid())
+		{
+			free(*it);
+			outMoves.push_back({ *it, to });
+			++numMoves;
+		}
+	}
+	return numMoves;
+}
+
+uint64 tlsf_allocator::getLargestFreeBlock() const
+{
+	if (!firstLevelBitmap)
+	{
+		return 0;
+	}
+
+	// Blocks in one bin differ in size, so the whole highest bin has to be searched.
+	uint32 firstLevel = indexOfHighestSetBit(firstLevelBitmap);
+	uint32 secondLevel = indexOfHighestSetBit(secondLevelBitmaps[firstLevel]);
+
+	uint32 largest = 0;
+	for (uint32 index = freeLists[firstLevel][secondLevel]; index != invalidBlock; index = blocks[index].nextFree)
+	{
+		largest = max(largest, blocks[index].size);
+	}
+	return (uint64)largest * granularity;
+}
+
+float tlsf_allocator::getFragmentation() const
+{
+	uint64 freeSize = getCapacity() - getUsedSize();
+	if (freeSize == 0)
+	{
+		return 0.f;
+	}
+	return 1.f - (float)((double)getLargestFreeBlock() / (double)freeSize);
+}
+
+bool tlsf_allocator::validate() const
+{
+	uint32 expectedOffset = 0;
+	uint32 usedGranules = 0;
+	uint32 allocationCount = 0;
+	uint32 freeBlockCount = 0;
+	uint32 prev = invalidBlock;
+
+	for (uint32 index = firstBlock; index != invalidBlock; index = blocks[index].nextPhysical)
+	{
+		const block& b = blocks[index];
+		if (b.offset != expectedOffset || b.size == 0 || b.prevPhysical != prev)
+		{
+			return false;
+		}
+
+		if (b.free)
+		{
+			// Neighbouring free blocks must have been merged.
+			if (prev != invalidBlock && blocks[prev].free)
+			{
+				return false;
+			}
+
+			uint32 firstLevel, secondLevel;
+			getBin(b.size, firstLevel, secondLevel);
+
+			bool found = false;
+			for (uint32 i = freeLists[firstLevel][secondLevel]; i != invalidBlock; i = blocks[i].nextFree)
+			{
+				found |= (i == index);
+			}
+			if (!found)
+			{
+				return false;
+			}
+			++freeBlockCount;
+		}
+		else
+		{
+			usedGranules += b.size;
+			++allocationCount;
+		}
+
+		expectedOffset += b.size;
+		prev = index;
+	}
+
+	if (expectedOffset != capacity || usedGranules != numUsedGranules || allocationCount != numAllocations || freeBlockCount != numFreeBlocks)
+	{
+		return false;
+	}
+
+	for (uint32 i = 0; i < numFirstLevelBins; ++i)
+	{
+		if (((firstLevelBitmap >> i) & 1) != (secondLevelBitmaps[i] != 0))
+		{
+			return false;
+		}
+		for (uint32 j = 0; j < numSecondLevelBins; ++j)
+		{
+			if (((secondLevelBitmaps[i] >> j) & 1) != (freeLists[i][j] != invalidBlock))
+			{
+				return false;
+			}
+		}
+	}
+
+	uint32 staleGranules = 0;
+	for (const stale_allocation& stale : staleAllocations)
+	{
+		if (blocks[stale.block].free)
+		{
+			return false;
+		}
+		staleGranules += blocks[stale.block].size;
+	}
+	return staleGranules == numStaleGranules;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+#include <deque>
+
+// Two-level segregated fit allocator over [0, capacity). Like free_list_allocator, this only manages offsets and does not
+// own any memory, so it can be used (and checked) without a device.
+// All sizes and offsets are multiples of a fixed granularity, which is therefore also the alignment of every allocation.
+// Free blocks are binned by size: the first level is the power of two, the second level splits each power of two into
+// 16 linear bins. Bitmaps record which bins are non-empty, so allocation and free are O(1). Freed blocks are merged with
+// their physical neighbours right away.
+class tlsf_allocator
+{
+private:
+	static const uint32 invalidBlock = (uint32)-1;
+
+public:
+	struct allocation
+	{
+		uint64 offset = 0;
+		uint64 size = 0;
+		uint32 block = invalidBlock;
+
+		bool isValid() const { return block != invalidBlock; }
+	};
+
+	struct move
+	{
+		allocation from;
+		allocation to;
+	};
+
+	void initialize(uint64 capacity, uint64 granularity);
+
+	// Returns an invalid allocation if there is no free block large enough.
+	allocation allocate(uint64 size);
+
+	// Places the allocation in the lowest free block which fits, and fails if it would end above maxEnd. This is O(number
+	// of blocks), and meant for moving allocations towards the start during defragmentation.
+	allocation allocateBelow(uint64 size, uint64 maxEnd);
+
+	void free(const allocation& allocation);
+
+	// The range is returned to the free bins in the first call to releaseStale with a frame number >= frameNumber.
+	void freeDeferred(const allocation& allocation, uint64 frameNumber);
+	void releaseStale(uint64 completedFrameNumber);
+
+	// Moves up to maxMoves allocations, starting with the highest one, into free space below them. The old ranges are freed
+	// right away, so the moves must be carried out in the returned order, before the next allocation. The new ranges
+	// never overlap the old range of the same allocation.
+	uint32 defragment(std::vector<move>& outMoves, uint32 maxMoves);
+
+	uint64 getCapacity() const { return (uint64)capacity * granularity; }
+	uint64 getGranularity() const { return granularity; }
+	uint64 getUsedSize() const { return (uint64)numUsedGranules * granularity; } // Including stale ranges.
+	uint64 getStaleSize() const { return (uint64)numStaleGranules * granularity; }
+	uint32 getNumAllocations() const { return numAllocations; }
+	uint32 getNumFreeBlocks() const { return numFreeBlocks; }
+	uint64 getLargestFreeBlock() const;
+
+	// 0 if all free memory is in one block, approaching 1 the more it is split up.
+	float getFragmentation() const;
+
+	// Checks all internal invariants. Only meant for debugging and benchmarks.
+	bool validate() const;
+
+private:
+	static const uint32 numSecondLevelBinsLog2 = 4;
+	static const uint32 numSecondLevelBins = 1 << numSecondLevelBinsLog2;
+	static const uint32 numFirstLevelBins = 32 - numSecondLevelBinsLog2 + 1;
+
+	// Offsets and sizes are in units of the granularity.
+	struct block
+	{
+		uint32 offset;
+		uint32 size;
+		uint32 prevPhysical;
+		uint32 nextPhysical;
+		uint32 prevFree;
+		uint32 nextFree;
+		bool free;
+	};
+
+	struct stale_allocation
+	{
+		uint32 block;
+		uint64 frameNumber;
+	};
+
+	static void getBin(uint32 size, uint32& firstLevel, uint32& secondLevel);
+
+	uint32 findFreeBlock(uint32 size) const;
+	void insertFreeBlock(uint32 index);
+	void removeFreeBlock(uint32 index);
+	uint32 useFreeBlock(uint32 index, uint32 size);
+	void freeBlock(uint32 index);
+
+	uint32 newBlock();
+	void deleteBlock(uint32 index);
+
+	allocation makeAllocation(uint32 index) const;
+
+	std::vector<block> blocks;
+	std::vector<uint32> unusedBlocks;
+	uint32 firstBlock = invalidBlock;
+
+	uint32 firstLevelBitmap = 0;
+	uint32 secondLevelBitmaps[numFirstLevelBins] = {};
+	uint32 freeLists[numFirstLevelBins][numSecondLevelBins];
+
+	std::deque<stale_allocation> staleAllocations;
+
+	uint64 granularity = 0;
+	uint32 capacity = 0;
+	uint32 numUsedGranules = 0;
+	uint32 numStaleGranules = 0;
+	uint32 numAllocations = 0;
+	uint32 numFreeBlocks = 0;
+};
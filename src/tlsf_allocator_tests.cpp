@@ -0,0 +1,248 @@
+#include "pch.h"
+#include "tests.h"
+#include "tlsf_allocator.h"
+
+#include <random>
+
+
+// Most tests use a granularity of 1, so that sizes and offsets are in granules. Bins below 16 granules are exact, above
+// that each power of two is split into 16 bins, e.g. sizes 32 and 33 share a bin, 34 is in the next one.
+
+static void testGranularity()
+{
+	tlsf_allocator allocator;
+	allocator.initialize(KB(64), 256);
+
+	tlsf_allocator::allocation a = allocator.allocate(1);
+	tlsf_allocator::allocation b = allocator.allocate(0);
+	tlsf_allocator::allocation c = allocator.allocate(257);
+	CHECK(a.isValid() && b.isValid() && c.isValid());
+	CHECK(a.size == 256 && b.size == 256 && c.size == 512);
+	CHECK(a.offset % 256 == 0 && b.offset % 256 == 0 && c.offset % 256 == 0);
+	CHECK(allocator.getUsedSize() == 1024);
+
+	// Larger than the capacity.
+	CHECK(!allocator.allocate(KB(64) + 1).isValid());
+	CHECK(allocator.validate());
+}
+
+static void testBins()
+{
+	tlsf_allocator allocator;
+	allocator.initialize(1000, 1);
+
+	// Free blocks of 33 and 100 granules, with the rest of the capacity used.
+	tlsf_allocator::allocation small = allocator.allocate(33);
+	tlsf_allocator::allocation separator0 = allocator.allocate(1);
+	tlsf_allocator::allocation large = allocator.allocate(100);
+	tlsf_allocator::allocation separator1 = allocator.allocate(1);
+	tlsf_allocator::allocation rest = allocator.allocate(1000 - 135);
+	CHECK(rest.isValid() && allocator.getNumFreeBlocks() == 0);
+	allocator.free(small);
+	allocator.free(large);
+	CHECK(allocator.getNumFreeBlocks() == 2);
+
+	// 32 is rounded up to its bin, which starts at 32, so the small block is good enough.
+	tlsf_allocator::allocation a = allocator.allocate(32);
+	CHECK(a.isValid() && a.offset == small.offset);
+	allocator.free(a);
+
+	// 33 shares the bin with 32. The bin above is empty up to the large block, which is taken, although the small one fits.
+	tlsf_allocator::allocation b = allocator.allocate(33);
+	CHECK(b.isValid() && b.offset == large.offset);
+	allocator.free(b);
+
+	// Without the large block, only the exact bin is left, which is searched for a block which is large enough.
+	tlsf_allocator::allocation blocker = allocator.allocate(100);
+	CHECK(blocker.isValid() && blocker.offset == large.offset);
+	tlsf_allocator::allocation c = allocator.allocate(33);
+	CHECK(c.isValid() && c.offset == small.offset);
+	allocator.free(c);
+
+	// The remaining 32 granules are in the same bin, but too small.
+	tlsf_allocator::allocation d = allocator.allocate(1);
+	CHECK(d.isValid() && d.offset == small.offset);
+	CHECK(!allocator.allocate(33).isValid());
+	CHECK(allocator.getLargestFreeBlock() == 32);
+
+	allocator.free(d);
+	allocator.free(blocker);
+	allocator.free(separator0);
+	allocator.free(separator1);
+	allocator.free(rest);
+	CHECK(allocator.getNumAllocations() == 0);
+	CHECK(allocator.validate());
+}
+
+static void testMerge()
+{
+	tlsf_allocator allocator;
+	allocator.initialize(64, 1);
+
+	tlsf_allocator::allocation a = allocator.allocate(16);
+	tlsf_allocator::allocation b = allocator.allocate(16);
+	tlsf_allocator::allocation c = allocator.allocate(16);
+	tlsf_allocator::allocation d = allocator.allocate(16);
+	CHECK(d.isValid() && allocator.getNumFreeBlocks() == 0);
+
+	// Neither neighbour is free.
+	allocator.free(b);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+	CHECK(allocator.getLargestFreeBlock() == 16);
+
+	// Merged with the next block.
+	allocator.free(a);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+	CHECK(allocator.getLargestFreeBlock() == 32);
+	CHECK(allocator.validate());
+
+	allocator.free(d);
+	CHECK(allocator.getNumFreeBlocks() == 2);
+
+	// Merged with both, back to one block spanning the capacity.
+	allocator.free(c);
+	CHECK(allocator.getNumFreeBlocks() == 1);
+	CHECK(allocator.getLargestFreeBlock() == 64);
+	CHECK(allocator.getFragmentation() == 0.f);
+	CHECK(allocator.validate());
+
+	tlsf_allocator::allocation e = allocator.allocate(64);
+	CHECK(e.isValid() && e.offset == 0);
+	allocator.free(e);
+
+	// Two holes of 16, which cannot hold 32.
+	a = allocator.allocate(16);
+	b = allocator.allocate(16);
+	c = allocator.allocate(16);
+	d = allocator.allocate(16);
+	allocator.free(a);
+	allocator.free(c);
+	CHECK(allocator.getNumFreeBlocks() == 2);
+	CHECK(allocator.getFragmentation() == 0.5f);
+	CHECK(!allocator.allocate(32).isValid());
+	CHECK(allocator.validate());
+}
+
+static void testAllocateBelow()
+{
+	tlsf_allocator allocator;
+	allocator.initialize(1024, 1);
+
+	tlsf_allocator::allocation allocations[8];
+	for (uint32 i = 0; i < 8; ++i)
+	{
+		allocations[i] = allocator.allocate(64);
+	}
+
+	// Holes at 64 (64 granules), 256 (128 granules) and 512 up to the end.
+	allocator.free(allocations[1]);
+	allocator.free(allocations[4]);
+	allocator.free(allocations[5]);
+
+	// The lowest hole which fits is taken, not the best fitting one.
+	tlsf_allocator::allocation a = allocator.allocateBelow(32, 1024);
+	CHECK(a.isValid() && a.offset == 64);
+
+	// The rest of the first hole is too small, the second one fits.
+	tlsf_allocator::allocation b = allocator.allocateBelow(64, 1024);
+	CHECK(b.isValid() && b.offset == 256);
+
+	// The remainder of the second hole ends exactly at maxEnd.
+	tlsf_allocator::allocation c = allocator.allocateBelow(64, 384);
+	CHECK(c.isValid() && c.offset == 320);
+
+	// Free space exists, but only above maxEnd.
+	CHECK(!allocator.allocateBelow(64, 575).isValid());
+	tlsf_allocator::allocation d = allocator.allocateBelow(64, 576);
+	CHECK(d.isValid() && d.offset == 512);
+
+	CHECK(allocator.getUsedSize() == 5 * 64 + 32 + 3 * 64);
+	CHECK(allocator.validate());
+}
+
+static void testDeferredFree()
+{
+	tlsf_allocator allocator;
+	allocator.initialize(256, 1);
+
+	tlsf_allocator::allocation a = allocator.allocate(128);
+	tlsf_allocator::allocation b = allocator.allocate(128);
+
+	allocator.freeDeferred(a, 1);
+	allocator.freeDeferred(b, 2);
+	CHECK(allocator.getStaleSize() == 256);
+	CHECK(!allocator.allocate(1).isValid());
+	CHECK(allocator.validate());
+
+	allocator.releaseStale(0);
+	CHECK(allocator.getStaleSize() == 256);
+
+	allocator.releaseStale(1);
+	CHECK(allocator.getStaleSize() == 128 && allocator.getUsedSize() == 128);
+	CHECK(allocator.allocate(128).offset == a.offset);
+	CHECK(!allocator.allocate(1).isValid());
+
+	allocator.releaseStale(5);
+	CHECK(allocator.getStaleSize() == 0);
+	CHECK(allocator.getNumAllocations() == 1);
+	CHECK(allocator.validate());
+}
+
+static void testRandomAllocationsAndDefragmentation()
+{
+	tlsf_allocator allocator;
+	allocator.initialize(MB(1), 256);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<uint32> sizeDistribution(1, 16 * 256);
+
+	std::vector<tlsf_allocator::allocation> live;
+	uint64 liveSize = 0;
+	for (uint32 i = 0; i < 10000; ++i)
+	{
+		if (live.empty() || rng() % 3 != 0)
+		{
+			tlsf_allocator::allocation a = allocator.allocate(sizeDistribution(rng));
+			if (a.isValid())
+			{
+				live.push_back(a);
+				liveSize += a.size;
+			}
+		}
+		else
+		{
+			uint32 index = rng() % (uint32)live.size();
+			liveSize -= live[index].size;
+			allocator.free(live[index]);
+			live[index] = live.back();
+			live.pop_back();
+		}
+	}
+	CHECK(allocator.getUsedSize() == liveSize);
+	CHECK(allocator.getNumAllocations() == (uint32)live.size());
+	CHECK(allocator.validate());
+
+	// Moves go downwards and never overlap the old range of the same allocation.
+	std::vector<tlsf_allocator::move> moves;
+	allocator.defragment(moves, (uint32)live.size());
+	for (const tlsf_allocator::move& m : moves)
+	{
+		CHECK(m.to.offset + m.to.size <= m.from.offset);
+		CHECK(m.to.size == m.from.size);
+	}
+	CHECK(allocator.getUsedSize() == liveSize);
+	CHECK(allocator.validate());
+}
+
+std::vector<unit_test> getTLSFAllocatorTests()
+{
+	return
+	{
+		{ "tlsf_allocator/granularity", testGranularity },
+		{ "tlsf_allocator/bins", testBins },
+		{ "tlsf_allocator/merge", testMerge },
+		{ "tlsf_allocator/allocate_below", testAllocateBelow },
+		{ "tlsf_allocator/deferred_free", testDeferredFree },
+		{ "tlsf_allocator/random_allocations_and_defragmentation", testRandomAllocationsAndDefragmentation },
+	};
+}
@@ -3,6 +3,8 @@
 #include "error.h"
 #include "graphics.h"
 #include "profiling.h"
+#include "shader_store.h"
+#include "pipeline_factory.h"
 
 #include <pix3.h>
 
@@ -11,26 +13,22 @@
 #define TREE_ROOTPARAM_SKIN				1
 #define TREE_ROOTPARAM_MATERIAL			2
 #define TREE_ROOTPARAM_BRDF_TEXTURES	3
-#define TREE_ROOTPARAM_ALBEDOS			4
-#define TREE_ROOTPARAM_NORMALS			5
-#define TREE_ROOTPARAM_ROUGHNESSES		6
-#define TREE_ROOTPARAM_METALLICS		7
-#define TREE_ROOTPARAM_DIRECTIONAL		8
-#define TREE_ROOTPARAM_SPOT				9
-#define TREE_ROOTPARAM_SHADOWMAPS		10
-#define TREE_ROOTPARAM_LIGHTPROBES		11
+#define TREE_ROOTPARAM_BINDLESS_TEXTURES	4
+#define TREE_ROOTPARAM_MATERIAL_TEXTURES	5
+#define TREE_ROOTPARAM_DIRECTIONAL		6
+#define TREE_ROOTPARAM_SPOT				7
+#define TREE_ROOTPARAM_SHADOWMAPS		8
+#define TREE_ROOTPARAM_LIGHTPROBES		9
 
 
 void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* commandList, const dx_render_target& renderTarget, DXGI_FORMAT shadowMapFormat)
 {
 	PROFILE_FUNCTION();
 
-	ComPtr<ID3DBlob> vertexShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/tree_vs.cso", &vertexShaderBlob));
-	ComPtr<ID3DBlob> pixelShaderBlob;
-	checkResult(D3DReadFileToBlob(L"shaders/bin/standard_ps.cso", &pixelShaderBlob));
+	D3D12_SHADER_BYTECODE vertexShader = dx_shader_store::load(L"shaders/bin/tree_vs.cso");
+	D3D12_SHADER_BYTECODE pixelShader = dx_shader_store::load(L"shaders/bin/standard_ps.cso");
 
-	D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
+	static const D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORDS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -50,10 +48,8 @@ void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 
 	CD3DX12_DESCRIPTOR_RANGE1 pbrTextures(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 0, 1);
 
-	CD3DX12_DESCRIPTOR_RANGE1 albedos(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 2);
-	CD3DX12_DESCRIPTOR_RANGE1 normals(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 3);
-	CD3DX12_DESCRIPTOR_RANGE1 roughnesses(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 4);
-	CD3DX12_DESCRIPTOR_RANGE1 metallics(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 5);
+	CD3DX12_DESCRIPTOR_RANGE1 bindlessTextures(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UNBOUNDED_DESCRIPTOR_RANGE, 0, 2, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
+	CD3DX12_DESCRIPTOR_RANGE1 materialTextures(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 3);
 
 	CD3DX12_DESCRIPTOR_RANGE1 shadowMaps(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, MAX_NUM_SUN_SHADOW_CASCADES + 1, 0, 6); // Sun cascades + spot light.
 
@@ -66,7 +62,7 @@ void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 		CD3DX12_DESCRIPTOR_RANGE1(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2, 7), // Tetrahedra.
 	};
 
-	CD3DX12_ROOT_PARAMETER1 rootParameters[12];
+	CD3DX12_ROOT_PARAMETER1 rootParameters[10];
 	rootParameters[TREE_ROOTPARAM_CAMERA].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_ALL); // Camera.
 	rootParameters[TREE_ROOTPARAM_SKIN].InitAsConstantBufferView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_VERTEX); // Skin.
 
@@ -76,10 +72,8 @@ void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 	rootParameters[TREE_ROOTPARAM_BRDF_TEXTURES].InitAsDescriptorTable(1, &pbrTextures, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	// Materials.
-	rootParameters[TREE_ROOTPARAM_ALBEDOS].InitAsDescriptorTable(1, &albedos, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootParameters[TREE_ROOTPARAM_NORMALS].InitAsDescriptorTable(1, &normals, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootParameters[TREE_ROOTPARAM_ROUGHNESSES].InitAsDescriptorTable(1, &roughnesses, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootParameters[TREE_ROOTPARAM_METALLICS].InitAsDescriptorTable(1, &metallics, D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameters[TREE_ROOTPARAM_BINDLESS_TEXTURES].InitAsDescriptorTable(1, &bindlessTextures, D3D12_SHADER_VISIBILITY_PIXEL);
+	rootParameters[TREE_ROOTPARAM_MATERIAL_TEXTURES].InitAsDescriptorTable(1, &materialTextures, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	// Sun.
 	rootParameters[TREE_ROOTPARAM_DIRECTIONAL].InitAsConstantBufferView(3, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -129,8 +123,8 @@ void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 		pipelineStateStream.rootSignature = lightingRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
-		pipelineStateStream.ps = CD3DX12_SHADER_BYTECODE(pixelShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
+		pipelineStateStream.ps = pixelShader;
 		pipelineStateStream.dsvFormat = renderTarget.depthStencilFormat;
 		pipelineStateStream.rtvFormats = renderTarget.renderTargetFormat;
 		pipelineStateStream.rasterizer = noBackfaceCullRasterizerDesc;
@@ -138,10 +132,7 @@ void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 		pipelineStateStream.depthStencil = equalDepthDesc;
 #endif
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&lightingPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, lightingPipelineState, L"Tree Pipeline");
 	}
 
 	// Depth only pass (for depth pre pass and shadow maps).
@@ -165,21 +156,16 @@ void tree_pipeline::initialize(ComPtr<ID3D12Device2> device, dx_command_list* co
 		pipelineStateStream.rootSignature = depthOnlyRootSignature.rootSignature.Get();
 		pipelineStateStream.inputLayout = { inputLayout, arraysize(inputLayout) };
 		pipelineStateStream.primitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		pipelineStateStream.vs = CD3DX12_SHADER_BYTECODE(vertexShaderBlob.Get());
+		pipelineStateStream.vs = vertexShader;
 		pipelineStateStream.dsvFormat = shadowMapFormat;
 		pipelineStateStream.rasterizer = noBackfaceCullRasterizerDesc;
 
-		D3D12_PIPELINE_STATE_STREAM_DESC pipelineStateStreamDesc = {
-			sizeof(pipeline_state_stream), &pipelineStateStream
-		};
-		checkResult(device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&depthOnlyPipelineState)));
+		dx_pipeline_factory::createPipelineState(pipelineStateStream, depthOnlyPipelineState, L"Tree Depth Only Pipeline");
 	}
 
 
 	SET_NAME(lightingRootSignature.rootSignature, "Tree Root Signature");
-	SET_NAME(lightingPipelineState, "Tree Pipeline");
 	SET_NAME(depthOnlyRootSignature.rootSignature, "Tree Depth Only Root Signature");
-	SET_NAME(depthOnlyPipelineState, "Tree Depth Only Pipeline");
 
 
 	cpu_triangle_mesh<vertex_3PUNTLW> treeMesh;
@@ -244,10 +230,8 @@ void tree_pipeline::render(dx_command_list* commandList,
 	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_BRDF_TEXTURES, descriptors.brdfOffset);
 
 	// Materials.
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_ALBEDOS, descriptors.albedosOffset);
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_NORMALS, descriptors.normalsOffset);
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_ROUGHNESSES, descriptors.roughnessesOffset);
-	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_METALLICS, descriptors.metallicsOffset);
+	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_BINDLESS_TEXTURES, descriptors.bindlessTexturesOffset);
+	commandList->getD3D12CommandList()->SetGraphicsRootDescriptorTable(TREE_ROOTPARAM_MATERIAL_TEXTURES, descriptors.materialTexturesOffset);
 
 	// Sun.
 	commandList->setGraphicsDynamicConstantBuffer(TREE_ROOTPARAM_DIRECTIONAL, sunCBAddress);
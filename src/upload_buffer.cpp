@@ -1,109 +1,304 @@
 #include "pch.h"
 #include "upload_buffer.h"
 #include "error.h"
+#include "profiling.h"
+#include "memory_tracking.h"
+#include "command_queue.h"
 
 
-void dx_upload_buffer::initialize(ComPtr<ID3D12Device2> device, uint64 pageSize)
+void dx_upload_ring::initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Fence> fence, dx_command_queue* queue, uint64 capacity, uint32 maxIdleOverflowFrames)
 {
-	this->pageSize = pageSize;
 	this->device = device;
+	this->fence = fence;
+	this->queue = queue;
+	this->maxIdleOverflowFrames = maxIdleOverflowFrames;
+
+	checkResult(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(capacity),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&resource)
+	));
+	trackGPUMemory(resource.Get(), capacity, memory_tag_upload);
+
+	gpuBasePtr = resource->GetGPUVirtualAddress();
+	resource->Map(0, nullptr, &cpuBasePtr);
+
+	ring.initialize(capacity);
 }
 
-dx_upload_buffer::allocation dx_upload_buffer::allocate(uint64 sizeInBytes, uint64 alignment)
+dx_upload_ring::~dx_upload_ring()
+{
+	if (cpuBasePtr)
+	{
+		resource->Unmap(0, nullptr);
+	}
+
+	for (uint32 i = 0; i < numOverflowSizeClasses; ++i)
+	{
+		for (overflow_buffer& buffer : overflowBuffers[i])
+		{
+			if (buffer.resource)
+			{
+				buffer.resource->Unmap(0, nullptr);
+			}
+		}
+	}
+}
+
+dx_upload_ring::block dx_upload_ring::allocateBlock(uint64 sizeInBytes)
 {
-	assert(sizeInBytes < pageSize);
+	// Keep all blocks 256-byte aligned, so that constant buffers can be placed at the start of a block.
+	sizeInBytes = alignTo(sizeInBytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
-	if (pages.size() == 0 || !pages[currentPageIndex].hasSpace(sizeInBytes, alignment))
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Very large allocations would block the ring for too long.
+	if (sizeInBytes <= ring.getCapacity() / 4)
 	{
-		currentPageIndex = requestPage();
+		ring.retire(fence->GetCompletedValue());
+
+		uint64 id, offset;
+		while (!ring.allocateBlock(sizeInBytes, id, offset))
+		{
+			uint64 fenceValue;
+			if (!ring.getOldestSubmittedFenceValue(fenceValue))
+			{
+				// The oldest block is still being recorded into, so waiting would not help.
+				return allocateOverflowBlock(sizeInBytes);
+			}
+
+			// Other threads can keep allocating and submitting while we wait. The ring may look different afterwards, so
+			// we just try again.
+			++numWaitStallsThisFrame;
+			lock.unlock();
+			queue->waitForFenceValue(fenceValue, "Upload ring full");
+			lock.lock();
+
+			ring.retire(fence->GetCompletedValue());
+		}
+
+		peakUsedSize = max(peakUsedSize, ring.getUsedSize());
+
+		block result;
+		result.cpu = (uint8*)cpuBasePtr + offset;
+		result.gpu = gpuBasePtr + offset;
+		result.resource = resource.Get();
+		result.offset = offset;
+		result.size = sizeInBytes;
+		result.id = id;
+		result.overflow = false;
+		return result;
 	}
 
-	return pages[currentPageIndex].allocate(sizeInBytes, alignment);
+	return allocateOverflowBlock(sizeInBytes);
 }
 
-void dx_upload_buffer::reset()
+dx_upload_ring::block dx_upload_ring::allocateOverflowBlock(uint64 sizeInBytes)
 {
-	currentPageIndex = 0;
-	freePages.clear();
-	freePages.reserve(pages.size());
+	DWORD highestBit;
+	_BitScanReverse64(&highestBit, sizeInBytes);
+	uint32 sizeClass = (uint32)highestBit + ((sizeInBytes & (sizeInBytes - 1)) ? 1 : 0);
+	sizeClass = max(sizeClass, minOverflowSizeClass);
+	assert(sizeClass < minOverflowSizeClass + numOverflowSizeClasses);
 
-	for (uint32 i = 0; i < (uint32)pages.size(); ++i)
+	uint64 classSize = 1ull << sizeClass;
+	std::vector<overflow_buffer>& buffers = overflowBuffers[sizeClass - minOverflowSizeClass];
+
+	uint64 completedFenceValue = fence->GetCompletedValue();
+
+	// Released buffers keep their slot, because the index is part of the block ID. Prefer a slot which still has memory.
+	uint32 index = (uint32)buffers.size();
+	for (uint32 i = 0; i < (uint32)buffers.size(); ++i)
+	{
+		const overflow_buffer& buffer = buffers[i];
+		if (!buffer.inUse || (buffer.submitted && buffer.fenceValue <= completedFenceValue))
+		{
+			if (buffer.resource)
+			{
+				index = i;
+				break;
+			}
+			if (index == (uint32)buffers.size())
+			{
+				index = i;
+			}
+		}
+	}
+
+	if (index == (uint32)buffers.size() || !buffers[index].resource)
 	{
-		pages[i].reset();
-		freePages.push_back(i);
+		overflow_buffer buffer = {};
+
+		checkResult(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(classSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&buffer.resource)
+		));
+		trackGPUMemory(buffer.resource.Get(), classSize, memory_tag_upload);
+
+		buffer.gpu = buffer.resource->GetGPUVirtualAddress();
+		buffer.resource->Map(0, nullptr, &buffer.cpu);
+
+		if (index == (uint32)buffers.size())
+		{
+			buffers.push_back(buffer);
+		}
+		else
+		{
+			buffers[index] = buffer;
+		}
+		overflowMemory += classSize;
 	}
+
+	overflow_buffer& buffer = buffers[index];
+	buffer.lastUsedFrame = currentFrame;
+	buffer.inUse = true;
+	buffer.submitted = false;
+	buffer.fenceValue = 0;
+
+	++numOverflowAllocationsThisFrame;
+
+	block result;
+	result.cpu = buffer.cpu;
+	result.gpu = buffer.gpu;
+	result.resource = buffer.resource.Get();
+	result.offset = 0;
+	result.size = classSize;
+	result.id = ((uint64)sizeClass << 32) | index;
+	result.overflow = true;
+	return result;
 }
 
-uint32 dx_upload_buffer::requestPage()
+void dx_upload_ring::submitBlock(const block& block, uint64 fenceValue)
 {
-	uint32 page;
+	std::lock_guard<std::mutex> lock(mutex);
 
-	if (!freePages.empty())
+	if (block.overflow)
 	{
-		page = freePages.back();
-		freePages.pop_back();
+		uint32 sizeClass = (uint32)(block.id >> 32);
+		uint32 index = (uint32)block.id;
+
+		overflow_buffer& buffer = overflowBuffers[sizeClass - minOverflowSizeClass][index];
+		buffer.fenceValue = fenceValue;
+		buffer.submitted = true;
 	}
 	else
 	{
-		page = (uint32)pages.size();
-		pages.emplace_back(device, pageSize);
+		ring.submitBlock(block.id, fenceValue);
 	}
-
-	return page;
 }
 
-dx_upload_buffer::memory_page::memory_page(ComPtr<ID3D12Device2> device, uint64 sizeInBytes)
-	: pageSize(sizeInBytes)
-	, currentOffset(0)
-	, cpuBasePtr(nullptr)
-	, gpuBasePtr(D3D12_GPU_VIRTUAL_ADDRESS(0))
+upload_ring_statistics dx_upload_ring::endFrame()
 {
-	checkResult(device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(pageSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&resource)
-	));
+	std::lock_guard<std::mutex> lock(mutex);
 
-	gpuBasePtr = resource->GetGPUVirtualAddress();
-	resource->Map(0, nullptr, &cpuBasePtr);
+	upload_ring_statistics result;
+	result.bytesAllocatedThisFrame = bytesAllocatedThisFrame.exchange(0);
+	result.usedSize = ring.getUsedSize();
+	result.peakUsedSize = peakUsedSize;
+	result.capacity = ring.getCapacity();
+	result.numWaitStallsThisFrame = numWaitStallsThisFrame;
+	result.numOverflowAllocationsThisFrame = numOverflowAllocationsThisFrame;
+	result.overflowMemory = overflowMemory;
+
+	numWaitStallsThisFrame = 0;
+	numOverflowAllocationsThisFrame = 0;
+
+	return result;
 }
 
-dx_upload_buffer::memory_page::~memory_page()
+void dx_upload_ring::beginFrame(uint64 frameID)
 {
-	if (cpuBasePtr)
+	std::lock_guard<std::mutex> lock(mutex);
+
+	currentFrame = frameID;
+
+	uint64 completedFenceValue = fence->GetCompletedValue();
+
+	for (uint32 i = 0; i < numOverflowSizeClasses; ++i)
 	{
-		resource->Unmap(0, nullptr);
+		for (overflow_buffer& buffer : overflowBuffers[i])
+		{
+			bool free = !buffer.inUse || (buffer.submitted && buffer.fenceValue <= completedFenceValue);
+			if (!buffer.resource || !free || buffer.lastUsedFrame + maxIdleOverflowFrames >= frameID)
+			{
+				continue;
+			}
+
+			buffer.resource->Unmap(0, nullptr);
+			buffer.resource.Reset();
+			buffer.cpu = nullptr;
+			buffer.gpu = 0;
+			buffer.inUse = false;
+
+			overflowMemory -= 1ull << (minOverflowSizeClass + i);
+		}
 	}
 }
 
-bool dx_upload_buffer::memory_page::hasSpace(uint64 sizeInBytes, uint64 alignment) const
+void dx_upload_buffer::initialize(dx_upload_ring* ring, uint64 blockSize)
 {
-	size_t alignedSize = alignTo(sizeInBytes, alignment);
-	size_t alignedOffset = alignTo(currentOffset, alignment);
-
-	return alignedOffset + alignedSize <= pageSize;
+	this->ring = ring;
+	this->blockSize = blockSize;
+	this->currentOffset = 0;
 }
 
-dx_upload_buffer::allocation dx_upload_buffer::memory_page::allocate(uint64 sizeInBytes, uint64 alignment)
+dx_upload_buffer::allocation dx_upload_buffer::allocate(uint64 sizeInBytes, uint64 alignment)
 {
-	assert(hasSpace(sizeInBytes, alignment));
+	uint64 alignedSize = alignTo(sizeInBytes, alignment);
 
-	size_t alignedSize = alignTo(sizeInBytes, alignment);
-	currentOffset = alignTo(currentOffset, alignment);
+	// Blocks are only 256-byte aligned inside the ring, so align the offset in the underlying resource (copy sources can
+	// need more, e.g. 512 bytes for texture data).
+	uint64 alignedOffset = blocks.empty() ? 0 : alignTo(blocks.back().offset + currentOffset, alignment) - blocks.back().offset;
+
+	if (blocks.empty() || alignedOffset + alignedSize > blocks.back().size)
+	{
+		dx_upload_ring::block block = ring->allocateBlock(max(blockSize, alignedSize + alignment));
+		alignedOffset = alignTo(block.offset, alignment) - block.offset;
+		blocks.push_back(block);
+	}
+
+	const dx_upload_ring::block& block = blocks.back();
 
 	allocation result;
-	result.cpu = (uint8*)cpuBasePtr + currentOffset;
-	result.gpu = gpuBasePtr + currentOffset;
+	result.cpu = (uint8*)block.cpu + alignedOffset;
+	result.gpu = block.gpu + alignedOffset;
+	result.resource = block.resource;
+	result.offset = block.offset + alignedOffset;
+
+	currentOffset = alignedOffset + alignedSize;
 
-	currentOffset += alignedSize;
+	ring->recordAllocation(alignedSize);
+	bytesAllocated += alignedSize;
 
 	return result;
 }
 
-void dx_upload_buffer::memory_page::reset()
+void dx_upload_buffer::submit(uint64 fenceValue)
 {
+	for (const dx_upload_ring::block& block : blocks)
+	{
+		ring->submitBlock(block, fenceValue);
+	}
+
+	blocks.clear();
 	currentOffset = 0;
+
+	if (bytesAllocated > 0)
+	{
+		PROFILE_COUNTER_ADD("Upload bytes", bytesAllocated);
+		bytesAllocated = 0;
+	}
+}
+
+void dx_upload_buffer::reset()
+{
+	// Blocks of lists which were never executed can be reused right away.
+	submit(0);
 }
@@ -1,9 +1,98 @@
 #pragma once
 
 #include "common.h"
+#include "ring_allocator.h"
 
+#include <mutex>
+#include <atomic>
 
+class dx_command_queue;
 
+struct upload_ring_statistics
+{
+	uint64 bytesAllocatedThisFrame;
+	uint64 usedSize;
+	uint64 peakUsedSize;
+	uint64 capacity;
+	uint32 numWaitStallsThisFrame;
+	uint32 numOverflowAllocationsThisFrame;
+	uint64 overflowMemory; // Total size of all dedicated overflow buffers.
+};
+
+// Persistently mapped upload memory, shared by all command lists of one command queue.
+// The memory is handed out in blocks, which are retired by the fence value of the submission which used them.
+// Blocks which do not fit into the ring (or which are requested while the ring is full of blocks which are still
+// being recorded into) are served from dedicated buffers, which are recycled by size class. Overflow buffers which have not
+// been used for maxIdleOverflowFrames are released in beginFrame.
+class dx_upload_ring
+{
+public:
+	struct block
+	{
+		void*						cpu;
+		D3D12_GPU_VIRTUAL_ADDRESS	gpu;
+		ID3D12Resource*				resource;	// For copies. The block starts at offset in this resource.
+		uint64						offset;
+		uint64						size;
+		uint64						id;
+		bool						overflow;
+	};
+
+	// Stalls on a full ring wait through the queue, so that they show up in its wait statistics.
+	void initialize(ComPtr<ID3D12Device2> device, ComPtr<ID3D12Fence> fence, dx_command_queue* queue, uint64 capacity = MB(32), uint32 maxIdleOverflowFrames = 60);
+	~dx_upload_ring();
+
+	block allocateBlock(uint64 sizeInBytes);
+	void submitBlock(const block& block, uint64 fenceValue);
+
+	void recordAllocation(uint64 sizeInBytes) { bytesAllocatedThisFrame += sizeInBytes; }
+
+	// Returns the statistics and resets the per-frame counters.
+	upload_ring_statistics endFrame();
+
+	// Releases idle overflow buffers.
+	void beginFrame(uint64 frameID);
+
+private:
+	struct overflow_buffer
+	{
+		ComPtr<ID3D12Resource>		resource;
+		void*						cpu;
+		D3D12_GPU_VIRTUAL_ADDRESS	gpu;
+		uint64						fenceValue;
+		uint64						lastUsedFrame;
+		bool						inUse;
+		bool						submitted;
+	};
+
+	static const uint32 minOverflowSizeClass = 16; // 64KB.
+	static const uint32 numOverflowSizeClasses = 16;
+
+	block allocateOverflowBlock(uint64 sizeInBytes);
+
+	ComPtr<ID3D12Device2>			device;
+	ComPtr<ID3D12Fence>				fence;
+	dx_command_queue*				queue = nullptr;
+
+	ComPtr<ID3D12Resource>			resource;
+	void*							cpuBasePtr = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS		gpuBasePtr = 0;
+
+	ring_allocator					ring;
+	std::vector<overflow_buffer>	overflowBuffers[numOverflowSizeClasses];
+	std::mutex						mutex;
+
+	uint32							maxIdleOverflowFrames;
+	uint64							currentFrame = 0;
+
+	std::atomic_uint64_t			bytesAllocatedThisFrame{ 0 };
+	uint64							peakUsedSize = 0;
+	uint64							overflowMemory = 0;
+	uint32							numWaitStallsThisFrame = 0;
+	uint32							numOverflowAllocationsThisFrame = 0;
+};
+
+// Per command list linear allocator, which sub-allocates from blocks of the queue's upload ring.
 class dx_upload_buffer
 {
 public:
@@ -11,13 +100,14 @@ public:
 	{
 		void* cpu;
 		D3D12_GPU_VIRTUAL_ADDRESS gpu;
+		ID3D12Resource* resource;
+		uint64 offset; // Into resource.
 	};
 
-	void initialize(ComPtr<ID3D12Device2> device, uint64 pageSize = MB(2));
+	void initialize(dx_upload_ring* ring, uint64 blockSize = KB(256));
 
 	/**
 	 * Allocate memory in an Upload heap.
-	 * An allocation must not exceed the size of a page.
 	 * Use a memcpy or similar method to copy the
 	 * buffer data to CPU pointer in the Allocation structure returned from
 	 * this function.
@@ -25,38 +115,21 @@ public:
 	allocation allocate(uint64 sizeInBytes, uint64 alignment);
 
 	/**
-	 * Release all allocated pages. This should only be done when the command list
-	 * is finished executing on the CommandQueue.
+	 * Hand all blocks used so far back to the ring. They will be reused once the
+	 * given fence value has completed.
+	 */
+	void submit(uint64 fenceValue);
+
+	/**
+	 * This should only be done when the command list is finished executing on the CommandQueue.
 	 */
 	void reset();
 
 private:
-	// A single page for the allocator.
-	struct memory_page
-	{
-		memory_page(ComPtr<ID3D12Device2> device, uint64 sizeInBytes);
-		~memory_page();
+	dx_upload_ring*						ring = nullptr;
+	std::vector<dx_upload_ring::block>	blocks;
+	uint64								currentOffset;
+	uint64								bytesAllocated = 0; // Recorded as a profiler counter on submit.
 
-		bool hasSpace(uint64 sizeInBytes, uint64 alignment) const;
-		allocation allocate(uint64 sizeInBytes, uint64 alignment);
-		void reset();
-
-		ComPtr<ID3D12Resource>		resource;
-
-		void*						cpuBasePtr;
-		D3D12_GPU_VIRTUAL_ADDRESS	gpuBasePtr;
-
-		uint64						pageSize;
-		uint64						currentOffset;
-	};
-
-
-	uint32 requestPage();
-
-	std::vector<memory_page>		pages;
-	std::vector<uint32>				freePages;
-	uint32							currentPageIndex;
-
-	uint64							pageSize;
-	ComPtr<ID3D12Device2>			device;
+	uint64								blockSize;
 };
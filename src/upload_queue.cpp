@@ -0,0 +1,261 @@
+#include "pch.h"
+#include "upload_queue.h"
+#include "command_list.h"
+#include "command_queue.h"
+#include "texture.h"
+#include "error.h"
+#include "profiling.h"
+
+
+ComPtr<ID3D12Device2> dx_upload_queue::device;
+uint64 dx_upload_queue::batchSize;
+float dx_upload_queue::maxLatencyInMilliseconds;
+
+dx_upload_buffer dx_upload_queue::staging;
+dx_command_list* dx_upload_queue::commandList = nullptr;
+std::vector<ComPtr<ID3D12Resource>> dx_upload_queue::destinations;
+uint64 dx_upload_queue::openBatchSize = 0;
+std::chrono::high_resolution_clock::time_point dx_upload_queue::openBatchStartTime;
+
+upload_token dx_upload_queue::nextToken = 1;
+std::deque<dx_upload_queue::batch> dx_upload_queue::batchesInFlight;
+
+upload_queue_statistics dx_upload_queue::statistics = {};
+std::mutex dx_upload_queue::mutex;
+
+void dx_upload_queue::initialize(ComPtr<ID3D12Device2> device, uint64 batchSize, float maxLatencyInMilliseconds)
+{
+	dx_upload_queue::device = device;
+	dx_upload_queue::batchSize = batchSize;
+	dx_upload_queue::maxLatencyInMilliseconds = maxLatencyInMilliseconds;
+
+	// Large blocks, so that many small uploads share one.
+	staging.initialize(&dx_command_queue::copyCommandQueue.getUploadRing(), MB(4));
+}
+
+upload_token dx_upload_queue::beginUpload(uint64 size)
+{
+	if (!commandList)
+	{
+		commandList = dx_command_queue::copyCommandQueue.getAvailableCommandList(command_allocator_size_medium);
+		openBatchSize = 0;
+		openBatchStartTime = std::chrono::high_resolution_clock::now();
+	}
+
+	openBatchSize += size;
+	statistics.bytesUploaded += size;
+	++statistics.numUploads;
+
+	return nextToken;
+}
+
+void dx_upload_queue::endUpload(ComPtr<ID3D12Resource> destination)
+{
+	destinations.push_back(destination);
+
+	if (openBatchSize >= batchSize)
+	{
+		++statistics.numSizeTriggeredBatches;
+		submitBatch();
+	}
+	else
+	{
+		float age = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - openBatchStartTime).count();
+		if (age >= maxLatencyInMilliseconds)
+		{
+			++statistics.numTimeTriggeredBatches;
+			submitBatch();
+		}
+	}
+}
+
+upload_token dx_upload_queue::uploadBuffer(ComPtr<ID3D12Resource> destination, const void* data, uint64 size, uint64 destinationOffset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	upload_token token = beginUpload(size);
+
+	dx_upload_buffer::allocation allocation = staging.allocate(size, 16);
+	memcpy(allocation.cpu, data, size);
+
+	commandList->transitionBarrier(destination, D3D12_RESOURCE_STATE_COPY_DEST);
+	commandList->flushResourceBarriers();
+	commandList->getD3D12CommandList()->CopyBufferRegion(destination.Get(), destinationOffset, allocation.resource, allocation.offset, size);
+
+	endUpload(destination);
+
+	return token;
+}
+
+upload_token dx_upload_queue::uploadTexture(dx_texture& texture, uint32 firstSubresource, uint32 numSubresources, const D3D12_SUBRESOURCE_DATA* subresourceData)
+{
+	D3D12_RESOURCE_DESC desc = texture.resource->GetDesc();
+
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(numSubresources);
+	std::vector<uint32> numRows(numSubresources);
+	std::vector<uint64> rowSizes(numSubresources);
+	uint64 totalSize;
+	device->GetCopyableFootprints(&desc, firstSubresource, numSubresources, 0, layouts.data(), numRows.data(), rowSizes.data(), &totalSize);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	upload_token token = beginUpload(totalSize);
+
+	dx_upload_buffer::allocation allocation = staging.allocate(totalSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+	commandList->transitionBarrier(texture, D3D12_RESOURCE_STATE_COPY_DEST);
+	commandList->flushResourceBarriers();
+
+	for (uint32 i = 0; i < numSubresources; ++i)
+	{
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = layouts[i];
+
+		D3D12_MEMCPY_DEST destination = { (uint8*)allocation.cpu + layout.Offset, layout.Footprint.RowPitch, (SIZE_T)layout.Footprint.RowPitch * numRows[i] };
+		MemcpySubresource(&destination, &subresourceData[i], (SIZE_T)rowSizes[i], numRows[i], layout.Footprint.Depth);
+
+		layout.Offset += allocation.offset;
+
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture.resource.Get(), firstSubresource + i);
+		CD3DX12_TEXTURE_COPY_LOCATION src(allocation.resource, layout);
+		commandList->getD3D12CommandList()->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+
+	endUpload(texture.resource);
+
+	return token;
+}
+
+void dx_upload_queue::submitBatch()
+{
+	PROFILE_FUNCTION();
+
+	// Hand everything back in COMMON, which every queue can pick up. Repeated destinations are skipped by the state tracker.
+	for (ComPtr<ID3D12Resource>& destination : destinations)
+	{
+		commandList->transitionBarrier(destination, D3D12_RESOURCE_STATE_COMMON);
+	}
+
+	batch& submitted = batchesInFlight.emplace_back();
+	submitted.token = nextToken++;
+	submitted.fenceValue = dx_command_queue::copyCommandQueue.executeCommandList(commandList);
+	submitted.destinations.swap(destinations);
+
+	staging.submit(submitted.fenceValue);
+
+	commandList = nullptr;
+	openBatchSize = 0;
+	++statistics.numBatches;
+}
+
+void dx_upload_queue::retireBatches()
+{
+	while (!batchesInFlight.empty() && dx_command_queue::copyCommandQueue.isFenceComplete(batchesInFlight.front().fenceValue))
+	{
+		batchesInFlight.pop_front();
+	}
+}
+
+bool dx_upload_queue::getFenceValue(upload_token token, uint64& outFenceValue)
+{
+	if (token == nextToken && commandList)
+	{
+		submitBatch();
+	}
+
+	retireBatches();
+
+	for (const batch& batch : batchesInFlight)
+	{
+		if (batch.token >= token)
+		{
+			outFenceValue = batch.fenceValue;
+			return true;
+		}
+	}
+
+	// Already completed.
+	return false;
+}
+
+void dx_upload_queue::update()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (commandList)
+	{
+		float age = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - openBatchStartTime).count();
+		if (age >= maxLatencyInMilliseconds)
+		{
+			++statistics.numTimeTriggeredBatches;
+			submitBatch();
+		}
+	}
+
+	retireBatches();
+}
+
+upload_token dx_upload_queue::flush()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (commandList)
+	{
+		submitBatch();
+	}
+	return nextToken - 1;
+}
+
+bool dx_upload_queue::isComplete(upload_token token)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (token == nextToken && commandList)
+	{
+		return false;
+	}
+
+	retireBatches();
+	return batchesInFlight.empty() || token < batchesInFlight.front().token;
+}
+
+void dx_upload_queue::waitForUpload(upload_token token)
+{
+	uint64 fenceValue;
+	bool pending;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending = getFenceValue(token, fenceValue);
+	}
+
+	if (pending)
+	{
+		dx_command_queue::copyCommandQueue.waitForFenceValue(fenceValue, "Wait for upload");
+	}
+}
+
+void dx_upload_queue::waitForUploadOnQueue(dx_command_queue& queue, upload_token token)
+{
+	uint64 fenceValue;
+	bool pending;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending = getFenceValue(token, fenceValue);
+	}
+
+	if (pending)
+	{
+		queue.waitForOtherQueue(dx_command_queue::copyCommandQueue, fenceValue);
+	}
+}
+
+upload_queue_statistics dx_upload_queue::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	retireBatches();
+
+	upload_queue_statistics result = statistics;
+	result.bytesInOpenBatch = commandList ? openBatchSize : 0;
+	result.numBatchesInFlight = (uint32)batchesInFlight.size();
+	return result;
+}
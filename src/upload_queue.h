@@ -0,0 +1,87 @@
+#pragma once
+
+#include "common.h"
+#include "upload_buffer.h"
+
+#include <deque>
+
+class dx_command_list;
+class dx_command_queue;
+struct dx_texture;
+
+// Identifies the batch an upload went into. Batches complete in order, so a token also covers all uploads before it.
+typedef uint64 upload_token;
+
+struct upload_queue_statistics
+{
+	uint64 numUploads;
+	uint64 numBatches;
+	uint64 bytesUploaded;
+	uint64 bytesInOpenBatch;
+	uint32 numBatchesInFlight;
+	uint32 numSizeTriggeredBatches;
+	uint32 numTimeTriggeredBatches;
+};
+
+// Asynchronous uploads on the copy queue. The data is copied into staging memory right away (so the caller can free it),
+// and the copy is recorded into the open batch. A batch is submitted when it holds batchSize bytes, when its oldest upload
+// is older than the latency limit (checked in update, which should run once per frame, and on every upload), or when
+// someone needs it.
+// Staging memory comes from the copy queue's upload ring in large blocks. If the ring is full, uploading stalls until the
+// copy queue has caught up.
+// Destinations must be in the COMMON state and not in use by the GPU, e.g. freshly created resources. They are returned
+// to COMMON after the copy, so any queue can use them once it has waited for the token.
+class dx_upload_queue
+{
+public:
+	static void initialize(ComPtr<ID3D12Device2> device, uint64 batchSize = MB(16), float maxLatencyInMilliseconds = 4.f);
+
+	static upload_token uploadBuffer(ComPtr<ID3D12Resource> destination, const void* data, uint64 size, uint64 destinationOffset = 0);
+	static upload_token uploadTexture(dx_texture& texture, uint32 firstSubresource, uint32 numSubresources, const D3D12_SUBRESOURCE_DATA* subresourceData);
+
+	// Submits the open batch, if it is old enough.
+	static void update();
+
+	// Submits the open batch, if there is one. Returns the token of the last batch.
+	static upload_token flush();
+
+	static bool isComplete(upload_token token);
+
+	// Blocks the CPU. Submits the batch first, if necessary.
+	static void waitForUpload(upload_token token);
+
+	// Makes the given queue wait on the GPU. Submits the batch first, if necessary.
+	static void waitForUploadOnQueue(dx_command_queue& queue, upload_token token);
+
+	static upload_queue_statistics getStatistics();
+
+private:
+	struct batch
+	{
+		upload_token token;
+		uint64 fenceValue;
+		std::vector<ComPtr<ID3D12Resource>> destinations; // Kept alive until the copies are done.
+	};
+
+	static upload_token beginUpload(uint64 size);
+	static void endUpload(ComPtr<ID3D12Resource> destination);
+	static void submitBatch();
+	static void retireBatches();
+	static bool getFenceValue(upload_token token, uint64& outFenceValue);
+
+	static ComPtr<ID3D12Device2> device;
+	static uint64 batchSize;
+	static float maxLatencyInMilliseconds;
+
+	static dx_upload_buffer staging;
+	static dx_command_list* commandList; // Of the open batch. Null if there is none.
+	static std::vector<ComPtr<ID3D12Resource>> destinations;
+	static uint64 openBatchSize;
+	static std::chrono::high_resolution_clock::time_point openBatchStartTime;
+
+	static upload_token nextToken;
+	static std::deque<batch> batchesInFlight;
+
+	static upload_queue_statistics statistics;
+	static std::mutex mutex;
+};